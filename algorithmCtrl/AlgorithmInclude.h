@@ -6,6 +6,12 @@
 #define CAISS_ALGORITHMINCLUDE_H
 
 #include "./hnsw/hnswProc/HnswProc.h"
+#include "./flat/flatProc/FlatProc.h"
+#include "./nsg/nsgProc/NsgProc.h"
+#include "./ivf/ivfProc/IvfProc.h"
+#include "./ivfpq/ivfpqProc/IvfPqProc.h"
+#include "./diskann/diskannProc/DiskAnnProc.h"
+#include "./shard/shardProc/ShardProc.h"
 
 
 
@@ -8,6 +8,10 @@
 
 
 #include <string>
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include <mutex>
 #include "../caissLib/CaissLib.h"
 #include "../utilsCtrl/UtilsInclude.h"
 #include "../threadCtrl/ThreadInclude.h"
@@ -17,16 +21,31 @@ const static unsigned int DEFAULT_STEP = 2;
 const static unsigned int DEFAULT_MAX_EPOCH = 5;
 const static unsigned int DEFAULT_SHOW_SPAN = 1000;    // 1000行会显示一次日志
 const static std::string MODEL_SUFFIX = ".caiss";   // 默认的模型后缀
+const static unsigned int DEFAULT_QUERY_CACHE_TOLERANCE = 10;    // 近似重复模式下，默认的量化步长（单位：万分之一）
+const static std::string TRAIN_BUFFER_PATH = "memory buffer";    // 通过内存训练时，传给train的数据路径（仅用于日志显示）
+
+/**
+ * 查询上下文，保存一次查询的全部结果信息。由调用方创建和持有，不属于任何句柄；
+ * 不同线程使用各自的上下文时，可以通过同一个句柄并行查询
+ */
+struct AlgorithmSearchContext {
+    std::vector<CaissResultDetail> details;    // 按照距离从近到远排列的结果
+    std::vector<CAISS_RESULT_ITEM> items;    // 其中的label指向details中的信息
+};
 
 
 class AlgorithmProc {
 
 public:
     explicit AlgorithmProc() {
-        this->last_search_type_ = CAISS_SEARCH_DEFAULT;
-        this->last_topK_ = UINT_MAX;
         this->cur_mode_ = CAISS_MODE_DEFAULT;
+        this->query_cache_type_ = CAISS_QUERY_CACHE_NONE;
+        this->query_cache_tolerance_ = DEFAULT_QUERY_CACHE_TOLERANCE;
+        this->train_buffer_ = nullptr;
+        this->train_labels_ = nullptr;
+        this->train_buffer_size_ = 0;
         getIgnoreTrie();
+        getResultCache();
     }
 
     virtual ~AlgorithmProc() {
@@ -69,6 +88,50 @@ public:
                                  const unsigned int maxEpoch=DEFAULT_MAX_EPOCH,
                                  const unsigned int showSpan=DEFAULT_SHOW_SPAN) = 0;
 
+    /**
+     * 使用内存中的向量训练模型，不需要先写成训练文件。训练流程跟train完全一致
+     * @param datas 连续存放的num个向量，每个向量dim维
+     * @param labels num个标签信息，跟datas一一对应
+     * @param num
+     * @param dim 需要跟init时设定的维度一致
+     * @param maxDataSize 小于num的时候，按照num处理
+     * @param normalize
+     * @param maxIndexSize
+     * @param precision
+     * @param fastRank
+     * @param realRank
+     * @param step
+     * @param maxEpoch
+     * @param showSpan
+     * @return
+     */
+    CAISS_RET_TYPE trainFromBuffer(const CAISS_FLOAT *datas, const char **labels, const unsigned int num,
+                                   const unsigned int dim, const unsigned int maxDataSize, const CAISS_BOOL normalize,
+                                   const unsigned int maxIndexSize, const float precision, const unsigned int fastRank,
+                                   const unsigned int realRank, const unsigned int step=DEFAULT_STEP,
+                                   const unsigned int maxEpoch=DEFAULT_MAX_EPOCH,
+                                   const unsigned int showSpan=DEFAULT_SHOW_SPAN) {
+        CAISS_FUNCTION_BEGIN
+        CAISS_ASSERT_NOT_NULL(datas)
+        CAISS_ASSERT_NOT_NULL(labels)
+
+        if (dim != this->dim_) {
+            return CAISS_RET_DIM;
+        }
+
+        // 各算法的train在loadDatas中读取这里记录的向量，训练结束后清空，不持有调用方的内存
+        this->train_buffer_ = datas;
+        this->train_labels_ = labels;
+        this->train_buffer_size_ = num;
+        ret = train(TRAIN_BUFFER_PATH.c_str(), std::max(maxDataSize, num), normalize, maxIndexSize, precision,
+                    fastRank, realRank, step, maxEpoch, showSpan);
+        this->train_buffer_ = nullptr;
+        this->train_labels_ = nullptr;
+        this->train_buffer_size_ = 0;
+
+        return ret;    // 精度不满足要求的时候，返回警告信息，跟train一致
+    }
+
     // process_mode
     /**
      * 查询结果
@@ -87,6 +150,113 @@ public:
                                   const CAISS_SEARCH_CALLBACK searchCBFunc = nullptr,
                                   const void *cbParams = nullptr) = 0;
 
+    /**
+     * 查询结果，不拼接json信息，结果保存在result_items_中（按照距离从近到远排列）
+     * @param info
+     * @param searchType
+     * @param topK
+     * @param filterEditDistance
+     * @param searchCBFunc
+     * @param cbParams
+     * @return
+     */
+    virtual CAISS_RET_TYPE searchEx(void *info,
+                                    const CAISS_SEARCH_TYPE searchType,
+                                    const unsigned int topK,
+                                    const unsigned int filterEditDistance,
+                                    const CAISS_SEARCH_EX_CALLBACK searchCBFunc,
+                                    const void *cbParams) {
+        CAISS_FUNCTION_NO_SUPPORT
+    }
+
+    /**
+     * 使用调用方传入的上下文查询，结果保存在context中。不修改句柄中的任何信息，可以多线程同时调用
+     * @param info
+     * @param searchType
+     * @param topK
+     * @param filterEditDistance
+     * @param context
+     * @param searchCBFunc
+     * @param cbParams
+     * @return
+     */
+    virtual CAISS_RET_TYPE searchWithContext(void *info,
+                                             const CAISS_SEARCH_TYPE searchType,
+                                             const unsigned int topK,
+                                             const unsigned int filterEditDistance,
+                                             AlgorithmSearchContext *context,
+                                             const CAISS_SEARCH_EX_CALLBACK searchCBFunc,
+                                             const void *cbParams) {
+        CAISS_FUNCTION_NO_SUPPORT
+    }
+
+    /**
+     * 设定进程内共用的结果缓存大小
+     * @param size 单位MB，为0表示不缓存
+     * @return
+     */
+    static CAISS_RET_TYPE setResultCacheSize(unsigned int size) {
+        getResultCache()->setCapacity((size_t)size << 20);
+        return CAISS_RET_OK;
+    }
+
+    /**
+     * 设定向量查询结果的缓存方式（所有算法共用的参数，仅对当前句柄生效）
+     * @param paramType
+     * @param value
+     * @return
+     */
+    CAISS_RET_TYPE setQueryCacheParam(CAISS_PARAM_TYPE paramType, unsigned int value) {
+        switch (paramType) {
+            case CAISS_PARAM_QUERY_CACHE:
+                if (value > CAISS_QUERY_CACHE_NEAR) {
+                    return CAISS_RET_PARAM;
+                }
+                this->query_cache_type_ = (CAISS_QUERY_CACHE_TYPE)value;
+                break;
+            case CAISS_PARAM_QUERY_CACHE_TOLERANCE:
+                this->query_cache_tolerance_ = (0 == value) ? DEFAULT_QUERY_CACHE_TOLERANCE : value;
+                break;
+            default:
+                return CAISS_RET_NO_SUPPORT;
+        }
+
+        return CAISS_RET_OK;
+    }
+
+    /**
+     * 模型信息有变动（如：插入、重新加载），当前模型之前缓存的结果全部失效，其他模型的不受影响
+     */
+    void invalidateResultCache() {
+        getResultCache()->invalidate(this->model_path_);
+    }
+
+    /**
+     * 获取最近一次searchEx的结果
+     * @param results 至少包含topK个元素
+     * @param size
+     * @return
+     */
+    CAISS_RET_TYPE getResultItems(CAISS_RESULT_ITEM *results, unsigned int &size) {
+        return copyResultItems(this->result_items_, results, size);
+    }
+
+    /**
+     * 将结果拷贝到调用方的数组中
+     * @param items
+     * @param results 至少包含topK个元素
+     * @param size
+     * @return
+     */
+    static CAISS_RET_TYPE copyResultItems(const std::vector<CAISS_RESULT_ITEM> &items, CAISS_RESULT_ITEM *results,
+                                          unsigned int &size) {
+        CAISS_ASSERT_NOT_NULL(results)
+
+        std::copy(items.begin(), items.end(), results);
+        size = (unsigned int)items.size();
+        return CAISS_RET_OK;
+    }
+
     /**
      * 插入结果信息
      * @param node
@@ -96,6 +266,37 @@ public:
      */
     virtual CAISS_RET_TYPE insert(CAISS_FLOAT *node, const char *index, const CAISS_INSERT_TYPE insertType = CAISS_INSERT_OVERWRITE) = 0;   // label 是数据标签
 
+    /**
+     * 批量插入信息。默认逐条调用insert，遇到失败的时候直接返回（之前的已经插入）
+     * @param nodes 连续存放的num个向量，每个向量dim_维
+     * @param indexes num个标签信息
+     * @param num
+     * @param insertType
+     * @return
+     */
+    virtual CAISS_RET_TYPE insertBatch(CAISS_FLOAT *nodes, const char **indexes, const unsigned int num,
+                                       const CAISS_INSERT_TYPE insertType = CAISS_INSERT_OVERWRITE) {
+        CAISS_FUNCTION_BEGIN
+        CAISS_ASSERT_NOT_NULL(nodes)
+        CAISS_ASSERT_NOT_NULL(indexes)
+
+        for (unsigned int i = 0; i < num; i++) {
+            ret = insert(nodes + (size_t)i * this->dim_, indexes[i], insertType);
+            CAISS_FUNCTION_CHECK_STATUS
+        }
+
+        CAISS_FUNCTION_END
+    }
+
+    /**
+     * 插入是否可以跟查询并行执行。支持的算法，需要在内部处理插入和查询之间的同步
+     * 不支持的时候，插入需要独占模型，期间所有的查询都会被阻塞
+     * @return
+     */
+    virtual bool supportConcurrentInsert() {
+        return false;
+    }
+
     /**
      * 保存模型信息
      * @param modelPath
@@ -127,15 +328,82 @@ public:
      */
     virtual CAISS_RET_TYPE ignore(const char *label, const bool isIgnore = true) = 0;
 
+    /**
+     * 设定参数信息（不同算法支持的参数不同，默认不支持）
+     * @param paramType
+     * @param value
+     * @return
+     */
+    virtual CAISS_RET_TYPE setParam(CAISS_PARAM_TYPE paramType, const void *value) {
+        CAISS_FUNCTION_NO_SUPPORT
+    }
+
 
 protected:
     /**
-     * 从lru中查询
-     * @param word
-     * @param isGet
-     * @return
+     * 结果缓存的作用域。只有作用域相同的句柄，才能共用缓存的结果
+     * 影响查询结果的参数（如：ivf的nprobe）仅对当前句柄生效的算法，需要把参数信息加入作用域中
+     * @param scope 覆盖写入，已申请的内存可以重复使用
      */
+    virtual void getCacheScope(std::string &scope) {
+        scope.assign(this->model_path_);
+    }
+
+    /**
+     * 拼接结果缓存的key。词语查询都会缓存；向量查询按照设定的方式缓存，不缓存的时候为空
+     * @param info
+     * @param searchType
+     * @param filterEditDistance
+     * @param key
+     */
+    void buildResultCacheKey(void *info, const CAISS_SEARCH_TYPE searchType, const unsigned int filterEditDistance,
+                             std::string &key) {
+        if (CAISS_SEARCH_WORD == searchType || CAISS_LOOP_WORD == searchType) {
+            getCacheScope(key);
+            ResultCacheProc::buildKey((const char *)info, searchType, filterEditDistance, key);
+            return;
+        }
+
+        if (CAISS_QUERY_CACHE_NONE == this->query_cache_type_) {
+            key.clear();
+            return;
+        }
+
+        static thread_local std::vector<CAISS_FLOAT> query;
+        query.assign((CAISS_FLOAT *)info, (CAISS_FLOAT *)info + this->dim_);
+        normalizeNode(query, this->dim_);    // 按照归一化之后的向量拼接，跟查询时的处理方式一致
+        CAISS_FLOAT tolerance = (CAISS_QUERY_CACHE_NEAR == this->query_cache_type_)
+                                ? (CAISS_FLOAT)this->query_cache_tolerance_ / 10000.0f : 0.0f;
+        getCacheScope(key);
+        ResultCacheProc::buildKey(query.data(), this->dim_, searchType, tolerance, key);
+    }
+
+    /**
+     * 将details中的结果写入items中，label指向details中的词语
+     * @param details
+     * @param items
+     */
+    static void buildResultItems(const std::vector<CaissResultDetail> &details, std::vector<CAISS_RESULT_ITEM> &items) {
+        items.resize(details.size());
+        for (size_t i = 0; i < details.size(); i++) {
+            CAISS_RESULT_ITEM &item = items[i];
+            item.index = details[i].index;
+            item.distance = details[i].distance;
+            item.label = details[i].label.c_str();
+        }
+    }
+
     CAISS_RET_TYPE normalizeNode(std::vector<CAISS_FLOAT>& node, unsigned int dim) {
+        return normalizeNode(node.data(), dim);
+    }
+
+    /**
+     * 原地归一化，node中需要有dim个元素
+     * @param node
+     * @param dim
+     * @return
+     */
+    CAISS_RET_TYPE normalizeNode(CAISS_FLOAT *node, unsigned int dim) {
         if (CAISS_FALSE == this->normalize_) {
             return CAISS_RET_OK;    // 如果不需要归一化，直接返回
         }
@@ -157,6 +425,33 @@ protected:
         return CAISS_RET_OK;
     }
 
+    /**
+     * 将trainFromBuffer传入的向量，整理成跟读取训练文件相同的格式
+     * @param datas
+     * @return
+     */
+    CAISS_RET_TYPE loadBufferDatas(std::vector<CaissDataNode> &datas) {
+        CAISS_FUNCTION_BEGIN
+        CAISS_ASSERT_NOT_NULL(this->train_buffer_)
+        CAISS_ASSERT_NOT_NULL(this->train_labels_)
+
+        for (unsigned int i = 0; i < this->train_buffer_size_; i++) {
+            CAISS_ASSERT_NOT_NULL(this->train_labels_[i])
+
+            CaissDataNode dataNode;
+            dataNode.index.assign(this->train_labels_[i]);
+            const CAISS_FLOAT *node = this->train_buffer_ + (size_t)i * this->dim_;
+            dataNode.node.assign(node, node + this->dim_);
+
+            ret = normalizeNode(dataNode.node, this->dim_);
+            CAISS_FUNCTION_CHECK_STATUS
+
+            datas.push_back(std::move(dataNode));
+        }
+
+        CAISS_FUNCTION_END
+    }
+
     float fastSqrt(float x) {
         /* 快速开平方计算方式 */
         float half = 0.5f * x;
@@ -179,6 +474,14 @@ protected:
         return AlgorithmProc::ignore_trie_ptr_;
     }
 
+    static ResultCacheProc* getResultCache() {
+        std::call_once(AlgorithmProc::result_cache_flag_, [] {
+            AlgorithmProc::result_cache_ptr_ = new ResultCacheProc();    // 进程内所有句柄共用，不随句柄释放
+        });
+
+        return AlgorithmProc::result_cache_ptr_;
+    }
+
 
 protected:
     std::string model_path_;
@@ -186,14 +489,19 @@ protected:
     CAISS_MODE cur_mode_;
     CAISS_BOOL normalize_;    // 是否需要标准化数据
     std::string result_;
+    std::vector<CaissResultDetail> result_details_;    // 最近一次查询的结果（按照距离从近到远排列）
+    std::vector<CAISS_RESULT_ITEM> result_items_;    // searchEx的结果，其中的label指向result_details_中的信息
     CAISS_DISTANCE_TYPE distance_type_;
-
-    LruProc lru_cache_;    // 最近N次的查询记录
-    unsigned int last_topK_;    // 记录上一次的topK跟这一次的topK是否相同
-    CAISS_SEARCH_TYPE last_search_type_;
+    CAISS_QUERY_CACHE_TYPE query_cache_type_;    // 向量查询结果的缓存方式（通过setParam设定，init时不清空）
+    unsigned int query_cache_tolerance_;    // 近似重复模式下的量化步长，单位：万分之一（通过setParam设定，init时不清空）
+    const CAISS_FLOAT *train_buffer_;    // trainFromBuffer训练期间，调用方传入的向量信息
+    const char **train_labels_;
+    unsigned int train_buffer_size_;
 
     static RWLock trie_lock_;
     static TrieProc* ignore_trie_ptr_;    // 标识忽略的字典树
+    static std::once_flag result_cache_flag_;
+    static ResultCacheProc* result_cache_ptr_;    // 进程内共用的结果缓存
 };
 
 #endif //CAISS_ALGORITHMPROC_H
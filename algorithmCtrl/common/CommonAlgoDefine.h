@@ -0,0 +1,19 @@
+//
+// Created by Chunel on 2020/9/13.
+//
+
+#ifndef CAISS_COMMONALGODEFINE_H
+#define CAISS_COMMONALGODEFINE_H
+
+#include <queue>
+#include <vector>
+#include <utility>
+
+#include "../../caissLib/CaissLibDefine.h"
+
+using ALGO_RET_TYPE = std::priority_queue<std::pair<CAISS_FLOAT, unsigned int>>;    // 大顶堆，<距离, 模型内部id>
+
+const static unsigned int ALGO_QUERY_TOPK_TIMES = 7;    // 为了过滤之后还能剩下topK个，查询的时候多召回一些
+const static int ALGO_NO_WORD_ID = -1;    // 模型中没有找到对应词语
+
+#endif //CAISS_COMMONALGODEFINE_H
@@ -0,0 +1,404 @@
+//
+// Created by Chunel on 2020/9/13.
+//
+
+#include <fstream>
+#include "CommonAlgoProc.h"
+
+using namespace std;
+
+
+CAISS_RET_TYPE CommonAlgoProc::search(void *info,
+                                      const CAISS_SEARCH_TYPE searchType,
+                                      const unsigned int topK,
+                                      const unsigned int filterEditDistance,
+                                      const CAISS_SEARCH_CALLBACK searchCBFunc,
+                                      const void *cbParams) {
+    CAISS_FUNCTION_BEGIN
+
+    CAISS_ASSERT_NOT_NULL(info)
+    CAISS_CHECK_MODE_ENABLE(CAISS_MODE_PROCESS)
+
+    /* 将信息清空。词语和距离链表保留已申请的内存，在buildResult中原地赋值 */
+    this->result_.clear();
+    ret = innerSearchDetails(info, searchType, topK, filterEditDistance, this->result_details_);
+    if (CAISS_RET_OK != ret) {
+        this->result_words_.clear();
+        this->result_distance_.clear();
+        return ret;
+    }
+
+    ret = buildResult(searchType);
+    CAISS_FUNCTION_CHECK_STATUS
+
+    if (nullptr != searchCBFunc) {
+        searchCBFunc(this->result_words_, this->result_distance_, cbParams);
+    }
+
+    CAISS_FUNCTION_END
+}
+
+
+CAISS_RET_TYPE CommonAlgoProc::searchEx(void *info,
+                                        const CAISS_SEARCH_TYPE searchType,
+                                        const unsigned int topK,
+                                        const unsigned int filterEditDistance,
+                                        const CAISS_SEARCH_EX_CALLBACK searchCBFunc,
+                                        const void *cbParams) {
+    CAISS_FUNCTION_BEGIN
+
+    CAISS_ASSERT_NOT_NULL(info)
+    CAISS_CHECK_MODE_ENABLE(CAISS_MODE_PROCESS)
+
+    this->result_items_.clear();    // 不修改json结果信息
+    ret = innerSearchDetails(info, searchType, topK, filterEditDistance, this->result_details_);
+    CAISS_FUNCTION_CHECK_STATUS
+
+    AlgorithmProc::buildResultItems(this->result_details_, this->result_items_);
+
+    if (nullptr != searchCBFunc) {
+        searchCBFunc(this->result_items_.data(), (unsigned int)this->result_items_.size(), cbParams);
+    }
+
+    CAISS_FUNCTION_END
+}
+
+
+/**
+ * 查询信息和结果均保存在context中（查询过程中的临时信息为线程独有），不修改句柄中的结果信息，
+ * 所以同一个句柄可以被多个线程同时使用
+ */
+CAISS_RET_TYPE CommonAlgoProc::searchWithContext(void *info,
+                                                 const CAISS_SEARCH_TYPE searchType,
+                                                 const unsigned int topK,
+                                                 const unsigned int filterEditDistance,
+                                                 AlgorithmSearchContext *context,
+                                                 const CAISS_SEARCH_EX_CALLBACK searchCBFunc,
+                                                 const void *cbParams) {
+    CAISS_FUNCTION_BEGIN
+
+    CAISS_ASSERT_NOT_NULL(info)
+    CAISS_ASSERT_NOT_NULL(context)
+    CAISS_CHECK_MODE_ENABLE(CAISS_MODE_PROCESS)
+
+    ret = innerSearchDetails(info, searchType, topK, filterEditDistance, context->details);
+    if (CAISS_RET_OK != ret) {
+        context->items.clear();
+        return ret;
+    }
+
+    AlgorithmProc::buildResultItems(context->details, context->items);
+
+    if (nullptr != searchCBFunc) {
+        searchCBFunc(context->items.data(), (unsigned int)context->items.size(), cbParams);
+    }
+
+    CAISS_FUNCTION_END
+}
+
+
+CAISS_RET_TYPE CommonAlgoProc::getResultSize(unsigned int &size) {
+    CAISS_FUNCTION_BEGIN
+    CAISS_CHECK_MODE_ENABLE(CAISS_MODE_PROCESS)
+
+    size = this->result_.size();
+
+    CAISS_FUNCTION_END
+}
+
+
+CAISS_RET_TYPE CommonAlgoProc::getResult(char *result, unsigned int size) {
+    CAISS_FUNCTION_BEGIN
+    CAISS_ASSERT_NOT_NULL(result)
+    CAISS_CHECK_MODE_ENABLE(CAISS_MODE_PROCESS)
+
+    memset(result, 0, size);
+    memcpy(result, this->result_.data(), this->result_.size());
+
+    CAISS_FUNCTION_END
+}
+
+
+CAISS_RET_TYPE CommonAlgoProc::ignore(const char *label, const bool isIgnore) {
+    CAISS_FUNCTION_BEGIN
+    CAISS_ASSERT_NOT_NULL(label)
+    CAISS_CHECK_MODE_ENABLE(CAISS_MODE_PROCESS)
+
+    string info = label;
+    if (isIgnore) {
+        AlgorithmProc::getIgnoreTrie()->insert(info);
+    } else {
+        AlgorithmProc::getIgnoreTrie()->eraser(info);
+    }
+
+    AlgorithmProc::invalidateResultCache();    // 忽略信息有变动，则之前缓存的结果失效
+
+    CAISS_FUNCTION_END
+}
+
+
+CAISS_RET_TYPE CommonAlgoProc::prepareQuery(std::vector<CAISS_FLOAT> &vec) {
+    return normalizeNode(vec, this->dim_);
+}
+
+
+/**
+ * 查询结果，并写入details中。可以缓存的查询，优先从进程共用的缓存中获取
+ * @param info
+ * @param searchType
+ * @param topK
+ * @param filterEditDistance
+ * @param details
+ * @return
+ */
+CAISS_RET_TYPE CommonAlgoProc::innerSearchDetails(void *info, const CAISS_SEARCH_TYPE searchType, const unsigned int topK,
+                                                  const unsigned int filterEditDistance,
+                                                  std::vector<CaissResultDetail> &details) {
+    CAISS_FUNCTION_BEGIN
+
+    // details不提前清空，命中缓存或者查询完毕之后按照结果个数调整，其中词语的内存可以重复使用
+    unsigned long long generation = 0;
+    static thread_local std::string key;
+    buildResultCacheKey(info, searchType, filterEditDistance, key);
+    if (!key.empty() && AlgorithmProc::getResultCache()->get(this->model_path_, key, topK, details, generation)) {
+        return CAISS_RET_OK;    // 命中缓存，不需要再查询
+    }
+
+    ALGO_RET_TYPE result;
+    ret = innerSearch(info, searchType, topK, filterEditDistance, result);
+    if (CAISS_RET_OK != ret) {
+        details.clear();
+        return ret;
+    }
+
+    ret = buildResultDetails(result, details);
+    CAISS_FUNCTION_CHECK_STATUS
+
+    if (!key.empty()) {
+        AlgorithmProc::getResultCache()->put(this->model_path_, key, generation, topK, details);
+    }
+
+    CAISS_FUNCTION_END
+}
+
+
+CAISS_RET_TYPE CommonAlgoProc::innerSearch(void *info, const CAISS_SEARCH_TYPE searchType, const unsigned int topK,
+                                           const unsigned int filterEditDistance, ALGO_RET_TYPE &result) {
+    CAISS_FUNCTION_BEGIN
+    CAISS_ASSERT_NOT_NULL(info)
+
+    static thread_local std::vector<CAISS_FLOAT> vec;    // 每个线程一份，重复查询时不再申请内存
+    switch (searchType) {
+        case CAISS_SEARCH_QUERY:
+        case CAISS_LOOP_QUERY: {
+            vec.assign((CAISS_FLOAT *)info, (CAISS_FLOAT *)info + this->dim_);
+            ret = prepareQuery(vec);
+            break;
+        }
+        case CAISS_SEARCH_WORD:
+        case CAISS_LOOP_WORD: {
+            int id = findWordId(std::string((const char *)info));
+            if (ALGO_NO_WORD_ID != id) {
+                ret = getVectorById((unsigned int)id, vec);    // 模型中保存的向量，已经是处理过的了
+            } else {
+                ret = CAISS_RET_NO_WORD;
+            }
+            break;
+        }
+        default:
+            ret = CAISS_RET_PARAM;
+            break;
+    }
+    CAISS_FUNCTION_CHECK_STATUS
+
+    ret = searchVector(vec.data(), topK * ALGO_QUERY_TOPK_TIMES, searchType, result);
+    CAISS_FUNCTION_CHECK_STATUS
+
+    ret = filterByRules(info, searchType, result, topK, filterEditDistance);
+    CAISS_FUNCTION_CHECK_STATUS
+
+    CAISS_FUNCTION_END
+}
+
+
+CAISS_RET_TYPE CommonAlgoProc::loadDatas(const char *dataPath, std::vector<CaissDataNode> &datas) {
+    CAISS_FUNCTION_BEGIN
+    if (nullptr != this->train_buffer_) {
+        return loadBufferDatas(datas);    // 通过内存中的向量训练，不需要读取文件
+    }
+
+    CAISS_ASSERT_NOT_NULL(dataPath)
+
+    std::ifstream in(dataPath);
+    if (!in) {
+        return CAISS_RET_PATH;
+    }
+
+    std::string line;
+    while (getline(in, line)) {
+        if (0 == line.length()) {
+            continue;
+        }
+
+        CaissDataNode dataNode;
+        ret = RapidJsonProc::parseInputData(line.data(), dataNode);
+        CAISS_FUNCTION_CHECK_STATUS
+
+        if (dataNode.node.size() != this->dim_) {
+            return CAISS_RET_DIM;
+        }
+
+        ret = normalizeNode(dataNode.node, this->dim_);
+        CAISS_FUNCTION_CHECK_STATUS
+
+        datas.push_back(dataNode);
+    }
+
+    in.close();
+    CAISS_FUNCTION_END
+}
+
+
+CAISS_RET_TYPE CommonAlgoProc::buildResult(const CAISS_SEARCH_TYPE searchType) {
+    CAISS_FUNCTION_BEGIN
+
+    // 按照结果个数调整链表长度后原地赋值，已有的节点和词语的内存可以重复使用
+    this->result_words_.resize(this->result_details_.size());
+    this->result_distance_.resize(this->result_details_.size());
+    auto wordIter = this->result_words_.begin();
+    auto distIter = this->result_distance_.begin();
+    for (const CaissResultDetail &detail : this->result_details_) {
+        *(wordIter++) = detail.label;
+        *(distIter++) = detail.distance;
+    }
+
+    const char *type = isAnnSearchType(searchType) ? "ann_search" : "force_loop";
+    ret = RapidJsonProc::buildSearchResult(this->result_details_, this->distance_type_, this->result_, type);
+    CAISS_FUNCTION_CHECK_STATUS
+
+    CAISS_FUNCTION_END
+}
+
+
+/**
+ * 将查询结果（大顶堆）按照距离从近到远，写入details中
+ * @param result
+ * @param details
+ * @return
+ */
+CAISS_RET_TYPE CommonAlgoProc::buildResultDetails(ALGO_RET_TYPE &result, std::vector<CaissResultDetail> &details) {
+    CAISS_FUNCTION_BEGIN
+
+    details.resize(result.size());
+    for (size_t i = result.size(); i > 0; i--) {    // 大顶堆，从后往前填充
+        auto cur = result.top();
+        result.pop();
+
+        CaissResultDetail &detail = details[i - 1];
+        ret = getWordById(cur.second, detail.label);
+        CAISS_FUNCTION_CHECK_STATUS
+        detail.distance = cur.first;
+        detail.index = cur.second;
+    }
+
+    CAISS_FUNCTION_END
+}
+
+
+CAISS_RET_TYPE CommonAlgoProc::filterByRules(void *info, const CAISS_SEARCH_TYPE searchType, ALGO_RET_TYPE &result,
+                                             const unsigned int topK, const unsigned int filterEditDistance) {
+    CAISS_FUNCTION_BEGIN
+    if (result.size() <= topK) {
+        return CAISS_RET_OK;
+    }
+
+    ret = filterByEditDistance(info, searchType, result, filterEditDistance);
+    CAISS_FUNCTION_CHECK_STATUS
+
+    ret = filterByIgnoreTrie(result);
+    CAISS_FUNCTION_CHECK_STATUS
+
+    while (result.size() > topK) {
+        result.pop();
+    }
+
+    CAISS_FUNCTION_END
+}
+
+
+CAISS_RET_TYPE CommonAlgoProc::filterByEditDistance(void *info, const CAISS_SEARCH_TYPE searchType, ALGO_RET_TYPE &result,
+                                                    const unsigned int filterEditDistance) {
+    CAISS_FUNCTION_BEGIN
+    CAISS_ASSERT_NOT_NULL(info)
+
+    if (!isWordSearchType(searchType)
+        || (CAISS_MIN_EDIT_DISTANCE == filterEditDistance)) {
+        return CAISS_RET_OK;
+    }
+
+    if (CAISS_MAX_EDIT_DISTANCE < filterEditDistance) {
+        return CAISS_RET_PARAM;
+    }
+
+    // 临时信息每个线程一份，重复查询时不再申请内存
+    static thread_local std::vector<ALGO_RET_TYPE::value_type> candidates;
+    static thread_local std::string word;
+    static thread_local std::string candWord;
+    word.assign((const char *)info);
+    candidates.clear();
+    while (!result.empty()) {
+        candidates.push_back(result.top());
+        result.pop();
+    }
+
+    for (const auto &cur : candidates) {
+        ret = getWordById(cur.second, candWord);
+        CAISS_FUNCTION_CHECK_STATUS
+        if (EditDistanceProc::BeyondEditDistance(word, candWord, filterEditDistance)) {
+            result.push(cur);    // 超过编辑距离的词语，才会被保留下来
+        }
+    }
+
+    CAISS_FUNCTION_END
+}
+
+
+CAISS_RET_TYPE CommonAlgoProc::filterByIgnoreTrie(ALGO_RET_TYPE &result) {
+    CAISS_FUNCTION_BEGIN
+
+    static thread_local std::vector<ALGO_RET_TYPE::value_type> candidates;
+    static thread_local std::string candWord;
+    candidates.clear();
+    while (!result.empty()) {
+        candidates.push_back(result.top());
+        result.pop();
+    }
+
+    for (const auto &cur : candidates) {
+        ret = getWordById(cur.second, candWord);
+        CAISS_FUNCTION_CHECK_STATUS
+        if (!AlgorithmProc::getIgnoreTrie()->find(candWord)) {
+            result.push(cur);
+        }
+    }
+
+    CAISS_FUNCTION_END
+}
+
+
+std::string CommonAlgoProc::buildModelPath(const char *modelPath) {
+    string path = string(modelPath);
+    bool isAnnSuffix = (path.length() >= MODEL_SUFFIX.length())
+                       && (path.find(MODEL_SUFFIX) == path.length() - MODEL_SUFFIX.length());
+    return isAnnSuffix ? path : (path + MODEL_SUFFIX);
+}
+
+
+bool CommonAlgoProc::isWordSearchType(const CAISS_SEARCH_TYPE searchType) {
+    return (CAISS_SEARCH_WORD == searchType || CAISS_LOOP_WORD == searchType);
+}
+
+
+bool CommonAlgoProc::isAnnSearchType(const CAISS_SEARCH_TYPE searchType) {
+    return (CAISS_SEARCH_WORD == searchType || CAISS_SEARCH_QUERY == searchType);
+}
@@ -0,0 +1,86 @@
+//
+// Created by Chunel on 2020/9/13.
+// 非hnsw算法共用的封装层。查询、缓存、过滤和结果拼接的流程均在这里实现，
+// 具体算法只需要实现向量查询，以及词语和向量的获取方法
+//
+
+#ifndef CAISS_COMMONALGOPROC_H
+#define CAISS_COMMONALGOPROC_H
+
+#include <list>
+#include <string>
+#include <vector>
+
+#include "../AlgorithmProc.h"
+#include "./CommonAlgoDefine.h"
+
+class CommonAlgoProc : public AlgorithmProc {
+
+public:
+    std::list<std::string>                 result_words_;
+    std::list<CAISS_FLOAT>                 result_distance_;    // 查找到的距离
+
+    explicit CommonAlgoProc() = default;
+    ~CommonAlgoProc() override = default;
+
+    CAISS_RET_TYPE search(void *info, CAISS_SEARCH_TYPE searchType, unsigned int topK, unsigned int filterEditDistance,
+                          CAISS_SEARCH_CALLBACK searchCBFunc, const void *cbParams) override;
+    CAISS_RET_TYPE searchEx(void *info, CAISS_SEARCH_TYPE searchType, unsigned int topK, unsigned int filterEditDistance,
+                            CAISS_SEARCH_EX_CALLBACK searchCBFunc, const void *cbParams) override;
+    CAISS_RET_TYPE searchWithContext(void *info, CAISS_SEARCH_TYPE searchType, unsigned int topK,
+                                     unsigned int filterEditDistance, AlgorithmSearchContext *context,
+                                     CAISS_SEARCH_EX_CALLBACK searchCBFunc, const void *cbParams) override;
+    CAISS_RET_TYPE getResultSize(unsigned int& size) override;
+    CAISS_RET_TYPE getResult(char *result, unsigned int size) override;
+    CAISS_RET_TYPE ignore(const char *label, bool isIgnore) override;
+
+protected:
+    /**
+     * 查询距离query最近的topK个点
+     * @param query 已经归一化的向量
+     * @param topK
+     * @param searchType 快速查询，或者暴力查询
+     * @param result
+     * @return
+     */
+    virtual CAISS_RET_TYPE searchVector(const CAISS_FLOAT *query, unsigned int topK, CAISS_SEARCH_TYPE searchType,
+                                        ALGO_RET_TYPE &result) = 0;
+
+    /**
+     * 查询词语在模型中的id，没有找到返回ALGO_NO_WORD_ID
+     * @param word
+     * @return
+     */
+    virtual int findWordId(const std::string &word) = 0;
+    virtual CAISS_RET_TYPE getWordById(unsigned int id, std::string &word) = 0;
+    virtual CAISS_RET_TYPE getVectorById(unsigned int id, std::vector<CAISS_FLOAT> &vec) = 0;
+
+    /**
+     * 将传入的query向量，转换成模型中的格式（默认是归一化）
+     * @param vec
+     * @return
+     */
+    virtual CAISS_RET_TYPE prepareQuery(std::vector<CAISS_FLOAT> &vec);
+
+    CAISS_RET_TYPE innerSearchDetails(void *info, CAISS_SEARCH_TYPE searchType, unsigned int topK,
+                                      unsigned int filterEditDistance, std::vector<CaissResultDetail> &details);
+    CAISS_RET_TYPE innerSearch(void *info, CAISS_SEARCH_TYPE searchType, unsigned int topK,
+                               unsigned int filterEditDistance, ALGO_RET_TYPE &result);
+    CAISS_RET_TYPE loadDatas(const char *dataPath, std::vector<CaissDataNode> &datas);
+    CAISS_RET_TYPE buildResult(CAISS_SEARCH_TYPE searchType);
+    CAISS_RET_TYPE buildResultDetails(ALGO_RET_TYPE &result, std::vector<CaissResultDetail> &details);
+
+    /* 函数过滤条件 */
+    CAISS_RET_TYPE filterByRules(void *info, CAISS_SEARCH_TYPE searchType, ALGO_RET_TYPE &result, unsigned int topK,
+                                 unsigned int filterEditDistance);
+    CAISS_RET_TYPE filterByEditDistance(void *info, CAISS_SEARCH_TYPE searchType, ALGO_RET_TYPE &result,
+                                        unsigned int filterEditDistance);
+    CAISS_RET_TYPE filterByIgnoreTrie(ALGO_RET_TYPE &result);
+
+    static std::string buildModelPath(const char *modelPath);
+    static bool isWordSearchType(CAISS_SEARCH_TYPE searchType);
+    static bool isAnnSearchType(CAISS_SEARCH_TYPE searchType);
+};
+
+
+#endif //CAISS_COMMONALGOPROC_H
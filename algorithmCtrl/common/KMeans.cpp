@@ -0,0 +1,246 @@
+//
+// Created by Chunel on 2020/10/4.
+//
+
+#include <random>
+#include <thread>
+#include <atomic>
+#include <limits>
+#include <cmath>
+#include <algorithm>
+
+#include "KMeans.h"
+#include "../flat/flatAlgo/FlatKernel.h"
+#include "../flat/flatAlgo/FlatIndex.h"
+
+using namespace std;
+
+
+KMeans::KMeans(unsigned int dim, CAISS_DISTANCE_TYPE distanceType) {
+    this->dim_ = dim;
+    this->distance_type_ = distanceType;
+    this->iteration_ = KMEANS_ITERATION_DEFAULT;
+    this->thread_num_ = 0;
+}
+
+
+CAISS_RET_TYPE KMeans::train(const CAISS_FLOAT *datas, unsigned int size, unsigned int k,
+                             std::vector<CAISS_FLOAT> &centroids) {
+    CAISS_FUNCTION_BEGIN
+    CAISS_ASSERT_NOT_NULL(datas)
+
+    if (CAISS_DISTANCE_EUC != this->distance_type_ && CAISS_DISTANCE_INNER != this->distance_type_) {
+        return CAISS_RET_NO_SUPPORT;
+    }
+
+    if (0 == k || k > size || 0 == this->dim_) {
+        return CAISS_RET_PARAM;
+    }
+
+    std::mt19937 rng(k);
+    std::vector<unsigned int> ids(size);
+    for (unsigned int i = 0; i < size; i++) {
+        ids[i] = i;
+    }
+
+    // 点数过多的时候，随机选择一部分点参与训练，对聚类中心的质量影响不大
+    const CAISS_FLOAT *trainDatas = datas;
+    std::vector<CAISS_FLOAT> samples;
+    if ((size_t)size > (size_t)k * KMEANS_SAMPLE_TIMES) {
+        std::shuffle(ids.begin(), ids.end(), rng);
+        size = k * KMEANS_SAMPLE_TIMES;
+        samples.resize((size_t)size * this->dim_);
+        for (unsigned int i = 0; i < size; i++) {
+            std::copy(datas + (size_t)ids[i] * this->dim_, datas + (size_t)(ids[i] + 1) * this->dim_,
+                      samples.begin() + (size_t)i * this->dim_);
+        }
+        trainDatas = samples.data();
+        ids.resize(size);
+        for (unsigned int i = 0; i < size; i++) {
+            ids[i] = i;
+        }
+    }
+
+    // 随机选择k个点，作为初始的中心
+    std::shuffle(ids.begin(), ids.end(), rng);
+    centroids.resize((size_t)k * this->dim_);
+    for (unsigned int i = 0; i < k; i++) {
+        std::copy(trainDatas + (size_t)ids[i] * this->dim_, trainDatas + (size_t)(ids[i] + 1) * this->dim_,
+                  centroids.begin() + (size_t)i * this->dim_);
+    }
+
+    std::vector<unsigned int> labels;
+    std::vector<unsigned int> lastLabels;
+    for (unsigned int iter = 0; iter < this->iteration_; iter++) {
+        assign(trainDatas, size, centroids.data(), k, labels, nullptr);
+        if (labels == lastLabels) {
+            break;    // 分配结果不再变化，说明已经收敛
+        }
+
+        updateCentroids(trainDatas, size, labels, k, centroids);
+        lastLabels.swap(labels);
+    }
+
+    CAISS_FUNCTION_END
+}
+
+
+void KMeans::assign(const CAISS_FLOAT *datas, unsigned int size, const CAISS_FLOAT *centroids, unsigned int k,
+                    std::vector<unsigned int> &labels, std::vector<CAISS_FLOAT> *dists) const {
+    labels.assign(size, 0);
+    if (nullptr != dists) {
+        dists->assign(size, 0.0f);
+    }
+
+    // 欧氏距离中，向量自身的模长不影响排序，仅需要 |c|^2 - 2<x,c>
+    std::vector<CAISS_FLOAT> centroidNorms(k, 0.0f);
+    if (CAISS_DISTANCE_EUC == this->distance_type_) {
+        for (unsigned int i = 0; i < k; i++) {
+            const CAISS_FLOAT *cur = centroids + (size_t)i * this->dim_;
+            centroidNorms[i] = FlatDot(cur, cur, this->dim_);
+        }
+    }
+
+    unsigned int blockNum = (size + FLAT_QUERY_BLOCK - 1) / FLAT_QUERY_BLOCK;
+    unsigned int threadNum = (0 != this->thread_num_) ? this->thread_num_ : std::max(std::thread::hardware_concurrency(), 1u);
+    threadNum = std::max(std::min(threadNum, blockNum), 1u);
+    std::atomic<unsigned int> nextBlock(0);
+
+    auto worker = [&]() {
+        unsigned int baseNum = std::min(k, FLAT_BASE_BLOCK);
+        std::vector<CAISS_FLOAT> dots((size_t)FLAT_QUERY_BLOCK * baseNum);
+        std::vector<CAISS_FLOAT> bestDists(FLAT_QUERY_BLOCK);
+        unsigned int block = 0;
+        while ((block = nextBlock++) < blockNum) {
+            unsigned int begin = block * FLAT_QUERY_BLOCK;
+            unsigned int num = std::min(FLAT_QUERY_BLOCK, size - begin);
+            std::fill(bestDists.begin(), bestDists.end(), std::numeric_limits<CAISS_FLOAT>::max());
+
+            for (unsigned int cBegin = 0; cBegin < k; cBegin += baseNum) {
+                unsigned int cNum = std::min(baseNum, k - cBegin);
+                FlatDotTile(datas + (size_t)begin * this->dim_, num, centroids + (size_t)cBegin * this->dim_, cNum,
+                            this->dim_, dots.data(), baseNum);
+                for (unsigned int i = 0; i < num; i++) {
+                    const CAISS_FLOAT *cur = dots.data() + (size_t)i * baseNum;
+                    for (unsigned int j = 0; j < cNum; j++) {
+                        CAISS_FLOAT dist = centroidNorms[cBegin + j] - 2.0f * cur[j];
+                        if (dist < bestDists[i]) {
+                            bestDists[i] = dist;
+                            labels[begin + i] = cBegin + j;
+                        }
+                    }
+                }
+            }
+
+            if (nullptr != dists) {
+                for (unsigned int i = 0; i < num; i++) {
+                    const CAISS_FLOAT *node = datas + (size_t)(begin + i) * this->dim_;
+                    CAISS_FLOAT dist = bestDists[i];
+                    (*dists)[begin + i] = (CAISS_DISTANCE_INNER == this->distance_type_)
+                                          ? 1.0f + dist / 2.0f
+                                          : std::max(dist + FlatDot(node, node, this->dim_), 0.0f);
+                }
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (unsigned int i = 1; i < threadNum; i++) {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for (auto &t : threads) {
+        t.join();
+    }
+}
+
+
+void KMeans::nearest(const CAISS_FLOAT *query, unsigned int dim, const CAISS_FLOAT *centroids,
+                     const CAISS_FLOAT *centroidNorms, unsigned int k, unsigned int num, std::vector<unsigned int> &ids) {
+    num = std::max(std::min(num, k), 1u);
+    std::vector<CAISS_FLOAT> dots(k);
+    FlatDotTile(query, 1, centroids, k, dim, dots.data(), k);
+
+    // 仅用于排序，|q|^2 对所有中心都相同，不需要计算
+    std::vector<std::pair<CAISS_FLOAT, unsigned int>> dists(k);
+    for (unsigned int i = 0; i < k; i++) {
+        dists[i].first = centroidNorms[i] - 2.0f * dots[i];
+        dists[i].second = i;
+    }
+    std::partial_sort(dists.begin(), dists.begin() + num, dists.end());
+
+    ids.resize(num);
+    for (unsigned int i = 0; i < num; i++) {
+        ids[i] = dists[i].second;
+    }
+}
+
+
+void KMeans::setIteration(unsigned int iteration) {
+    this->iteration_ = iteration;
+}
+
+
+void KMeans::setThreadNum(unsigned int threadNum) {
+    this->thread_num_ = threadNum;
+}
+
+
+void KMeans::updateCentroids(const CAISS_FLOAT *datas, unsigned int size, const std::vector<unsigned int> &labels,
+                             unsigned int k, std::vector<CAISS_FLOAT> &centroids) const {
+    std::vector<double> sums((size_t)k * this->dim_, 0.0);
+    std::vector<unsigned int> counts(k, 0);
+    for (unsigned int i = 0; i < size; i++) {
+        const CAISS_FLOAT *node = datas + (size_t)i * this->dim_;
+        double *sum = sums.data() + (size_t)labels[i] * this->dim_;
+        for (unsigned int j = 0; j < this->dim_; j++) {
+            sum[j] += node[j];
+        }
+        counts[labels[i]]++;
+    }
+
+    for (unsigned int i = 0; i < k; i++) {
+        if (0 == counts[i]) {
+            continue;
+        }
+        CAISS_FLOAT *cur = centroids.data() + (size_t)i * this->dim_;
+        for (unsigned int j = 0; j < this->dim_; j++) {
+            cur[j] = (CAISS_FLOAT)(sums[(size_t)i * this->dim_ + j] / counts[i]);
+        }
+    }
+
+    // 空的类，从当前最大的类中分裂出来：两个中心分别做一个很小的反向扰动，点数各分一半
+    for (unsigned int i = 0; i < k; i++) {
+        if (0 != counts[i]) {
+            continue;
+        }
+
+        auto big = (unsigned int)(std::max_element(counts.begin(), counts.end()) - counts.begin());
+        if (counts[big] < 2) {
+            break;
+        }
+
+        CAISS_FLOAT *src = centroids.data() + (size_t)big * this->dim_;
+        CAISS_FLOAT *dst = centroids.data() + (size_t)i * this->dim_;
+        for (unsigned int j = 0; j < this->dim_; j++) {
+            CAISS_FLOAT delta = (j % 2 == 0) ? KMEANS_SPLIT_EPS : -KMEANS_SPLIT_EPS;
+            dst[j] = src[j] * (1.0f + delta);
+            src[j] = src[j] * (1.0f - delta);
+        }
+        counts[i] = counts[big] / 2;
+        counts[big] -= counts[i];
+    }
+
+    // 内积距离下，中心点需要保持在单位球面上，否则模长较大的中心会吸收过多的点
+    if (CAISS_DISTANCE_INNER == this->distance_type_) {
+        for (unsigned int i = 0; i < k; i++) {
+            CAISS_FLOAT *cur = centroids.data() + (size_t)i * this->dim_;
+            CAISS_FLOAT norm = std::sqrt(FlatDot(cur, cur, this->dim_));
+            if (norm > 0.0f) {
+                for (unsigned int j = 0; j < this->dim_; j++) {
+                    cur[j] /= norm;
+                }
+            }
+        }
+    }
+}
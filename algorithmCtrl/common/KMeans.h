@@ -0,0 +1,77 @@
+//
+// Created by Chunel on 2020/10/4.
+// k-means聚类。ivf的粗聚类中心，以及pq的码本，都是通过这里训练得到
+//
+
+#ifndef CAISS_KMEANS_H
+#define CAISS_KMEANS_H
+
+#include <vector>
+
+#include "../../caissLib/CaissLibDefine.h"
+#include "../../utilsCtrl/UtilsInclude.h"
+
+const static unsigned int KMEANS_ITERATION_DEFAULT = 20;      // 最大迭代轮数
+const static unsigned int KMEANS_SAMPLE_TIMES = 256;          // 每个中心最多使用的训练点数，点数过多时随机采样
+const static float KMEANS_SPLIT_EPS = 1.0f / 1024.0f;         // 空类分裂时的扰动比例
+
+class KMeans {
+
+public:
+    /**
+     * @param dim
+     * @param distanceType 欧氏距离按照平方距离聚类；内积距离按照最大内积分配，且中心会被归一化（球面k-means）
+     */
+    KMeans(unsigned int dim, CAISS_DISTANCE_TYPE distanceType);
+
+    /**
+     * 训练聚类中心
+     * @param datas 连续存放的向量
+     * @param size
+     * @param k 中心的个数（不能超过size）
+     * @param centroids 连续存放的k个中心
+     * @return
+     */
+    CAISS_RET_TYPE train(const CAISS_FLOAT *datas, unsigned int size, unsigned int k, std::vector<CAISS_FLOAT> &centroids);
+
+    /**
+     * 找到每个向量最近的中心（多线程分块计算）
+     * @param datas
+     * @param size
+     * @param centroids
+     * @param k
+     * @param labels 每个向量对应的中心id
+     * @param dists 每个向量到对应中心的距离，可以为nullptr
+     */
+    void assign(const CAISS_FLOAT *datas, unsigned int size, const CAISS_FLOAT *centroids, unsigned int k,
+                std::vector<unsigned int> &labels, std::vector<CAISS_FLOAT> *dists) const;
+
+    /**
+     * 查找距离query最近的num个中心，按照距离从近到远放入ids中
+     * @param query
+     * @param dim
+     * @param centroids
+     * @param centroidNorms 每个中心模长的平方
+     * @param k 中心的个数
+     * @param num
+     * @param ids
+     */
+    static void nearest(const CAISS_FLOAT *query, unsigned int dim, const CAISS_FLOAT *centroids,
+                        const CAISS_FLOAT *centroidNorms, unsigned int k, unsigned int num, std::vector<unsigned int> &ids);
+
+    void setIteration(unsigned int iteration);
+    void setThreadNum(unsigned int threadNum);
+
+protected:
+    void updateCentroids(const CAISS_FLOAT *datas, unsigned int size, const std::vector<unsigned int> &labels,
+                         unsigned int k, std::vector<CAISS_FLOAT> &centroids) const;
+
+private:
+    unsigned int dim_;
+    CAISS_DISTANCE_TYPE distance_type_;
+    unsigned int iteration_;
+    unsigned int thread_num_;    // 为0表示根据cpu核数自动决定
+};
+
+
+#endif //CAISS_KMEANS_H
@@ -0,0 +1,265 @@
+//
+// Created by Chunel on 2020/9/27.
+//
+
+#include <random>
+#include <thread>
+#include <algorithm>
+
+#include "NNDescent.h"
+#include "../flat/flatAlgo/FlatKernel.h"
+
+using namespace std;
+
+
+NNDescent::NNDescent(const CAISS_FLOAT *datas, unsigned int size, unsigned int dim, CAISS_DISTANCE_TYPE distanceType)
+        : locks_(NND_LOCK_NUM) {
+    this->datas_ = datas;
+    this->size_ = size;
+    this->dim_ = dim;
+    this->distance_type_ = distanceType;
+    this->thread_num_ = 1;
+}
+
+
+CAISS_RET_TYPE NNDescent::build(const NNDescentParams &params, std::vector<std::vector<unsigned>> &graph) {
+    CAISS_FUNCTION_BEGIN
+    CAISS_ASSERT_NOT_NULL(this->datas_)
+
+    if (CAISS_DISTANCE_EUC != this->distance_type_ && CAISS_DISTANCE_INNER != this->distance_type_) {
+        return CAISS_RET_NO_SUPPORT;
+    }
+
+    if (this->size_ < 2 || 0 == params.knn) {
+        return CAISS_RET_PARAM;
+    }
+
+    this->params_ = params;
+    this->params_.pool = std::min(std::max(params.pool, params.knn), this->size_ - 1);
+    this->thread_num_ = (0 != params.threadNum) ? params.threadNum : std::max(std::thread::hardware_concurrency(), 1u);
+
+    this->norms_.resize(this->size_);
+    for (unsigned int i = 0; i < this->size_; i++) {
+        const CAISS_FLOAT *cur = this->datas_ + (size_t)i * this->dim_;
+        this->norms_[i] = FlatDot(cur, cur, this->dim_);
+    }
+
+    std::vector<std::mt19937> rngs;
+    for (unsigned int i = 0; i < this->thread_num_; i++) {
+        rngs.emplace_back(i + 1);    // 每个线程使用自己的随机数生成器，保证结果可复现（单线程情况下）
+    }
+
+    this->nodes_ = std::vector<NNDescentNode>(this->size_);
+    parallelRun([&](unsigned int id, unsigned int threadId) {
+        initPool(id, rngs[threadId]);
+    });
+
+    // 候选集合全部更新一遍，约为 size * pool 次更新
+    auto threshold = (size_t)(this->params_.delta * (float)this->size_ * (float)this->params_.pool);
+    for (unsigned int iter = 0; iter < this->params_.iteration; iter++) {
+        parallelRun([&](unsigned int id, unsigned int threadId) {
+            sample(id);
+        });
+        parallelRun([&](unsigned int id, unsigned int threadId) {
+            reverse(id, rngs[threadId]);
+        });
+        parallelRun([&](unsigned int id, unsigned int threadId) {
+            merge(id);
+        });
+
+        std::atomic<size_t> updates(0);
+        parallelRun([&](unsigned int id, unsigned int threadId) {
+            updates += join(id);
+        });
+
+        CAISS_ECHO("nn-descent iteration [%d], update [%d] neighbors.", iter + 1, (int)updates.load());
+        if (updates.load() <= threshold) {
+            break;
+        }
+    }
+
+    graph.assign(this->size_, std::vector<unsigned>());
+    for (unsigned int i = 0; i < this->size_; i++) {
+        auto &pool = this->nodes_[i].pool;
+        std::sort(pool.begin(), pool.end());
+        unsigned int num = std::min((unsigned int)pool.size(), params.knn);
+        graph[i].resize(num);
+        for (unsigned int j = 0; j < num; j++) {
+            graph[i][j] = pool[j].id;
+        }
+    }
+
+    std::vector<NNDescentNode>().swap(this->nodes_);
+    std::vector<CAISS_FLOAT>().swap(this->norms_);
+    CAISS_FUNCTION_END
+}
+
+
+void NNDescent::initPool(unsigned int id, std::mt19937 &rng) {
+    auto &pool = this->nodes_[id].pool;
+    pool.reserve(this->params_.pool);
+
+    // 随机选择pool个邻居作为初始值。点数不多的时候，随机选择很难结束，则直接选择全部的点
+    bool takeAll = (this->params_.pool * 2 > this->size_);
+    unsigned int cur = 0;
+    while (pool.size() < this->params_.pool) {
+        unsigned int nbr = takeAll ? cur++ : (unsigned int)(rng() % this->size_);
+        if (nbr == id) {
+            continue;
+        }
+
+        bool exist = std::any_of(pool.begin(), pool.end(), [nbr](const NNDescentNeighbor &n) {
+            return n.id == nbr;
+        });
+        if (!exist) {
+            pool.emplace_back(nbr, calcDistance(id, nbr), true);
+        }
+    }
+
+    std::make_heap(pool.begin(), pool.end());
+}
+
+
+void NNDescent::sample(unsigned int id) {
+    auto &node = this->nodes_[id];
+    node.nnNew.clear();
+    node.nnOld.clear();
+
+    // 优先选择距离较近的新邻居参与计算
+    std::sort(node.pool.begin(), node.pool.end());
+    for (auto &cur : node.pool) {
+        if (cur.isNew) {
+            if (node.nnNew.size() < this->params_.sample) {
+                node.nnNew.push_back(cur.id);
+                cur.isNew = false;
+            }
+        } else if (node.nnOld.size() < this->params_.sample) {
+            node.nnOld.push_back(cur.id);
+        }
+    }
+    std::make_heap(node.pool.begin(), node.pool.end());
+}
+
+
+void NNDescent::reverse(unsigned int id, std::mt19937 &rng) {
+    auto &node = this->nodes_[id];
+    auto addReverse = [&](std::vector<unsigned int> &rnn) {
+        if (rnn.size() < this->params_.reverse) {
+            rnn.push_back(id);
+        } else {
+            rnn[rng() % rnn.size()] = id;    // 反向邻居过多时，随机替换
+        }
+    };
+
+    for (auto nbr : node.nnNew) {
+        std::lock_guard<std::mutex> lock(getLock(nbr));
+        addReverse(this->nodes_[nbr].rnnNew);
+    }
+    for (auto nbr : node.nnOld) {
+        std::lock_guard<std::mutex> lock(getLock(nbr));
+        addReverse(this->nodes_[nbr].rnnOld);
+    }
+}
+
+
+void NNDescent::merge(unsigned int id) {
+    auto &node = this->nodes_[id];
+    node.nnNew.insert(node.nnNew.end(), node.rnnNew.begin(), node.rnnNew.end());
+    node.nnOld.insert(node.nnOld.end(), node.rnnOld.begin(), node.rnnOld.end());
+    std::vector<unsigned int>().swap(node.rnnNew);
+    std::vector<unsigned int>().swap(node.rnnOld);
+
+    std::sort(node.nnNew.begin(), node.nnNew.end());
+    node.nnNew.erase(std::unique(node.nnNew.begin(), node.nnNew.end()), node.nnNew.end());
+    std::sort(node.nnOld.begin(), node.nnOld.end());
+    node.nnOld.erase(std::unique(node.nnOld.begin(), node.nnOld.end()), node.nnOld.end());
+}
+
+
+unsigned int NNDescent::join(unsigned int id) {
+    const auto &node = this->nodes_[id];
+    unsigned int updates = 0;
+
+    // 新邻居之间两两计算，新邻居和旧邻居之间计算。旧邻居之间在之前的轮次中已经计算过了
+    for (size_t i = 0; i < node.nnNew.size(); i++) {
+        unsigned int u = node.nnNew[i];
+        for (size_t j = i + 1; j < node.nnNew.size(); j++) {
+            unsigned int v = node.nnNew[j];
+            CAISS_FLOAT dist = calcDistance(u, v);
+            updates += insert(u, v, dist);
+            updates += insert(v, u, dist);
+        }
+
+        for (auto v : node.nnOld) {
+            if (u == v) {
+                continue;
+            }
+            CAISS_FLOAT dist = calcDistance(u, v);
+            updates += insert(u, v, dist);
+            updates += insert(v, u, dist);
+        }
+    }
+
+    return updates;
+}
+
+
+unsigned int NNDescent::insert(unsigned int id, unsigned int nbr, CAISS_FLOAT distance) {
+    std::lock_guard<std::mutex> lock(getLock(id));
+    auto &pool = this->nodes_[id].pool;
+    if (pool.size() >= this->params_.pool && distance >= pool.front().distance) {
+        return 0;
+    }
+
+    for (const auto &cur : pool) {
+        if (cur.id == nbr) {
+            return 0;
+        }
+    }
+
+    if (pool.size() >= this->params_.pool) {
+        std::pop_heap(pool.begin(), pool.end());
+        pool.pop_back();
+    }
+    pool.emplace_back(nbr, distance, true);
+    std::push_heap(pool.begin(), pool.end());
+
+    return 1;
+}
+
+
+CAISS_FLOAT NNDescent::calcDistance(unsigned int a, unsigned int b) const {
+    CAISS_FLOAT dot = FlatDot(this->datas_ + (size_t)a * this->dim_, this->datas_ + (size_t)b * this->dim_, this->dim_);
+    if (CAISS_DISTANCE_INNER == this->distance_type_) {
+        return 1.0f - dot;    // 跟hnsw中内积距离的定义保持一致
+    }
+
+    return std::max(this->norms_[a] + this->norms_[b] - 2.0f * dot, 0.0f);
+}
+
+
+void NNDescent::parallelRun(const std::function<void(unsigned int, unsigned int)> &func) {
+    unsigned int blockNum = (this->size_ + NND_BLOCK_SIZE - 1) / NND_BLOCK_SIZE;
+    unsigned int threadNum = std::max(std::min(this->thread_num_, blockNum), 1u);
+    std::atomic<unsigned int> nextBlock(0);
+
+    auto worker = [&](unsigned int threadId) {
+        unsigned int block = 0;
+        while ((block = nextBlock++) < blockNum) {
+            unsigned int begin = block * NND_BLOCK_SIZE;
+            unsigned int end = std::min(begin + NND_BLOCK_SIZE, this->size_);
+            for (unsigned int id = begin; id < end; id++) {
+                func(id, threadId);
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (unsigned int i = 1; i < threadNum; i++) {
+        threads.emplace_back(worker, i);
+    }
+    worker(0);    // 当前线程也参与计算
+    for (auto &t : threads) {
+        t.join();
+    }
+}
@@ -0,0 +1,128 @@
+//
+// Created by Chunel on 2020/9/27.
+// 通过NN-Descent的方式，构建近似kNN图。邻居的邻居，很可能也是邻居：
+// 每一轮迭代中，对每个点的新邻居两两计算距离，并尝试更新到对方的候选集合中，直到更新量足够小为止。
+// 构建的结果，可以作为nsg构图的输入，或者hnsw第0层邻居的补充
+//
+
+#ifndef CAISS_NNDESCENT_H
+#define CAISS_NNDESCENT_H
+
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include <random>
+#include <algorithm>
+
+#include "../../caissLib/CaissLibDefine.h"
+#include "../../utilsCtrl/UtilsInclude.h"
+
+const static unsigned int NND_KNN_DEFAULT = 64;           // 构建完成后，每个点保留的邻居数
+const static unsigned int NND_POOL_DEFAULT = 80;          // 迭代时，每个点的候选集合大小（不小于邻居数）
+const static unsigned int NND_SAMPLE_DEFAULT = 12;        // 每一轮中，每个点参与计算的新邻居（以及旧邻居）数
+const static unsigned int NND_REVERSE_DEFAULT = 24;       // 每一轮中，每个点最多保留的反向邻居数
+const static unsigned int NND_ITERATION_DEFAULT = 12;     // 最大迭代轮数
+const static float NND_DELTA_DEFAULT = 0.001f;            // 一轮中更新比例低于此值时，提前结束
+const static unsigned int NND_BLOCK_SIZE = 256;           // 多线程处理时，每次领取的点数
+const static unsigned int NND_LOCK_NUM = 4096;            // 锁的数量（多个点共用一把锁，避免点数过多时锁占用内存过大）
+
+struct NNDescentParams {
+    explicit NNDescentParams(unsigned int knn = NND_KNN_DEFAULT) {
+        this->knn = knn;
+        this->pool = std::max(knn, NND_POOL_DEFAULT);
+        this->sample = NND_SAMPLE_DEFAULT;
+        this->reverse = NND_REVERSE_DEFAULT;
+        this->iteration = NND_ITERATION_DEFAULT;
+        this->delta = NND_DELTA_DEFAULT;
+        this->threadNum = 0;
+    }
+
+    unsigned int knn;               // 每个点保留的邻居数
+    unsigned int pool;              // 候选集合大小
+    unsigned int sample;            // 采样的新邻居（以及旧邻居）数
+    unsigned int reverse;           // 反向邻居数
+    unsigned int iteration;         // 最大迭代轮数
+    float delta;                    // 提前结束的阈值
+    unsigned int threadNum;         // 线程数，为0表示根据cpu核数自动决定
+};
+
+class NNDescent {
+
+public:
+    /**
+     * @param datas 连续存放的向量（已经归一化），构建过程中需要保持有效
+     * @param size
+     * @param dim
+     * @param distanceType 仅支持欧氏距离和内积距离
+     */
+    NNDescent(const CAISS_FLOAT *datas, unsigned int size, unsigned int dim, CAISS_DISTANCE_TYPE distanceType);
+
+    /**
+     * 构建kNN图。graph[i]中，按照距离从近到远，存放点i的邻居（不包含自身）
+     * @param params
+     * @param graph
+     * @return
+     */
+    CAISS_RET_TYPE build(const NNDescentParams &params, std::vector<std::vector<unsigned>> &graph);
+
+protected:
+    struct NNDescentNeighbor {
+        NNDescentNeighbor() = default;
+        NNDescentNeighbor(unsigned int id, CAISS_FLOAT distance, bool isNew) : id(id), distance(distance), isNew(isNew) {}
+
+        bool operator<(const NNDescentNeighbor &other) const {
+            return distance < other.distance;
+        }
+
+        unsigned int id;
+        CAISS_FLOAT distance;
+        bool isNew;    // 是否还没有参与过计算
+    };
+
+    struct NNDescentNode {
+        std::vector<NNDescentNeighbor> pool;    // 候选集合，大顶堆
+        std::vector<unsigned int> nnNew;
+        std::vector<unsigned int> nnOld;
+        std::vector<unsigned int> rnnNew;
+        std::vector<unsigned int> rnnOld;
+    };
+
+    void initPool(unsigned int id, std::mt19937 &rng);
+    void sample(unsigned int id);
+    void reverse(unsigned int id, std::mt19937 &rng);
+    void merge(unsigned int id);
+    unsigned int join(unsigned int id);
+
+    /**
+     * 将nbr尝试加入id的候选集合中
+     * @return 加入成功返回1，否则返回0
+     */
+    unsigned int insert(unsigned int id, unsigned int nbr, CAISS_FLOAT distance);
+    CAISS_FLOAT calcDistance(unsigned int a, unsigned int b) const;
+
+    /**
+     * 多线程遍历所有点。点按照NND_BLOCK_SIZE分块，由多个线程依次领取处理
+     * @param func 参数依次为：点的id，线程id
+     */
+    void parallelRun(const std::function<void(unsigned int, unsigned int)> &func);
+
+    inline std::mutex &getLock(unsigned int id) {
+        return this->locks_[id % NND_LOCK_NUM];
+    }
+
+private:
+    const CAISS_FLOAT *datas_;
+    unsigned int size_;
+    unsigned int dim_;
+    CAISS_DISTANCE_TYPE distance_type_;
+    std::vector<CAISS_FLOAT> norms_;    // 每个向量模长的平方（欧氏距离使用）
+
+    NNDescentParams params_;
+    unsigned int thread_num_;
+    std::vector<NNDescentNode> nodes_;
+    std::vector<std::mutex> locks_;
+};
+
+
+#endif //CAISS_NNDESCENT_H
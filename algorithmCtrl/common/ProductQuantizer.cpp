@@ -0,0 +1,201 @@
+//
+// Created by Chunel on 2020/10/11.
+//
+
+#include <limits>
+#include <algorithm>
+
+#include "ProductQuantizer.h"
+#include "KMeans.h"
+#include "../flat/flatAlgo/FlatKernel.h"
+
+using namespace std;
+
+template<typename T>
+static void writePqPOD(std::ostream &out, const T &podRef) {
+    out.write((char *) &podRef, sizeof(T));
+}
+
+template<typename T>
+static void readPqPOD(std::istream &in, T &podRef) {
+    in.read((char *) &podRef, sizeof(T));
+}
+
+
+ProductQuantizer::ProductQuantizer() {
+    this->dim_ = 0;
+    this->m_ = 0;
+    this->dsub_ = 0;
+    this->ksub_ = 0;
+}
+
+
+ProductQuantizer::ProductQuantizer(unsigned int dim, unsigned int m) {
+    if (0 == m || 0 != dim % m) {
+        // 选择不超过 dim/PQ_SUB_DIM_DEFAULT，且能整除dim的最大段数
+        m = std::max(dim / PQ_SUB_DIM_DEFAULT, 1u);
+        while (m > 1 && 0 != dim % m) {
+            m--;
+        }
+    }
+
+    this->dim_ = dim;
+    this->m_ = m;
+    this->dsub_ = dim / m;
+    this->ksub_ = 0;
+}
+
+
+CAISS_RET_TYPE ProductQuantizer::train(const CAISS_FLOAT *datas, unsigned int size) {
+    CAISS_FUNCTION_BEGIN
+    CAISS_ASSERT_NOT_NULL(datas)
+
+    if (0 == size || 0 == this->m_) {
+        return CAISS_RET_PARAM;
+    }
+
+    this->ksub_ = std::min(size, PQ_KSUB_MAX);
+    this->centroids_.resize((size_t)this->m_ * this->ksub_ * this->dsub_);
+
+    // 每一段的维度很低，少量的点就可以训练出稳定的中心。点数过多时，按照固定间隔采样
+    unsigned int sampleNum = std::min(size, this->ksub_ * PQ_SAMPLE_TIMES);
+    std::vector<CAISS_FLOAT> subDatas((size_t)sampleNum * this->dsub_);
+    std::vector<CAISS_FLOAT> subCentroids;
+    KMeans kmeans(this->dsub_, CAISS_DISTANCE_EUC);    // 每一段都按照欧氏距离聚类，内积的误差同样可以被控制住
+    kmeans.setIteration(PQ_ITERATION);
+    for (unsigned int i = 0; i < this->m_; i++) {
+        for (unsigned int j = 0; j < sampleNum; j++) {
+            size_t row = (size_t)j * size / sampleNum;
+            const CAISS_FLOAT *src = datas + row * this->dim_ + (size_t)i * this->dsub_;
+            std::copy(src, src + this->dsub_, subDatas.begin() + (size_t)j * this->dsub_);
+        }
+
+        ret = kmeans.train(subDatas.data(), sampleNum, this->ksub_, subCentroids);
+        CAISS_FUNCTION_CHECK_STATUS
+        std::copy(subCentroids.begin(), subCentroids.end(),
+                  this->centroids_.begin() + (size_t)i * this->ksub_ * this->dsub_);
+    }
+    buildCentroidNorms();
+
+    CAISS_FUNCTION_END
+}
+
+
+void ProductQuantizer::encode(const CAISS_FLOAT *vec, PQ_CODE_TYPE *code) const {
+    for (unsigned int i = 0; i < this->m_; i++) {
+        const CAISS_FLOAT *sub = vec + (size_t)i * this->dsub_;
+        const CAISS_FLOAT *center = this->centroids_.data() + (size_t)i * this->ksub_ * this->dsub_;
+        CAISS_FLOAT best = std::numeric_limits<CAISS_FLOAT>::max();
+        for (unsigned int j = 0; j < this->ksub_; j++, center += this->dsub_) {
+            CAISS_FLOAT dist = 0.0f;
+            for (unsigned int k = 0; k < this->dsub_; k++) {
+                CAISS_FLOAT diff = sub[k] - center[k];
+                dist += diff * diff;
+            }
+            if (dist < best) {
+                best = dist;
+                code[i] = (PQ_CODE_TYPE)j;
+            }
+        }
+    }
+}
+
+
+void ProductQuantizer::encode(const CAISS_FLOAT *datas, unsigned int size, PQ_CODE_TYPE *codes) const {
+    std::vector<CAISS_FLOAT> subDatas((size_t)size * this->dsub_);
+    std::vector<unsigned int> labels;
+    KMeans kmeans(this->dsub_, CAISS_DISTANCE_EUC);
+    for (unsigned int i = 0; i < this->m_; i++) {
+        for (unsigned int j = 0; j < size; j++) {
+            const CAISS_FLOAT *src = datas + (size_t)j * this->dim_ + (size_t)i * this->dsub_;
+            std::copy(src, src + this->dsub_, subDatas.begin() + (size_t)j * this->dsub_);
+        }
+
+        // 按段分配中心，跟k-means训练时的计算方式一致
+        kmeans.assign(subDatas.data(), size, this->centroids_.data() + (size_t)i * this->ksub_ * this->dsub_,
+                      this->ksub_, labels, nullptr);
+        for (unsigned int j = 0; j < size; j++) {
+            codes[(size_t)j * this->m_ + i] = (PQ_CODE_TYPE)labels[j];
+        }
+    }
+}
+
+
+void ProductQuantizer::decode(const PQ_CODE_TYPE *code, CAISS_FLOAT *vec) const {
+    for (unsigned int i = 0; i < this->m_; i++) {
+        const CAISS_FLOAT *center = this->centroids_.data() + ((size_t)i * this->ksub_ + code[i]) * this->dsub_;
+        std::copy(center, center + this->dsub_, vec + (size_t)i * this->dsub_);
+    }
+}
+
+
+void ProductQuantizer::computeL2Table(const CAISS_FLOAT *query, CAISS_FLOAT *table) const {
+    // |q - c|^2 = |q|^2 + |c|^2 - 2<q,c>，内积部分按照分块的方式计算
+    computeDotTable(query, table);
+    for (unsigned int i = 0; i < this->m_; i++) {
+        const CAISS_FLOAT *sub = query + (size_t)i * this->dsub_;
+        const CAISS_FLOAT *norms = this->centroid_norms_.data() + (size_t)i * this->ksub_;
+        CAISS_FLOAT subNorm = FlatDot(sub, sub, this->dsub_);
+        for (unsigned int j = 0; j < this->ksub_; j++) {
+            table[j] = std::max(subNorm + norms[j] - 2.0f * table[j], 0.0f);
+        }
+        table += this->ksub_;
+    }
+}
+
+
+void ProductQuantizer::computeDotTable(const CAISS_FLOAT *query, CAISS_FLOAT *table) const {
+    for (unsigned int i = 0; i < this->m_; i++) {
+        FlatDotTile(query + (size_t)i * this->dsub_, 1, this->centroids_.data() + (size_t)i * this->ksub_ * this->dsub_,
+                    this->ksub_, this->dsub_, table + (size_t)i * this->ksub_, this->ksub_);
+    }
+}
+
+
+void ProductQuantizer::save(std::ostream &out) const {
+    writePqPOD(out, this->dim_);
+    writePqPOD(out, this->m_);
+    writePqPOD(out, this->ksub_);
+    out.write((const char *)this->centroids_.data(), this->centroids_.size() * sizeof(CAISS_FLOAT));
+}
+
+
+void ProductQuantizer::load(std::istream &in) {
+    readPqPOD(in, this->dim_);
+    readPqPOD(in, this->m_);
+    readPqPOD(in, this->ksub_);
+    this->dsub_ = (0 != this->m_) ? this->dim_ / this->m_ : 0;
+    this->centroids_.resize((size_t)this->m_ * this->ksub_ * this->dsub_);
+    in.read((char *)this->centroids_.data(), this->centroids_.size() * sizeof(CAISS_FLOAT));
+    buildCentroidNorms();
+}
+
+
+unsigned int ProductQuantizer::getM() const {
+    return this->m_;
+}
+
+
+unsigned int ProductQuantizer::getKsub() const {
+    return this->ksub_;
+}
+
+
+unsigned int ProductQuantizer::getCodeSize() const {
+    return this->m_ * (unsigned int)sizeof(PQ_CODE_TYPE);
+}
+
+
+unsigned int ProductQuantizer::getTableSize() const {
+    return this->m_ * this->ksub_;
+}
+
+
+void ProductQuantizer::buildCentroidNorms() {
+    auto num = (size_t)this->m_ * this->ksub_;
+    this->centroid_norms_.resize(num);
+    for (size_t i = 0; i < num; i++) {
+        const CAISS_FLOAT *cur = this->centroids_.data() + i * this->dsub_;
+        this->centroid_norms_[i] = FlatDot(cur, cur, this->dsub_);
+    }
+}
@@ -0,0 +1,98 @@
+//
+// Created by Chunel on 2020/10/11.
+// 乘积量化（pq）。向量被切分成m段，每一段独立训练256个中心，编码之后每个向量只占m个字节。
+// 查询的时候，先计算query每一段到所有中心的距离表，之后每个编码的距离只需要m次查表（adc）
+//
+
+#ifndef CAISS_PRODUCTQUANTIZER_H
+#define CAISS_PRODUCTQUANTIZER_H
+
+#include <vector>
+#include <iostream>
+
+#include "../../caissLib/CaissLibDefine.h"
+#include "../../utilsCtrl/UtilsInclude.h"
+
+using PQ_CODE_TYPE = unsigned char;
+
+const static unsigned int PQ_KSUB_MAX = 256;          // 每一段的中心个数（8bit编码）
+const static unsigned int PQ_SUB_DIM_DEFAULT = 8;     // 自动决定段数时，每一段的目标维度
+const static unsigned int PQ_SAMPLE_TIMES = 64;       // 训练时，每个中心最多使用的点数
+const static unsigned int PQ_ITERATION = 10;          // 每一段k-means的迭代轮数
+
+class ProductQuantizer {
+
+public:
+    explicit ProductQuantizer();
+
+    /**
+     * @param dim
+     * @param m 段数，需要能整除dim。为0表示按照PQ_SUB_DIM_DEFAULT自动决定
+     */
+    ProductQuantizer(unsigned int dim, unsigned int m);
+
+    /**
+     * 训练每一段的中心
+     * @param datas 连续存放的向量
+     * @param size
+     * @return
+     */
+    CAISS_RET_TYPE train(const CAISS_FLOAT *datas, unsigned int size);
+
+    void encode(const CAISS_FLOAT *vec, PQ_CODE_TYPE *code) const;
+
+    /**
+     * 批量编码（多线程），codes中连续存放每个向量的编码
+     */
+    void encode(const CAISS_FLOAT *datas, unsigned int size, PQ_CODE_TYPE *codes) const;
+    void decode(const PQ_CODE_TYPE *code, CAISS_FLOAT *vec) const;
+
+    /**
+     * 计算欧氏距离表，table[i * ksub + j] = |query_i - center_ij|^2
+     */
+    void computeL2Table(const CAISS_FLOAT *query, CAISS_FLOAT *table) const;
+
+    /**
+     * 计算内积表，table[i * ksub + j] = <query_i, center_ij>
+     */
+    void computeDotTable(const CAISS_FLOAT *query, CAISS_FLOAT *table) const;
+
+    /**
+     * 通过距离表，计算编码对应的距离（或内积）
+     */
+    inline CAISS_FLOAT lookup(const CAISS_FLOAT *table, const PQ_CODE_TYPE *code) const {
+        CAISS_FLOAT res0 = 0.0f, res1 = 0.0f;
+        unsigned int i = 0;
+        for (; i + 2 <= this->m_; i += 2) {
+            res0 += table[code[i]];
+            res1 += table[this->ksub_ + code[i + 1]];
+            table += 2 * this->ksub_;
+        }
+        if (i < this->m_) {
+            res0 += table[code[i]];
+        }
+        return res0 + res1;
+    }
+
+    void save(std::ostream &out) const;
+    void load(std::istream &in);
+
+    unsigned int getM() const;
+    unsigned int getKsub() const;
+    unsigned int getCodeSize() const;
+    unsigned int getTableSize() const;
+
+protected:
+    void buildCentroidNorms();
+
+private:
+    unsigned int dim_;
+    unsigned int m_;
+    unsigned int dsub_;    // 每一段的维度
+    unsigned int ksub_;    // 每一段的中心个数
+    std::vector<CAISS_FLOAT> centroids_;    // m * ksub * dsub，按段连续存放
+    std::vector<CAISS_FLOAT> centroid_norms_;    // 每个中心模长的平方
+};
+
+
+#endif //CAISS_PRODUCTQUANTIZER_H
@@ -0,0 +1,676 @@
+//
+// Created by Chunel on 2020/10/18.
+//
+
+#include <cstring>
+#include <algorithm>
+#include <limits>
+#include <unordered_set>
+
+#ifndef WIN32
+    #include <fcntl.h>
+    #include <unistd.h>
+#endif
+
+#include "DiskAnnIndex.h"
+#include "../../common/NNDescent.h"
+
+using namespace std;
+
+template<typename T>
+static void writeDiskAnnPOD(std::ostream &out, const T &podRef) {
+    out.write((char *) &podRef, sizeof(T));
+}
+
+template<typename T>
+static void readDiskAnnPOD(std::istream &in, T &podRef) {
+    in.read((char *) &podRef, sizeof(T));
+}
+
+static void writeDiskAnnString(std::ostream &out, const std::string &str) {
+    auto len = (unsigned int)str.size();
+    writeDiskAnnPOD(out, len);
+    out.write(str.data(), len);
+}
+
+static void readDiskAnnString(std::istream &in, std::string &str) {
+    unsigned int len = 0;
+    readDiskAnnPOD(in, len);
+    str.resize(len);
+    in.read(&str[0], len);
+}
+
+struct DiskAnnCandidate {
+    CAISS_FLOAT distance;    // pq距离
+    unsigned int id;
+    bool expanded;           // 节点信息是否已经读取
+};
+
+
+DiskAnnIndex::DiskAnnIndex() {
+    this->dim_ = 0;
+    this->distance_type_ = CAISS_DISTANCE_DEFAULT;
+    this->max_size_ = 0;
+    this->max_index_size_ = 0;
+    this->normalize_ = CAISS_FALSE;
+    this->search_pool_ = 0;
+    this->beam_width_ = 1;
+    this->max_degree_ = 0;
+    this->entry_ = 0;
+    this->node_size_ = 0;
+    this->graph_offset_ = 0;
+    this->index_ = nullptr;
+#ifndef WIN32
+    this->graph_fd_ = -1;
+#endif
+    this->graph_opened_ = false;
+}
+
+
+DiskAnnIndex::DiskAnnIndex(unsigned int dim, CAISS_DISTANCE_TYPE distanceType, unsigned int maxSize,
+                           unsigned int maxIndexSize, CAISS_BOOL normalize) : DiskAnnIndex() {
+    this->dim_ = dim;
+    this->distance_type_ = distanceType;
+    this->max_size_ = maxSize;
+    this->max_index_size_ = maxIndexSize;
+    this->normalize_ = normalize;
+}
+
+
+DiskAnnIndex::~DiskAnnIndex() {
+    closeGraph();
+    CAISS_DELETE_PTR(this->index_)
+}
+
+
+CAISS_RET_TYPE DiskAnnIndex::addPoint(const CAISS_FLOAT *node, const std::string &word) {
+    CAISS_FUNCTION_BEGIN
+    CAISS_ASSERT_NOT_NULL(node)
+
+    if (word.empty() || word.size() > this->max_index_size_) {
+        return CAISS_RET_WORD_SIZE;
+    }
+
+    if (nullptr != this->index_ || this->graph_opened_) {
+        return CAISS_RET_NO_SUPPORT;    // 磁盘上的图是静态的，构建完成之后不支持插入
+    }
+
+    auto cur = this->word_lookup_.find(word);
+    if (cur != this->word_lookup_.end()) {
+        std::copy(node, node + this->dim_, this->datas_.begin() + (size_t)cur->second * this->dim_);
+        return CAISS_RET_OK;
+    }
+
+    if (this->words_.size() >= this->max_size_) {
+        return CAISS_RET_MODEL_SIZE;
+    }
+
+    this->word_lookup_[word] = (unsigned int)this->words_.size();
+    this->words_.push_back(word);
+    this->datas_.insert(this->datas_.end(), node, node + this->dim_);
+
+    CAISS_FUNCTION_END
+}
+
+
+CAISS_RET_TYPE DiskAnnIndex::buildKnnGraph(unsigned int knn, std::vector<std::vector<unsigned>> &graph) const {
+    CAISS_FUNCTION_BEGIN
+
+    NNDescent nnd(this->datas_.data(), getSize(), this->dim_, this->distance_type_);
+    ret = nnd.build(NNDescentParams(knn), graph);
+    CAISS_FUNCTION_CHECK_STATUS
+
+    CAISS_FUNCTION_END
+}
+
+
+CAISS_RET_TYPE DiskAnnIndex::buildQuantizer(unsigned int m) {
+    CAISS_FUNCTION_BEGIN
+
+    auto size = getSize();
+    if (0 == size) {
+        return CAISS_RET_PARAM;
+    }
+
+    this->pq_ = ProductQuantizer(this->dim_, m);
+    ret = this->pq_.train(this->datas_.data(), size);
+    CAISS_FUNCTION_CHECK_STATUS
+
+    this->codes_.resize((size_t)size * this->pq_.getCodeSize());
+    this->pq_.encode(this->datas_.data(), size, this->codes_.data());
+
+    CAISS_FUNCTION_END
+}
+
+
+CAISS_RET_TYPE DiskAnnIndex::buildGraph(const std::vector<std::vector<unsigned>> &knnGraph, unsigned int buildPool,
+                                        unsigned int maxDegree, unsigned int maxCandidate) {
+    CAISS_FUNCTION_BEGIN
+
+    auto size = getSize();
+    if (size < 2 || knnGraph.size() != size) {
+        return CAISS_RET_PARAM;
+    }
+
+    efanna2e::Parameters params;
+    params.Set<unsigned>("L", std::min(buildPool, size));    // 候选集合不能超过点的总数
+    params.Set<unsigned>("R", maxDegree);
+    params.Set<unsigned>("C", maxCandidate);
+
+    CAISS_DELETE_PTR(this->index_)
+    this->index_ = new efanna2e::IndexNSG(this->dim_, size, getMetric(), nullptr);
+    std::vector<std::vector<unsigned>> graph(knnGraph);    // 多轮训练时，kNN图会被重复使用
+    this->index_->SetNnGraph(graph);
+    this->index_->Build(size, this->datas_.data(), params);
+
+    // 连通性修补之后，个别点的出度可能超过R，按照实际的最大出度决定节点长度
+    this->max_degree_ = 1;
+    for (const auto &neighbors : this->index_->GetGraph()) {
+        this->max_degree_ = std::max(this->max_degree_, (unsigned int)neighbors.size());
+    }
+    this->entry_ = this->index_->GetEntry();
+    this->node_size_ = this->dim_ * (unsigned int)sizeof(CAISS_FLOAT)
+                       + (1 + this->max_degree_) * (unsigned int)sizeof(unsigned int);
+
+    CAISS_FUNCTION_END
+}
+
+
+CAISS_RET_TYPE DiskAnnIndex::search(const CAISS_FLOAT *query, unsigned int topK, unsigned int searchPool,
+                                    unsigned int beamWidth, ALGO_RET_TYPE &result) const {
+    CAISS_FUNCTION_BEGIN
+    CAISS_ASSERT_NOT_NULL(query)
+
+    auto size = getSize();
+    topK = std::min(topK, size);
+    if (0 == topK || 0 == this->node_size_) {
+        return CAISS_RET_OK;
+    }
+
+    unsigned int pool = std::max((0 != searchPool) ? searchPool : this->search_pool_, topK);
+    unsigned int beam = std::max((0 != beamWidth) ? beamWidth : this->beam_width_, 1u);
+
+    // 跟hnsw和flat中的距离定义保持一致，内积距离为 1 - <q, x>
+    bool isInner = (CAISS_DISTANCE_INNER == this->distance_type_);
+    std::vector<CAISS_FLOAT> table(this->pq_.getTableSize());
+    if (isInner) {
+        this->pq_.computeDotTable(query, table.data());
+    } else {
+        this->pq_.computeL2Table(query, table.data());
+    }
+
+    unsigned int codeSize = this->pq_.getCodeSize();
+    auto calcPqDistance = [&](unsigned int id) -> CAISS_FLOAT {
+        CAISS_FLOAT val = this->pq_.lookup(table.data(), this->codes_.data() + (size_t)id * codeSize);
+        return isInner ? 1.0f - val : val;
+    };
+
+    std::vector<DiskAnnCandidate> candidates;    // 按照pq距离从小到大排列，最多保留pool个
+    candidates.reserve(pool + 1);
+    candidates.push_back({calcPqDistance(this->entry_), this->entry_, false});
+    std::unordered_set<unsigned int> visited;
+    visited.insert(this->entry_);
+
+    std::vector<std::pair<CAISS_FLOAT, unsigned int>> exacts;    // 已经读取的节点，以及真实距离
+    std::vector<unsigned int> beamIds;
+    std::vector<char> buffer;
+    while (true) {
+        beamIds.clear();
+        for (auto &cand : candidates) {
+            if (!cand.expanded) {
+                cand.expanded = true;
+                beamIds.push_back(cand.id);
+                if (beamIds.size() >= beam) {
+                    break;
+                }
+            }
+        }
+
+        if (beamIds.empty()) {
+            break;    // 候选集合中的点均已展开
+        }
+
+        ret = readNodes(beamIds.data(), (unsigned int)beamIds.size(), buffer);
+        CAISS_FUNCTION_CHECK_STATUS
+
+        for (unsigned int i = 0; i < beamIds.size(); i++) {
+            const char *node = buffer.data() + (size_t)i * this->node_size_;
+            exacts.emplace_back(calcDistance(query, (const CAISS_FLOAT *)node), beamIds[i]);
+
+            const auto *neighbors = (const unsigned int *)(node + this->dim_ * sizeof(CAISS_FLOAT));
+            unsigned int num = std::min(neighbors[0], this->max_degree_);
+            for (unsigned int j = 1; j <= num; j++) {
+                unsigned int id = neighbors[j];
+                if (id >= size || !visited.insert(id).second) {
+                    continue;
+                }
+
+                CAISS_FLOAT dist = calcPqDistance(id);
+                if (candidates.size() >= pool && dist >= candidates.back().distance) {
+                    continue;
+                }
+
+                auto pos = std::upper_bound(candidates.begin(), candidates.end(), dist,
+                                            [](CAISS_FLOAT val, const DiskAnnCandidate &cand) {
+                                                return val < cand.distance;
+                                            });
+                candidates.insert(pos, {dist, id, false});
+                if (candidates.size() > pool) {
+                    candidates.pop_back();
+                }
+            }
+        }
+    }
+
+    for (const auto &cur : exacts) {
+        result.emplace(cur);
+        if (result.size() > topK) {
+            result.pop();
+        }
+    }
+
+    CAISS_FUNCTION_END
+}
+
+
+CAISS_RET_TYPE DiskAnnIndex::forceLoop(const CAISS_FLOAT *query, unsigned int topK, ALGO_RET_TYPE &result) const {
+    CAISS_FUNCTION_BEGIN
+    CAISS_ASSERT_NOT_NULL(query)
+
+    if (0 == topK || 0 == this->node_size_) {
+        return CAISS_RET_OK;
+    }
+
+    auto size = getSize();
+    CAISS_FLOAT threshold = std::numeric_limits<CAISS_FLOAT>::max();
+    auto update = [&](const CAISS_FLOAT *node, unsigned int id) {
+        CAISS_FLOAT dist = calcDistance(query, node);
+        if (dist >= threshold) {
+            return;
+        }
+
+        result.emplace(dist, id);
+        if (result.size() > topK) {
+            result.pop();
+        }
+        if (result.size() >= topK) {
+            threshold = result.top().first;
+        }
+    };
+
+    if (!this->graph_opened_) {
+        for (unsigned int i = 0; i < size; i++) {
+            update(this->datas_.data() + (size_t)i * this->dim_, i);
+        }
+        return CAISS_RET_OK;
+    }
+
+    // 加载之后，按照块顺序读取磁盘上的节点
+    unsigned int blockNum = std::max((unsigned int)(DISKANN_COPY_BLOCK_SIZE / this->node_size_), 1u);
+    std::vector<char> buffer;
+    for (unsigned int begin = 0; begin < size; begin += blockNum) {
+        unsigned int end = std::min(begin + blockNum, size);
+        size_t first = getNodeOffset(begin);
+        size_t last = getNodeOffset(end - 1) + this->node_size_;
+        buffer.resize(last - first);
+        ret = readGraph(this->graph_offset_ + first, last - first, buffer.data());
+        CAISS_FUNCTION_CHECK_STATUS
+
+        for (unsigned int i = begin; i < end; i++) {
+            update((const CAISS_FLOAT *)(buffer.data() + getNodeOffset(i) - first), i);
+        }
+    }
+
+    CAISS_FUNCTION_END
+}
+
+
+CAISS_RET_TYPE DiskAnnIndex::save(const std::string &path, const std::list<std::string> &ignoreList) const {
+    CAISS_FUNCTION_BEGIN
+
+    if (0 == this->node_size_ || (nullptr == this->index_ && !this->graph_opened_)) {
+        return CAISS_RET_ERR;    // 还没有构图
+    }
+
+    std::ofstream output(path, std::ios::binary);
+    if (!output) {
+        return CAISS_RET_PATH;
+    }
+
+    writeDiskAnnPOD(output, DISKANN_MODEL_MAGIC);
+    writeDiskAnnPOD(output, DISKANN_MODEL_VERSION);
+    writeDiskAnnPOD(output, this->dim_);
+    writeDiskAnnPOD(output, (int)this->distance_type_);
+    writeDiskAnnPOD(output, (int)this->normalize_);
+    writeDiskAnnPOD(output, this->max_size_);
+    writeDiskAnnPOD(output, this->max_index_size_);
+    writeDiskAnnPOD(output, this->search_pool_);
+    writeDiskAnnPOD(output, this->beam_width_);
+    writeDiskAnnPOD(output, this->max_degree_);
+    writeDiskAnnPOD(output, this->entry_);
+    writeDiskAnnPOD(output, this->node_size_);
+
+    this->pq_.save(output);
+    auto size = getSize();
+    writeDiskAnnPOD(output, size);
+    output.write((const char *)this->codes_.data(), this->codes_.size() * sizeof(PQ_CODE_TYPE));
+    for (const auto &word : this->words_) {
+        writeDiskAnnString(output, word);
+    }
+
+    auto ignoreSize = (unsigned int)ignoreList.size();
+    writeDiskAnnPOD(output, ignoreSize);
+    for (const auto &word : ignoreList) {
+        writeDiskAnnString(output, word);
+    }
+
+    // 图信息放在文件尾部，起始位置按照扇区对齐，加载的时候不读入内存
+    auto graphOffset = (unsigned long long)MmapAlignSize((size_t)output.tellp() + sizeof(unsigned long long));
+    writeDiskAnnPOD(output, graphOffset);
+    std::vector<char> buffer((size_t)graphOffset - (size_t)output.tellp(), 0);
+    output.write(buffer.data(), buffer.size());
+
+    size_t graphLength = getGraphLength();
+    if (this->graph_opened_) {
+        // 已经加载的模型，直接拷贝磁盘上的图信息
+        for (size_t pos = 0; pos < graphLength; pos += DISKANN_COPY_BLOCK_SIZE) {
+            size_t len = std::min(DISKANN_COPY_BLOCK_SIZE, graphLength - pos);
+            buffer.resize(len);
+            ret = readGraph(this->graph_offset_ + pos, len, buffer.data());
+            CAISS_FUNCTION_CHECK_STATUS
+            output.write(buffer.data(), len);
+        }
+    } else {
+        unsigned int blockNum = std::max((unsigned int)(DISKANN_COPY_BLOCK_SIZE / this->node_size_), 1u);
+        for (unsigned int begin = 0; begin < size; begin += blockNum) {
+            unsigned int end = std::min(begin + blockNum, size);
+            size_t first = getNodeOffset(begin);
+            size_t last = (end < size) ? getNodeOffset(end) : graphLength;
+            buffer.assign(last - first, 0);
+            for (unsigned int i = begin; i < end; i++) {
+                fillNode(i, buffer.data() + getNodeOffset(i) - first);
+            }
+            output.write(buffer.data(), buffer.size());
+        }
+    }
+
+    if (!output) {
+        return CAISS_RET_ERR;
+    }
+
+    output.close();
+    CAISS_FUNCTION_END
+}
+
+
+CAISS_RET_TYPE DiskAnnIndex::load(const std::string &path, TrieProc *trie) {
+    CAISS_FUNCTION_BEGIN
+
+    std::ifstream input(path, std::ios::binary);
+    if (!input) {
+        return CAISS_RET_PATH;
+    }
+
+    int magic = 0, version = 0, distanceType = 0, normalize = 0;
+    readDiskAnnPOD(input, magic);
+    readDiskAnnPOD(input, version);
+    if (DISKANN_MODEL_MAGIC != magic || DISKANN_MODEL_VERSION < version) {
+        return CAISS_RET_PATH;    // 不是diskann算法生成的模型
+    }
+
+    readDiskAnnPOD(input, this->dim_);
+    readDiskAnnPOD(input, distanceType);
+    readDiskAnnPOD(input, normalize);
+    readDiskAnnPOD(input, this->max_size_);
+    readDiskAnnPOD(input, this->max_index_size_);
+    readDiskAnnPOD(input, this->search_pool_);
+    readDiskAnnPOD(input, this->beam_width_);
+    readDiskAnnPOD(input, this->max_degree_);
+    readDiskAnnPOD(input, this->entry_);
+    readDiskAnnPOD(input, this->node_size_);
+    this->distance_type_ = (CAISS_DISTANCE_TYPE)distanceType;
+    this->normalize_ = (CAISS_BOOL)normalize;
+
+    this->pq_.load(input);
+    unsigned int size = 0;
+    readDiskAnnPOD(input, size);
+    this->codes_.resize((size_t)size * this->pq_.getCodeSize());
+    input.read((char *)this->codes_.data(), this->codes_.size() * sizeof(PQ_CODE_TYPE));
+    this->words_.resize(size);
+    this->word_lookup_.clear();
+    for (unsigned int i = 0; i < size; i++) {
+        readDiskAnnString(input, this->words_[i]);
+        this->word_lookup_[this->words_[i]] = i;
+    }
+
+    unsigned int ignoreSize = 0;
+    readDiskAnnPOD(input, ignoreSize);
+    for (unsigned int i = 0; i < ignoreSize; i++) {
+        std::string word;
+        readDiskAnnString(input, word);
+        if (nullptr != trie) {
+            trie->insert(word);
+        }
+    }
+
+    readDiskAnnPOD(input, this->graph_offset_);
+    if (!input || (size > 0 && this->entry_ >= size)) {
+        return CAISS_RET_ERR;    // 模型文件不完整
+    }
+    input.close();
+
+    this->datas_.clear();
+    CAISS_DELETE_PTR(this->index_)
+    ret = openGraph(path);
+    CAISS_FUNCTION_CHECK_STATUS
+
+    CAISS_FUNCTION_END
+}
+
+
+void DiskAnnIndex::setSearchPool(unsigned int searchPool) {
+    this->search_pool_ = searchPool;
+}
+
+
+unsigned int DiskAnnIndex::getSearchPool() const {
+    return this->search_pool_;
+}
+
+
+void DiskAnnIndex::setBeamWidth(unsigned int beamWidth) {
+    this->beam_width_ = std::max(beamWidth, 1u);
+}
+
+
+unsigned int DiskAnnIndex::getBeamWidth() const {
+    return this->beam_width_;
+}
+
+
+int DiskAnnIndex::findWordId(const std::string &word) const {
+    auto cur = this->word_lookup_.find(word);
+    return (cur != this->word_lookup_.end()) ? (int)cur->second : ALGO_NO_WORD_ID;
+}
+
+
+const std::string &DiskAnnIndex::getWord(unsigned int id) const {
+    return this->words_[id];
+}
+
+
+CAISS_RET_TYPE DiskAnnIndex::getData(unsigned int id, std::vector<CAISS_FLOAT> &vec) const {
+    CAISS_FUNCTION_BEGIN
+
+    if (!this->graph_opened_) {
+        const CAISS_FLOAT *data = this->datas_.data() + (size_t)id * this->dim_;
+        vec.assign(data, data + this->dim_);
+        return CAISS_RET_OK;
+    }
+
+    std::vector<char> buffer;
+    ret = readNodes(&id, 1, buffer);
+    CAISS_FUNCTION_CHECK_STATUS
+
+    const auto *data = (const CAISS_FLOAT *)buffer.data();
+    vec.assign(data, data + this->dim_);
+    CAISS_FUNCTION_END
+}
+
+
+unsigned int DiskAnnIndex::getDim() const {
+    return this->dim_;
+}
+
+
+unsigned int DiskAnnIndex::getSize() const {
+    return (unsigned int)this->words_.size();
+}
+
+
+CAISS_BOOL DiskAnnIndex::getNormalize() const {
+    return this->normalize_;
+}
+
+
+CAISS_DISTANCE_TYPE DiskAnnIndex::getDistanceType() const {
+    return this->distance_type_;
+}
+
+
+CAISS_RET_TYPE DiskAnnIndex::readNodes(const unsigned int *ids, unsigned int num, std::vector<char> &buffer) const {
+    CAISS_FUNCTION_BEGIN
+    CAISS_ASSERT_NOT_NULL(ids)
+
+    buffer.resize((size_t)num * this->node_size_);
+    if (!this->graph_opened_) {
+        CAISS_ASSERT_NOT_NULL(this->index_)
+        for (unsigned int i = 0; i < num; i++) {
+            fillNode(ids[i], buffer.data() + (size_t)i * this->node_size_);
+        }
+        return CAISS_RET_OK;
+    }
+
+    // 一个beam中的节点在磁盘上并不连续，逐个发起读取。节点不会跨越扇区，每个节点最多读取一个扇区
+    for (unsigned int i = 0; i < num; i++) {
+        ret = readGraph(this->graph_offset_ + getNodeOffset(ids[i]), this->node_size_,
+                        buffer.data() + (size_t)i * this->node_size_);
+        CAISS_FUNCTION_CHECK_STATUS
+    }
+
+    CAISS_FUNCTION_END
+}
+
+
+CAISS_RET_TYPE DiskAnnIndex::readGraph(size_t offset, size_t length, char *buffer) const {
+    CAISS_FUNCTION_BEGIN
+    CAISS_ASSERT_NOT_NULL(buffer)
+
+#ifndef WIN32
+    while (length > 0) {
+        ssize_t cur = pread(this->graph_fd_, buffer, length, (off_t)offset);
+        if (cur <= 0) {
+            return CAISS_RET_ERR;    // 读取失败，或者文件被截断
+        }
+        buffer += cur;
+        offset += (size_t)cur;
+        length -= (size_t)cur;
+    }
+#else
+    std::lock_guard<std::mutex> lock(this->graph_lock_);
+    this->graph_input_.seekg((std::streamoff)offset);
+    this->graph_input_.read(buffer, length);
+    if (!this->graph_input_) {
+        this->graph_input_.clear();
+        return CAISS_RET_ERR;
+    }
+#endif
+
+    CAISS_FUNCTION_END
+}
+
+
+void DiskAnnIndex::fillNode(unsigned int id, char *buffer) const {
+    memset(buffer, 0, this->node_size_);
+    memcpy(buffer, this->datas_.data() + (size_t)id * this->dim_, this->dim_ * sizeof(CAISS_FLOAT));
+
+    const auto &neighbors = this->index_->GetGraph()[id];
+    auto num = (unsigned int)std::min((size_t)this->max_degree_, neighbors.size());
+    auto *dst = (unsigned int *)(buffer + this->dim_ * sizeof(CAISS_FLOAT));
+    dst[0] = num;
+    memcpy(dst + 1, neighbors.data(), num * sizeof(unsigned int));
+}
+
+
+size_t DiskAnnIndex::getNodeOffset(unsigned int id) const {
+    if (this->node_size_ <= DISKANN_SECTOR_SIZE) {
+        size_t nodesPerSector = DISKANN_SECTOR_SIZE / this->node_size_;
+        return (id / nodesPerSector) * DISKANN_SECTOR_SIZE + (id % nodesPerSector) * this->node_size_;
+    }
+
+    // 单个节点超过一个扇区的时候，每个节点独占若干个扇区
+    return (size_t)id * MmapAlignSize(this->node_size_);
+}
+
+
+size_t DiskAnnIndex::getGraphLength() const {
+    size_t size = getSize();
+    if (this->node_size_ <= DISKANN_SECTOR_SIZE) {
+        size_t nodesPerSector = DISKANN_SECTOR_SIZE / this->node_size_;
+        return (size + nodesPerSector - 1) / nodesPerSector * DISKANN_SECTOR_SIZE;
+    }
+
+    return size * MmapAlignSize(this->node_size_);
+}
+
+
+CAISS_RET_TYPE DiskAnnIndex::openGraph(const std::string &path) {
+    CAISS_FUNCTION_BEGIN
+
+    closeGraph();
+#ifndef WIN32
+    this->graph_fd_ = ::open(path.c_str(), O_RDONLY);
+    if (this->graph_fd_ < 0) {
+        return CAISS_RET_PATH;
+    }
+    #ifdef POSIX_FADV_RANDOM
+        posix_fadvise(this->graph_fd_, 0, 0, POSIX_FADV_RANDOM);    // 查询时随机读取，关闭预读
+    #endif
+#else
+    this->graph_input_.open(path, std::ios::binary);
+    if (!this->graph_input_) {
+        return CAISS_RET_PATH;
+    }
+#endif
+    this->graph_opened_ = true;
+
+    CAISS_FUNCTION_END
+}
+
+
+void DiskAnnIndex::closeGraph() {
+#ifndef WIN32
+    if (this->graph_fd_ >= 0) {
+        ::close(this->graph_fd_);
+        this->graph_fd_ = -1;
+    }
+#else
+    if (this->graph_input_.is_open()) {
+        this->graph_input_.close();
+    }
+#endif
+    this->graph_opened_ = false;
+}
+
+
+CAISS_FLOAT DiskAnnIndex::calcDistance(const CAISS_FLOAT *query, const CAISS_FLOAT *node) const {
+    // 跟hnsw和flat中的距离定义保持一致
+    return (CAISS_DISTANCE_INNER == this->distance_type_)
+           ? 1.0f - efanna2e::DotSIMD(query, node, this->dim_)
+           : efanna2e::L2SqrSIMD(query, node, this->dim_);
+}
+
+
+efanna2e::Metric DiskAnnIndex::getMetric() const {
+    return (CAISS_DISTANCE_INNER == this->distance_type_) ? efanna2e::INNER_PRODUCT : efanna2e::L2;
+}
@@ -0,0 +1,163 @@
+//
+// Created by Chunel on 2020/10/18.
+// 磁盘图索引（diskann）的模型信息。内存中只保存向量的pq编码，用于在图上导航；
+// 原始向量和邻居信息按照4K扇区对齐存放在模型文件中，查询时按照beam的方式批量pread读取，并按照真实距离排序
+//
+
+#ifndef CAISS_DISKANNINDEX_H
+#define CAISS_DISKANNINDEX_H
+
+#include <list>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <unordered_map>
+
+#include "../../common/CommonAlgoDefine.h"
+#include "../../common/ProductQuantizer.h"
+#include "../../../utilsCtrl/UtilsInclude.h"
+#include "../../nsg/nsgAlgo/efanna2e/index_nsg.h"
+
+const static int DISKANN_MODEL_MAGIC = 0x4B534944;    // 模型文件头部的标识（"DISK"）
+const static int DISKANN_MODEL_VERSION = 1;
+const static size_t DISKANN_SECTOR_SIZE = MMAP_PAGE_SIZE;    // 节点按照扇区对齐存放，单个节点不会跨越扇区
+const static size_t DISKANN_COPY_BLOCK_SIZE = 256 * DISKANN_SECTOR_SIZE;    // 顺序读取图信息时，每次读取的长度
+
+class DiskAnnIndex {
+
+public:
+    explicit DiskAnnIndex();
+    DiskAnnIndex(unsigned int dim, CAISS_DISTANCE_TYPE distanceType, unsigned int maxSize, unsigned int maxIndexSize,
+                 CAISS_BOOL normalize);
+    ~DiskAnnIndex();
+
+    /**
+     * 加入向量信息，仅在构图之前使用。词语已经存在的时候，覆盖之前的向量
+     * @param node 已经归一化的向量
+     * @param word
+     * @return
+     */
+    CAISS_RET_TYPE addPoint(const CAISS_FLOAT *node, const std::string &word);
+
+    /**
+     * 通过NN-Descent构建kNN图（不包含自身），作为构图的输入
+     * @param knn 每个点的邻居数
+     * @param graph
+     * @return
+     */
+    CAISS_RET_TYPE buildKnnGraph(unsigned int knn, std::vector<std::vector<unsigned>> &graph) const;
+
+    /**
+     * 训练pq码本，并对所有向量编码。编码常驻内存，用于查询时在图上导航
+     * @param m pq的段数，为0表示自动决定
+     * @return
+     */
+    CAISS_RET_TYPE buildQuantizer(unsigned int m);
+
+    /**
+     * 根据kNN图构建nsg图，并确定磁盘上每个节点的存放格式
+     * @param knnGraph
+     * @param buildPool 构图时的候选集合大小（L）
+     * @param maxDegree 最大出度（R）
+     * @param maxCandidate 裁边时最多考虑的候选点数（C）
+     * @return
+     */
+    CAISS_RET_TYPE buildGraph(const std::vector<std::vector<unsigned>> &knnGraph, unsigned int buildPool,
+                              unsigned int maxDegree, unsigned int maxCandidate);
+
+    /**
+     * beam查询。候选集合按照pq距离排序，每一轮读取其中最近的beamWidth个未展开节点，
+     * 返回结果中的距离是通过读取到的原始向量计算的真实距离
+     * @param query
+     * @param topK
+     * @param searchPool 候选集合大小，为0表示使用模型中保存的值
+     * @param beamWidth 每一轮读取的节点数，为0表示使用模型中保存的值
+     * @param result
+     * @return
+     */
+    CAISS_RET_TYPE search(const CAISS_FLOAT *query, unsigned int topK, unsigned int searchPool, unsigned int beamWidth,
+                          ALGO_RET_TYPE &result) const;
+    CAISS_RET_TYPE forceLoop(const CAISS_FLOAT *query, unsigned int topK, ALGO_RET_TYPE &result) const;
+
+    CAISS_RET_TYPE save(const std::string &path, const std::list<std::string> &ignoreList) const;
+
+    /**
+     * 加载模型。图信息保留在磁盘上，查询的时候按需读取
+     * @param path
+     * @param trie
+     * @return
+     */
+    CAISS_RET_TYPE load(const std::string &path, TrieProc *trie);
+
+    void setSearchPool(unsigned int searchPool);
+    unsigned int getSearchPool() const;
+    void setBeamWidth(unsigned int beamWidth);
+    unsigned int getBeamWidth() const;
+
+    int findWordId(const std::string &word) const;
+    const std::string &getWord(unsigned int id) const;
+    CAISS_RET_TYPE getData(unsigned int id, std::vector<CAISS_FLOAT> &vec) const;
+
+    unsigned int getDim() const;
+    unsigned int getSize() const;
+    CAISS_BOOL getNormalize() const;
+    CAISS_DISTANCE_TYPE getDistanceType() const;
+
+protected:
+    /**
+     * 批量读取节点信息。每个节点在buffer中占node_size_个字节，依次为向量、邻居个数和邻居id
+     * @param ids
+     * @param num
+     * @param buffer
+     * @return
+     */
+    CAISS_RET_TYPE readNodes(const unsigned int *ids, unsigned int num, std::vector<char> &buffer) const;
+    CAISS_RET_TYPE readGraph(size_t offset, size_t length, char *buffer) const;
+
+    /**
+     * 训练模式下，按照磁盘上的格式拼接节点信息
+     */
+    void fillNode(unsigned int id, char *buffer) const;
+
+    size_t getNodeOffset(unsigned int id) const;
+    size_t getGraphLength() const;
+    CAISS_RET_TYPE openGraph(const std::string &path);
+    void closeGraph();
+
+    inline CAISS_FLOAT calcDistance(const CAISS_FLOAT *query, const CAISS_FLOAT *node) const;
+    efanna2e::Metric getMetric() const;
+
+private:
+    unsigned int dim_;
+    CAISS_DISTANCE_TYPE distance_type_;
+    unsigned int max_size_;
+    unsigned int max_index_size_;    // 词语的最大长度
+    CAISS_BOOL normalize_;
+    unsigned int search_pool_;       // 查询时候选集合大小
+    unsigned int beam_width_;        // 查询时每一轮读取的节点数
+
+    unsigned int max_degree_;        // 图中的最大出度，决定每个节点在磁盘上的长度
+    unsigned int entry_;             // 查询的入口点
+    unsigned int node_size_;         // 每个节点的长度：向量 + 邻居个数 + max_degree_个邻居
+    unsigned long long graph_offset_;    // 图信息在模型文件中的起始位置（按照扇区对齐）
+
+    ProductQuantizer pq_;
+    std::vector<PQ_CODE_TYPE> codes_;    // 所有向量的pq编码，按照id连续存放
+    std::vector<std::string> words_;
+    std::unordered_map<std::string, unsigned int> word_lookup_;
+
+    std::vector<CAISS_FLOAT> datas_;    // 训练时的原始向量。加载模型的时候不保存，从磁盘中读取
+    efanna2e::IndexNSG *index_;         // 训练时构建的图
+
+#ifndef WIN32
+    int graph_fd_;                      // 加载之后，通过pread读取图信息
+#else
+    mutable std::ifstream graph_input_;
+    mutable std::mutex graph_lock_;     // 不支持pread的平台上，读取时需要加锁
+#endif
+    bool graph_opened_;
+};
+
+
+#endif //CAISS_DISKANNINDEX_H
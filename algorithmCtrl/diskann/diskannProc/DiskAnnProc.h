@@ -0,0 +1,65 @@
+//
+// Created by Chunel on 2020/10/18.
+// diskann算法的封装层。内存中只保存pq编码和词语，图信息和原始向量放在磁盘上，适合数据量远超内存容量的场景
+//
+
+#ifndef CAISS_DISKANNPROC_H
+#define CAISS_DISKANNPROC_H
+
+#include "../../common/CommonAlgoProc.h"
+#include "../diskannAlgo/DiskAnnIndex.h"
+#include "DiskAnnProcDefine.h"
+
+class DiskAnnProc : public CommonAlgoProc {
+
+public:
+    explicit DiskAnnProc();
+    ~DiskAnnProc() override;
+
+    CAISS_RET_TYPE init(CAISS_MODE mode, CAISS_DISTANCE_TYPE distanceType,
+                        unsigned int dim, const char *modelPath, CAISS_DIST_FUNC distFunc) override;
+
+    // train_mode
+    CAISS_RET_TYPE train(const char *dataPath, unsigned int maxDataSize, CAISS_BOOL normalize,
+                         unsigned int maxIndexSize, float precision, unsigned int fastRank,
+                         unsigned int realRank, unsigned int step, unsigned int maxEpoch,
+                         unsigned int showSpan) override;
+
+    // process_mode
+    CAISS_RET_TYPE insert(CAISS_FLOAT *node, const char *index, CAISS_INSERT_TYPE insertType) override;
+    CAISS_RET_TYPE save(const char *modelPath) override;
+
+    CAISS_RET_TYPE setParam(CAISS_PARAM_TYPE paramType, const void *value) override;
+
+protected:
+    CAISS_RET_TYPE reset();
+    CAISS_RET_TYPE loadModel();
+    CAISS_RET_TYPE trainModel(const std::vector<std::vector<unsigned>> &knnGraph, const DiskAnnTrainParams &params);
+    CAISS_RET_TYPE checkModelPrecisionEnable(float targetPrecision, unsigned int fastRank, unsigned int realRank,
+                                             const std::vector<CaissDataNode> &datas, float &calcPrecision);
+
+    CAISS_RET_TYPE searchVector(const CAISS_FLOAT *query, unsigned int topK, CAISS_SEARCH_TYPE searchType,
+                                ALGO_RET_TYPE &result) override;
+    int findWordId(const std::string &word) override;
+    CAISS_RET_TYPE getWordById(unsigned int id, std::string &word) override;
+    CAISS_RET_TYPE getVectorById(unsigned int id, std::vector<CAISS_FLOAT> &vec) override;
+    void getCacheScope(std::string &scope) override;
+
+private:
+    static CAISS_RET_TYPE createDiskAnnSingleton(unsigned int dim, CAISS_DISTANCE_TYPE distanceType, unsigned int maxDataSize,
+                                                 unsigned int maxIndexSize, CAISS_BOOL normalize);
+    static CAISS_RET_TYPE createDiskAnnSingleton(const std::string &modelPath);
+    static CAISS_RET_TYPE destroyDiskAnnSingleton();
+    static DiskAnnIndex* getDiskAnnSingleton();
+
+    static DiskAnnIndex*                     disk_ann_index_ptr_;
+    static RWLock                            disk_ann_index_lock_;
+
+private:
+    unsigned int                             pq_m_;          // 训练时pq的段数，为0表示自动决定（通过setParam设定，init时不清空）
+    unsigned int                             search_pool_;   // 查询时候选集合大小，为0表示使用模型中的值（通过setParam设定，init时不清空）
+    unsigned int                             beam_width_;    // 查询时每一轮读取的节点数，为0表示使用模型中的值（通过setParam设定，init时不清空）
+};
+
+
+#endif //CAISS_DISKANNPROC_H
@@ -0,0 +1,45 @@
+//
+// Created by Chunel on 2020/10/18.
+//
+
+#ifndef CAISS_DISKANNPROCDEFINE_H
+#define CAISS_DISKANNPROCDEFINE_H
+
+const static unsigned int DISKANN_KNN_DEFAULT = 64;              // kNN图中每个点的邻居数
+const static unsigned int DISKANN_BUILD_POOL_DEFAULT = 60;       // 构图时的候选集合大小（L）
+const static unsigned int DISKANN_MAX_DEGREE_DEFAULT = 48;       // 最大出度（R）。每次读取都会拿到全部邻居，出度比nsg略大
+const static unsigned int DISKANN_MAX_CANDIDATE_DEFAULT = 500;   // 裁边时最多考虑的候选点数（C）
+const static unsigned int DISKANN_SEARCH_POOL_DEFAULT = 100;     // 查询时候选集合大小
+const static unsigned int DISKANN_BEAM_WIDTH_DEFAULT = 4;        // 查询时每一轮读取的节点数
+const static unsigned int DISKANN_CHECK_TIMES_MAX = 2000;        // 检查准确率时，最多的比较次数
+
+struct DiskAnnTrainParams {
+    explicit DiskAnnTrainParams(unsigned int m, unsigned int step) {
+        this->knn = DISKANN_KNN_DEFAULT;
+        this->buildPool = DISKANN_BUILD_POOL_DEFAULT;
+        this->maxDegree = DISKANN_MAX_DEGREE_DEFAULT;
+        this->maxCandidate = DISKANN_MAX_CANDIDATE_DEFAULT;
+        this->searchPool = DISKANN_SEARCH_POOL_DEFAULT;
+        this->beamWidth = DISKANN_BEAM_WIDTH_DEFAULT;
+        this->m = m;
+        this->step = step;
+    }
+
+    void update(float span) {
+        // 传入的是精确度的差距。kNN图和pq码本不需要重新构建，只调整构图和查询的参数
+        this->buildPool += (unsigned int)(10.0f + (float)this->buildPool * (1.0f + span * 10.0f) * (float)step / 10.0f);
+        this->maxDegree += (unsigned int)(8.0f + (float)this->maxDegree * (1.0f + span * 10.0f) * (float)step / 10.0f);
+        this->searchPool += (unsigned int)(20.0f + (float)this->searchPool * (1.0f + span * 5.0f) * (float)step / 5.0f);
+    }
+
+    unsigned int knn;               // kNN图中每个点的邻居数
+    unsigned int buildPool;         // 构图时的候选集合大小
+    unsigned int maxDegree;         // 最大出度
+    unsigned int maxCandidate;      // 裁边时最多考虑的候选点数
+    unsigned int searchPool;        // 查询时候选集合大小
+    unsigned int beamWidth;         // 查询时每一轮读取的节点数
+    unsigned int m;                 // pq的段数，为0表示自动决定
+    unsigned int step;              // 数据更新快慢的决定因素
+};
+
+#endif //CAISS_DISKANNPROCDEFINE_H
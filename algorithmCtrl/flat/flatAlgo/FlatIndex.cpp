@@ -0,0 +1,313 @@
+//
+// Created by Chunel on 2020/9/13.
+//
+
+#include <fstream>
+#include <algorithm>
+#include <limits>
+
+#include "FlatIndex.h"
+#include "FlatKernel.h"
+
+using namespace std;
+
+template<typename T>
+static void writeFlatPOD(std::ostream &out, const T &podRef) {
+    out.write((char *) &podRef, sizeof(T));
+}
+
+template<typename T>
+static void readFlatPOD(std::istream &in, T &podRef) {
+    in.read((char *) &podRef, sizeof(T));
+}
+
+static void writeFlatString(std::ostream &out, const std::string &str) {
+    auto len = (unsigned int)str.size();
+    writeFlatPOD(out, len);
+    out.write(str.data(), len);
+}
+
+static void readFlatString(std::istream &in, std::string &str) {
+    unsigned int len = 0;
+    readFlatPOD(in, len);
+    str.resize(len);
+    in.read(&str[0], len);
+}
+
+
+FlatIndex::FlatIndex() {
+    this->dim_ = 0;
+    this->distance_type_ = CAISS_DISTANCE_DEFAULT;
+    this->max_size_ = 0;
+    this->max_index_size_ = 0;
+    this->normalize_ = CAISS_FALSE;
+    this->dist_func_ = nullptr;
+}
+
+
+FlatIndex::FlatIndex(unsigned int dim, CAISS_DISTANCE_TYPE distanceType, unsigned int maxSize,
+                     unsigned int maxIndexSize, CAISS_BOOL normalize) {
+    this->dim_ = dim;
+    this->distance_type_ = distanceType;
+    this->max_size_ = maxSize;
+    this->max_index_size_ = maxIndexSize;
+    this->normalize_ = normalize;
+    this->dist_func_ = nullptr;
+}
+
+
+CAISS_RET_TYPE FlatIndex::addPoint(const CAISS_FLOAT *node, const std::string &word, bool overwrite) {
+    CAISS_FUNCTION_BEGIN
+    CAISS_ASSERT_NOT_NULL(node)
+
+    if (word.empty() || word.size() > this->max_index_size_) {
+        return CAISS_RET_WORD_SIZE;
+    }
+
+    CAISS_FLOAT norm = FlatDot(node, node, this->dim_);
+    auto cur = this->word_lookup_.find(word);
+    if (cur != this->word_lookup_.end()) {
+        if (overwrite) {
+            std::copy(node, node + this->dim_, this->datas_.begin() + (size_t)cur->second * this->dim_);
+            this->norms_[cur->second] = norm;
+        }
+        return CAISS_RET_OK;
+    }
+
+    if (this->words_.size() >= this->max_size_) {
+        return CAISS_RET_MODEL_SIZE;
+    }
+
+    this->word_lookup_[word] = (unsigned int)this->words_.size();
+    this->words_.push_back(word);
+    this->datas_.insert(this->datas_.end(), node, node + this->dim_);
+    this->norms_.push_back(norm);
+
+    CAISS_FUNCTION_END
+}
+
+
+CAISS_RET_TYPE FlatIndex::search(const CAISS_FLOAT *queries, unsigned int queryNum, unsigned int topK,
+                                 std::vector<ALGO_RET_TYPE> &results) const {
+    CAISS_FUNCTION_BEGIN
+    CAISS_ASSERT_NOT_NULL(queries)
+
+    results.assign(queryNum, ALGO_RET_TYPE());
+    if (0 == topK) {
+        return CAISS_RET_OK;
+    }
+
+    auto size = (unsigned int)this->words_.size();
+    std::vector<CAISS_FLOAT> dists((size_t)FLAT_QUERY_BLOCK * FLAT_BASE_BLOCK);
+    std::vector<CAISS_FLOAT> queryNorms(FLAT_QUERY_BLOCK);
+    // 每个query的结果，用vector维护大顶堆。堆满之后，只有小于堆顶的距离，才需要入堆
+    std::vector<std::vector<std::pair<CAISS_FLOAT, unsigned int>>> heaps(FLAT_QUERY_BLOCK);
+    std::vector<CAISS_FLOAT> thresholds(FLAT_QUERY_BLOCK);
+
+    for (unsigned int qBegin = 0; qBegin < queryNum; qBegin += FLAT_QUERY_BLOCK) {
+        unsigned int qNum = std::min(FLAT_QUERY_BLOCK, queryNum - qBegin);
+        const CAISS_FLOAT *curQueries = queries + (size_t)qBegin * this->dim_;
+        for (unsigned int i = 0; i < qNum; i++) {
+            queryNorms[i] = FlatDot(curQueries + (size_t)i * this->dim_, curQueries + (size_t)i * this->dim_, this->dim_);
+            heaps[i].clear();
+            thresholds[i] = std::numeric_limits<CAISS_FLOAT>::max();
+        }
+
+        for (unsigned int bBegin = 0; bBegin < size; bBegin += FLAT_BASE_BLOCK) {
+            unsigned int bNum = std::min(FLAT_BASE_BLOCK, size - bBegin);
+            if (CAISS_DISTANCE_EDITION == this->distance_type_) {
+                searchCustomBlock(curQueries, qNum, bBegin, bNum, dists.data());
+            } else {
+                FlatDotTile(curQueries, qNum, this->datas_.data() + (size_t)bBegin * this->dim_, bNum,
+                            this->dim_, dists.data(), FLAT_BASE_BLOCK);
+            }
+
+            for (unsigned int i = 0; i < qNum; i++) {
+                const CAISS_FLOAT *cur = dists.data() + (size_t)i * FLAT_BASE_BLOCK;
+                auto &heap = heaps[i];
+                for (unsigned int j = 0; j < bNum; j++) {
+                    CAISS_FLOAT dist = (CAISS_DISTANCE_EDITION == this->distance_type_)
+                            ? cur[j] : calcDistance(cur[j], queryNorms[i], this->norms_[bBegin + j]);
+                    if (dist >= thresholds[i]) {
+                        continue;
+                    }
+
+                    heap.emplace_back(dist, bBegin + j);
+                    std::push_heap(heap.begin(), heap.end());
+                    if (heap.size() > topK) {
+                        std::pop_heap(heap.begin(), heap.end());
+                        heap.pop_back();
+                    }
+                    if (heap.size() >= topK) {
+                        thresholds[i] = heap.front().first;
+                    }
+                }
+            }
+        }
+
+        for (unsigned int i = 0; i < qNum; i++) {
+            results[qBegin + i] = ALGO_RET_TYPE(std::less<std::pair<CAISS_FLOAT, unsigned int>>(), std::move(heaps[i]));
+            heaps[i] = std::vector<std::pair<CAISS_FLOAT, unsigned int>>();
+        }
+    }
+
+    CAISS_FUNCTION_END
+}
+
+
+CAISS_RET_TYPE FlatIndex::save(const std::string &path, const std::list<std::string> &ignoreList) const {
+    CAISS_FUNCTION_BEGIN
+
+    std::ofstream output(path, std::ios::binary);
+    if (!output) {
+        return CAISS_RET_PATH;
+    }
+
+    writeFlatPOD(output, FLAT_MODEL_MAGIC);
+    writeFlatPOD(output, FLAT_MODEL_VERSION);
+    writeFlatPOD(output, this->dim_);
+    writeFlatPOD(output, (int)this->distance_type_);
+    writeFlatPOD(output, (int)this->normalize_);
+    writeFlatPOD(output, this->max_size_);
+    writeFlatPOD(output, this->max_index_size_);
+
+    auto size = (unsigned int)this->words_.size();
+    writeFlatPOD(output, size);
+    for (const auto &word : this->words_) {
+        writeFlatString(output, word);
+    }
+    output.write((const char *)this->datas_.data(), this->datas_.size() * sizeof(CAISS_FLOAT));
+
+    auto ignoreSize = (unsigned int)ignoreList.size();
+    writeFlatPOD(output, ignoreSize);
+    for (const auto &word : ignoreList) {
+        writeFlatString(output, word);
+    }
+
+    output.close();
+    CAISS_FUNCTION_END
+}
+
+
+CAISS_RET_TYPE FlatIndex::load(const std::string &path, TrieProc *trie) {
+    CAISS_FUNCTION_BEGIN
+
+    std::ifstream input(path, std::ios::binary);
+    if (!input) {
+        return CAISS_RET_PATH;
+    }
+
+    int magic = 0, version = 0, distanceType = 0, normalize = 0;
+    readFlatPOD(input, magic);
+    readFlatPOD(input, version);
+    if (FLAT_MODEL_MAGIC != magic || FLAT_MODEL_VERSION < version) {
+        return CAISS_RET_PATH;    // 不是flat算法生成的模型
+    }
+
+    readFlatPOD(input, this->dim_);
+    readFlatPOD(input, distanceType);
+    readFlatPOD(input, normalize);
+    readFlatPOD(input, this->max_size_);
+    readFlatPOD(input, this->max_index_size_);
+    this->distance_type_ = (CAISS_DISTANCE_TYPE)distanceType;
+    this->normalize_ = (CAISS_BOOL)normalize;
+
+    unsigned int size = 0;
+    readFlatPOD(input, size);
+    this->words_.resize(size);
+    this->word_lookup_.clear();
+    for (unsigned int i = 0; i < size; i++) {
+        readFlatString(input, this->words_[i]);
+        this->word_lookup_[this->words_[i]] = i;
+    }
+
+    this->datas_.resize((size_t)size * this->dim_);
+    input.read((char *)this->datas_.data(), this->datas_.size() * sizeof(CAISS_FLOAT));
+    this->norms_.resize(size);
+    for (unsigned int i = 0; i < size; i++) {
+        this->norms_[i] = FlatDot(getData(i), getData(i), this->dim_);
+    }
+
+    unsigned int ignoreSize = 0;
+    readFlatPOD(input, ignoreSize);
+    for (unsigned int i = 0; i < ignoreSize && nullptr != trie; i++) {
+        std::string word;
+        readFlatString(input, word);
+        trie->insert(word);
+    }
+
+    if (!input) {
+        return CAISS_RET_ERR;    // 模型文件不完整
+    }
+
+    input.close();
+    CAISS_FUNCTION_END
+}
+
+
+void FlatIndex::setDistFunc(CAISS_DIST_FUNC distFunc) {
+    this->dist_func_ = distFunc;
+}
+
+
+int FlatIndex::findWordId(const std::string &word) const {
+    auto cur = this->word_lookup_.find(word);
+    return (cur != this->word_lookup_.end()) ? (int)cur->second : ALGO_NO_WORD_ID;
+}
+
+
+const std::string &FlatIndex::getWord(unsigned int id) const {
+    return this->words_[id];
+}
+
+
+const CAISS_FLOAT *FlatIndex::getData(unsigned int id) const {
+    return this->datas_.data() + (size_t)id * this->dim_;
+}
+
+
+unsigned int FlatIndex::getDim() const {
+    return this->dim_;
+}
+
+
+unsigned int FlatIndex::getSize() const {
+    return (unsigned int)this->words_.size();
+}
+
+
+unsigned int FlatIndex::getMaxSize() const {
+    return this->max_size_;
+}
+
+
+CAISS_BOOL FlatIndex::getNormalize() const {
+    return this->normalize_;
+}
+
+
+CAISS_DISTANCE_TYPE FlatIndex::getDistanceType() const {
+    return this->distance_type_;
+}
+
+
+CAISS_FLOAT FlatIndex::calcDistance(CAISS_FLOAT dot, CAISS_FLOAT queryNorm, CAISS_FLOAT baseNorm) const {
+    if (CAISS_DISTANCE_INNER == this->distance_type_) {
+        return 1.0f - dot;    // 跟hnsw中内积距离的定义保持一致
+    }
+
+    CAISS_FLOAT dist = queryNorm + baseNorm - 2.0f * dot;    // |q-x|^2 = |q|^2 + |x|^2 - 2<q,x>
+    return std::max(dist, 0.0f);
+}
+
+
+void FlatIndex::searchCustomBlock(const CAISS_FLOAT *queries, unsigned int queryNum, unsigned int baseBegin,
+                                  unsigned int baseNum, CAISS_FLOAT *dists) const {
+    size_t dim = this->dim_;
+    for (unsigned int i = 0; i < queryNum; i++) {
+        for (unsigned int j = 0; j < baseNum; j++) {
+            dists[(size_t)i * FLAT_BASE_BLOCK + j] = this->dist_func_((CAISS_VOID *)(queries + i * dim),
+                                                                            (CAISS_VOID *)getData(baseBegin + j), &dim);
+        }
+    }
+}
@@ -0,0 +1,93 @@
+//
+// Created by Chunel on 2020/9/13.
+// 精确查询的模型信息。所有向量连续存放，查询的时候，按照 query块 x 底库块 的方式计算距离，
+// 每个query维护自己的topK结果
+//
+
+#ifndef CAISS_FLATINDEX_H
+#define CAISS_FLATINDEX_H
+
+#include <list>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include "../../common/CommonAlgoDefine.h"
+#include "../../../utilsCtrl/UtilsInclude.h"
+
+const static int FLAT_MODEL_MAGIC = 0x54414C46;    // 模型文件头部的标识（"FLAT"）
+const static int FLAT_MODEL_VERSION = 1;
+const static unsigned int FLAT_QUERY_BLOCK = 32;     // 每次一起计算的query数量
+const static unsigned int FLAT_BASE_BLOCK = 512;     // 每次一起计算的底库向量数量（按照缓存大小设定）
+
+class FlatIndex {
+
+public:
+    explicit FlatIndex();
+    FlatIndex(unsigned int dim, CAISS_DISTANCE_TYPE distanceType, unsigned int maxSize, unsigned int maxIndexSize,
+              CAISS_BOOL normalize);
+
+    /**
+     * 加入向量信息
+     * @param node 已经归一化的向量
+     * @param word
+     * @param overwrite 词语已经存在的时候，是否覆盖
+     * @return
+     */
+    CAISS_RET_TYPE addPoint(const CAISS_FLOAT *node, const std::string &word, bool overwrite);
+
+    /**
+     * 批量查询。每个query的结果，放在results中对应的位置
+     * @param queries 连续存放的query向量
+     * @param queryNum
+     * @param topK
+     * @param results
+     * @return
+     */
+    CAISS_RET_TYPE search(const CAISS_FLOAT *queries, unsigned int queryNum, unsigned int topK,
+                          std::vector<ALGO_RET_TYPE> &results) const;
+
+    CAISS_RET_TYPE save(const std::string &path, const std::list<std::string> &ignoreList) const;
+    CAISS_RET_TYPE load(const std::string &path, TrieProc *trie);
+
+    /**
+     * 设定自定义距离函数（自定义距离不会被保存在模型中，加载之后需要重新设定）
+     * @param distFunc
+     */
+    void setDistFunc(CAISS_DIST_FUNC distFunc);
+
+    int findWordId(const std::string &word) const;
+    const std::string &getWord(unsigned int id) const;
+    const CAISS_FLOAT *getData(unsigned int id) const;
+
+    unsigned int getDim() const;
+    unsigned int getSize() const;
+    unsigned int getMaxSize() const;
+    CAISS_BOOL getNormalize() const;
+    CAISS_DISTANCE_TYPE getDistanceType() const;
+
+protected:
+    /**
+     * 将内积信息，转换成对应的距离
+     */
+    inline CAISS_FLOAT calcDistance(CAISS_FLOAT dot, CAISS_FLOAT queryNorm, CAISS_FLOAT baseNorm) const;
+
+    void searchCustomBlock(const CAISS_FLOAT *queries, unsigned int queryNum, unsigned int baseBegin, unsigned int baseNum,
+                           CAISS_FLOAT *dists) const;
+
+private:
+    unsigned int dim_;
+    CAISS_DISTANCE_TYPE distance_type_;
+    unsigned int max_size_;
+    unsigned int max_index_size_;    // 词语的最大长度
+    CAISS_BOOL normalize_;
+    CAISS_DIST_FUNC dist_func_;
+
+    std::vector<CAISS_FLOAT> datas_;    // 所有向量，按照id连续存放
+    std::vector<CAISS_FLOAT> norms_;    // 每个向量模长的平方（欧氏距离使用）
+    std::vector<std::string> words_;
+    std::unordered_map<std::string, unsigned int> word_lookup_;
+};
+
+
+#endif //CAISS_FLATINDEX_H
@@ -0,0 +1,221 @@
+//
+// Created by Chunel on 2020/9/13.
+// 暴力查询使用的内积计算核。按照 2个query x 4个底库向量 的方式分块，
+// 8个累加器常驻寄存器，每次读取的query和底库数据都会被复用多次，减少访存
+//
+
+#ifndef CAISS_FLATKERNEL_H
+#define CAISS_FLATKERNEL_H
+
+#include <stddef.h>
+
+#if defined(__AVX__)
+    #include <immintrin.h>
+    #define FLAT_USE_AVX
+#elif defined(__SSE__)
+    #include <xmmintrin.h>
+    #define FLAT_USE_SSE
+#endif
+
+const static size_t FLAT_QUERY_TILE = 2;    // 每次计算的query数量
+const static size_t FLAT_BASE_TILE = 4;     // 每次计算的底库向量数量
+
+#if defined(FLAT_USE_AVX) || defined(FLAT_USE_SSE)
+/**
+ * 将4个累加器，各自横向求和之后，拼成一个向量：{sum(a), sum(b), sum(c), sum(d)}
+ */
+static inline __m128 FlatReduce4(__m128 a, __m128 b, __m128 c, __m128 d) {
+    _MM_TRANSPOSE4_PS(a, b, c, d);
+    return _mm_add_ps(_mm_add_ps(a, b), _mm_add_ps(c, d));
+}
+#endif
+
+#ifdef FLAT_USE_AVX
+static inline __m128 FlatFold(__m256 v) {
+    return _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+}
+#endif
+
+
+/**
+ * 计算单个内积
+ * @param a
+ * @param b
+ * @param dim
+ * @return
+ */
+static inline float FlatDot(const float *a, const float *b, size_t dim) {
+    size_t i = 0;
+    float res = 0.0f;
+#if defined(FLAT_USE_AVX)
+    __m256 acc = _mm256_setzero_ps();
+    for (; i + 8 <= dim; i += 8) {
+        acc = _mm256_add_ps(acc, _mm256_mul_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)));
+    }
+    float tmp[4];
+    _mm_storeu_ps(tmp, FlatFold(acc));
+    res = tmp[0] + tmp[1] + tmp[2] + tmp[3];
+#elif defined(FLAT_USE_SSE)
+    __m128 acc = _mm_setzero_ps();
+    for (; i + 4 <= dim; i += 4) {
+        acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+    }
+    float tmp[4];
+    _mm_storeu_ps(tmp, acc);
+    res = tmp[0] + tmp[1] + tmp[2] + tmp[3];
+#endif
+    for (; i < dim; i++) {
+        res += a[i] * b[i];
+    }
+    return res;
+}
+
+
+/**
+ * 计算1个query和4个底库向量的内积，结果写入out[0..3]
+ */
+static inline void FlatDot1x4(const float *q, const float *b0, const float *b1, const float *b2, const float *b3,
+                              size_t dim, float *out) {
+    size_t i = 0;
+#if defined(FLAT_USE_AVX)
+    __m256 a0 = _mm256_setzero_ps(), a1 = _mm256_setzero_ps(), a2 = _mm256_setzero_ps(), a3 = _mm256_setzero_ps();
+    for (; i + 8 <= dim; i += 8) {
+        __m256 v = _mm256_loadu_ps(q + i);
+        a0 = _mm256_add_ps(a0, _mm256_mul_ps(v, _mm256_loadu_ps(b0 + i)));
+        a1 = _mm256_add_ps(a1, _mm256_mul_ps(v, _mm256_loadu_ps(b1 + i)));
+        a2 = _mm256_add_ps(a2, _mm256_mul_ps(v, _mm256_loadu_ps(b2 + i)));
+        a3 = _mm256_add_ps(a3, _mm256_mul_ps(v, _mm256_loadu_ps(b3 + i)));
+    }
+    _mm_storeu_ps(out, FlatReduce4(FlatFold(a0), FlatFold(a1), FlatFold(a2), FlatFold(a3)));
+#elif defined(FLAT_USE_SSE)
+    __m128 a0 = _mm_setzero_ps(), a1 = _mm_setzero_ps(), a2 = _mm_setzero_ps(), a3 = _mm_setzero_ps();
+    for (; i + 4 <= dim; i += 4) {
+        __m128 v = _mm_loadu_ps(q + i);
+        a0 = _mm_add_ps(a0, _mm_mul_ps(v, _mm_loadu_ps(b0 + i)));
+        a1 = _mm_add_ps(a1, _mm_mul_ps(v, _mm_loadu_ps(b1 + i)));
+        a2 = _mm_add_ps(a2, _mm_mul_ps(v, _mm_loadu_ps(b2 + i)));
+        a3 = _mm_add_ps(a3, _mm_mul_ps(v, _mm_loadu_ps(b3 + i)));
+    }
+    _mm_storeu_ps(out, FlatReduce4(a0, a1, a2, a3));
+#else
+    out[0] = out[1] = out[2] = out[3] = 0.0f;
+#endif
+    for (; i < dim; i++) {
+        out[0] += q[i] * b0[i];
+        out[1] += q[i] * b1[i];
+        out[2] += q[i] * b2[i];
+        out[3] += q[i] * b3[i];
+    }
+}
+
+
+/**
+ * 计算2个query和4个底库向量的内积，结果写入out0[0..3]和out1[0..3]
+ */
+static inline void FlatDot2x4(const float *q0, const float *q1,
+                              const float *b0, const float *b1, const float *b2, const float *b3,
+                              size_t dim, float *out0, float *out1) {
+    size_t i = 0;
+#if defined(FLAT_USE_AVX)
+    __m256 a00 = _mm256_setzero_ps(), a01 = _mm256_setzero_ps(), a02 = _mm256_setzero_ps(), a03 = _mm256_setzero_ps();
+    __m256 a10 = _mm256_setzero_ps(), a11 = _mm256_setzero_ps(), a12 = _mm256_setzero_ps(), a13 = _mm256_setzero_ps();
+    for (; i + 8 <= dim; i += 8) {
+        __m256 v0 = _mm256_loadu_ps(q0 + i);
+        __m256 v1 = _mm256_loadu_ps(q1 + i);
+        __m256 b = _mm256_loadu_ps(b0 + i);
+        a00 = _mm256_add_ps(a00, _mm256_mul_ps(v0, b));
+        a10 = _mm256_add_ps(a10, _mm256_mul_ps(v1, b));
+        b = _mm256_loadu_ps(b1 + i);
+        a01 = _mm256_add_ps(a01, _mm256_mul_ps(v0, b));
+        a11 = _mm256_add_ps(a11, _mm256_mul_ps(v1, b));
+        b = _mm256_loadu_ps(b2 + i);
+        a02 = _mm256_add_ps(a02, _mm256_mul_ps(v0, b));
+        a12 = _mm256_add_ps(a12, _mm256_mul_ps(v1, b));
+        b = _mm256_loadu_ps(b3 + i);
+        a03 = _mm256_add_ps(a03, _mm256_mul_ps(v0, b));
+        a13 = _mm256_add_ps(a13, _mm256_mul_ps(v1, b));
+    }
+    _mm_storeu_ps(out0, FlatReduce4(FlatFold(a00), FlatFold(a01), FlatFold(a02), FlatFold(a03)));
+    _mm_storeu_ps(out1, FlatReduce4(FlatFold(a10), FlatFold(a11), FlatFold(a12), FlatFold(a13)));
+#elif defined(FLAT_USE_SSE)
+    __m128 a00 = _mm_setzero_ps(), a01 = _mm_setzero_ps(), a02 = _mm_setzero_ps(), a03 = _mm_setzero_ps();
+    __m128 a10 = _mm_setzero_ps(), a11 = _mm_setzero_ps(), a12 = _mm_setzero_ps(), a13 = _mm_setzero_ps();
+    for (; i + 4 <= dim; i += 4) {
+        __m128 v0 = _mm_loadu_ps(q0 + i);
+        __m128 v1 = _mm_loadu_ps(q1 + i);
+        __m128 b = _mm_loadu_ps(b0 + i);
+        a00 = _mm_add_ps(a00, _mm_mul_ps(v0, b));
+        a10 = _mm_add_ps(a10, _mm_mul_ps(v1, b));
+        b = _mm_loadu_ps(b1 + i);
+        a01 = _mm_add_ps(a01, _mm_mul_ps(v0, b));
+        a11 = _mm_add_ps(a11, _mm_mul_ps(v1, b));
+        b = _mm_loadu_ps(b2 + i);
+        a02 = _mm_add_ps(a02, _mm_mul_ps(v0, b));
+        a12 = _mm_add_ps(a12, _mm_mul_ps(v1, b));
+        b = _mm_loadu_ps(b3 + i);
+        a03 = _mm_add_ps(a03, _mm_mul_ps(v0, b));
+        a13 = _mm_add_ps(a13, _mm_mul_ps(v1, b));
+    }
+    _mm_storeu_ps(out0, FlatReduce4(a00, a01, a02, a03));
+    _mm_storeu_ps(out1, FlatReduce4(a10, a11, a12, a13));
+#else
+    out0[0] = out0[1] = out0[2] = out0[3] = 0.0f;
+    out1[0] = out1[1] = out1[2] = out1[3] = 0.0f;
+#endif
+    for (; i < dim; i++) {
+        out0[0] += q0[i] * b0[i];
+        out0[1] += q0[i] * b1[i];
+        out0[2] += q0[i] * b2[i];
+        out0[3] += q0[i] * b3[i];
+        out1[0] += q1[i] * b0[i];
+        out1[1] += q1[i] * b1[i];
+        out1[2] += q1[i] * b2[i];
+        out1[3] += q1[i] * b3[i];
+    }
+}
+
+
+/**
+ * 计算一块query和一块底库向量之间的内积，out[i * outStride + j] = <queries[i], bases[j]>
+ * @param queries 连续存放的query向量
+ * @param queryNum
+ * @param bases 连续存放的底库向量
+ * @param baseNum
+ * @param dim
+ * @param out
+ * @param outStride
+ */
+static void FlatDotTile(const float *queries, size_t queryNum, const float *bases, size_t baseNum,
+                        size_t dim, float *out, size_t outStride) {
+    size_t i = 0;
+    for (; i + FLAT_QUERY_TILE <= queryNum; i += FLAT_QUERY_TILE) {
+        const float *q0 = queries + i * dim;
+        const float *q1 = q0 + dim;
+        float *out0 = out + i * outStride;
+        float *out1 = out0 + outStride;
+        size_t j = 0;
+        for (; j + FLAT_BASE_TILE <= baseNum; j += FLAT_BASE_TILE) {
+            const float *b = bases + j * dim;
+            FlatDot2x4(q0, q1, b, b + dim, b + 2 * dim, b + 3 * dim, dim, out0 + j, out1 + j);
+        }
+        for (; j < baseNum; j++) {
+            out0[j] = FlatDot(q0, bases + j * dim, dim);
+            out1[j] = FlatDot(q1, bases + j * dim, dim);
+        }
+    }
+
+    for (; i < queryNum; i++) {
+        const float *q = queries + i * dim;
+        float *cur = out + i * outStride;
+        size_t j = 0;
+        for (; j + FLAT_BASE_TILE <= baseNum; j += FLAT_BASE_TILE) {
+            const float *b = bases + j * dim;
+            FlatDot1x4(q, b, b + dim, b + 2 * dim, b + 3 * dim, dim, cur + j);
+        }
+        for (; j < baseNum; j++) {
+            cur[j] = FlatDot(q, bases + j * dim, dim);
+        }
+    }
+}
+
+#endif //CAISS_FLATKERNEL_H
@@ -0,0 +1,262 @@
+//
+// Created by Chunel on 2020/9/13.
+// 跟hnsw一样，模型信息是所有句柄共用的，锁在manage这一层保存
+//
+
+#include "FlatProc.h"
+
+using namespace std;
+
+FlatIndex* FlatProc::flat_index_ptr_ = nullptr;
+RWLock FlatProc::flat_index_lock_;
+
+
+FlatProc::FlatProc() {
+    this->dist_func_ = nullptr;
+}
+
+
+FlatProc::~FlatProc() {
+    this->reset();
+}
+
+
+CAISS_RET_TYPE FlatProc::init(const CAISS_MODE mode, const CAISS_DISTANCE_TYPE distanceType, const unsigned int dim,
+                              const char *modelPath, const CAISS_DIST_FUNC distFunc) {
+    CAISS_FUNCTION_BEGIN
+    CAISS_ASSERT_NOT_NULL(modelPath)
+
+    if (CAISS_DISTANCE_EDITION == distanceType) {
+        CAISS_ASSERT_NOT_NULL(distFunc)
+    } else if (CAISS_DISTANCE_EUC != distanceType && CAISS_DISTANCE_INNER != distanceType) {
+        return CAISS_RET_NO_SUPPORT;
+    }
+
+    reset();
+
+    this->dim_ = dim;
+    this->cur_mode_ = mode;
+    this->model_path_ = buildModelPath(modelPath);
+    this->distance_type_ = distanceType;
+    this->dist_func_ = distFunc;
+
+    if (CAISS_MODE_PROCESS == this->cur_mode_) {
+        ret = loadModel();
+        CAISS_FUNCTION_CHECK_STATUS
+    }
+
+    CAISS_FUNCTION_END
+}
+
+
+CAISS_RET_TYPE FlatProc::reset() {
+    CAISS_FUNCTION_BEGIN
+
+    this->dim_ = 0;
+    this->cur_mode_ = CAISS_MODE_DEFAULT;
+    this->normalize_ = CAISS_FALSE;
+    this->result_.clear();
+
+    CAISS_FUNCTION_END
+}
+
+
+CAISS_RET_TYPE FlatProc::train(const char *dataPath, const unsigned int maxDataSize, const CAISS_BOOL normalize,
+                               const unsigned int maxIndexSize, const float precision, const unsigned int fastRank,
+                               const unsigned int realRank, const unsigned int step, const unsigned int maxEpoch,
+                               const unsigned int showSpan) {
+    CAISS_FUNCTION_BEGIN
+    CAISS_ASSERT_NOT_NULL(dataPath)
+    CAISS_CHECK_MODE_ENABLE(CAISS_MODE_TRAIN)
+
+    this->normalize_ = normalize;
+    std::vector<CaissDataNode> datas;
+    CAISS_ECHO("start load datas from [%s].", dataPath);
+    ret = loadDatas(dataPath, datas);
+    CAISS_FUNCTION_CHECK_STATUS
+
+    // 精确查询，不需要迭代训练，也不需要检查准确率
+    destroyFlatSingleton();
+    ret = createFlatSingleton(this->dim_, this->distance_type_, maxDataSize, maxIndexSize, normalize);
+    CAISS_FUNCTION_CHECK_STATUS
+
+    auto ptr = FlatProc::getFlatSingleton();
+    CAISS_ASSERT_NOT_NULL(ptr)
+    for (unsigned int i = 0; i < datas.size(); i++) {
+        ret = ptr->addPoint(datas[i].node.data(), datas[i].index, true);
+        CAISS_FUNCTION_CHECK_STATUS
+
+        if (showSpan != 0 && i % showSpan == 0) {
+            CAISS_ECHO("train [%d] node, total size is [%d].", i, (int)datas.size());
+        }
+    }
+
+    remove(this->model_path_.c_str());
+    ret = ptr->save(this->model_path_, std::list<std::string>());
+    CAISS_FUNCTION_CHECK_STATUS
+
+    CAISS_ECHO("train success, precision is [1.0000] , model is saved to path [%s].", this->model_path_.c_str());
+    CAISS_FUNCTION_END
+}
+
+
+CAISS_RET_TYPE FlatProc::insert(CAISS_FLOAT *node, const char *index, const CAISS_INSERT_TYPE insertType) {
+    CAISS_FUNCTION_BEGIN
+    CAISS_ASSERT_NOT_NULL(node)
+    CAISS_ASSERT_NOT_NULL(index)
+    CAISS_CHECK_MODE_ENABLE(CAISS_MODE_PROCESS)
+    auto ptr = FlatProc::getFlatSingleton();
+    CAISS_ASSERT_NOT_NULL(ptr)
+
+    if (CAISS_INSERT_OVERWRITE != insertType && CAISS_INSERT_DISCARD != insertType) {
+        return CAISS_RET_PARAM;
+    }
+
+    std::vector<CAISS_FLOAT> vec(node, node + this->dim_);
+    ret = normalizeNode(vec, this->dim_);
+    CAISS_FUNCTION_CHECK_STATUS
+
+    ret = ptr->addPoint(vec.data(), std::string(index), CAISS_INSERT_OVERWRITE == insertType);
+    CAISS_FUNCTION_CHECK_STATUS
+
+    AlgorithmProc::invalidateResultCache();    // 如果插入成功，则之前缓存的结果失效
+    CAISS_FUNCTION_END
+}
+
+
+CAISS_RET_TYPE FlatProc::save(const char *modelPath) {
+    CAISS_FUNCTION_BEGIN
+    auto ptr = FlatProc::getFlatSingleton();
+    CAISS_ASSERT_NOT_NULL(ptr)
+
+    std::string path = (nullptr == modelPath) ? this->model_path_ : buildModelPath(modelPath);
+    remove(path.c_str());
+    ret = ptr->save(path, AlgorithmProc::getIgnoreTrie()->getAllWords());
+    CAISS_FUNCTION_CHECK_STATUS
+
+    CAISS_FUNCTION_END
+}
+
+
+/************************ 以下是本Proc类内部函数 ************************/
+CAISS_RET_TYPE FlatProc::loadModel() {
+    CAISS_FUNCTION_BEGIN
+
+    ret = createFlatSingleton(this->model_path_);
+    CAISS_FUNCTION_CHECK_STATUS
+    auto ptr = FlatProc::getFlatSingleton();
+    CAISS_ASSERT_NOT_NULL(ptr)
+
+    if (ptr->getDim() != this->dim_) {
+        return CAISS_RET_DIM;
+    }
+
+    if (ptr->getDistanceType() != this->distance_type_) {
+        return CAISS_RET_PARAM;    // 模型中的距离，是按照训练时的距离类型计算的
+    }
+
+    if (CAISS_DISTANCE_EDITION == this->distance_type_) {
+        ptr->setDistFunc(this->dist_func_);
+    }
+    this->normalize_ = ptr->getNormalize();
+
+    CAISS_FUNCTION_END
+}
+
+
+CAISS_RET_TYPE FlatProc::searchVector(const CAISS_FLOAT *query, const unsigned int topK, const CAISS_SEARCH_TYPE searchType,
+                                      ALGO_RET_TYPE &result) {
+    CAISS_FUNCTION_BEGIN
+    CAISS_ASSERT_NOT_NULL(query)
+    auto ptr = FlatProc::getFlatSingleton();
+    CAISS_ASSERT_NOT_NULL(ptr)
+
+    std::vector<ALGO_RET_TYPE> results;
+    ret = ptr->search(query, 1, topK, results);    // 快速查询和暴力查询，都是精确的结果
+    CAISS_FUNCTION_CHECK_STATUS
+
+    result.swap(results[0]);
+    CAISS_FUNCTION_END
+}
+
+
+int FlatProc::findWordId(const std::string &word) {
+    auto ptr = FlatProc::getFlatSingleton();
+    return (nullptr != ptr) ? ptr->findWordId(word) : ALGO_NO_WORD_ID;
+}
+
+
+CAISS_RET_TYPE FlatProc::getWordById(const unsigned int id, std::string &word) {
+    CAISS_FUNCTION_BEGIN
+    auto ptr = FlatProc::getFlatSingleton();
+    CAISS_ASSERT_NOT_NULL(ptr)
+
+    word = ptr->getWord(id);
+    CAISS_FUNCTION_END
+}
+
+
+CAISS_RET_TYPE FlatProc::getVectorById(const unsigned int id, std::vector<CAISS_FLOAT> &vec) {
+    CAISS_FUNCTION_BEGIN
+    auto ptr = FlatProc::getFlatSingleton();
+    CAISS_ASSERT_NOT_NULL(ptr)
+
+    const CAISS_FLOAT *data = ptr->getData(id);
+    vec.assign(data, data + ptr->getDim());
+    CAISS_FUNCTION_END
+}
+
+
+CAISS_RET_TYPE FlatProc::createFlatSingleton(const unsigned int dim, const CAISS_DISTANCE_TYPE distanceType,
+                                             const unsigned int maxDataSize, const unsigned int maxIndexSize,
+                                             const CAISS_BOOL normalize) {
+    CAISS_FUNCTION_BEGIN
+
+    if (nullptr == FlatProc::flat_index_ptr_) {
+        FlatProc::flat_index_lock_.writeLock();
+        if (nullptr == FlatProc::flat_index_ptr_) {
+            FlatProc::flat_index_ptr_ = new FlatIndex(dim, distanceType, maxDataSize, maxIndexSize, normalize);
+        }
+        FlatProc::flat_index_lock_.writeUnlock();
+    }
+
+    CAISS_FUNCTION_END
+}
+
+
+CAISS_RET_TYPE FlatProc::createFlatSingleton(const std::string &modelPath) {
+    CAISS_FUNCTION_BEGIN
+
+    if (nullptr == FlatProc::flat_index_ptr_) {
+        FlatProc::flat_index_lock_.writeLock();
+        if (nullptr == FlatProc::flat_index_ptr_) {
+            auto ptr = new FlatIndex();
+            ret = ptr->load(modelPath, AlgorithmProc::getIgnoreTrie());
+            if (CAISS_RET_OK == ret) {
+                FlatProc::flat_index_ptr_ = ptr;
+            } else {
+                CAISS_DELETE_PTR(ptr)
+            }
+        }
+        FlatProc::flat_index_lock_.writeUnlock();
+    }
+
+    CAISS_FUNCTION_CHECK_STATUS
+    CAISS_FUNCTION_END
+}
+
+
+CAISS_RET_TYPE FlatProc::destroyFlatSingleton() {
+    CAISS_FUNCTION_BEGIN
+
+    FlatProc::flat_index_lock_.writeLock();
+    CAISS_DELETE_PTR(FlatProc::flat_index_ptr_)
+    FlatProc::flat_index_lock_.writeUnlock();
+
+    CAISS_FUNCTION_END
+}
+
+
+FlatIndex* FlatProc::getFlatSingleton() {
+    return FlatProc::flat_index_ptr_;
+}
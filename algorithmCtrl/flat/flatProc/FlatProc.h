@@ -0,0 +1,56 @@
+//
+// Created by Chunel on 2020/9/13.
+// flat算法（精确查询）的封装层。模型构建只需要保存向量，适合数据量不大，或者对召回率要求很高的场景
+//
+
+#ifndef CAISS_FLATPROC_H
+#define CAISS_FLATPROC_H
+
+#include "../../common/CommonAlgoProc.h"
+#include "../flatAlgo/FlatIndex.h"
+
+class FlatProc : public CommonAlgoProc {
+
+public:
+    explicit FlatProc();
+    ~FlatProc() override;
+
+    CAISS_RET_TYPE init(CAISS_MODE mode, CAISS_DISTANCE_TYPE distanceType,
+                        unsigned int dim, const char *modelPath, CAISS_DIST_FUNC distFunc) override;
+
+    // train_mode
+    CAISS_RET_TYPE train(const char *dataPath, unsigned int maxDataSize, CAISS_BOOL normalize,
+                         unsigned int maxIndexSize, float precision, unsigned int fastRank,
+                         unsigned int realRank, unsigned int step, unsigned int maxEpoch,
+                         unsigned int showSpan) override;
+
+    // process_mode
+    CAISS_RET_TYPE insert(CAISS_FLOAT *node, const char *index, CAISS_INSERT_TYPE insertType) override;
+    CAISS_RET_TYPE save(const char *modelPath) override;
+
+protected:
+    CAISS_RET_TYPE reset();
+    CAISS_RET_TYPE loadModel();
+
+    CAISS_RET_TYPE searchVector(const CAISS_FLOAT *query, unsigned int topK, CAISS_SEARCH_TYPE searchType,
+                                ALGO_RET_TYPE &result) override;
+    int findWordId(const std::string &word) override;
+    CAISS_RET_TYPE getWordById(unsigned int id, std::string &word) override;
+    CAISS_RET_TYPE getVectorById(unsigned int id, std::vector<CAISS_FLOAT> &vec) override;
+
+private:
+    static CAISS_RET_TYPE createFlatSingleton(unsigned int dim, CAISS_DISTANCE_TYPE distanceType, unsigned int maxDataSize,
+                                              unsigned int maxIndexSize, CAISS_BOOL normalize);
+    static CAISS_RET_TYPE createFlatSingleton(const std::string &modelPath);
+    static CAISS_RET_TYPE destroyFlatSingleton();
+    static FlatIndex* getFlatSingleton();
+
+    static FlatIndex*                        flat_index_ptr_;
+    static RWLock                            flat_index_lock_;
+
+private:
+    CAISS_DIST_FUNC                          dist_func_;
+};
+
+
+#endif //CAISS_FLATPROC_H
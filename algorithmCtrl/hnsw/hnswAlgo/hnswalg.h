@@ -10,26 +10,68 @@
 #include <string.h>
 #include <algorithm>
 #include <atomic>
+#include <thread>
+#include <mutex>
+#include <chrono>
+#include <iterator>
+#include <condition_variable>
+#include <limits>
 #include <list>
 #include <unordered_set>
 #include <unordered_map>
 #include "./boost/bimap/bimap.hpp"
 
 #include "../../../utilsCtrl/UtilsInclude.h"
+#include "../../../threadCtrl/rwLock/RWLock.h"
 
 namespace hnswlib {
     typedef unsigned int tableint;
     typedef unsigned int linklistsizeint;
     typedef boost::bimaps::bimap<labeltype, std::string> BOOST_BIMAP;
 
+    /* 写入模型头部的标识。旧版本模型中的placeholder信息未初始化，通过此标识区分 */
+    const static int HNSW_MODEL_MAGIC = 0x53534143;
+
+    const static size_t FORCE_LOOP_BLOCK_SIZE = 256;    // 暴力查询时，每个数据块的大小（也是批量计算距离的大小）
+    const static size_t FORCE_LOOP_MAX_THREAD_NUM = 8;    // 暴力查询时，最多开启的线程数
+    const static size_t FORCE_LOOP_MIN_THREAD_SIZE = 16384;    // 暴力查询时，每个线程至少处理的数据量
+
+    const static unsigned int HNSW_TIER_MIGRATE_INTERVAL = 1000;    // 分层模式下，后台调整热点数据的间隔（毫秒）
+    const static unsigned char HNSW_TIER_ACCESS_MAX = 255;    // 访问计数的上限，每次调整之后减半
+    const static unsigned int HNSW_DELTA_DRAIN_INTERVAL = 100;    // 后台将增量段合入图中的间隔（毫秒），增量段过半时会提前合入
+    const static labeltype HNSW_AUTO_LABEL = (labeltype)-1;    // 添加点时传入此值，label跟点在图中的位置一致（并行添加时使用）
+
+    /**
+     * 可以清空并保留已申请内存的堆，查询时作为临时空间重复使用
+     */
+    template<typename T, typename Compare>
+    class ReusableHeap : public std::priority_queue<T, std::vector<T>, Compare> {
+    public:
+        void clear() {
+            this->c.clear();
+        }
+    };
+
+    const static unsigned int NEIGHBOR_LIST_EMPTY_LABEL = 0xFFFFFFFF;    // 近邻列表中的空位（模型中的点数少于列表长度时）
+
     template<typename dist_t>
     class HierarchicalNSW : public AlgorithmInterface<dist_t> {
     public:
         HierarchicalNSW(SpaceInterface<dist_t> *s) {
         }
 
-        HierarchicalNSW(SpaceInterface<dist_t> *s, const std::string &location, TrieProc* trie, size_t max_elements=0) {
-            loadIndex(location, s, trie, max_elements);
+        /**
+         * 从模型文件中加载
+         * @param s
+         * @param location
+         * @param trie
+         * @param max_elements
+         * @param hot_bytes 为0表示第0层全部读入内存；否则第0层通过mmap按需读取，
+         *                  后台按照访问频率，将最多hot_bytes字节的热点数据常驻内存，其余部分交给系统回收
+         */
+        HierarchicalNSW(SpaceInterface<dist_t> *s, const std::string &location, TrieProc* trie, size_t max_elements=0,
+                        size_t hot_bytes=0) {
+            loadIndex(location, s, trie, max_elements, hot_bytes);
         }
 
         HierarchicalNSW(SpaceInterface<dist_t> *s, size_t max_elements, int normalize = 0,
@@ -42,6 +84,8 @@ namespace hnswlib {
             data_size_ = s->get_data_size();
             fstdistfunc_ = s->get_dist_func();
             dist_func_param_ = s->get_dist_func_param();
+            encodefunc_ = s->get_encode_func();
+            decodefunc_ = s->get_decode_func();
             M_ = M;
             maxM_ = M_;
             maxM0_ = M_ * 2;
@@ -73,6 +117,13 @@ namespace hnswlib {
             revSize_ = 1.0 / mult_;
 
             normalize_ = normalize;
+            boundeddistfunc_ = s->get_bounded_dist_func(0 != normalize_);
+            batchdistfunc_ = s->get_batch_dist_func();
+            model_magic_ = HNSW_MODEL_MAGIC;
+            storage_type_ = s->get_storage_type();
+            ext_info_size_ = neighbor_list_size_ = placeholder_4_ = placeholder_5_ = placeholder_6_ = placeholder_7_ = 0;
+            binary_dim_ = binary_words_ = 0;
+            hammingfunc_ = nullptr;
             per_index_size_ = index_size;
             index_ptr_ = (char *)malloc(max_elements_ * per_index_size_);    // 分配空间，保存具体index信息，训练的时候加载的方法
             memset(index_ptr_, 0, max_elements_ * per_index_size_);
@@ -88,8 +139,28 @@ namespace hnswlib {
             }
         };
 
+        typedef ReusableHeap<std::pair<dist_t, tableint>, CompareByFirst> SEARCH_HEAP;
+
+        /**
+         * 查询时使用的临时空间。由调用方持有，在同一个线程内重复使用，查询稳定之后不再申请内存
+         */
+        struct SearchScratch {
+            SEARCH_HEAP top_candidates;
+            SEARCH_HEAP candidate_set;
+            std::vector<char> buffer;    // 半精度等存储格式下，编码之后的query
+            std::vector<uint64_t> query_code;    // 开启二值粗筛时，query的二值编码
+            SEARCH_HEAP binary_candidates;    // 二值粗筛得到的候选点（距离为汉明距离）
+            std::vector<tableint> batch_ids;    // 以下三个，仅在批量计算距离的时候使用
+            std::vector<const void *> batch_datas;
+            std::vector<dist_t> batch_dists;
+        };
+
         ~HierarchicalNSW() {
-            free(data_level0_memory_);
+            stopDeltaThread();
+            stopTierThread();
+            if (!level0_map_.isOpen()) {
+                free(data_level0_memory_);    // 分层模式下，第0层的空间由level0_map_释放
+            }
             for (tableint i = 0; i < cur_element_count_; i++) {
                 if (element_levels_[i] > 0)
                     free(linkLists_[i]);
@@ -110,7 +181,7 @@ namespace hnswlib {
         }
 
         size_t max_elements_;
-        size_t cur_element_count_;
+        std::atomic<size_t> cur_element_count_;    // 点的信息全部写入之后才会增加，查询时读到的点都是完整的
         size_t size_data_per_element_;
         size_t size_links_per_element_;
 
@@ -121,23 +192,23 @@ namespace hnswlib {
 
         int normalize_;    // 是否是标准化的内容
         int ignore_word_size_;    // 忽略的词语的数量
-        int placeholder_0_;    // 添加placeholder信息
-        int placeholder_1_;
-        int placeholder_2_;
-        int placeholder_3_;
+        int model_magic_;    // 模型标识，等于HNSW_MODEL_MAGIC时，以下头部信息有效
+        int storage_type_;    // 向量存储格式（取值同CAISS_STORAGE_TYPE）
+        int ext_info_size_;    // 扩展信息（如：投影矩阵）的长度，扩展信息写在忽略词语信息之后
+        int neighbor_list_size_;    // 每个点物化的近邻个数，为0表示模型中没有近邻列表，近邻列表写在扩展信息之后
         int placeholder_4_;
         int placeholder_5_;
         int placeholder_6_;
         int placeholder_7_;
 
         double mult_, revSize_;
-        int maxlevel_;
+        std::atomic<int> maxlevel_;    // 插入时先更新入口点再更新层数，查询时先读层数再读入口点，保证入口点的层数足够
 
         VisitedListPool *visited_list_pool_;
         std::mutex cur_element_count_guard_;
 
-        std::vector<std::mutex> link_list_locks_;
-        tableint enterpoint_node_;
+        mutable std::vector<std::mutex> link_list_locks_;    // 插入和查询的时候，都需要锁住正在读写的点的邻居信息
+        std::atomic<tableint> enterpoint_node_;
 
         size_t size_links_level0_;
         size_t offsetData_, offsetLevel0_;
@@ -150,14 +221,59 @@ namespace hnswlib {
         size_t label_offset_;
         DISTFUNC<dist_t> fstdistfunc_;
         void *dist_func_param_;
+        BOUNDEDDISTFUNC<dist_t> boundeddistfunc_;    // 为空表示不支持提前放弃计算
+        BATCHDISTFUNC<dist_t> batchdistfunc_;    // 为空表示逐个计算距离
+        CODECFUNC encodefunc_;    // 为空表示按float32原样存储
+        CODECFUNC decodefunc_;
         std::unordered_map<labeltype, tableint> label_lookup_;
         std::default_random_engine level_generator_;
 
         char *index_ptr_;    // 用于存放所有单词的地方
         unsigned int per_index_size_;
         BOOST_BIMAP index_lookup_;
+        mutable RWLock lookup_lock_;    // 保护label_lookup_、index_lookup_和近邻列表，插入的时候加写锁，查询的时候加读锁
+        mutable RWLock data_lock_;    // 保护图中已有点的向量和二值编码，覆盖的时候加写锁，查询和建图的时候加读锁
 
         char *ignore_info_;    // 用于存放被忽略的信息（当调用save的时候，被加入模型）
+        std::string ext_info_;    // 上层写入的扩展信息，随模型一起保存和读取
+
+        std::vector<unsigned int> neighbor_list_labels_;    // 按照内部id排列，每个点neighbor_list_size_个label，距离从小到大
+        std::vector<dist_t> neighbor_list_dists_;    // 跟neighbor_list_labels_一一对应的距离信息
+        std::vector<unsigned char> neighbor_list_stale_;    // 按照内部id排列，插入或者覆盖之后可能受影响的列表标记为失效，查询时不再使用
+        size_t neighbor_list_stale_num_ = 0;    // 失效的列表个数，不为0的时候，保存之前需要重新物化
+
+        size_t binary_dim_;    // 二值编码对应的向量维度，为0表示未开启二值粗筛
+        size_t binary_words_;    // 每个点的二值编码，占用多少个uint64_t
+        std::vector<uint64_t> binary_codes_;    // 二值编码信息，跟data_level0_memory_中的点按照内部id一一对应
+        std::vector<float> binary_mean_;    // 各维度的均值，作为编码的阈值
+        HAMMINGFUNC hammingfunc_;
+
+        // 以下为分层模式（hot_bytes_不为0）时使用的信息
+        size_t hot_bytes_ = 0;    // 常驻内存的热点数据的最大字节数
+        MmapProc level0_map_;    // 第0层数据的映射，写时复制，修改不会写回模型文件
+        mutable std::vector<std::atomic<unsigned char>> access_counts_;    // 每个点在第0层被展开的次数
+        std::vector<size_t> hot_pages_;    // 当前锁定在内存中的页（相对于第0层起始位置），从小到大排列
+        std::thread tier_thread_;
+        std::mutex tier_lock_;
+        std::condition_variable tier_cond_;
+        bool tier_stop_ = false;
+
+        // 以下为增量段信息。插入的点先追加到增量段中，查询时跟图一起查询，由后台线程按照插入顺序分批合入图中
+        std::atomic<size_t> delta_capacity_{0};    // 增量段最多容纳的点数，为0表示不使用增量段
+        std::vector<float> delta_nodes_;    // 原始向量，按照 label % delta_capacity_ 环形存放
+        std::vector<char> delta_data_;    // 存储格式的向量，查询时逐个计算距离
+        std::vector<std::string> delta_words_;
+        std::vector<unsigned int> delta_versions_;    // 被覆盖写入的次数
+        std::unordered_map<std::string, size_t> delta_lookup_;    // 词语对应的label
+        std::atomic<size_t> delta_begin_{0};    // 增量段中第一个点的label，label即合入之后在图中的内部id
+        std::atomic<size_t> delta_end_{0};
+        mutable RWLock delta_lock_;    // 查询时加读锁，修改增量段的时候加写锁
+        std::mutex delta_write_lock_;    // 插入和合入之间互斥，合入图的过程中不持有
+        std::mutex delta_drain_lock_;    // 同一时刻只有一个线程在合入
+        std::thread delta_thread_;
+        std::mutex delta_thread_lock_;
+        std::condition_variable delta_cond_;
+        bool delta_stop_ = false;
 
         /**
          * 获取当前
@@ -179,6 +295,152 @@ namespace hnswlib {
             return (data_level0_memory_ + internal_id * size_data_per_element_ + offsetData_);
         }
 
+        /**
+         * 将外部传入的float向量，转换成模型内部的存储格式
+         * @param data_point
+         * @param buffer 转换后数据的存放位置
+         * @return 不需要转换的时候，直接返回data_point
+         */
+        inline const void *encodeData(const void *data_point, std::vector<char> &buffer) const {
+            if (nullptr == encodefunc_) {
+                return data_point;
+            }
+
+            buffer.resize(data_size_);
+            encodefunc_(data_point, buffer.data(), dist_func_param_);
+            return buffer.data();
+        }
+
+        /**
+         * 重新绑定距离空间信息（如：加载模型后，发现存储格式跟当前距离空间不一致的时候）
+         * @param s
+         */
+        void resetSpace(SpaceInterface<dist_t> *s) {
+            fstdistfunc_ = s->get_dist_func();
+            dist_func_param_ = s->get_dist_func_param();
+            encodefunc_ = s->get_encode_func();
+            decodefunc_ = s->get_decode_func();
+            boundeddistfunc_ = s->get_bounded_dist_func(0 != normalize_);
+            batchdistfunc_ = s->get_batch_dist_func();
+        }
+
+        /**
+         * 获取内部id对应的float向量信息。按照float32存储的时候，直接返回模型中的地址
+         * @param internal_id
+         * @param buffer 需要解码的时候，解码后数据的存放位置
+         * @return
+         */
+        inline const float *getFloatDataByInternalId(tableint internal_id, std::vector<float> &buffer) const {
+            char *data = getDataByInternalId(internal_id);
+            if (nullptr == decodefunc_) {
+                return (const float *)data;
+            }
+
+            buffer.resize(binary_dim_);
+            decodefunc_(data, buffer.data(), dist_func_param_);
+            return buffer.data();
+        }
+
+        /**
+         * 开启二值粗筛。按照当前模型中的所有点，计算各维度均值，并生成每个点的二值编码
+         * @param dim 模型中向量的维度
+         */
+        void enableBinaryCodes(size_t dim) {
+            binary_dim_ = dim;
+            binary_words_ = BinaryCodeWords(dim);
+            hammingfunc_ = GetHammingFunc();
+
+            std::vector<float> buffer;
+            std::vector<double> sum(dim, 0.0);
+            for (tableint i = 0; i < cur_element_count_; i++) {
+                const float *vec = getFloatDataByInternalId(i, buffer);
+                for (size_t j = 0; j < dim; j++) {
+                    sum[j] += vec[j];
+                }
+            }
+
+            binary_mean_.assign(dim, 0.0f);
+            for (size_t j = 0; j < dim && cur_element_count_ > 0; j++) {
+                binary_mean_[j] = (float)(sum[j] / (double)cur_element_count_);
+            }
+
+            binary_codes_.assign(max_elements_ * binary_words_, 0);    // 按照最大数量分配，插入的时候无需扩容
+            for (tableint i = 0; i < cur_element_count_; i++) {
+                updateBinaryCode(i, getFloatDataByInternalId(i, buffer));
+            }
+        }
+
+        void disableBinaryCodes() {
+            binary_dim_ = binary_words_ = 0;
+            std::vector<uint64_t>().swap(binary_codes_);
+            std::vector<float>().swap(binary_mean_);
+        }
+
+        /**
+         * 更新内部id对应的二值编码（未开启二值粗筛的时候，不做任何处理）
+         * @param internal_id
+         * @param node float格式的向量信息
+         */
+        inline void updateBinaryCode(tableint internal_id, const void *node) {
+            if (0 == binary_dim_) {
+                return;
+            }
+            BinaryEncode((const float *)node, binary_mean_.data(), binary_dim_,
+                         binary_codes_.data() + internal_id * binary_words_);
+        }
+
+        /**
+         * 将候选点（如kNN图中的邻居）合并进第0层的邻居中，并通过启发式裁边，保证邻居数不超过maxM0_
+         * @param internal_id
+         * @param candidates 候选点的内部id
+         */
+        void mergeBaseLayerNeighbors(tableint internal_id, const std::vector<tableint> &candidates) {
+            std::unique_lock<std::mutex> lock(link_list_locks_[internal_id]);
+            linklistsizeint *ll_cur = get_linklist0(internal_id);
+            tableint *data = (tableint *) (ll_cur + 1);
+            size_t size = *ll_cur;
+
+            std::unordered_set<tableint> exist(data, data + size);
+            std::priority_queue<std::pair<dist_t, tableint>, std::vector<std::pair<dist_t, tableint>>, CompareByFirst> top_candidates;
+            const void *cur_data = getDataByInternalId(internal_id);
+            for (size_t i = 0; i < size; i++) {
+                top_candidates.emplace(fstdistfunc_(cur_data, getDataByInternalId(data[i]), dist_func_param_), data[i]);
+            }
+            for (tableint candidate : candidates) {
+                if (candidate == internal_id || candidate >= cur_element_count_ || !exist.insert(candidate).second) {
+                    continue;
+                }
+                top_candidates.emplace(fstdistfunc_(cur_data, getDataByInternalId(candidate), dist_func_param_), candidate);
+            }
+
+            getNeighborsByHeuristic2(top_candidates, maxM0_);
+            while (top_candidates.size() > maxM0_) {
+                top_candidates.pop();    // 候选点不足maxM0_的时候不会裁边，这里保证不会越界
+            }
+
+            size_t indx = 0;
+            while (!top_candidates.empty()) {
+                data[indx++] = top_candidates.top().second;
+                top_candidates.pop();
+            }
+            *ll_cur = (linklistsizeint)indx;
+        }
+
+        /**
+         * 计算查询点和候选点的距离。结果集已满的时候，超过bound的点注定会被丢弃，故可以提前放弃计算
+         * @param data_point
+         * @param candidate
+         * @param bound 当前结果集中最远的距离
+         * @param isFull 结果集是否已满
+         * @return
+         */
+        inline dist_t calcCandidateDist(const void *data_point, const void *candidate, dist_t bound, bool isFull) const {
+            if (isFull && nullptr != boundeddistfunc_) {
+                return boundeddistfunc_(data_point, candidate, dist_func_param_, bound);
+            }
+            return fstdistfunc_(data_point, candidate, dist_func_param_);
+        }
+
         int getRandomLevel(double reverse_size) {
             std::uniform_real_distribution<double> distribution(0.0, 1.0);
             double r = -log(distribution(level_generator_)) * reverse_size;
@@ -186,7 +448,7 @@ namespace hnswlib {
         }
 
         std::priority_queue<std::pair<dist_t, tableint>, std::vector<std::pair<dist_t, tableint>>, CompareByFirst>
-        searchBaseLayer(tableint enterpoint_id, void *data_point, int layer) {
+        searchBaseLayer(tableint enterpoint_id, const void *data_point, int layer) {
             VisitedList *vl = visited_list_pool_->getFreeVisitedList();
             vl_type *visited_array = vl->mass;
             vl_type visited_array_tag = vl->curV;
@@ -235,7 +497,8 @@ namespace hnswlib {
                     visited_array[candidate_id] = visited_array_tag;
                     char *currObj1 = (getDataByInternalId(candidate_id));
 
-                    dist_t dist1 = fstdistfunc_(data_point, currObj1, dist_func_param_);
+                    dist_t dist1 = calcCandidateDist(data_point, currObj1, lowerBound,
+                                                     top_candidates.size() >= ef_construction_);
                     if (top_candidates.top().first > dist1 || top_candidates.size() < ef_construction_) {
                         candidateSet.emplace(-dist1, candidate_id);
         #ifdef USE_SSE
@@ -263,13 +526,31 @@ namespace hnswlib {
          */
         std::priority_queue<std::pair<dist_t, tableint>, std::vector<std::pair<dist_t, tableint>>, CompareByFirst>
         searchBaseLayerST(tableint ep_id, const void *data_point, size_t ef) const {
+            SearchScratch scratch;
+            searchBaseLayerST(ep_id, data_point, ef, scratch);
+            return std::move(scratch.top_candidates);
+        }
+
+        /**
+         * 在最下面一层查询，结果写入scratch.top_candidates中。scratch中的容器会先被清空，已经申请的内存可以重复使用
+         * @param ep_id
+         * @param data_point
+         * @param ef
+         * @param scratch
+         */
+        void searchBaseLayerST(tableint ep_id, const void *data_point, size_t ef, SearchScratch &scratch) const {
+            SEARCH_HEAP &top_candidates = scratch.top_candidates;
+            SEARCH_HEAP &candidate_set = scratch.candidate_set;
+            std::vector<tableint> &batch_ids = scratch.batch_ids;
+            std::vector<const void *> &batch_datas = scratch.batch_datas;
+            std::vector<dist_t> &batch_dists = scratch.batch_dists;
             // 其中ep-id表示，当前是第几个节点；data-point是查询点的矩阵信息
             VisitedList *vl = visited_list_pool_->getFreeVisitedList();
             vl_type *visited_array = vl->mass;
             vl_type visited_array_tag = vl->curV;
 
-            std::priority_queue<std::pair<dist_t, tableint>, std::vector<std::pair<dist_t, tableint>>, CompareByFirst> top_candidates;
-            std::priority_queue<std::pair<dist_t, tableint>, std::vector<std::pair<dist_t, tableint>>, CompareByFirst> candidate_set;
+            top_candidates.clear();
+            candidate_set.clear();
             dist_t dist = fstdistfunc_(data_point, getDataByInternalId(ep_id), dist_func_param_);
 
             top_candidates.emplace(dist, ep_id);    // 放入当前的节点和query点的距离
@@ -277,6 +558,24 @@ namespace hnswlib {
             visited_array[ep_id] = visited_array_tag;
             dist_t lower_bound = dist;
 
+            // 距离小于当前结果集中最远距离的点（或结果集未满），加入结果集和候选集
+            auto tryAddCandidate = [&](dist_t candidate_dist, tableint candidate_id) {
+                if (top_candidates.top().first > candidate_dist || top_candidates.size() < ef) {
+                    candidate_set.emplace(-candidate_dist, candidate_id);
+        #ifdef USE_SSE
+                    _mm_prefetch(data_level0_memory_ + candidate_set.top().second * size_data_per_element_ +
+                                 offsetLevel0_, _MM_HINT_T0);
+        #endif
+
+                    top_candidates.emplace(candidate_dist, candidate_id);
+
+                    if (top_candidates.size() > ef) {
+                        top_candidates.pop();
+                    }
+                    lower_bound = top_candidates.top().first;
+                }
+            };
+
             while (!candidate_set.empty()) {
 
                 std::pair<dist_t, tableint> current_node_pair = candidate_set.top();
@@ -287,6 +586,8 @@ namespace hnswlib {
                 candidate_set.pop();
 
                 tableint current_node_id = current_node_pair.second;
+                recordAccess(current_node_id);
+                std::unique_lock<std::mutex> lock(link_list_locks_[current_node_id]);    // 插入的时候，可能正在修改这个点的邻居
                 int *data = (int *) (data_level0_memory_ + current_node_id * size_data_per_element_ + offsetLevel0_);
                 int size = *data;    // size的值是dim，从第0层中，拿到数据信息。偏移后，拿到的应该是表示这个node-id有多少个邻居点的
         #ifdef USE_SSE
@@ -296,6 +597,33 @@ namespace hnswlib {
                 _mm_prefetch((char *) (data + 2), _MM_HINT_T0);
         #endif
 
+                if (nullptr != batchdistfunc_) {
+                    // 设定了批量计算函数的时候，先收集当前点所有未访问过的邻居，一次性计算距离
+                    batch_ids.clear();
+                    batch_datas.clear();
+                    for (int j = 1; j <= size; j++) {
+                        int candidate_id = *(data + j);
+                        if (visited_array[candidate_id] == visited_array_tag) {
+                            continue;
+                        }
+                        visited_array[candidate_id] = visited_array_tag;
+                        batch_ids.push_back(candidate_id);
+                        batch_datas.push_back(getDataByInternalId(candidate_id));
+                    }
+
+                    if (batch_ids.empty()) {
+                        continue;
+                    }
+
+                    batch_dists.resize(batch_ids.size());
+                    batchdistfunc_(data_point, batch_datas.data(), (unsigned int)batch_ids.size(),
+                                   batch_dists.data(), dist_func_param_);
+                    for (size_t k = 0; k < batch_ids.size(); k++) {
+                        tryAddCandidate(batch_dists[k], batch_ids[k]);
+                    }
+                    continue;
+                }
+
                 for (int j = 1; j <= size; j++) {
                     int candidate_id = *(data + j);
         #ifdef USE_SSE
@@ -308,28 +636,81 @@ namespace hnswlib {
                         visited_array[candidate_id] = visited_array_tag;
 
                         char *currObj1 = (getDataByInternalId(candidate_id));
-                        dist_t dist = fstdistfunc_(data_point, currObj1, dist_func_param_);
+                        dist_t dist = calcCandidateDist(data_point, currObj1, lower_bound, top_candidates.size() >= ef);
+                        tryAddCandidate(dist, candidate_id);
+                    }
+                }
+            }
+
+            visited_list_pool_->releaseVisitedList(vl);
+        }
+
+        /**
+         * 在最下面一层，按照二值编码的汉明距离查询，将ef个候选点写入top_candidates中（距离为汉明距离，需要上层重新排序）
+         * 两个堆会先被清空，已经申请的内存可以重复使用
+         * @param ep_id
+         * @param query_code
+         * @param ef
+         * @param top_candidates
+         * @param candidate_set
+         */
+        void searchBaseLayerBinaryST(tableint ep_id, const uint64_t *query_code, size_t ef,
+                                     SEARCH_HEAP &top_candidates, SEARCH_HEAP &candidate_set) const {
+            VisitedList *vl = visited_list_pool_->getFreeVisitedList();
+            vl_type *visited_array = vl->mass;
+            vl_type visited_array_tag = vl->curV;
 
-                        if (top_candidates.top().first > dist || top_candidates.size() < ef) {
-                            candidate_set.emplace(-dist, candidate_id);
+            top_candidates.clear();
+            candidate_set.clear();
+            const uint64_t *codes = binary_codes_.data();
+            dist_t dist = (dist_t)hammingfunc_(query_code, codes + ep_id * binary_words_, binary_words_);
+
+            top_candidates.emplace(dist, ep_id);
+            candidate_set.emplace(-dist, ep_id);
+            visited_array[ep_id] = visited_array_tag;
+            dist_t lower_bound = dist;
+
+            while (!candidate_set.empty()) {
+                std::pair<dist_t, tableint> current_node_pair = candidate_set.top();
+                if ((-current_node_pair.first) > lower_bound) {
+                    break;
+                }
+                candidate_set.pop();
+
+                tableint current_node_id = current_node_pair.second;
+                recordAccess(current_node_id);
+                std::unique_lock<std::mutex> lock(link_list_locks_[current_node_id]);    // 插入的时候，可能正在修改这个点的邻居
+                int *data = (int *) (data_level0_memory_ + current_node_id * size_data_per_element_ + offsetLevel0_);
+                int size = *data;
         #ifdef USE_SSE
-                            _mm_prefetch(data_level0_memory_ + candidate_set.top().second * size_data_per_element_ +
-                                         offsetLevel0_, _MM_HINT_T0);
+                _mm_prefetch((char *) (visited_array + *(data + 1)), _MM_HINT_T0);
+                _mm_prefetch((char *) (codes + *(data + 1) * binary_words_), _MM_HINT_T0);
         #endif
 
-                            top_candidates.emplace(dist, candidate_id);
+                for (int j = 1; j <= size; j++) {
+                    int candidate_id = *(data + j);
+        #ifdef USE_SSE
+                    _mm_prefetch((char *) (visited_array + *(data + j + 1)), _MM_HINT_T0);
+                    _mm_prefetch((char *) (codes + *(data + j + 1) * binary_words_), _MM_HINT_T0);
+        #endif
+                    if (visited_array[candidate_id] == visited_array_tag) {
+                        continue;
+                    }
+                    visited_array[candidate_id] = visited_array_tag;
 
-                            if (top_candidates.size() > ef) {
-                                top_candidates.pop();
-                            }
-                            lower_bound = top_candidates.top().first;
+                    dist_t candidate_dist = (dist_t)hammingfunc_(query_code, codes + candidate_id * binary_words_, binary_words_);
+                    if (top_candidates.top().first > candidate_dist || top_candidates.size() < ef) {
+                        candidate_set.emplace(-candidate_dist, candidate_id);
+                        top_candidates.emplace(candidate_dist, candidate_id);
+                        if (top_candidates.size() > ef) {
+                            top_candidates.pop();
                         }
+                        lower_bound = top_candidates.top().first;
                     }
                 }
             }
 
             visited_list_pool_->releaseVisitedList(vl);
-            return top_candidates;
         }
 
         void getNeighborsByHeuristic2(
@@ -386,9 +767,17 @@ namespace hnswlib {
             return (linklistsizeint *) (linkLists_[internal_id] + (level - 1) * size_links_per_element_);
         };
 
-        void mutuallyConnectNewElement(void *data_point, tableint cur_c,
+        /**
+         * 给cur_c设定近邻，并在近邻中加入指向cur_c的连接
+         * @param data_point
+         * @param cur_c
+         * @param top_candidates
+         * @param level
+         * @param is_update 为true表示cur_c已经在图中（向量被覆盖），原来的近邻直接替换，已经指向cur_c的点不再修改
+         */
+        void mutuallyConnectNewElement(const void *data_point, tableint cur_c,
                                        std::priority_queue<std::pair<dist_t, tableint>, std::vector<std::pair<dist_t, tableint>>, CompareByFirst> top_candidates,
-                                       int level) {
+                                       int level, bool is_update = false) {
 
             size_t Mcurmax = level ? maxM_ : maxM0_;
             getNeighborsByHeuristic2(top_candidates, M_);
@@ -402,13 +791,19 @@ namespace hnswlib {
                 top_candidates.pop();
             }
             {
+                // 新添加的点在addPoint中已经加锁，覆盖的时候才需要在这里加锁
+                std::unique_lock <std::mutex> lock(link_list_locks_[cur_c], std::defer_lock);
+                if (is_update) {
+                    lock.lock();
+                }
+
                 linklistsizeint *ll_cur;
                 if (level == 0)
                     ll_cur = get_linklist0(cur_c);
                 else
                     ll_cur = get_linklist(cur_c, level);
 
-                if (*ll_cur) {
+                if (*ll_cur && !is_update) {
                     throw std::runtime_error("The newly inserted element should have blank link list");
                 }
                 *ll_cur = selectedNeighbors.size();
@@ -416,7 +811,7 @@ namespace hnswlib {
 
 
                 for (size_t idx = 0; idx < selectedNeighbors.size(); idx++) {
-                    if (data[idx])
+                    if (data[idx] && !is_update)
                         throw std::runtime_error("Possible memory corruption");
                     if (level > element_levels_[selectedNeighbors[idx]])
                         throw std::runtime_error("Trying to make a link on a non-existent level");
@@ -446,6 +841,10 @@ namespace hnswlib {
                     throw std::runtime_error("Trying to make a link on a non-existent level");
 
                 tableint *data = (tableint *) (ll_other + 1);
+                if (is_update && std::find(data, data + sz_link_list_other, cur_c) != data + sz_link_list_other) {
+                    continue;    // 已经有指向cur_c的连接了
+                }
+
                 if (sz_link_list_other < Mcurmax) {
                     data[sz_link_list_other] = cur_c;
                     *ll_other = sz_link_list_other + 1;
@@ -489,6 +888,116 @@ namespace hnswlib {
             }
         }
 
+        /**
+         * 获取点在某一层的近邻（拷贝一份，获取时加锁）
+         * @param internal_id
+         * @param level
+         * @param result 已经申请的内存可以重复使用
+         */
+        void getConnectionsWithLock(tableint internal_id, int level, std::vector<tableint> &result) {
+            std::unique_lock <std::mutex> lock(link_list_locks_[internal_id]);
+            linklistsizeint *ll = (0 == level) ? get_linklist0(internal_id) : get_linklist(internal_id, level);
+            size_t size = *ll;
+            result.resize(size);
+            std::copy((tableint *) (ll + 1), (tableint *) (ll + 1) + size, result.begin());
+        }
+
+        /**
+         * 点的向量被覆盖之后，重新建立跟它相关的连接（参考hnswlib中的updatePoint）
+         * 原来的每个近邻，在自己的近邻和这个点原来的近邻中重新选择（hnswlib中使用全部两跳的点，耗时太多）；
+         * 再从入口点开始查询，给这个点重新选择近邻，并补上反向的连接
+         * @param cur_c 向量已经更新过的点
+         */
+        void repairConnections(tableint cur_c) {
+            int maxlevelcopy = maxlevel_;    // 先读层数，再读入口点（跟插入时的更新顺序相反）
+            tableint entry = enterpoint_node_;
+            if (cur_element_count_ <= 1 || (signed)entry == -1) {
+                return;
+            }
+
+            data_lock_.readLock();
+            const void *data_point = getDataByInternalId(cur_c);
+            int elem_level = std::min(element_levels_[cur_c], maxlevelcopy);
+            std::vector<tableint> one_hop;
+            std::vector<tableint> cands;
+            std::vector<std::pair<dist_t, tableint>> near;    // 第0层新旧位置附近的点，用于标记失效的近邻列表
+            for (int level = 0; level <= elem_level; level++) {
+                getConnectionsWithLock(cur_c, level, one_hop);    // 旧的位置附近的点
+                for (tableint neigh : one_hop) {
+                    // 读取、重新选择、写回的整个过程都持有这个点的锁，避免其他线程同时加入的连接被覆盖
+                    std::unique_lock <std::mutex> lock(link_list_locks_[neigh]);
+                    linklistsizeint *ll = (0 == level) ? get_linklist0(neigh) : get_linklist(neigh, level);
+                    tableint *data = (tableint *) (ll + 1);
+                    cands.assign(data, data + *ll);
+                    cands.insert(cands.end(), one_hop.begin(), one_hop.end());
+                    cands.push_back(cur_c);
+                    std::sort(cands.begin(), cands.end());
+                    cands.erase(std::unique(cands.begin(), cands.end()), cands.end());
+                    if (0 == level && hasNeighborLists()) {
+                        for (tableint cand : cands) {
+                            near.emplace_back(std::numeric_limits<dist_t>::max(), cand);    // 旧的位置附近，只检查列表中是否包含这个点
+                        }
+                    }
+
+                    std::priority_queue<std::pair<dist_t, tableint>, std::vector<std::pair<dist_t, tableint>>, CompareByFirst> candidates;
+                    const void *neigh_data = getDataByInternalId(neigh);
+                    for (tableint cand : cands) {
+                        if (cand != neigh) {
+                            candidates.emplace(fstdistfunc_(neigh_data, getDataByInternalId(cand), dist_func_param_), cand);
+                        }
+                    }
+                    getNeighborsByHeuristic2(candidates, (0 == level) ? maxM0_ : maxM_);
+
+                    *ll = (linklistsizeint)candidates.size();
+                    for (size_t idx = 0; !candidates.empty(); idx++) {
+                        data[idx] = candidates.top().second;
+                        candidates.pop();
+                    }
+                }
+            }
+
+            tableint curr_obj = entry;
+            if (elem_level < maxlevelcopy) {
+                dist_t curdist = fstdistfunc_(data_point, getDataByInternalId(curr_obj), dist_func_param_);
+                for (int level = maxlevelcopy; level > elem_level; level--) {
+                    bool changed = true;
+                    while (changed) {
+                        changed = false;
+                        getConnectionsWithLock(curr_obj, level, cands);
+                        for (tableint cand : cands) {
+                            dist_t d = fstdistfunc_(data_point, getDataByInternalId(cand), dist_func_param_);
+                            if (d < curdist) {
+                                curdist = d;
+                                curr_obj = cand;
+                                changed = true;
+                            }
+                        }
+                    }
+                }
+            }
+
+            for (int level = elem_level; level >= 0; level--) {
+                auto top_candidates = searchBaseLayer(curr_obj, data_point, level);
+                std::priority_queue<std::pair<dist_t, tableint>, std::vector<std::pair<dist_t, tableint>>, CompareByFirst> filtered;
+                while (!top_candidates.empty()) {
+                    if (top_candidates.top().second != cur_c) {
+                        filtered.push(top_candidates.top());    // 不能连接到自己
+                        curr_obj = top_candidates.top().second;    // 大顶堆，最后取出的是最近的点，作为下一层的入口
+                        if (0 == level && hasNeighborLists()) {
+                            near.push_back(top_candidates.top());
+                        }
+                    }
+                    top_candidates.pop();
+                }
+
+                if (!filtered.empty()) {
+                    mutuallyConnectNewElement(data_point, cur_c, filtered, level, true);
+                }
+            }
+            markNeighborListsStale(cur_c, near);
+            data_lock_.readUnlock();
+        }
+
         std::mutex global;
         size_t ef_;
 
@@ -539,12 +1048,12 @@ namespace hnswlib {
 
             writeBinaryPOD(output, offsetLevel0_);
             writeBinaryPOD(output, max_elements_);
-            writeBinaryPOD(output, cur_element_count_);
+            writeBinaryPOD(output, cur_element_count_.load());
             writeBinaryPOD(output, size_data_per_element_);    // =152
             writeBinaryPOD(output, label_offset_);    // 这个是什么 = 148
             writeBinaryPOD(output, offsetData_);    // = 132
-            writeBinaryPOD(output, maxlevel_);
-            writeBinaryPOD(output, enterpoint_node_);
+            writeBinaryPOD(output, maxlevel_.load());
+            writeBinaryPOD(output, enterpoint_node_.load());
             writeBinaryPOD(output, maxM_);
 
             writeBinaryPOD(output, maxM0_);
@@ -555,10 +1064,12 @@ namespace hnswlib {
             writeBinaryPOD(output, normalize_);    // fj add
             ignore_word_size_ = (int)ignore_list.size();
             writeBinaryPOD(output, ignore_word_size_);    // 被忽略的词语的数量
-            writeBinaryPOD(output, placeholder_0_);
-            writeBinaryPOD(output, placeholder_1_);
-            writeBinaryPOD(output, placeholder_2_);
-            writeBinaryPOD(output, placeholder_3_);
+            writeBinaryPOD(output, model_magic_);
+            writeBinaryPOD(output, storage_type_);
+            ext_info_size_ = (int)ext_info_.size();
+            writeBinaryPOD(output, ext_info_size_);
+            int neighbor_list_size = isNeighborListsFresh() ? neighbor_list_size_ : 0;    // 有失效的列表时，不写入模型
+            writeBinaryPOD(output, neighbor_list_size);
             writeBinaryPOD(output, placeholder_4_);
             writeBinaryPOD(output, placeholder_5_);
             writeBinaryPOD(output, placeholder_6_);
@@ -578,6 +1089,12 @@ namespace hnswlib {
                 output.write(ignore_info_, ignore_word_size_ * per_index_size_);
             }
 
+            output.write(ext_info_.data(), ext_info_.size());
+            if (neighbor_list_size > 0) {
+                output.write((char *)neighbor_list_labels_.data(), neighbor_list_labels_.size() * sizeof(unsigned int));
+                output.write((char *)neighbor_list_dists_.data(), neighbor_list_dists_.size() * sizeof(dist_t));
+            }
+
             output.write(data_level0_memory_, cur_element_count_ * size_data_per_element_);
             for (size_t i = 0; i < cur_element_count_; i++) {
                 unsigned int linkListSize = element_levels_[i] > 0 ? size_links_per_element_ * element_levels_[i] : 0;
@@ -589,8 +1106,11 @@ namespace hnswlib {
             output.close();
         }
 
-        void loadIndex(const std::string &location, SpaceInterface<dist_t> *s, TrieProc* trie, size_t max_elements_i=0) {
+        void loadIndex(const std::string &location, SpaceInterface<dist_t> *s, TrieProc* trie, size_t max_elements_i=0,
+                       size_t hot_bytes=0) {
             std::ifstream input(location, std::ios::binary);
+            binary_dim_ = binary_words_ = 0;    // 二值编码不写入模型，加载后按需生成
+            hammingfunc_ = nullptr;
 
             // get file size:
             input.seekg(0,input.end);
@@ -599,7 +1119,9 @@ namespace hnswlib {
 
             readBinaryPOD(input, offsetLevel0_);
             readBinaryPOD(input, max_elements_);
-            readBinaryPOD(input, cur_element_count_);
+            size_t element_count = 0;
+            readBinaryPOD(input, element_count);
+            cur_element_count_ = element_count;
 
             size_t max_elements=max_elements_i;    // 针对默认传入的max_elements_i = 0 的情况
             if(max_elements < cur_element_count_)
@@ -608,8 +1130,12 @@ namespace hnswlib {
             readBinaryPOD(input, size_data_per_element_);
             readBinaryPOD(input, label_offset_);     // label的偏移量
             readBinaryPOD(input, offsetData_);    // 这里是260，表示数据的偏移量
-            readBinaryPOD(input, maxlevel_);
-            readBinaryPOD(input, enterpoint_node_);
+            int maxlevel = 0;
+            tableint enterpoint_node = 0;
+            readBinaryPOD(input, maxlevel);
+            readBinaryPOD(input, enterpoint_node);
+            maxlevel_ = maxlevel;
+            enterpoint_node_ = enterpoint_node;
 
             readBinaryPOD(input, maxM_);    // 16
             readBinaryPOD(input, maxM0_);    // 32
@@ -620,14 +1146,20 @@ namespace hnswlib {
             readBinaryPOD(input, normalize_);
             readBinaryPOD(input, ignore_word_size_);    // 读取被忽略词语的数量
 
-            readBinaryPOD(input, placeholder_0_);
-            readBinaryPOD(input, placeholder_1_);
-            readBinaryPOD(input, placeholder_2_);
-            readBinaryPOD(input, placeholder_3_);
+            readBinaryPOD(input, model_magic_);
+            readBinaryPOD(input, storage_type_);
+            readBinaryPOD(input, ext_info_size_);
+            readBinaryPOD(input, neighbor_list_size_);
             readBinaryPOD(input, placeholder_4_);
             readBinaryPOD(input, placeholder_5_);
             readBinaryPOD(input, placeholder_6_);
             readBinaryPOD(input, placeholder_7_);
+            if (HNSW_MODEL_MAGIC != model_magic_) {
+                // 旧版本的模型，头部的占位信息是随机值，统一按照默认值处理
+                model_magic_ = HNSW_MODEL_MAGIC;
+                storage_type_ = 0;
+                ext_info_size_ = neighbor_list_size_ = placeholder_4_ = placeholder_5_ = placeholder_6_ = placeholder_7_ = 0;
+            }
 
             readBinaryPOD(input, per_index_size_);    // 每个单词最大size
 
@@ -659,9 +1191,27 @@ namespace hnswlib {
             }
             free(ignore_word);
 
-            data_size_ = s->get_data_size();    // 这个是纯数据的大小，dim*size
+            ext_info_.resize(ext_info_size_);
+            input.read(&ext_info_[0], ext_info_size_);
+
+            neighbor_list_labels_.clear();
+            neighbor_list_dists_.clear();
+            if (neighbor_list_size_ > 0) {
+                neighbor_list_labels_.resize(cur_element_count_ * neighbor_list_size_);
+                neighbor_list_dists_.resize(cur_element_count_ * neighbor_list_size_);
+                input.read((char *)neighbor_list_labels_.data(), neighbor_list_labels_.size() * sizeof(unsigned int));
+                input.read((char *)neighbor_list_dists_.data(), neighbor_list_dists_.size() * sizeof(dist_t));
+            }
+            neighbor_list_stale_.assign(neighbor_list_size_ > 0 ? cur_element_count_.load() : 0, 0);
+            neighbor_list_stale_num_ = 0;
+
+            data_size_ = label_offset_ - offsetData_;    // 这个是纯数据的大小，以模型中的存储格式为准
             fstdistfunc_ = s->get_dist_func();
             dist_func_param_ = s->get_dist_func_param();
+            encodefunc_ = s->get_encode_func();
+            decodefunc_ = s->get_decode_func();
+            boundeddistfunc_ = s->get_bounded_dist_func(0 != normalize_);
+            batchdistfunc_ = s->get_batch_dist_func();
 
             /// Legacy, check that everything is ok
 
@@ -694,8 +1244,19 @@ namespace hnswlib {
             input.clear();
             input.seekg(pos,input.beg);
 
-            data_level0_memory_ = (char *) malloc(max_elements * size_data_per_element_);    // data_level0_memory_ 第0层总的buf的大小
-            input.read(data_level0_memory_, cur_element_count_ * size_data_per_element_);
+            hot_bytes_ = 0;
+            if (hot_bytes > 0 && CAISS_RET_OK == level0_map_.openPrivate(location, (size_t)pos,
+                                                                         cur_element_count_ * size_data_per_element_,
+                                                                         max_elements * size_data_per_element_,
+                                                                         MMAP_ADVICE_RANDOM)) {
+                // 分层模式，第0层不读入内存，由系统按需加载。映射失败的时候，按照原来的方式全部读入
+                hot_bytes_ = hot_bytes;
+                data_level0_memory_ = level0_map_.getMutableData();
+                input.seekg(cur_element_count_ * size_data_per_element_, input.cur);
+            } else {
+                data_level0_memory_ = (char *) malloc(max_elements * size_data_per_element_);    // data_level0_memory_ 第0层总的buf的大小
+                input.read(data_level0_memory_, cur_element_count_ * size_data_per_element_);
+            }
 
             if(old_index)
                 input.seekg(((max_elements_ - cur_element_count_) * size_data_per_element_), input.cur);
@@ -727,31 +1288,640 @@ namespace hnswlib {
 
             input.close();
 
+            if (0 != hot_bytes_) {
+                std::vector<std::atomic<unsigned char>>(max_elements).swap(access_counts_);
+                for (auto &count : access_counts_) {
+                    count.store(0, std::memory_order_relaxed);
+                }
+                tier_stop_ = false;
+                tier_thread_ = std::thread(&HierarchicalNSW::tierLoop, this);
+            }
+
             return;
         }
 
+        /**
+         * 记录第0层中点的访问次数，仅在分层模式下生效
+         * @param internal_id
+         */
+        inline void recordAccess(tableint internal_id) const {
+            if (0 == hot_bytes_) {
+                return;
+            }
+
+            // 不需要精确计数，并发时丢失部分计数不影响热点的判断
+            std::atomic<unsigned char> &count = access_counts_[internal_id];
+            unsigned char cur = count.load(std::memory_order_relaxed);
+            if (cur < HNSW_TIER_ACCESS_MAX) {
+                count.store(cur + 1, std::memory_order_relaxed);
+            }
+        }
+
+        /**
+         * 根据访问次数重新选择热点数据：访问最多的点所在的页锁定在内存中，
+         * 不再是热点的页解除锁定，并提示系统优先回收。锁定失败（超过RLIMIT_MEMLOCK）时只做预读
+         */
+        void migrateHotNodes() {
+            size_t count = 0;
+            {
+                std::unique_lock<std::mutex> lock(cur_element_count_guard_);
+                count = std::min(cur_element_count_.load(), access_counts_.size());
+            }
+
+            std::vector<std::pair<unsigned char, tableint>> candidates;
+            for (size_t i = 0; i < count; i++) {
+                unsigned char cur = access_counts_[i].load(std::memory_order_relaxed);
+                if (cur > 0) {
+                    candidates.emplace_back(cur, (tableint)i);
+                }
+                access_counts_[i].store(cur / 2, std::memory_order_relaxed);    // 逐步淡化之前的访问记录
+            }
+
+            size_t hotNum = hot_bytes_ / size_data_per_element_;
+            if (candidates.size() > hotNum) {
+                std::nth_element(candidates.begin(), candidates.begin() + hotNum, candidates.end(),
+                                 [](const std::pair<unsigned char, tableint> &a,
+                                    const std::pair<unsigned char, tableint> &b) {
+                                     return a.first > b.first;
+                                 });
+                candidates.resize(hotNum);
+            }
+
+            std::vector<size_t> pages;
+            for (const auto &candidate : candidates) {
+                size_t begin = candidate.second * size_data_per_element_;
+                size_t end = begin + size_data_per_element_;
+                for (size_t page = begin / MMAP_PAGE_SIZE; page * MMAP_PAGE_SIZE < end; page++) {
+                    pages.push_back(page);
+                }
+            }
+            std::sort(pages.begin(), pages.end());
+            pages.erase(std::unique(pages.begin(), pages.end()), pages.end());
+
+            std::vector<size_t> demoted;
+            std::vector<size_t> promoted;
+            std::set_difference(hot_pages_.begin(), hot_pages_.end(), pages.begin(), pages.end(),
+                                std::back_inserter(demoted));
+            std::set_difference(pages.begin(), pages.end(), hot_pages_.begin(), hot_pages_.end(),
+                                std::back_inserter(promoted));
+
+            // 先处理降级的页，再锁定新的热点页，保证两者相邻时热点页不会被解除锁定
+            forEachPageRange(demoted, [this](size_t offset, size_t length) {
+                level0_map_.unlock(offset, length);
+                level0_map_.advise(offset, length, MMAP_ADVICE_COLD);
+            });
+            forEachPageRange(promoted, [this](size_t offset, size_t length) {
+                level0_map_.advise(offset, length, MMAP_ADVICE_WILLNEED);
+                level0_map_.lock(offset, length);
+            });
+
+            hot_pages_.swap(pages);
+        }
+
+        /**
+         * 将连续的页合并成区域之后处理
+         * @param pages 从小到大排列的页号
+         * @param func 参数为区域相对于第0层起始位置的偏移和长度
+         */
+        template<typename FUNC>
+        void forEachPageRange(const std::vector<size_t> &pages, FUNC func) const {
+            size_t limit = level0_map_.getLength();
+            size_t i = 0;
+            while (i < pages.size()) {
+                size_t j = i + 1;
+                while (j < pages.size() && pages[j] == pages[j - 1] + 1) {
+                    j++;
+                }
+
+                size_t offset = pages[i] * MMAP_PAGE_SIZE;
+                size_t end = std::min((pages[j - 1] + 1) * MMAP_PAGE_SIZE, limit);
+                if (end > offset) {
+                    func(offset, end - offset);
+                }
+                i = j;
+            }
+        }
+
+        void tierLoop() {
+            std::unique_lock<std::mutex> lock(tier_lock_);
+            while (!tier_stop_) {
+                tier_cond_.wait_for(lock, std::chrono::milliseconds(HNSW_TIER_MIGRATE_INTERVAL));
+                if (tier_stop_) {
+                    break;
+                }
+
+                lock.unlock();
+                migrateHotNodes();
+                lock.lock();
+            }
+        }
+
+        /**
+         * 合入增量段中的点，调用方需要持有delta_drain_lock_
+         * 合入的过程中，点同时存在于图和增量段中（查询时以增量段为准），合入完成之后再从增量段中删除
+         */
+        void drainDeltaLocked() {
+            if (delta_begin_ >= delta_end_) {
+                return;    // 空闲时定时唤醒，不做任何申请
+            }
+
+            size_t dim = *((size_t *) dist_func_param_);
+            std::vector<float> node(dim);
+            std::string word;
+            while (delta_begin_ < delta_end_) {
+                size_t label = delta_begin_;
+                size_t slot = label % delta_capacity_;
+                unsigned int version = 0;
+                {
+                    std::lock_guard<std::mutex> lock(delta_write_lock_);    // 插入线程可能正在覆盖这个点
+                    memcpy(node.data(), &delta_nodes_[slot * dim], dim * sizeof(float));
+                    word = delta_words_[slot];
+                    version = delta_versions_[slot];
+                }
+
+                // 只有合入线程会向图中添加点，label在写入增量段的时候，就已经按照图中的点数分配好了
+                if (label != cur_element_count_ || 0 != addPoint(node.data(), label, word.c_str())) {
+                    break;
+                }
+
+                std::lock_guard<std::mutex> lock(delta_write_lock_);
+                if (version != delta_versions_[slot]) {
+                    overwriteNode(&delta_nodes_[slot * dim], word.c_str());    // 合入的过程中被覆盖过，以最新的为准
+                }
+                delta_lock_.writeLock();
+                delta_lookup_.erase(word);
+                delta_begin_++;
+                delta_lock_.writeUnlock();
+            }
+        }
+
+        void deltaLoop() {
+            std::unique_lock<std::mutex> lock(delta_thread_lock_);
+            while (!delta_stop_) {
+                delta_cond_.wait_for(lock, std::chrono::milliseconds(HNSW_DELTA_DRAIN_INTERVAL));
+                if (delta_stop_) {
+                    break;
+                }
+
+                lock.unlock();
+                drainDelta();
+                lock.lock();
+            }
+        }
+
+        void stopDeltaThread() {
+            if (!delta_thread_.joinable()) {
+                return;
+            }
+
+            {
+                std::unique_lock<std::mutex> lock(delta_thread_lock_);
+                delta_stop_ = true;
+            }
+            delta_cond_.notify_all();
+            delta_thread_.join();
+        }
+
+        void stopTierThread() {
+            if (!tier_thread_.joinable()) {
+                return;
+            }
+
+            {
+                std::unique_lock<std::mutex> lock(tier_lock_);
+                tier_stop_ = true;
+            }
+            tier_cond_.notify_all();
+            tier_thread_.join();
+        }
+
+        /**
+         * 设定增量段的容量。已有的点会先全部合入图中
+         * @param capacity 为0表示不使用增量段，插入时直接加入图中
+         */
+        void setDeltaCapacity(size_t capacity) {
+            {
+                std::lock_guard<std::mutex> drain_lock(delta_drain_lock_);
+                if (capacity == delta_capacity_) {
+                    return;
+                }
+
+                drainDeltaLocked();
+                std::lock_guard<std::mutex> lock(delta_write_lock_);
+                size_t dim = *((size_t *) dist_func_param_);
+                delta_lock_.writeLock();
+                std::vector<float>(capacity * dim).swap(delta_nodes_);
+                std::vector<char>(capacity * data_size_).swap(delta_data_);
+                std::vector<std::string>(capacity).swap(delta_words_);
+                std::vector<unsigned int>(capacity, 0).swap(delta_versions_);
+                delta_lookup_.clear();
+                delta_begin_ = cur_element_count_.load();
+                delta_end_ = delta_begin_.load();
+                delta_capacity_ = capacity;
+                delta_lock_.writeUnlock();
+            }
+
+            if (0 == capacity) {
+                stopDeltaThread();
+            } else if (!delta_thread_.joinable()) {
+                delta_stop_ = false;
+                delta_thread_ = std::thread(&HierarchicalNSW::deltaLoop, this);
+            }
+        }
+
+        inline size_t getDeltaSize() const {
+            return delta_end_ - delta_begin_;
+        }
+
+        /**
+         * 插入到增量段中。词语已经存在的时候，覆盖原来的向量
+         * @param node 原始向量（已经归一化和投影）
+         * @param word
+         * @param overwrite 为false的时候，词语已经存在则直接返回
+         * @return 0表示成功，-9表示超过模型的最大尺寸，-10表示词语过长
+         */
+        int insertDelta(void *node, const char *word, bool overwrite) {
+            if (nullptr == node || nullptr == word) {
+                return -2;
+            }
+            if (strlen(word) > per_index_size_) {
+                return -10;
+            }
+            if (getDeltaSize() >= delta_capacity_) {
+                drainDelta();    // 增量段满了，由插入线程自己合入，避免无限制的堆积
+            }
+
+            std::lock_guard<std::mutex> lock(delta_write_lock_);
+            int label = findWordLabel(word);
+            if (-1 != label && !overwrite) {
+                return 0;
+            }
+            if (-1 != label && (size_t)label < delta_begin_) {
+                return overwriteNode(node, word);    // 已经合入图中，直接覆盖
+            }
+
+            size_t cur = (-1 != label) ? (size_t)label : delta_end_.load();
+            if (-1 == label && (getDeltaSize() >= delta_capacity_ || cur >= max_elements_)) {
+                return -9;
+            }
+
+            size_t dim = *((size_t *) dist_func_param_);
+            size_t slot = cur % delta_capacity_;
+            std::vector<char> buffer;
+            const void *data = encodeData(node, buffer);
+            delta_lock_.writeLock();
+            memcpy(&delta_nodes_[slot * dim], node, dim * sizeof(float));
+            memcpy(&delta_data_[slot * data_size_], data, data_size_);
+            delta_versions_[slot]++;    // 正在合入的点被覆盖时，合入线程据此重新写入图中
+            if (-1 == label) {
+                delta_words_[slot].assign(word);
+                delta_lookup_[delta_words_[slot]] = cur;
+                delta_end_++;
+            }
+            delta_lock_.writeUnlock();    // 增量段中的点不在近邻列表中，查询时跟列表的结果合并，合入图中的时候再标记受影响的列表
+
+            if (getDeltaSize() * 2 >= delta_capacity_) {
+                delta_cond_.notify_one();    // 增量段过半，提前合入
+            }
+            return 0;
+        }
+
+        /**
+         * 在增量段中逐个计算距离，将最近的k个点写入results中
+         * @param query 未编码的查询向量
+         * @param k
+         * @param buffer 编码之后的查询向量的存放位置
+         * @param results 需要为空，查询完毕后为大顶堆
+         * @param begin 查询时增量段中的label范围，图中结果的label在[begin, end)之间的，跟增量段中的重复
+         * @param end
+         */
+        void searchDelta(const void *query, size_t k, std::vector<char> &buffer,
+                         std::priority_queue<std::pair<dist_t, labeltype>> &results, size_t &begin, size_t &end) const {
+            const void *query_data = encodeData(query, buffer);
+            delta_lock_.readLock();
+            begin = delta_begin_;
+            end = delta_end_;
+            for (size_t label = begin; label < end; label++) {
+                const char *data = delta_data_.data() + (label % delta_capacity_) * data_size_;
+                dist_t dist = fstdistfunc_(query_data, data, dist_func_param_);
+                if (results.size() < k || dist < results.top().first) {
+                    results.emplace(dist, (labeltype)label);
+                    if (results.size() > k) {
+                        results.pop();
+                    }
+                }
+            }
+            delta_lock_.readUnlock();
+        }
+
+        /**
+         * 将增量段中的点，按照插入的顺序全部合入图中
+         */
+        void drainDelta() {
+            std::lock_guard<std::mutex> drain_lock(delta_drain_lock_);
+            drainDeltaLocked();
+        }
+
+        /**
+         * 多个线程并行添加点，label跟点在图中的位置一致。增量段中的点会先合入，添加完毕后增量段从新的位置开始
+         * @param nodes 已经归一化和投影的向量
+         * @param indexes 跟nodes一一对应的词语，需要是图和增量段中都没有的
+         * @param thread_num 为0表示根据cpu核数决定
+         * @return 0表示成功，-1表示增量段中的点没有全部合入，-9表示超过模型的最大尺寸，-10表示词语过长
+         */
+        int addPoints(const std::vector<const void *> &nodes, const std::vector<const char *> &indexes,
+                      size_t thread_num = 0) {
+            if (nodes.size() != indexes.size()) {
+                return -2;
+            }
+
+            std::lock_guard<std::mutex> drain_lock(delta_drain_lock_);
+            drainDeltaLocked();    // 保证增量段中预留的label，跟之后图中点的位置不冲突（合入时内部会加delta_write_lock_）
+            if (0 != getDeltaSize()) {
+                return -1;    // 合入失败的点仍然保留在增量段中，不能被新的点覆盖
+            }
+            if (cur_element_count_ + nodes.size() > max_elements_) {
+                return -9;
+            }
+
+            if (0 == thread_num) {
+                thread_num = std::max(std::thread::hardware_concurrency(), 1u);
+            }
+            thread_num = std::max(std::min(thread_num, nodes.size()), (size_t)1);
+
+            std::atomic<size_t> next_id(0);
+            std::atomic<int> result(0);
+            auto worker = [&]() {
+                size_t id = 0;
+                while ((id = next_id.fetch_add(1)) < nodes.size()) {
+                    int ret = addPoint((void *)nodes[id], HNSW_AUTO_LABEL, indexes[id], -1);
+                    if (0 != ret) {
+                        result = ret;
+                        next_id = nodes.size();    // 有失败的时候，其他线程也不再添加
+                    }
+                }
+            };
+
+            std::vector<std::thread> threads;
+            for (size_t i = 1; i < thread_num; i++) {
+                threads.emplace_back(worker);
+            }
+            worker();    // 当前线程也参与添加
+            for (auto &t : threads) {
+                t.join();
+            }
+
+            delta_lock_.writeLock();
+            delta_begin_ = cur_element_count_.load();
+            delta_end_ = delta_begin_.load();
+            delta_lock_.writeUnlock();
+            return result;
+        }
+
+        /**
+         * 多个线程并行给向量被覆盖过的点重新建立连接
+         * @param ids
+         * @param thread_num 为0表示根据cpu核数决定
+         */
+        void repairPoints(const std::vector<tableint> &ids, size_t thread_num = 0) {
+            if (0 == thread_num) {
+                thread_num = std::max(std::thread::hardware_concurrency(), 1u);
+            }
+            thread_num = std::max(std::min(thread_num, ids.size()), (size_t)1);
+
+            std::atomic<size_t> next_id(0);
+            auto worker = [&]() {
+                size_t id = 0;
+                while ((id = next_id.fetch_add(1)) < ids.size()) {
+                    repairConnections(ids[id]);
+                }
+            };
+
+            std::vector<std::thread> threads;
+            for (size_t i = 1; i < thread_num; i++) {
+                threads.emplace_back(worker);
+            }
+            worker();
+            for (auto &t : threads) {
+                t.join();
+            }
+        }
+
+        /**
+         * 物化每个点的近邻列表（包含该点自身），多个线程并行查询
+         * @param list_size 每个点保存的近邻个数（包含该点自身）
+         * @param search_k 查询时的候选个数，结果跟searchKnn(query, search_k)的前list_size个一致
+         * @param thread_num 为0表示根据cpu核数决定
+         */
+        void buildNeighborLists(size_t list_size, size_t search_k, size_t thread_num = 0) {
+            clearNeighborLists();
+            if (0 == list_size || 0 == cur_element_count_) {
+                return;
+            }
+
+            search_k = std::max(search_k, list_size);
+            std::vector<unsigned int> labels(cur_element_count_ * list_size, NEIGHBOR_LIST_EMPTY_LABEL);
+            std::vector<dist_t> dists(cur_element_count_ * list_size, std::numeric_limits<dist_t>::max());
+            if (0 == thread_num) {
+                thread_num = std::max(std::thread::hardware_concurrency(), 1u);
+            }
+            thread_num = std::max(std::min(thread_num, cur_element_count_.load()), (size_t)1);
+
+            std::atomic<size_t> next_id(0);
+            auto worker = [&]() {
+                size_t id = 0;
+                while ((id = next_id.fetch_add(1)) < cur_element_count_) {
+                    auto query = getDataByLabel<float>(getExternalLabel((tableint)id));    // 按照float查询，跟上层传入的query一致
+                    auto result = searchKnn(query.data(), search_k);
+                    while (result.size() > list_size) {
+                        result.pop();
+                    }
+                    for (size_t pos = result.size(); pos > 0; pos--) {    // 大顶堆，从后往前填充
+                        labels[id * list_size + pos - 1] = (unsigned int)result.top().second;
+                        dists[id * list_size + pos - 1] = result.top().first;
+                        result.pop();
+                    }
+                }
+            };
+
+            std::vector<std::thread> threads;
+            for (size_t i = 1; i < thread_num; i++) {
+                threads.emplace_back(worker);
+            }
+            worker();    // 当前线程也参与计算
+            for (auto &t : threads) {
+                t.join();
+            }
+
+            neighbor_list_labels_.swap(labels);
+            neighbor_list_dists_.swap(dists);
+            neighbor_list_stale_.assign(cur_element_count_, 0);
+            neighbor_list_stale_num_ = 0;
+            neighbor_list_size_ = (int)list_size;
+        }
+
+        /**
+         * 获取label对应的点物化的近邻列表
+         * @param label
+         * @param topK
+         * @param result 列表中的全部有效近邻（大顶堆）
+         * @return 没有近邻列表、列表已经失效，或者topK超过列表长度的时候，返回false
+         */
+        bool getNeighborList(labeltype label, size_t topK,
+                             std::priority_queue<std::pair<dist_t, labeltype>> &result) const {
+            if (!hasNeighborLists() || topK > (size_t)neighbor_list_size_) {
+                return false;
+            }
+
+            lookup_lock_.readLock();
+            auto cur = label_lookup_.find(label);
+            bool found = (cur != label_lookup_.end() && hasNeighborLists()    // 加锁之前，列表可能刚被清空
+                          && cur->second < neighbor_list_stale_.size()    // 物化之后新加入的点没有列表
+                          && 0 == neighbor_list_stale_[cur->second]);
+            if (found) {
+                size_t begin = (size_t)cur->second * neighbor_list_size_;
+                for (size_t i = begin; i < begin + neighbor_list_size_; i++) {
+                    if (NEIGHBOR_LIST_EMPTY_LABEL == neighbor_list_labels_[i]) {
+                        break;
+                    }
+                    result.emplace(neighbor_list_dists_[i], (labeltype)neighbor_list_labels_[i]);
+                }
+            }
+            lookup_lock_.readUnlock();
+            return found;
+        }
+
+        inline bool hasNeighborLists() const {
+            return neighbor_list_size_ > 0 && !neighbor_list_labels_.empty();
+        }
+
+        /**
+         * 模型中的每个点都有列表，并且没有失效的列表
+         */
+        inline bool isNeighborListsFresh() const {
+            return hasNeighborLists() && 0 == neighbor_list_stale_num_
+                   && neighbor_list_stale_.size() == cur_element_count_;
+        }
+
+        /**
+         * 清空近邻列表。列表长度保留，上层可以据此重新物化
+         */
+        inline void clearNeighborLists() {
+            if (!neighbor_list_labels_.empty()) {
+                lookup_lock_.writeLock();    // 可能有查询正在读取列表
+                std::vector<unsigned int>().swap(neighbor_list_labels_);
+                std::vector<dist_t>().swap(neighbor_list_dists_);
+                std::vector<unsigned char>().swap(neighbor_list_stale_);
+                neighbor_list_stale_num_ = 0;
+                lookup_lock_.writeUnlock();
+            }
+        }
+
+        /**
+         * 点加入图中（或者向量被覆盖）之后，将可能受影响的近邻列表标记为失效，其他的列表仍然可以使用
+         * 不额外查询，只检查建立连接时在第0层已经找到的点（最多ef_construction个）：
+         * 列表中包含这个点、列表没填满或者最远的距离大于跟这个点之间距离的，标记为失效。跟物化列表一样是近似的结果
+         * @param cur_c 加入（或者覆盖）的点，它自己的列表也标记为失效
+         * @param near 第0层找到的点，以及跟cur_c之间的距离
+         */
+        void markNeighborListsStale(tableint cur_c, const std::vector<std::pair<dist_t, tableint>> &near) {
+            if (!hasNeighborLists()) {
+                return;
+            }
+
+            labeltype label = getExternalLabel(cur_c);
+            size_t list_size = neighbor_list_size_;
+            lookup_lock_.writeLock();
+            auto markStale = [&](tableint id, dist_t dist, bool force) {
+                if (id >= neighbor_list_stale_.size() || 0 != neighbor_list_stale_[id]) {
+                    return;    // 物化之后新加入的点没有列表
+                }
+
+                size_t begin = (size_t)id * list_size;
+                size_t last = begin + list_size - 1;
+                bool stale = force || NEIGHBOR_LIST_EMPTY_LABEL == neighbor_list_labels_[last]
+                             || dist < neighbor_list_dists_[last];
+                for (size_t i = begin; !stale && i <= last; i++) {
+                    stale = ((labeltype)neighbor_list_labels_[i] == label);
+                }
+                if (stale) {
+                    neighbor_list_stale_[id] = 1;
+                    neighbor_list_stale_num_++;
+                }
+            };
+
+            markStale(cur_c, 0, true);
+            for (const auto &cur : near) {
+                markStale(cur.second, cur.first, false);
+            }
+            lookup_lock_.writeUnlock();
+        }
+
         template<typename data_t>
         std::vector<data_t> getDataByLabel(labeltype label)
+        {
+          std::vector<data_t> data;
+          getDataByLabel(label, data);
+          return data;
+        }
+
+        /**
+         * 获取label对应的向量，写入data中（data已经申请的内存可以重复使用）
+         */
+        template<typename data_t>
+        void getDataByLabel(labeltype label, std::vector<data_t> &data)
         {
           tableint label_c;
+          lookup_lock_.readLock();
           auto search = label_lookup_.find(label);
-          if (search == label_lookup_.end()) {
-              throw std::runtime_error("Label not found");
+          bool found = (search != label_lookup_.end());
+          label_c = found ? search->second : 0;
+          lookup_lock_.readUnlock();
+          if (!found) {
+              if (!getDeltaDataByLabel(label, data)) {
+                  throw std::runtime_error("Label not found");
+              }
+              return;
           }
-          label_c = search->second;
 
           char* data_ptrv = getDataByInternalId(label_c);
           size_t dim = *((size_t *) dist_func_param_);
-          std::vector<data_t> data;
-          data_t* data_ptr = (data_t*) data_ptrv;
-          for (int i = 0; i < dim; i++) {
-            data.push_back(*data_ptr);
-            data_ptr += 1;
+          data.resize(dim);
+          data_lock_.readLock();
+          if (nullptr != decodefunc_) {
+              decodefunc_(data_ptrv, data.data(), dist_func_param_);    // 半精度等存储格式，需要先还原成float信息
+          } else {
+              data_t* data_ptr = (data_t*) data_ptrv;
+              data.assign(data_ptr, data_ptr + dim);
           }
-          return data;
+          data_lock_.readUnlock();
+        }
+
+        /**
+         * 获取增量段中label对应的向量
+         * @return 不在增量段中的时候，返回false
+         */
+        template<typename data_t>
+        bool getDeltaDataByLabel(labeltype label, std::vector<data_t> &data) const {
+            size_t dim = *((size_t *) dist_func_param_);
+            delta_lock_.readLock();
+            bool found = (label >= delta_begin_ && label < delta_end_);
+            if (found) {
+                const float *node = &delta_nodes_[(label % delta_capacity_) * dim];
+                data.assign(node, node + dim);
+            }
+            delta_lock_.readUnlock();
+            return found;
         }
 
-        int overwriteNode(void *node, const char *index) {
+        /**
+         * 覆盖词语对应的向量
+         * @param node
+         * @param index
+         * @param repair 是否立即重新建立连接。为false的时候，需要之后调用repairPoints
+         * @return
+         */
+        int overwriteNode(void *node, const char *index, bool repair = true) {
             // 重新写入node信息
             if (nullptr == node || nullptr == index) {
                 return -2;
@@ -762,19 +1932,24 @@ namespace hnswlib {
                 return -10;
             }
 
-            labeltype label = (labeltype)index_lookup_.right.find(index)->second;
-
+            int found = findWordLabel(index);
+            if (-1 == found) {
+                return -2;
+            }
+            labeltype label = (labeltype)found;
+            std::vector<char> buffer;
+            const void *data = encodeData(node, buffer);    // 先在加锁之前完成编码，写锁内只做拷贝
             char *buff = this->getDataByInternalId(label);    // 这里的label传入的值，不会超过real_count的大小
-            memset(buff, 0, this->data_size_);
-            memcpy(buff, node, this->data_size_);    // 更新node的内容
-
-            memset(this->index_ptr_ + label * per_index_size_, 0, per_index_size_);
-            memcpy(this->index_ptr_ + label * per_index_size_, index, len);    // 更新index对应的内容
-
-            index_lookup_.left.erase(label);
-            index_lookup_.insert(BOOST_BIMAP::value_type(label, std::string(index)));
+            data_lock_.writeLock();    // 查询和建图的时候，不能读到写了一半的向量
+            memcpy(buff, data, this->data_size_);    // 更新node的内容
+            updateBinaryCode((tableint)label, node);
+            data_lock_.writeUnlock();
+            markNeighborListsStale((tableint)label, {});    // 自己的列表立即失效，新旧位置附近的列表在重新建立连接时标记
+            if (repair) {
+                repairConnections((tableint)label);    // 原来的连接是按照旧的向量建立的，需要重新建立
+            }
 
-            return 0;
+            return 0;    // 词语和label的对应关系不变，index_ptr_和index_lookup_都无需修改
         }
 
         /**
@@ -782,66 +1957,121 @@ namespace hnswlib {
          * @param word
          * @return
          */
-        int findWordLabel(const char *word) {
+        int findWordLabel(const char *word) const {
             int label = -1;    // 默认，没找到就是返回-1
+            lookup_lock_.readLock();
             auto result = index_lookup_.right.find(std::string(word));
             if (result != index_lookup_.right.end()) {
                 label = (int)result->second;    // 如果查到了，就把对应的标签给出去
             }
+            lookup_lock_.readUnlock();
+            if (-1 != label || 0 == delta_capacity_) {
+                return label;
+            }
 
+            delta_lock_.readLock();    // 图中没有的话，再查增量段
+            auto cur = delta_lookup_.find(std::string(word));
+            if (cur != delta_lookup_.end()) {
+                label = (int)cur->second;
+            }
+            delta_lock_.readUnlock();
             return label;
         }
 
+        /**
+         * 根据label获取对应的词语（图或者增量段中）。合入的时候，增量段中的词语会被删除，故拷贝一份出去
+         * @param label
+         * @param word 已经申请的内存可以重复使用
+         * @return 是否找到
+         */
+        bool getWordByLabel(labeltype label, std::string &word) const {
+            lookup_lock_.readLock();
+            auto cur = index_lookup_.left.find(label);
+            bool found = (cur != index_lookup_.left.end());
+            if (found) {
+                word.assign(cur->second);
+            }
+            lookup_lock_.readUnlock();
+            if (found || 0 == delta_capacity_) {
+                return found;
+            }
+
+            delta_lock_.readLock();
+            found = (label >= delta_begin_ && label < delta_end_);
+            if (found) {
+                word.assign(delta_words_[label % delta_capacity_]);
+            }
+            delta_lock_.readUnlock();
+            return found;
+        }
+
 
         int addPoint(void *data_point, labeltype label, const char *index) {
            int ret = addPoint(data_point, label, index, -1);
            return ret;
         }
 
-        int addPoint(void *data_point, labeltype label, const char* index, int level) {
+        int addPoint(void *node, labeltype label, const char* index, int level) {
+            data_lock_.readLock();    // 建图的时候需要读取已有点的向量，不能跟覆盖同时进行
+            int ret = addPointLocked(node, label, index, level);
+            data_lock_.readUnlock();
+            return ret;
+        }
+
+        /**
+         * 将点加入图中，调用方需要持有data_lock_的读锁
+         */
+        int addPointLocked(void *node, labeltype label, const char* index, int level) {
             // 函数的ret值，是当前的个数
             if (index == nullptr || strlen(index) > per_index_size_) {
                 return -10;
             }
 
+            std::vector<char> buffer;
+            const void *data_point = encodeData(node, buffer);    // 之后的流程，均使用存储格式的数据
+
             tableint cur_c = 0;
+            int curlevel = 0;
             {
                 std::unique_lock <std::mutex> lock(cur_element_count_guard_);
                 if (cur_element_count_ >= max_elements_) {
                     return -9;    // 有超过最大限制的话，就返回-9
                 };
                 cur_c = cur_element_count_;    // 如果当前是0，则保存
+                if (HNSW_AUTO_LABEL == label) {
+                    label = cur_c;
+                }
+                curlevel = (level > 0) ? level : getRandomLevel(mult_);
+                element_levels_[cur_c] = curlevel;
+
+                memset(data_level0_memory_ + cur_c * size_data_per_element_ + offsetLevel0_, 0, size_data_per_element_);
+                // Initialisation of the data and label
+                memcpy(getExternalLabeLp(cur_c), &label, sizeof(labeltype));
+                memcpy(getDataByInternalId(cur_c), data_point, data_size_);
+                updateBinaryCode(cur_c, node);
+                if (curlevel) {
+                    linkLists_[cur_c] = (char *) malloc(size_links_per_element_ * curlevel + 1);
+                    memset(linkLists_[cur_c], 0, size_links_per_element_ * curlevel + 1);
+                }
 
-                memset(index_ptr_ + cur_element_count_ * per_index_size_, 0, per_index_size_);
+                memset(index_ptr_ + cur_c * per_index_size_, 0, per_index_size_);
                 // add的时候，添加的内容，需要双向添加<label,index>，例子：<1, hello>
-                memcpy(index_ptr_ + cur_element_count_ * per_index_size_, index, strlen(index));
+                memcpy(index_ptr_ + cur_c * per_index_size_, index, strlen(index));
+                lookup_lock_.writeLock();
                 index_lookup_.insert(BOOST_BIMAP::value_type(label, std::string(index)));
-
                 label_lookup_[label] = cur_c;  // expected unique, if not will overwrite
-                cur_element_count_++;
+                lookup_lock_.writeUnlock();
+
+                // 点的信息全部写入之后再增加个数。之后才会连接到图中，查询时能走到的点都是完整的
+                cur_element_count_.store(cur_c + 1, std::memory_order_release);
             }
 
             std::unique_lock <std::mutex> lock_el(link_list_locks_[cur_c]);
-            int curlevel = getRandomLevel(mult_);
-            if (level > 0)
-                curlevel = level;
-
-            element_levels_[cur_c] = curlevel;
             std::unique_lock <std::mutex> templock(global);
             int maxlevelcopy = maxlevel_;
             if (curlevel <= maxlevelcopy)
                 templock.unlock();
             tableint currObj = enterpoint_node_;
-
-            memset(data_level0_memory_ + cur_c * size_data_per_element_ + offsetLevel0_, 0, size_data_per_element_);
-            // Initialisation of the data and label
-            memcpy(getExternalLabeLp(cur_c), &label, sizeof(labeltype));
-            memcpy(getDataByInternalId(cur_c), data_point, data_size_);
-
-            if (curlevel) {
-                linkLists_[cur_c] = (char *) malloc(size_links_per_element_ * curlevel + 1);
-                memset(linkLists_[cur_c], 0, size_links_per_element_ * curlevel + 1);
-            }
             if ((signed)currObj != -1) {
                 if (curlevel < maxlevelcopy) {
                     dist_t curdist = fstdistfunc_(data_point, getDataByInternalId(currObj), dist_func_param_);
@@ -875,6 +2105,16 @@ namespace hnswlib {
                     }
                     std::priority_queue<std::pair<dist_t, tableint>, std::vector<std::pair<dist_t, tableint>>, CompareByFirst> top_candidates = searchBaseLayer(
                             currObj, data_point, level);
+                    if (0 == level && hasNeighborLists()) {
+                        std::vector<std::pair<dist_t, tableint>> near;    // 连接之前先取出候选点，用于标记受影响的近邻列表
+                        near.reserve(top_candidates.size());
+                        auto candidates = top_candidates;
+                        while (!candidates.empty()) {
+                            near.push_back(candidates.top());
+                            candidates.pop();
+                        }
+                        markNeighborListsStale(cur_c, near);
+                    }
                     mutuallyConnectNewElement(data_point, cur_c, top_candidates, level);
                 }
             } else {
@@ -885,7 +2125,7 @@ namespace hnswlib {
 
             //Releasing lock for the maximum level
             if (curlevel > maxlevelcopy) {
-                enterpoint_node_ = cur_c;
+                enterpoint_node_ = cur_c;    // 先更新入口点再更新层数，查询时先读层数，读到的入口点一定有足够的层数
                 maxlevel_ = curlevel;
             }
 
@@ -893,15 +2133,38 @@ namespace hnswlib {
             //return cur_c;
         };
 
-        std::priority_queue<std::pair<dist_t, labeltype > > searchKnn(const void *query_data, size_t k) const {
+        std::priority_queue<std::pair<dist_t, labeltype > > searchKnn(const void *query, size_t k) const {
+            SearchScratch scratch;
+            std::priority_queue<std::pair<dist_t, labeltype>> results;
+            searchKnn(query, k, scratch, results);
+            return results;
+        }
+
+        /**
+         * 查询最近的k个点，查询过程中的临时信息保存在scratch中
+         * @param query
+         * @param k
+         * @param scratch
+         * @param results 需要为空，查询完毕后为大顶堆
+         */
+        void searchKnn(const void *query, size_t k, SearchScratch &scratch,
+                       std::priority_queue<std::pair<dist_t, labeltype>> &results) const {
+            const void *query_data = encodeData(query, scratch.buffer);
+            int maxlevel = maxlevel_;    // 先读层数，再读入口点（跟插入时的更新顺序相反）
             tableint currObj = enterpoint_node_;    // 进入点，是一个随机值，相当于最上层的入口点
-            dist_t curdist = fstdistfunc_(query_data, getDataByInternalId(enterpoint_node_), dist_func_param_);    // 计算入口点和查询点的距离
+            if ((signed)currObj == -1) {
+                return;    // 还没有插入任何点
+            }
+
+            data_lock_.readLock();    // 覆盖向量的时候，需要等待正在进行的查询结束
+            dist_t curdist = fstdistfunc_(query_data, getDataByInternalId(currObj), dist_func_param_);    // 计算入口点和查询点的距离
 
-            for (int level = maxlevel_; level > 0; level--) {
+            for (int level = maxlevel; level > 0; level--) {
                 bool changed = true;
                 while (changed) {
                     changed = false;
                     int *data;
+                    std::unique_lock<std::mutex> lock(link_list_locks_[currObj]);
                     data = (int *) (linkLists_[currObj] + (level - 1) * size_links_per_element_);
                     int size = *data;    // 这个size表示，currObj在当前level，有size个邻居
                     tableint *datal = (tableint *) (data + 1);    // 其中，*data的[0]表示有多少个邻居，后面的数字，表示具体的邻居的index信息。
@@ -920,9 +2183,22 @@ namespace hnswlib {
                 }
             }
 
-            std::priority_queue<std::pair<dist_t, tableint>, std::vector<std::pair<dist_t, tableint>>, CompareByFirst> top_candidates = searchBaseLayerST(
-                    currObj, query_data, std::max(ef_,k));    // 在最低层查询信息
-            std::priority_queue<std::pair<dist_t, labeltype> > results;
+            SEARCH_HEAP &top_candidates = scratch.top_candidates;
+            if (0 != binary_dim_) {
+                top_candidates.clear();
+                // 开启二值粗筛的时候，先按照汉明距离在最低层遍历，再对ef个候选点按照真实距离重新排序
+                scratch.query_code.resize(binary_words_);
+                BinaryEncode((const float *)query, binary_mean_.data(), binary_dim_, scratch.query_code.data());
+                SEARCH_HEAP &binary_candidates = scratch.binary_candidates;
+                searchBaseLayerBinaryST(currObj, scratch.query_code.data(), std::max(ef_, k), binary_candidates, scratch.candidate_set);
+                while (!binary_candidates.empty()) {
+                    tableint id = binary_candidates.top().second;
+                    binary_candidates.pop();
+                    top_candidates.emplace(fstdistfunc_(query_data, getDataByInternalId(id), dist_func_param_), id);
+                }
+            } else {
+                searchBaseLayerST(currObj, query_data, std::max(ef_, k), scratch);    // 在最低层查询信息
+            }
             while (top_candidates.size() > k) {    // 这里的top_candidates已经是最近的ef—search个节点了，但是只需要找k个点，所以把不需要的给pop掉
                 top_candidates.pop();
             }
@@ -931,24 +2207,112 @@ namespace hnswlib {
                 results.push(std::pair<dist_t, labeltype>(rez.first, getExternalLabel(rez.second)));    // rez.first是距离信息，rez.second是index对应的信息，这里，index和label相同。我们通过label去找word信息
                 top_candidates.pop();
             }
-            return results;
+            data_lock_.readUnlock();
         };
 
 
-        std::priority_queue<std::pair<dist_t, labeltype>> forceLoop(const void *query_data, size_t topK) {
-            // 暴力查找最近的topK个信息
+        /**
+         * 暴力查找最近的topK个信息。数据按照FORCE_LOOP_BLOCK_SIZE分块，由多个线程依次领取处理，
+         * 每个线程维护自己的topK结果，最后合并
+         * @param query
+         * @param topK
+         * @param thread_num 为0表示根据cpu核数和数据量自动决定
+         * @return
+         */
+        std::priority_queue<std::pair<dist_t, labeltype>> forceLoop(const void *query, size_t topK, size_t thread_num = 0) const {
+            std::vector<char> buffer;
+            const void *query_data = encodeData(query, buffer);
+            size_t block_num = (cur_element_count_ + FORCE_LOOP_BLOCK_SIZE - 1) / FORCE_LOOP_BLOCK_SIZE;
+            if (0 == thread_num) {
+                thread_num = std::min((size_t)std::max(std::thread::hardware_concurrency(), 1u), FORCE_LOOP_MAX_THREAD_NUM);
+                thread_num = std::min(thread_num, cur_element_count_ / FORCE_LOOP_MIN_THREAD_SIZE);    // 数据量少的时候，开线程不划算
+            }
+            thread_num = std::max(std::min(thread_num, block_num), (size_t)1);
+
+            std::atomic<size_t> next_block(0);
+            std::vector<std::vector<std::pair<dist_t, labeltype>>> heaps(thread_num);
+            auto worker = [&](size_t thread_id) {
+                forceLoopWorker(query_data, topK, next_block, block_num, heaps[thread_id]);
+            };
+
+            data_lock_.readLock();    // 工作线程读取的向量，由当前线程统一加锁保护
+            std::vector<std::thread> threads;
+            for (size_t i = 1; i < thread_num; i++) {
+                threads.emplace_back(worker, i);
+            }
+            worker(0);    // 当前线程也参与计算
+            for (auto &t : threads) {
+                t.join();
+            }
+            data_lock_.readUnlock();
+
             std::priority_queue<std::pair<dist_t, labeltype>> results;
-            for (unsigned int i = 0; i < cur_element_count_; ++i) {
-                float dist = fstdistfunc_(query_data, getDataByInternalId(i), dist_func_param_);
-                results.push(std::pair<dist_t, labeltype>(dist, i));
-                if (results.size() > topK) {
-                    results.pop();
+            for (const auto &heap : heaps) {
+                for (const auto &cur : heap) {
+                    if (results.size() < topK || cur.first < results.top().first) {
+                        results.push(cur);
+                        if (results.size() > topK) {
+                            results.pop();
+                        }
+                    }
                 }
             }
 
             return results;
         }
 
+        /**
+         * 暴力查询时，单个线程的执行逻辑。领取数据块，计算距离，并将结果维护在heap（大顶堆）中
+         * @param query_data
+         * @param topK
+         * @param next_block 下一个待处理的数据块
+         * @param block_num
+         * @param heap
+         */
+        void forceLoopWorker(const void *query_data, size_t topK, std::atomic<size_t> &next_block, size_t block_num,
+                             std::vector<std::pair<dist_t, labeltype>> &heap) const {
+            std::vector<const void *> datas(FORCE_LOOP_BLOCK_SIZE);
+            std::vector<dist_t> dists(FORCE_LOOP_BLOCK_SIZE);
+            heap.reserve(topK + 1);
+            dist_t threshold = std::numeric_limits<dist_t>::max();    // 堆满之后，只有小于堆顶的距离，才需要入堆
+
+            size_t block = 0;
+            while ((block = next_block.fetch_add(1)) < block_num) {
+                size_t begin = block * FORCE_LOOP_BLOCK_SIZE;
+                size_t num = std::min(FORCE_LOOP_BLOCK_SIZE, cur_element_count_ - begin);
+                if (nullptr != batchdistfunc_) {
+                    for (size_t k = 0; k < num; k++) {
+                        datas[k] = getDataByInternalId(begin + k);
+                    }
+                    batchdistfunc_(query_data, datas.data(), (unsigned int)num, dists.data(), dist_func_param_);
+                } else {
+                    for (size_t k = 0; k < num; k++) {
+        #ifdef USE_SSE
+                        if (k + 1 < num) {
+                            _mm_prefetch(getDataByInternalId(begin + k + 1), _MM_HINT_T0);
+                        }
+        #endif
+                        dists[k] = calcCandidateDist(query_data, getDataByInternalId(begin + k), threshold, heap.size() >= topK);
+                    }
+                }
+
+                for (size_t k = 0; k < num; k++) {
+                    if (dists[k] >= threshold) {
+                        continue;
+                    }
+                    heap.emplace_back(dists[k], begin + k);
+                    std::push_heap(heap.begin(), heap.end());
+                    if (heap.size() > topK) {
+                        std::pop_heap(heap.begin(), heap.end());
+                        heap.pop_back();
+                    }
+                    if (heap.size() >= topK) {
+                        threshold = heap.front().first;
+                    }
+                }
+            }
+        }
+
 
     };
 
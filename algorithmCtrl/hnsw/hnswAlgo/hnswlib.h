@@ -26,6 +26,8 @@
 
 #include <iostream>
 #include <queue>
+#include <algorithm>
+#include <cmath>
 #include <list>
 
 #include <string.h>
@@ -49,6 +51,17 @@ namespace hnswlib {
     template<typename MTYPE>
     using DISTFUNC = MTYPE(*)(const void *, const void *, const void *);
 
+    /* 带上界的距离计算函数，第4个参数为上界。计算过程中一旦确定结果大于上界，则提前返回一个大于上界的值 */
+    template<typename MTYPE>
+    using BOUNDEDDISTFUNC = MTYPE(*)(const void *, const void *, const void *, MTYPE);
+
+    /* 批量距离计算函数，参数依次为：查询向量、候选向量数组、候选个数、距离结果、维度信息 */
+    template<typename MTYPE>
+    using BATCHDISTFUNC = void(*)(const void *, const void **, unsigned int, MTYPE *, const void *);
+
+    /* 向量存储格式转换函数，参数依次为：源数据、目标数据、维度信息 */
+    typedef void (*CODECFUNC)(const void *, void *, const void *);
+
 
     template<typename MTYPE>
     class SpaceInterface {
@@ -62,6 +75,37 @@ namespace hnswlib {
 
         virtual void *get_dist_func_param() = 0;
 
+        /* 以下为存储格式相关接口，默认为float32原样存储，不需要转换 */
+        virtual CODECFUNC get_encode_func() {
+            return nullptr;    // float32 -> 存储格式
+        }
+
+        virtual CODECFUNC get_decode_func() {
+            return nullptr;    // 存储格式 -> float32
+        }
+
+        virtual int get_storage_type() {
+            return 0;    // 取值与CAISS_STORAGE_TYPE保持一致
+        }
+
+        /**
+         * 获取带上界的距离计算函数（用于查询过程中，提前放弃不可能进入结果集的点）
+         * @param normalized 模型中的向量是否已经归一化
+         * @return 不支持的时候，返回nullptr
+         */
+        virtual BOUNDEDDISTFUNC<MTYPE> get_bounded_dist_func(bool normalized) {
+            return nullptr;
+        }
+
+        /* 批量距离计算函数，仅在自定义距离的时候有效 */
+        virtual BATCHDISTFUNC<MTYPE> get_batch_dist_func() {
+            return nullptr;
+        }
+
+        virtual void set_batch_dist_func(BATCHDISTFUNC<MTYPE> batch_dist_func) {
+            return;
+        }
+
         virtual ~SpaceInterface() {}
     };
 
@@ -80,5 +124,7 @@ namespace hnswlib {
 #include "space_ip.h"
 #include "space_jaccard.h"
 #include "space_edition.h"
+#include "space_half.h"
+#include "space_binary.h"
 #include "bruteforce.h"
 #include "hnswalg.h"
@@ -0,0 +1,90 @@
+//
+// Created by Chunel on 2020/9/12.
+// 二值（1bit符号位）编码。每个维度按照是否大于均值，编码成1bit，
+// 编码之间通过异或+popcount计算汉明距离，用于第0层的粗筛遍历
+//
+
+#ifndef CAISS_SPACE_BINARY_H
+#define CAISS_SPACE_BINARY_H
+
+#pragma once
+#include <stdint.h>
+#include "hnswlib.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    #define BINARY_USE_POPCNT_DISPATCH    // 编译选项中未开启popcnt的时候，运行时判断是否支持
+#endif
+
+namespace hnswlib {
+
+    typedef unsigned int (*HAMMINGFUNC)(const uint64_t *, const uint64_t *, size_t);
+
+    const static size_t BINARY_WORD_BITS = 64;
+
+    static inline size_t BinaryCodeWords(size_t dim) {
+        return (dim + BINARY_WORD_BITS - 1) / BINARY_WORD_BITS;
+    }
+
+    /**
+     * 将float向量编码成符号位，第i维大于mean[i]的时候，对应bit为1
+     * @param vec
+     * @param mean
+     * @param dim
+     * @param code 长度为BinaryCodeWords(dim)
+     */
+    static void BinaryEncode(const float *vec, const float *mean, size_t dim, uint64_t *code) {
+        size_t words = BinaryCodeWords(dim);
+        for (size_t w = 0; w < words; w++) {
+            uint64_t bits = 0;
+            size_t end = std::min(dim, (w + 1) * BINARY_WORD_BITS);
+            for (size_t i = w * BINARY_WORD_BITS; i < end; i++) {
+                bits |= (uint64_t)(vec[i] > mean[i]) << (i - w * BINARY_WORD_BITS);
+            }
+            code[w] = bits;
+        }
+    }
+
+    static unsigned int HammingDistance(const uint64_t *a, const uint64_t *b, size_t words) {
+        unsigned int res = 0;
+        for (size_t i = 0; i < words; i++) {
+            res += (unsigned int)__builtin_popcountll(a[i] ^ b[i]);
+        }
+        return res;
+    }
+
+#ifdef BINARY_USE_POPCNT_DISPATCH
+    __attribute__((target("popcnt")))
+    static unsigned int HammingDistancePopcnt(const uint64_t *a, const uint64_t *b, size_t words) {
+        unsigned int res = 0;
+        size_t i = 0;
+        for (; i + 4 <= words; i += 4) {
+            // 分成4路累加，减少popcnt之间的依赖
+            unsigned int r0 = (unsigned int)__builtin_popcountll(a[i] ^ b[i]);
+            unsigned int r1 = (unsigned int)__builtin_popcountll(a[i + 1] ^ b[i + 1]);
+            unsigned int r2 = (unsigned int)__builtin_popcountll(a[i + 2] ^ b[i + 2]);
+            unsigned int r3 = (unsigned int)__builtin_popcountll(a[i + 3] ^ b[i + 3]);
+            res += r0 + r1 + r2 + r3;
+        }
+        for (; i < words; i++) {
+            res += (unsigned int)__builtin_popcountll(a[i] ^ b[i]);
+        }
+        return res;
+    }
+#endif
+
+    /**
+     * 获取当前cpu下，最快的汉明距离计算函数
+     * @return
+     */
+    static HAMMINGFUNC GetHammingFunc() {
+#ifdef BINARY_USE_POPCNT_DISPATCH
+        if (__builtin_cpu_supports("popcnt")) {
+            return HammingDistancePopcnt;
+        }
+#endif
+        return HammingDistance;
+    }
+
+}
+
+#endif //CAISS_SPACE_BINARY_H
@@ -12,12 +12,14 @@ namespace hnswlib {
     class EditionProductSpace : public SpaceInterface<float> {
 
         DISTFUNC<float> fstdistfunc_;
+        BATCHDISTFUNC<float> batchdistfunc_;
         size_t data_size_;
         size_t dim_;
 
     public:
         EditionProductSpace(size_t dim) {
             fstdistfunc_ = nullptr;
+            batchdistfunc_ = nullptr;
             dim_ = dim;
             data_size_ = dim * sizeof(float);
         }
@@ -41,6 +43,14 @@ namespace hnswlib {
             }
         }
 
+        BATCHDISTFUNC<float> get_batch_dist_func() {
+            return batchdistfunc_;
+        }
+
+        void set_batch_dist_func(BATCHDISTFUNC<float> func) {
+            this->batchdistfunc_ = func;    // 可以为空，表示不再使用批量计算的方式
+        }
+
         ~EditionProductSpace() {}
     };
 }
@@ -0,0 +1,358 @@
+//
+// Created by Chunel on 2020/9/5.
+// 半精度（fp16/bf16）存储的距离空间。向量以2字节的形式保存在data_level0_memory_中，
+// 计算距离的时候，在SIMD指令中直接转换为float32计算，内存和访存带宽均减半
+//
+
+#ifndef CAISS_SPACE_HALF_H
+#define CAISS_SPACE_HALF_H
+
+#pragma once
+#include <stdint.h>
+#include "hnswlib.h"
+
+#if defined(USE_AVX) && defined(__AVX2__) && defined(__F16C__)
+    #define HALF_USE_AVX    // 8路转换，fp16依赖F16C，bf16依赖AVX2
+#endif
+
+namespace hnswlib {
+
+    /* 取值与CAISS_STORAGE_TYPE保持一致，会被写入模型文件 */
+    enum HalfFormat {
+        HALF_FP16 = 1,
+        HALF_BF16 = 2
+    };
+
+    static inline float HalfBitsToFloat(uint32_t bits) {
+        float f;
+        memcpy(&f, &bits, sizeof(f));
+        return f;
+    }
+
+    static inline uint32_t HalfFloatToBits(float f) {
+        uint32_t bits;
+        memcpy(&bits, &f, sizeof(bits));
+        return bits;
+    }
+
+    struct Fp16Codec {
+        static inline uint16_t encode(float f) {
+            // 就近舍入（round-to-nearest-even）
+            uint32_t x = HalfFloatToBits(f);
+            uint32_t sign = (x >> 16) & 0x8000;
+            uint32_t exp = (x >> 23) & 0xff;
+            uint32_t mant = x & 0x7fffff;
+            if (exp == 0xff) {
+                return (uint16_t)(sign | 0x7c00 | (mant ? 0x200 : 0));    // inf/nan
+            }
+
+            int e = (int)exp - 127 + 15;
+            if (e >= 0x1f) {
+                return (uint16_t)(sign | 0x7c00);    // 上溢
+            }
+
+            if (e <= 0) {
+                if (e < -10) {
+                    return (uint16_t)sign;    // 下溢为0
+                }
+                mant |= 0x800000;
+                uint32_t shift = (uint32_t)(14 - e);
+                uint32_t half = mant >> shift;
+                uint32_t rem = mant & ((1u << shift) - 1);
+                uint32_t mid = 1u << (shift - 1);
+                if (rem > mid || (rem == mid && (half & 1))) {
+                    half++;
+                }
+                return (uint16_t)(sign | half);
+            }
+
+            uint32_t half = sign | ((uint32_t)e << 10) | (mant >> 13);
+            uint32_t rem = mant & 0x1fff;
+            if (rem > 0x1000 || (rem == 0x1000 && (half & 1))) {
+                half++;    // 进位到指数位，也是正确的结果
+            }
+            return (uint16_t)half;
+        }
+
+        static inline float decode(uint16_t h) {
+            // 无分支的转换方式，次正规数通过乘法处理
+            uint32_t expmant = (uint32_t)(h & 0x7fff) << 13;
+            uint32_t exp = expmant & 0x0f800000;
+            float f = HalfBitsToFloat(expmant) * HalfBitsToFloat((254 - 15) << 23);
+            uint32_t bits = HalfFloatToBits(f);
+            if (exp == 0x0f800000) {
+                bits |= (255u << 23);    // inf/nan
+            }
+            return HalfBitsToFloat(bits | ((uint32_t)(h & 0x8000) << 16));
+        }
+
+#if defined(HALF_USE_AVX)
+        static inline __m256 load8(const uint16_t *p) {
+            return _mm256_cvtph_ps(_mm_loadu_si128((const __m128i *)p));
+        }
+#elif defined(USE_SSE)
+        static inline __m128 load4(const uint16_t *p) {
+            __m128i h = _mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i *)p), _mm_setzero_si128());
+            __m128i expmant = _mm_and_si128(h, _mm_set1_epi32(0x7fff));
+            __m128i justsign = _mm_xor_si128(h, expmant);
+            __m128 scaled = _mm_mul_ps(_mm_castsi128_ps(_mm_slli_epi32(expmant, 13)),
+                                       _mm_castsi128_ps(_mm_set1_epi32((254 - 15) << 23)));
+            __m128i infnan = _mm_cmpgt_epi32(expmant, _mm_set1_epi32(0x7bff));
+            __m128 infnanexp = _mm_and_ps(_mm_castsi128_ps(infnan), _mm_castsi128_ps(_mm_set1_epi32(255 << 23)));
+            __m128 sign = _mm_castsi128_ps(_mm_slli_epi32(justsign, 16));
+            return _mm_or_ps(scaled, _mm_or_ps(sign, infnanexp));
+        }
+#endif
+    };
+
+    struct Bf16Codec {
+        static inline uint16_t encode(float f) {
+            uint32_t x = HalfFloatToBits(f);
+            if ((x & 0x7fffffff) > 0x7f800000) {
+                return (uint16_t)((x >> 16) | 0x40);    // nan，保证不会被舍入成inf
+            }
+            x += 0x7fff + ((x >> 16) & 1);    // 就近舍入
+            return (uint16_t)(x >> 16);
+        }
+
+        static inline float decode(uint16_t h) {
+            return HalfBitsToFloat((uint32_t)h << 16);
+        }
+
+#if defined(HALF_USE_AVX)
+        static inline __m256 load8(const uint16_t *p) {
+            __m256i v = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *)p));
+            return _mm256_castsi256_ps(_mm256_slli_epi32(v, 16));
+        }
+#elif defined(USE_SSE)
+        static inline __m128 load4(const uint16_t *p) {
+            return _mm_castsi128_ps(_mm_unpacklo_epi16(_mm_setzero_si128(), _mm_loadl_epi64((const __m128i *)p)));
+        }
+#endif
+    };
+
+
+    template<typename CODEC>
+    static float
+    HalfL2Sqr(const void *pVect1v, const void *pVect2v, const void *qty_ptr) {
+        const uint16_t *pVect1 = (const uint16_t *) pVect1v;
+        const uint16_t *pVect2 = (const uint16_t *) pVect2v;
+        size_t qty = *((size_t *) qty_ptr);
+        size_t i = 0;
+        float res = 0;
+
+#if defined(HALF_USE_AVX)
+        float PORTABLE_ALIGN32 TmpRes[8];
+        __m256 sum0 = _mm256_setzero_ps();
+        __m256 sum1 = _mm256_setzero_ps();
+        for (; i + 16 <= qty; i += 16) {
+            __m256 diff0 = _mm256_sub_ps(CODEC::load8(pVect1 + i), CODEC::load8(pVect2 + i));
+            __m256 diff1 = _mm256_sub_ps(CODEC::load8(pVect1 + i + 8), CODEC::load8(pVect2 + i + 8));
+            sum0 = _mm256_add_ps(sum0, _mm256_mul_ps(diff0, diff0));
+            sum1 = _mm256_add_ps(sum1, _mm256_mul_ps(diff1, diff1));
+        }
+        _mm256_store_ps(TmpRes, _mm256_add_ps(sum0, sum1));
+        res = TmpRes[0] + TmpRes[1] + TmpRes[2] + TmpRes[3] + TmpRes[4] + TmpRes[5] + TmpRes[6] + TmpRes[7];
+#elif defined(USE_SSE)
+        float PORTABLE_ALIGN32 TmpRes[8];
+        __m128 sum0 = _mm_setzero_ps();
+        __m128 sum1 = _mm_setzero_ps();
+        for (; i + 8 <= qty; i += 8) {
+            __m128 diff0 = _mm_sub_ps(CODEC::load4(pVect1 + i), CODEC::load4(pVect2 + i));
+            __m128 diff1 = _mm_sub_ps(CODEC::load4(pVect1 + i + 4), CODEC::load4(pVect2 + i + 4));
+            sum0 = _mm_add_ps(sum0, _mm_mul_ps(diff0, diff0));
+            sum1 = _mm_add_ps(sum1, _mm_mul_ps(diff1, diff1));
+        }
+        _mm_store_ps(TmpRes, _mm_add_ps(sum0, sum1));
+        res = TmpRes[0] + TmpRes[1] + TmpRes[2] + TmpRes[3];
+#endif
+
+        for (; i < qty; i++) {
+            float t = CODEC::decode(pVect1[i]) - CODEC::decode(pVect2[i]);
+            res += t * t;
+        }
+        return res;
+    }
+
+
+    template<typename CODEC>
+    static float
+    HalfInnerProduct(const void *pVect1v, const void *pVect2v, const void *qty_ptr) {
+        const uint16_t *pVect1 = (const uint16_t *) pVect1v;
+        const uint16_t *pVect2 = (const uint16_t *) pVect2v;
+        size_t qty = *((size_t *) qty_ptr);
+        size_t i = 0;
+        float res = 0;
+
+#if defined(HALF_USE_AVX)
+        float PORTABLE_ALIGN32 TmpRes[8];
+        __m256 sum0 = _mm256_setzero_ps();
+        __m256 sum1 = _mm256_setzero_ps();
+        for (; i + 16 <= qty; i += 16) {
+            sum0 = _mm256_add_ps(sum0, _mm256_mul_ps(CODEC::load8(pVect1 + i), CODEC::load8(pVect2 + i)));
+            sum1 = _mm256_add_ps(sum1, _mm256_mul_ps(CODEC::load8(pVect1 + i + 8), CODEC::load8(pVect2 + i + 8)));
+        }
+        _mm256_store_ps(TmpRes, _mm256_add_ps(sum0, sum1));
+        res = TmpRes[0] + TmpRes[1] + TmpRes[2] + TmpRes[3] + TmpRes[4] + TmpRes[5] + TmpRes[6] + TmpRes[7];
+#elif defined(USE_SSE)
+        float PORTABLE_ALIGN32 TmpRes[8];
+        __m128 sum0 = _mm_setzero_ps();
+        __m128 sum1 = _mm_setzero_ps();
+        for (; i + 8 <= qty; i += 8) {
+            sum0 = _mm_add_ps(sum0, _mm_mul_ps(CODEC::load4(pVect1 + i), CODEC::load4(pVect2 + i)));
+            sum1 = _mm_add_ps(sum1, _mm_mul_ps(CODEC::load4(pVect1 + i + 4), CODEC::load4(pVect2 + i + 4)));
+        }
+        _mm_store_ps(TmpRes, _mm_add_ps(sum0, sum1));
+        res = TmpRes[0] + TmpRes[1] + TmpRes[2] + TmpRes[3];
+#endif
+
+        for (; i < qty; i++) {
+            res += CODEC::decode(pVect1[i]) * CODEC::decode(pVect2[i]);
+        }
+        return (1.0f - res);
+    }
+
+
+#if defined(__AVX512BF16__)
+    /* 支持avx512-bf16指令集的情况下，bf16的内积直接使用dpbf16指令计算，无需转换 */
+    static float
+    Bf16InnerProductAVX512(const void *pVect1v, const void *pVect2v, const void *qty_ptr) {
+        const uint16_t *pVect1 = (const uint16_t *) pVect1v;
+        const uint16_t *pVect2 = (const uint16_t *) pVect2v;
+        size_t qty = *((size_t *) qty_ptr);
+
+        __m512 sum = _mm512_setzero_ps();
+        for (size_t i = 0; i < qty; i += 32) {
+            __m512bh v1 = (__m512bh) _mm512_loadu_si512((const void *)(pVect1 + i));
+            __m512bh v2 = (__m512bh) _mm512_loadu_si512((const void *)(pVect2 + i));
+            sum = _mm512_dpbf16_ps(sum, v1, v2);
+        }
+        return (1.0f - _mm512_reduce_add_ps(sum));
+    }
+#endif
+
+
+    template<typename CODEC>
+    static void
+    HalfEncode(const void *src, void *dst, const void *qty_ptr) {
+        const float *from = (const float *) src;
+        uint16_t *to = (uint16_t *) dst;
+        size_t qty = *((size_t *) qty_ptr);
+        for (size_t i = 0; i < qty; i++) {
+            to[i] = CODEC::encode(from[i]);
+        }
+    }
+
+#if defined(HALF_USE_AVX)
+    template<>
+    void
+    HalfEncode<Fp16Codec>(const void *src, void *dst, const void *qty_ptr) {
+        const float *from = (const float *) src;
+        uint16_t *to = (uint16_t *) dst;
+        size_t qty = *((size_t *) qty_ptr);
+        size_t i = 0;
+        for (; i + 8 <= qty; i += 8) {
+            __m128i h = _mm256_cvtps_ph(_mm256_loadu_ps(from + i), _MM_FROUND_TO_NEAREST_INT);
+            _mm_storeu_si128((__m128i *)(to + i), h);
+        }
+        for (; i < qty; i++) {
+            to[i] = Fp16Codec::encode(from[i]);
+        }
+    }
+#endif
+
+    template<typename CODEC>
+    static void
+    HalfDecode(const void *src, void *dst, const void *qty_ptr) {
+        const uint16_t *from = (const uint16_t *) src;
+        float *to = (float *) dst;
+        size_t qty = *((size_t *) qty_ptr);
+        for (size_t i = 0; i < qty; i++) {
+            to[i] = CODEC::decode(from[i]);
+        }
+    }
+
+
+    class HalfSpaceBase : public SpaceInterface<float> {
+    protected:
+        DISTFUNC<float> fstdistfunc_;
+        CODECFUNC encodefunc_;
+        CODECFUNC decodefunc_;
+        size_t data_size_;
+        size_t dim_;
+        HalfFormat format_;
+
+        HalfSpaceBase(size_t dim, HalfFormat format) {
+            dim_ = dim;
+            format_ = format;
+            data_size_ = dim * sizeof(uint16_t);
+            fstdistfunc_ = nullptr;
+            if (HALF_BF16 == format) {
+                encodefunc_ = HalfEncode<Bf16Codec>;
+                decodefunc_ = HalfDecode<Bf16Codec>;
+            } else {
+                encodefunc_ = HalfEncode<Fp16Codec>;
+                decodefunc_ = HalfDecode<Fp16Codec>;
+            }
+        }
+
+    public:
+        size_t get_data_size() {
+            return data_size_;
+        }
+
+        DISTFUNC<float> get_dist_func() {
+            return fstdistfunc_;
+        }
+
+        void *get_dist_func_param() {
+            return &dim_;
+        }
+
+        void set_dist_func(DISTFUNC<float> dist_func) {
+            return;    // 具体距离，无任何操作
+        }
+
+        CODECFUNC get_encode_func() {
+            return encodefunc_;
+        }
+
+        CODECFUNC get_decode_func() {
+            return decodefunc_;
+        }
+
+        int get_storage_type() {
+            return format_;
+        }
+
+        ~HalfSpaceBase() {}
+    };
+
+
+    class L2HalfSpace : public HalfSpaceBase {
+    public:
+        L2HalfSpace(size_t dim, HalfFormat format) : HalfSpaceBase(dim, format) {
+            fstdistfunc_ = (HALF_BF16 == format) ? HalfL2Sqr<Bf16Codec> : HalfL2Sqr<Fp16Codec>;
+        }
+
+        ~L2HalfSpace() {}
+    };
+
+
+    class InnerProductHalfSpace : public HalfSpaceBase {
+    public:
+        InnerProductHalfSpace(size_t dim, HalfFormat format) : HalfSpaceBase(dim, format) {
+            fstdistfunc_ = (HALF_BF16 == format) ? HalfInnerProduct<Bf16Codec> : HalfInnerProduct<Fp16Codec>;
+#if defined(__AVX512BF16__)
+            if (HALF_BF16 == format && dim % 32 == 0) {
+                fstdistfunc_ = Bf16InnerProductAVX512;
+            }
+#endif
+        }
+
+        ~InnerProductHalfSpace() {}
+    };
+
+}
+
+#endif //CAISS_SPACE_HALF_H
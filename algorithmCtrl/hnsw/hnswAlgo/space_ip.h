@@ -227,6 +227,34 @@ namespace hnswlib {
 
 #endif
 
+    /* 归一化误差的容忍值，防止因为浮点精度问题，误放弃了距离刚好在上界附近的点 */
+    static const float BOUNDED_IP_EPSILON = 1e-5f;
+
+    /**
+     * 带上界的点积距离（仅针对归一化后的向量）。
+     * 对于单位向量，有 1 - q·x = |q-x|^2 / 2，而|q-x|^2的部分和是单调递增的，
+     * 故先按照欧式距离的方式累加，部分和的一半超过上界的时候，即可提前放弃。
+     * 未被放弃的点（数量很少），再计算一次精确的点积距离，保证结果跟不带上界的计算方式一致
+     */
+    static float
+    InnerProductBounded(const void *pVect1v, const void *pVect2v, const void *qty_ptr, float bound) {
+        float partial = L2SqrBounded(pVect1v, pVect2v, qty_ptr, (bound + BOUNDED_IP_EPSILON) * 2.0f);
+        float lower = partial * 0.5f - BOUNDED_IP_EPSILON;
+        if (lower > bound) {
+            return lower;
+        }
+
+        size_t qty = *((size_t *) qty_ptr);
+    #if defined(USE_AVX) || defined(USE_SSE)
+        if (qty % 16 == 0) {
+            return InnerProductSIMD16Ext(pVect1v, pVect2v, qty_ptr);
+        } else if (qty % 4 == 0) {
+            return InnerProductSIMD4Ext(pVect1v, pVect2v, qty_ptr);
+        }
+    #endif
+        return InnerProduct(pVect1v, pVect2v, qty_ptr);
+    }
+
     class InnerProductSpace : public SpaceInterface<float> {
 
         DISTFUNC<float> fstdistfunc_;
@@ -266,6 +294,11 @@ namespace hnswlib {
             return;    // 具体距离，无任何操作
         }
 
+        BOUNDEDDISTFUNC<float> get_bounded_dist_func(bool normalized) {
+            // 未归一化的时候，无法估计剩余维度的点积上限
+            return (normalized && dim_ >= 2 * BOUNDED_CHECK_STEP) ? InnerProductBounded : nullptr;
+        }
+
     ~InnerProductSpace() {}
     };
 
@@ -143,6 +143,95 @@ namespace hnswlib {
     }
 #endif
 
+    /* 带上界的距离计算中，每计算这么多个维度，检查一次是否已经超过上界（需为16的倍数） */
+    static const size_t BOUNDED_CHECK_STEP = 64;
+
+    /**
+     * 计算[0, qty)维度上的欧式距离平方和，不要求qty是4的倍数
+     */
+    static inline float
+    L2SqrRange(const float *pVect1, const float *pVect2, size_t qty) {
+        float res = 0;
+        size_t i = 0;
+#if defined(USE_SSE) || defined(USE_AVX)
+        float PORTABLE_ALIGN32 TmpRes[8];
+        __m128 sum = _mm_set1_ps(0);
+        for (; i + 4 <= qty; i += 4) {
+            __m128 diff = _mm_sub_ps(_mm_loadu_ps(pVect1 + i), _mm_loadu_ps(pVect2 + i));
+            sum = _mm_add_ps(sum, _mm_mul_ps(diff, diff));
+        }
+        _mm_store_ps(TmpRes, sum);
+        res = TmpRes[0] + TmpRes[1] + TmpRes[2] + TmpRes[3];
+#endif
+        for (; i < qty; i++) {
+            float t = pVect1[i] - pVect2[i];
+            res += t * t;
+        }
+        return res;
+    }
+
+#if defined(USE_SSE) || defined(USE_AVX)
+    static inline float
+    HorizontalSum(__m128 v) {
+        __m128 shuf = _mm_movehl_ps(v, v);    // 高两位和低两位相加
+        __m128 sums = _mm_add_ps(v, shuf);
+        shuf = _mm_shuffle_ps(sums, sums, 0x55);
+        return _mm_cvtss_f32(_mm_add_ss(sums, shuf));
+    }
+#endif
+
+    /**
+     * 带上界的欧式距离。部分和是单调递增的，每BOUNDED_CHECK_STEP个维度检查一次，
+     * 一旦超过上界，直接返回部分和（必然大于上界），后面的维度不再计算
+     */
+    static float
+    L2SqrBounded(const void *pVect1v, const void *pVect2v, const void *qty_ptr, float bound) {
+        const float *pVect1 = (const float *) pVect1v;
+        const float *pVect2 = (const float *) pVect2v;
+        size_t qty = *((size_t *) qty_ptr);
+        size_t i = 0;
+        float res = 0;
+
+#if defined(USE_AVX)
+        __m256 sum = _mm256_set1_ps(0);
+        for (; i + BOUNDED_CHECK_STEP <= qty; ) {
+            for (size_t end = i + BOUNDED_CHECK_STEP; i < end; i += 16) {
+                __m256 diff = _mm256_sub_ps(_mm256_loadu_ps(pVect1 + i), _mm256_loadu_ps(pVect2 + i));
+                sum = _mm256_add_ps(sum, _mm256_mul_ps(diff, diff));
+                diff = _mm256_sub_ps(_mm256_loadu_ps(pVect1 + i + 8), _mm256_loadu_ps(pVect2 + i + 8));
+                sum = _mm256_add_ps(sum, _mm256_mul_ps(diff, diff));
+            }
+            res = HorizontalSum(_mm_add_ps(_mm256_castps256_ps128(sum), _mm256_extractf128_ps(sum, 1)));
+            if (res > bound) {
+                return res;
+            }
+        }
+#elif defined(USE_SSE)
+        __m128 sum = _mm_set1_ps(0);
+        for (; i + BOUNDED_CHECK_STEP <= qty; ) {
+            for (size_t end = i + BOUNDED_CHECK_STEP; i < end; i += 8) {
+                __m128 diff = _mm_sub_ps(_mm_loadu_ps(pVect1 + i), _mm_loadu_ps(pVect2 + i));
+                sum = _mm_add_ps(sum, _mm_mul_ps(diff, diff));
+                diff = _mm_sub_ps(_mm_loadu_ps(pVect1 + i + 4), _mm_loadu_ps(pVect2 + i + 4));
+                sum = _mm_add_ps(sum, _mm_mul_ps(diff, diff));
+            }
+            res = HorizontalSum(sum);
+            if (res > bound) {
+                return res;
+            }
+        }
+#else
+        for (; i + BOUNDED_CHECK_STEP <= qty; i += BOUNDED_CHECK_STEP) {
+            res += L2SqrRange(pVect1 + i, pVect2 + i, BOUNDED_CHECK_STEP);
+            if (res > bound) {
+                return res;
+            }
+        }
+#endif
+
+        return res + L2SqrRange(pVect1 + i, pVect2 + i, qty - i);    // 不足一个检查步长的尾部维度
+    }
+
     class L2Space : public SpaceInterface<float> {
 
         DISTFUNC<float> fstdistfunc_;
@@ -180,6 +269,11 @@ namespace hnswlib {
             return &dim_;
         }
 
+        BOUNDEDDISTFUNC<float> get_bounded_dist_func(bool normalized) {
+            // 欧式距离，不需要依赖归一化信息。维度较低的时候，提前放弃的收益抵不过检查的开销
+            return (dim_ >= 2 * BOUNDED_CHECK_STEP) ? L2SqrBounded : nullptr;
+        }
+
         ~L2Space() {}
     };
 
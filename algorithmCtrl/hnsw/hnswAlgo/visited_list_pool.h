@@ -44,7 +44,7 @@ namespace hnswlib {
         VisitedListPool(int initmaxpools, int numelements1) {
             numelements = numelements1;
             for (int i = 0; i < initmaxpools; i++)
-                pool.push_front(new VisitedList(numelements));
+                pool.push_back(new VisitedList(numelements));
         }
 
         VisitedList *getFreeVisitedList() {
@@ -52,8 +52,8 @@ namespace hnswlib {
             {
                 std::unique_lock <std::mutex> lock(poolguard);
                 if (pool.size() > 0) {
-                    rez = pool.front();
-                    pool.pop_front();
+                    rez = pool.back();    // 在尾部存取，deque不会反复申请和释放内存块
+                    pool.pop_back();
                 } else {
                     rez = new VisitedList(numelements);
                 }
@@ -64,7 +64,7 @@ namespace hnswlib {
 
         void releaseVisitedList(VisitedList *vl) {
             std::unique_lock <std::mutex> lock(poolguard);
-            pool.push_front(vl);
+            pool.push_back(vl);
         };
 
         ~VisitedListPool() {
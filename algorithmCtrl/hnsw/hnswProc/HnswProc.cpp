@@ -18,9 +18,12 @@ using namespace std;
 // 静态成员变量使用前，先初始化
 HierarchicalNSW<CAISS_FLOAT>* HnswProc::hnsw_algo_ptr_ = nullptr;
 RWLock HnswProc::hnsw_algo_lock_;
+std::mutex HnswProc::hnsw_insert_lock_;
 
 RWLock AlgorithmProc::trie_lock_;
 TrieProc* AlgorithmProc::ignore_trie_ptr_;
+std::once_flag AlgorithmProc::result_cache_flag_;
+ResultCacheProc* AlgorithmProc::result_cache_ptr_ = nullptr;
 
 inline static bool isAnnSuffix(const char *modelPath) {
     string path = string(modelPath);
@@ -52,6 +55,16 @@ inline static bool isAnnSearchType(CAISS_SEARCH_TYPE searchType) {
 HnswProc::HnswProc() {
     this->neighbors_ = 0;
     this->distance_ptr_ = nullptr;
+    this->dist_func_ = nullptr;
+    this->storage_type_ = CAISS_STORAGE_DEFAULT;
+    this->batch_dist_func_ = nullptr;
+    this->projection_type_ = CAISS_PROJECTION_NONE;
+    this->projection_dim_ = 0;
+    this->binary_search_ = CAISS_FALSE;
+    this->knn_graph_seed_ = CAISS_FALSE;
+    this->hot_memory_ = 0;
+    this->neighbor_list_size_ = 0;
+    this->delta_size_ = DELTA_SIZE_DEFAULT;
 }
 
 
@@ -77,7 +90,10 @@ HnswProc::init(const CAISS_MODE mode, const CAISS_DISTANCE_TYPE distanceType, co
     // 如果是train模式，则是需要保存到这里；如果process模式，则是读取模型
     this->model_path_ = isAnnSuffix(modelPath) ? (string(modelPath)) : (string(modelPath) + MODEL_SUFFIX);
     this->distance_type_ = distanceType;
-    createDistancePtr(distFunc);
+    this->dist_func_ = distFunc;
+    // 处理模式下，以模型中记录的存储格式为准，在loadModel中会重新确认
+    ret = createDistancePtr(distFunc, (CAISS_MODE_TRAIN == mode) ? this->storage_type_ : CAISS_STORAGE_FLOAT);
+    CAISS_FUNCTION_CHECK_STATUS
 
     if (this->cur_mode_ == CAISS_MODE_PROCESS) {
         ret = loadModel(modelPath);    // 如果是处理模式的话，则读取模型内容信息
@@ -97,6 +113,7 @@ CAISS_RET_TYPE HnswProc::reset() {
     this->normalize_ = 0;
     this->neighbors_ = 0;
     this->result_.clear();
+    this->projection_.clear();
 
     CAISS_FUNCTION_END
 }
@@ -120,13 +137,22 @@ CAISS_RET_TYPE HnswProc::train(const char *dataPath, const unsigned int maxDataS
     ret = loadDatas(dataPath, datas);
     CAISS_FUNCTION_CHECK_STATUS
 
+    ret = fitProjection(datas);    // 如果设定了投影方式，则拟合投影矩阵，并将训练数据投影
+    CAISS_FUNCTION_CHECK_STATUS
+
+    HnswProc::destroyHnswSingleton();    // 训练总是重新构建模型，不复用之前训练或者加载的模型
     HnswProc::createHnswSingleton(this->distance_ptr_, maxDataSize, normalize, maxIndexSize);
     HnswTrainParams params(step);
+    std::vector<std::vector<unsigned>> knnGraph;
+    if (this->knn_graph_seed_) {
+        ret = buildKnnGraph(datas, knnGraph);    // kNN图跟训练参数无关，多轮训练的时候复用
+        CAISS_FUNCTION_CHECK_STATUS
+    }
 
     unsigned int epoch = 0;
     while (epoch < maxEpoch) {    // 如果批量走完了，则默认返回
         CAISS_ECHO("start to train caiss model for [%d] in [%d] epochs.", ++epoch, maxEpoch);
-        ret = trainModel(datas, showSpan);
+        ret = trainModel(datas, knnGraph, showSpan);
         CAISS_FUNCTION_CHECK_STATUS
         CAISS_ECHO("model build finished, check model precision automatic, please wait for a moment...");
 
@@ -145,6 +171,17 @@ CAISS_RET_TYPE HnswProc::train(const char *dataPath, const unsigned int maxDataS
         }
     }
 
+    if (0 != this->neighbor_list_size_ && (CAISS_RET_OK == ret || CAISS_RET_WARNING == ret)) {
+        // 模型确定之后，再物化近邻列表并重新保存，避免每一轮训练都重复计算
+        CAISS_RET_TYPE listRet = buildNeighborLists(this->neighbor_list_size_);
+        CAISS_RETURN_IF_NOT_SUCESS(listRet)
+
+        remove(this->model_path_.c_str());
+        HnswProc::getHnswSingleton()->saveIndex(this->model_path_, std::list<string>());
+    }
+
+    // 模型已经保存了，释放训练用的模型。其中使用的距离空间属于当前句柄，句柄重新init之后就失效了
+    HnswProc::destroyHnswSingleton();
     CAISS_FUNCTION_CHECK_STATUS    // 如果是precision达不到要求，则返回警告信息
     CAISS_FUNCTION_END
 }
@@ -161,30 +198,78 @@ CAISS_RET_TYPE HnswProc::search(void *info,
     CAISS_ASSERT_NOT_NULL(info)
     CAISS_CHECK_MODE_ENABLE(CAISS_MODE_PROCESS)
 
-    /* 将信息清空 */
+    /* 将信息清空。词语和距离链表保留已申请的内存，在buildResult中原地赋值 */
     this->result_.clear();
-    this->result_words_.clear();
-    this->result_distance_.clear();
-    CAISS_BOOL isGet = CAISS_FALSE;
-
-    if (isWordSearchType(searchType)) {
-        ret = searchInLruCache((const char *)info, searchType, topK, isGet);    // 如果查询的是单词，则先进入cache中获取
-        CAISS_FUNCTION_CHECK_STATUS
+    ret = innerSearchDetails(info, searchType, topK, filterEditDistance, this->result_details_);    // 可以缓存的查询，先进入缓存中获取
+    if (CAISS_RET_OK != ret) {
+        this->result_words_.clear();
+        this->result_distance_.clear();
+        return ret;
     }
 
-    if (!isGet) {    // 如果没有在cache中获取到信息
-        ret = innerSearchResult(info, searchType, topK, filterEditDistance);
-        CAISS_FUNCTION_CHECK_STATUS
-    }
+    ret = buildResult(searchType);
+    CAISS_FUNCTION_CHECK_STATUS
 
     if (nullptr != searchCBFunc) {
         searchCBFunc(this->result_words_, this->result_distance_, cbParams);    // 可以看看params如何传递下来比较好一点
     }
 
-    this->last_topK_ = topK;    // 查询完毕之后，记录当前的topK信息
-    this->last_search_type_ = searchType;
-    if (isWordSearchType(searchType)) {
-        this->lru_cache_.put(std::string((char *)info), this->result_);
+    CAISS_FUNCTION_END
+}
+
+
+CAISS_RET_TYPE HnswProc::searchEx(void *info,
+                                  const CAISS_SEARCH_TYPE searchType,
+                                  const unsigned int topK,
+                                  const unsigned int filterEditDistance,
+                                  const CAISS_SEARCH_EX_CALLBACK searchCBFunc,
+                                  const void *cbParams) {
+    CAISS_FUNCTION_BEGIN
+
+    CAISS_ASSERT_NOT_NULL(info)
+    CAISS_CHECK_MODE_ENABLE(CAISS_MODE_PROCESS)
+
+    this->result_items_.clear();    // 不修改json结果信息
+    ret = innerSearchDetails(info, searchType, topK, filterEditDistance, this->result_details_);
+    CAISS_FUNCTION_CHECK_STATUS
+
+    AlgorithmProc::buildResultItems(this->result_details_, this->result_items_);
+
+    if (nullptr != searchCBFunc) {
+        searchCBFunc(this->result_items_.data(), (unsigned int)this->result_items_.size(), cbParams);
+    }
+
+    CAISS_FUNCTION_END
+}
+
+
+/**
+ * 查询信息和结果均保存在context中（查询过程中的临时信息为线程独有），不修改句柄中的结果信息，
+ * 所以同一个句柄可以被多个线程同时使用
+ */
+CAISS_RET_TYPE HnswProc::searchWithContext(void *info,
+                                           const CAISS_SEARCH_TYPE searchType,
+                                           const unsigned int topK,
+                                           const unsigned int filterEditDistance,
+                                           AlgorithmSearchContext *context,
+                                           const CAISS_SEARCH_EX_CALLBACK searchCBFunc,
+                                           const void *cbParams) {
+    CAISS_FUNCTION_BEGIN
+
+    CAISS_ASSERT_NOT_NULL(info)
+    CAISS_ASSERT_NOT_NULL(context)
+    CAISS_CHECK_MODE_ENABLE(CAISS_MODE_PROCESS)
+
+    ret = innerSearchDetails(info, searchType, topK, filterEditDistance, context->details);
+    if (CAISS_RET_OK != ret) {
+        context->items.clear();
+        return ret;
+    }
+
+    AlgorithmProc::buildResultItems(context->details, context->items);
+
+    if (nullptr != searchCBFunc) {
+        searchCBFunc(context->items.data(), (unsigned int)context->items.size(), cbParams);
     }
 
     CAISS_FUNCTION_END
@@ -200,11 +285,6 @@ CAISS_RET_TYPE HnswProc::insert(CAISS_FLOAT *node, const char *index, CAISS_INSE
 
     CAISS_CHECK_MODE_ENABLE(CAISS_MODE_PROCESS)
 
-    unsigned int curCount = ptr->cur_element_count_;
-    if (curCount >= ptr->max_elements_) {
-        return CAISS_RET_MODEL_SIZE;    // 超过模型的最大尺寸了
-    }
-
     std::vector<CAISS_FLOAT> vec;
     vec.reserve(this->dim_);
     for (int i = 0; i < this->dim_; i++) {
@@ -214,6 +294,24 @@ CAISS_RET_TYPE HnswProc::insert(CAISS_FLOAT *node, const char *index, CAISS_INSE
     ret = normalizeNode(vec, this->dim_);
     CAISS_FUNCTION_CHECK_STATUS
 
+    ret = projectNode(vec);
+    CAISS_FUNCTION_CHECK_STATUS
+
+    // 插入之间依次执行（label按照当前个数分配），跟查询之间通过图中的细粒度锁同步，可以并行
+    std::lock_guard<std::mutex> lock(HnswProc::hnsw_insert_lock_);
+    if (0 != ptr->delta_capacity_) {
+        ret = insertByDelta(vec.data(), index, insertType);    // 先写入增量段，由后台线程合入图中
+        CAISS_FUNCTION_CHECK_STATUS
+
+        AlgorithmProc::invalidateResultCache();
+        return CAISS_RET_OK;
+    }
+
+    unsigned int curCount = ptr->cur_element_count_;
+    if (curCount >= ptr->max_elements_) {
+        return CAISS_RET_MODEL_SIZE;    // 超过模型的最大尺寸了
+    }
+
     switch (insertType) {
         case CAISS_INSERT_OVERWRITE:
             ret = insertByOverwrite(vec.data(), curCount, index);
@@ -228,12 +326,129 @@ CAISS_RET_TYPE HnswProc::insert(CAISS_FLOAT *node, const char *index, CAISS_INSE
 
     CAISS_FUNCTION_CHECK_STATUS
 
-    this->last_topK_ = 0;    // 如果插入成功，则重新记录topK信息
-    this->last_search_type_ = CAISS_SEARCH_DEFAULT;
+    AlgorithmProc::invalidateResultCache();    // 如果插入成功，则之前缓存的结果失效
     CAISS_FUNCTION_END
 }
 
 
+/**
+ * 批量插入。先整体检查和归一化，再统一判断词语是否存在，新的词语由多个线程并行添加到图中
+ * 同一批中重复的词语，覆盖的时候以最后一个为准，忽略的时候以第一个为准
+ * @param nodes
+ * @param indexes
+ * @param num
+ * @param insertType
+ * @return
+ */
+CAISS_RET_TYPE HnswProc::insertBatch(CAISS_FLOAT *nodes, const char **indexes, const unsigned int num,
+                                     const CAISS_INSERT_TYPE insertType) {
+    CAISS_FUNCTION_BEGIN
+    CAISS_ASSERT_NOT_NULL(nodes)
+    CAISS_ASSERT_NOT_NULL(indexes)
+    auto ptr = HnswProc::getHnswSingleton();
+    CAISS_ASSERT_NOT_NULL(ptr)
+
+    CAISS_CHECK_MODE_ENABLE(CAISS_MODE_PROCESS)
+
+    if (CAISS_INSERT_OVERWRITE != insertType && CAISS_INSERT_DISCARD != insertType) {
+        return CAISS_RET_PARAM;
+    }
+
+    for (unsigned int i = 0; i < num; i++) {
+        CAISS_ASSERT_NOT_NULL(indexes[i])
+        if (strlen(indexes[i]) > ptr->per_index_size_) {
+            return CAISS_RET_WORD_SIZE;    // 先整体检查，避免插入一部分之后才失败
+        }
+    }
+
+    // 归一化（和投影）之后的向量，连续存放在一块内存中
+    bool isProject = this->projection_.isEnable();
+    unsigned int dim = isProject ? this->projection_.getOutDim() : this->dim_;
+    std::vector<CAISS_FLOAT> vecs((size_t)num * dim);
+    std::vector<CAISS_FLOAT> row;
+    std::vector<CAISS_FLOAT> projected;
+    for (unsigned int i = 0; i < num; i++) {
+        const CAISS_FLOAT *node = nodes + (size_t)i * this->dim_;
+        CAISS_FLOAT *vec = vecs.data() + (size_t)i * dim;
+        if (!isProject) {
+            std::copy(node, node + this->dim_, vec);
+            ret = normalizeNode(vec, this->dim_);
+            CAISS_FUNCTION_CHECK_STATUS
+            continue;
+        }
+
+        row.assign(node, node + this->dim_);
+        ret = normalizeNode(row.data(), this->dim_);
+        CAISS_FUNCTION_CHECK_STATUS
+
+        ret = this->projection_.transform(row.data(), projected, CAISS_FALSE != this->normalize_);
+        CAISS_FUNCTION_CHECK_STATUS
+        std::copy(projected.begin(), projected.end(), vec);
+    }
+
+    std::lock_guard<std::mutex> lock(HnswProc::hnsw_insert_lock_);
+    ptr->drainDelta();    // 增量段中的词语先合入图中，之后统一按照图中的信息判断是否存在
+    if (0 != ptr->getDeltaSize()) {
+        return CAISS_RET_ERR;    // 增量段没有全部合入（如：图已经满了），整批都不插入
+    }
+
+    std::unordered_map<std::string, unsigned int> positions;    // 每个词语最终使用的是哪一行
+    positions.reserve(num);
+    for (unsigned int i = 0; i < num; i++) {
+        auto cur = positions.emplace(indexes[i], i);
+        if (!cur.second && CAISS_INSERT_OVERWRITE == insertType) {
+            cur.first->second = i;
+        }
+    }
+
+    std::vector<unsigned int> overwrites;
+    std::vector<hnswlib::tableint> repairs;
+    std::vector<const void *> newNodes;
+    std::vector<const char *> newIndexes;
+    for (unsigned int i = 0; i < num; i++) {
+        if (positions[indexes[i]] != i) {
+            continue;
+        }
+
+        int label = ptr->findWordLabel(indexes[i]);
+        if (-1 == label) {
+            newNodes.push_back(vecs.data() + (size_t)i * dim);
+            newIndexes.push_back(indexes[i]);
+        } else if (CAISS_INSERT_OVERWRITE == insertType) {
+            overwrites.push_back(i);
+            repairs.push_back((hnswlib::tableint)label);
+        }
+    }
+
+    if (ptr->cur_element_count_ + newNodes.size() > ptr->max_elements_) {
+        return CAISS_RET_MODEL_SIZE;    // 超过模型的最大尺寸，整批都不插入
+    }
+
+    for (unsigned int i : overwrites) {
+        ret = ptr->overwriteNode(vecs.data() + (size_t)i * dim, indexes[i], false);
+        CAISS_FUNCTION_CHECK_STATUS
+    }
+    ptr->repairPoints(repairs);    // 全部覆盖之后，再并行重新建立连接
+
+    if (!newNodes.empty()) {
+        ret = ptr->addPoints(newNodes, newIndexes);
+    }
+    AlgorithmProc::invalidateResultCache();    // 即使部分失败，之前插入的也已经生效
+    CAISS_FUNCTION_CHECK_STATUS
+
+    CAISS_FUNCTION_END
+}
+
+
+/**
+ * 插入只修改模型（单例）中的信息，并且内部会加锁，可以跟查询并行执行
+ * @return
+ */
+bool HnswProc::supportConcurrentInsert() {
+    return true;
+}
+
+
 CAISS_RET_TYPE HnswProc::save(const char *modelPath) {
     CAISS_FUNCTION_BEGIN
     auto ptr = HnswProc::getHnswSingleton();
@@ -246,6 +461,15 @@ CAISS_RET_TYPE HnswProc::save(const char *modelPath) {
         path = isAnnSuffix(modelPath) ? string(modelPath) : (string(modelPath) + MODEL_SUFFIX);
     }
 
+    ptr->drainDelta();    // 增量段中的点不会写入模型，保存之前全部合入图中
+    // 模型中每个列表还包含词语自身，比设定的近邻个数多一个
+    unsigned int modelListSize = (ptr->neighbor_list_size_ > 0) ? (unsigned int)ptr->neighbor_list_size_ - 1 : 0;
+    unsigned int listSize = (0 != this->neighbor_list_size_) ? this->neighbor_list_size_ : modelListSize;
+    if (0 != listSize && (!ptr->isNeighborListsFresh() || listSize != modelListSize)) {
+        ret = buildNeighborLists(listSize);    // 有列表失效（或者调整了列表长度）的时候，在保存之前重新物化
+        CAISS_FUNCTION_CHECK_STATUS
+    }
+
     remove(path.c_str());    // 如果有的话，就删除
     list<string> ignoreList = AlgorithmProc::getIgnoreTrie()->getAllWords();
     ptr->saveIndex(path, ignoreList);
@@ -288,9 +512,52 @@ CAISS_RET_TYPE HnswProc::ignore(const char *label, const bool isIgnore) {
         AlgorithmProc::AlgorithmProc::getIgnoreTrie()->eraser(info);    // 对于外部的 not-ignore，相当于是在字典树中，
     }
 
-    this->last_topK_ = 0;    // 如果插入成功，则重新记录topK信息
-    this->last_search_type_ = CAISS_SEARCH_DEFAULT;
+    AlgorithmProc::invalidateResultCache();    // 忽略信息有变动，则之前缓存的结果失效
+
+    CAISS_FUNCTION_END
+}
+
+
+CAISS_RET_TYPE HnswProc::setParam(CAISS_PARAM_TYPE paramType, const void *value) {
+    CAISS_FUNCTION_BEGIN
+    CAISS_ASSERT_NOT_NULL(value)
+
+    switch (paramType) {
+        case CAISS_PARAM_STORAGE_TYPE:
+            ret = setStorageType(*(const unsigned int *)value);
+            break;
+        case CAISS_PARAM_BATCH_DIST_FUNC:
+            ret = setBatchDistFunc(*(const CAISS_BATCH_DIST_FUNC *)value);
+            break;
+        case CAISS_PARAM_PROJECTION_TYPE:
+        case CAISS_PARAM_PROJECTION_DIM:
+            ret = setProjectionParam(paramType, *(const unsigned int *)value);
+            break;
+        case CAISS_PARAM_BINARY_SEARCH:
+            ret = setBinarySearch(*(const unsigned int *)value);
+            break;
+        case CAISS_PARAM_KNN_GRAPH_SEED:
+            this->knn_graph_seed_ = (0 != *(const unsigned int *)value) ? CAISS_TRUE : CAISS_FALSE;
+            break;
+        case CAISS_PARAM_HNSW_HOT_MEMORY:
+            this->hot_memory_ = *(const unsigned int *)value;
+            break;
+        case CAISS_PARAM_HNSW_NEIGHBOR_LIST:
+            if (*(const unsigned int *)value > NEIGHBOR_LIST_SIZE_MAX) {
+                ret = CAISS_RET_PARAM;
+            } else {
+                this->neighbor_list_size_ = *(const unsigned int *)value;
+            }
+            break;
+        case CAISS_PARAM_HNSW_DELTA_SIZE:
+            ret = setDeltaSize(*(const unsigned int *)value);
+            break;
+        default:
+            ret = CAISS_RET_NO_SUPPORT;
+            break;
+    }
 
+    CAISS_FUNCTION_CHECK_STATUS
     CAISS_FUNCTION_END
 }
 
@@ -303,6 +570,10 @@ CAISS_RET_TYPE HnswProc::ignore(const char *label, const bool isIgnore) {
  */
 CAISS_RET_TYPE HnswProc::loadDatas(const char *dataPath, vector<CaissDataNode> &datas) {
     CAISS_FUNCTION_BEGIN
+    if (nullptr != this->train_buffer_) {
+        return loadBufferDatas(datas);    // 通过内存中的向量训练，不需要读取文件
+    }
+
     CAISS_ASSERT_NOT_NULL(dataPath);
 
     std::ifstream in(dataPath);
@@ -331,7 +602,8 @@ CAISS_RET_TYPE HnswProc::loadDatas(const char *dataPath, vector<CaissDataNode> &
 }
 
 
-CAISS_RET_TYPE HnswProc::trainModel(std::vector<CaissDataNode> &datas, const unsigned int showSpan) {
+CAISS_RET_TYPE HnswProc::trainModel(std::vector<CaissDataNode> &datas, const std::vector<std::vector<unsigned>> &knnGraph,
+                                    const unsigned int showSpan) {
     CAISS_FUNCTION_BEGIN
     auto ptr = HnswProc::getHnswSingleton();
     CAISS_ASSERT_NOT_NULL(ptr)
@@ -346,77 +618,195 @@ CAISS_RET_TYPE HnswProc::trainModel(std::vector<CaissDataNode> &datas, const uns
         }
     }
 
+    if (!knnGraph.empty()) {
+        ret = seedBaseLayer(knnGraph);
+        CAISS_FUNCTION_CHECK_STATUS
+    }
+
+    ret = this->projection_.serialize(ptr->ext_info_);    // 投影信息，随模型一起保存
+    CAISS_FUNCTION_CHECK_STATUS
+
     remove(this->model_path_.c_str());
     ptr->saveIndex(std::string(this->model_path_), std::list<string>());    // 训练的时候，传入的是空的ignore链表
     CAISS_FUNCTION_END
 }
 
 
-CAISS_RET_TYPE HnswProc::buildResult(const CAISS_FLOAT *query, const CAISS_SEARCH_TYPE searchType,
-                                     HNSW_RET_TYPE &predResult) {
+/**
+ * 通过NN-Descent，构建训练数据的kNN图。图中的id，是数据在datas中的位置（即训练时的label）
+ * @param datas 已经归一化（和投影）的训练数据
+ * @param knnGraph
+ * @return
+ */
+CAISS_RET_TYPE HnswProc::buildKnnGraph(const std::vector<CaissDataNode> &datas, std::vector<std::vector<unsigned>> &knnGraph) {
+    CAISS_FUNCTION_BEGIN
+
+    if (datas.empty()) {
+        return CAISS_RET_OK;
+    }
+
+    unsigned int dim = (unsigned int)datas[0].node.size();    // 开启投影的时候，跟dim_不一致
+    std::vector<CAISS_FLOAT> vecs;
+    vecs.reserve((size_t)datas.size() * dim);
+    for (const auto &data : datas) {
+        vecs.insert(vecs.end(), data.node.begin(), data.node.end());
+    }
+
+    CAISS_ECHO("start to build knn graph, please wait for a moment...");
+    NNDescent nnd(vecs.data(), (unsigned int)datas.size(), dim, this->distance_type_);
+    ret = nnd.build(NNDescentParams(), knnGraph);
+    CAISS_FUNCTION_CHECK_STATUS
+
+    CAISS_FUNCTION_END
+}
+
+
+/**
+ * 将kNN图中的邻居，合并进hnsw第0层的邻居中。逐点插入构建的图，早期插入的点邻居质量较差，可以通过kNN图补充
+ * @param knnGraph
+ * @return
+ */
+CAISS_RET_TYPE HnswProc::seedBaseLayer(const std::vector<std::vector<unsigned>> &knnGraph) {
     CAISS_FUNCTION_BEGIN
-    CAISS_ASSERT_NOT_NULL(query)
     auto ptr = HnswProc::getHnswSingleton();
-    CAISS_ASSERT_NOT_NULL(ptr);
+    CAISS_ASSERT_NOT_NULL(ptr)
 
-    std::list<CaissResultDetail> detailsList;
-    while (!predResult.empty()) {
-        CaissResultDetail detail;
-        auto cur = predResult.top();
-        predResult.pop();
-        detail.node = ptr->getDataByLabel<CAISS_FLOAT>(cur.second);
-        detail.distance = cur.first;
-        detail.index = cur.second;
-        detail.label = ptr->index_lookup_.left.find(cur.second)->second;    // 这里的label，是单词信息
+    std::vector<tableint> candidates;
+    for (unsigned int label = 0; label < knnGraph.size(); label++) {
+        auto cur = ptr->label_lookup_.find(label);
+        if (cur == ptr->label_lookup_.end()) {
+            continue;    // 词语重复的时候，对应的label没有被插入
+        }
 
-        detailsList.push_front(detail);
-        this->result_words_.push_front(detail.label);    // 保存label（词语）信息
-        this->result_distance_.push_front(detail.distance);    // 保存对应的距离信息
+        candidates.clear();
+        for (auto nbr : knnGraph[label]) {
+            auto nbrInfo = ptr->label_lookup_.find(nbr);
+            if (nbrInfo != ptr->label_lookup_.end()) {
+                candidates.push_back(nbrInfo->second);
+            }
+        }
+        ptr->mergeBaseLayerNeighbors(cur->second, candidates);
     }
 
-    std::string type;
-    if (isAnnSearchType(searchType)) {
-        type = "ann_search";
-    } else {
-        type = "force_loop";
+    CAISS_FUNCTION_END
+}
+
+
+CAISS_RET_TYPE HnswProc::buildResult(const CAISS_SEARCH_TYPE searchType) {
+    CAISS_FUNCTION_BEGIN
+
+    // 按照结果个数调整链表长度后原地赋值，已有的节点和词语的内存可以重复使用
+    this->result_words_.resize(this->result_details_.size());
+    this->result_distance_.resize(this->result_details_.size());
+    auto wordIter = this->result_words_.begin();
+    auto distIter = this->result_distance_.begin();
+    for (const CaissResultDetail &detail : this->result_details_) {
+        *(wordIter++) = detail.label;    // 保存label（词语）信息
+        *(distIter++) = detail.distance;    // 保存对应的距离信息
     }
 
+    const char *type = isAnnSearchType(searchType) ? "ann_search" : "force_loop";
 
-    ret = RapidJsonProc::buildSearchResult(detailsList, this->distance_type_, this->result_, type);
+    ret = RapidJsonProc::buildSearchResult(this->result_details_, this->distance_type_, this->result_, type);
     CAISS_FUNCTION_CHECK_STATUS
 
     CAISS_FUNCTION_END
 }
 
 
+/**
+ * 将查询结果（大顶堆）按照距离从近到远，写入details中
+ * @param predResult
+ * @param details
+ * @return
+ */
+CAISS_RET_TYPE HnswProc::buildResultDetails(HNSW_RET_TYPE &predResult, std::vector<CaissResultDetail> &details) {
+    CAISS_FUNCTION_BEGIN
+    auto ptr = HnswProc::getHnswSingleton();
+    CAISS_ASSERT_NOT_NULL(ptr);
+
+    details.resize(predResult.size());
+    for (size_t i = predResult.size(); i > 0; i--) {    // 大顶堆，从后往前填充
+        auto cur = predResult.top();
+        predResult.pop();
+        CaissResultDetail &detail = details[i - 1];
+        detail.distance = cur.first;
+        detail.index = (unsigned int)cur.second;
+        ptr->getWordByLabel(cur.second, detail.label);    // 这里的label，是单词信息
+    }
+
+    CAISS_FUNCTION_END
+}
+
+
 CAISS_RET_TYPE HnswProc::loadModel(const char *modelPath) {
     CAISS_FUNCTION_BEGIN
 
     CAISS_ASSERT_NOT_NULL(modelPath)
     CAISS_ASSERT_NOT_NULL(this->distance_ptr_)
 
-    HnswProc::createHnswSingleton(this->distance_ptr_, this->model_path_);    // 读取模型的时候，使用的获取方式
-    this->normalize_ = HnswProc::getHnswSingleton()->normalize_;    // 保存模型的时候，会写入是否被标准化的信息
-    this->neighbors_ = HnswProc::getHnswSingleton()->ef_construction_;
+    // 读取模型的时候，使用的获取方式。模型只加载一次，是否分层由第一个加载模型的句柄决定
+    HnswProc::createHnswSingleton(this->distance_ptr_, this->model_path_, (size_t)this->hot_memory_ * 1024 * 1024);
+    auto ptr = HnswProc::getHnswSingleton();
+    CAISS_ASSERT_NOT_NULL(ptr)
+
+    this->normalize_ = ptr->normalize_;    // 保存模型的时候，会写入是否被标准化的信息
+    this->neighbors_ = ptr->ef_construction_;
+
+    ret = this->projection_.deserialize(ptr->ext_info_);
+    CAISS_FUNCTION_CHECK_STATUS
+    if (this->projection_.isEnable() && this->projection_.getInDim() != this->dim_) {
+        return CAISS_RET_DIM;
+    }
+
+    auto storageType = (CAISS_STORAGE_TYPE)ptr->storage_type_;
+    if (storageType != (CAISS_STORAGE_TYPE)this->distance_ptr_->get_storage_type()
+        || this->projection_.isEnable()) {
+        // 模型的存储格式（或投影后的维度）跟当前距离空间不一致，则按照模型的信息重新生成
+        ret = createDistancePtr(this->dist_func_, storageType);
+        CAISS_FUNCTION_CHECK_STATUS
+        ptr->resetSpace(this->distance_ptr_);
+    }
+
+    ret = applyBinarySearch();
+    CAISS_FUNCTION_CHECK_STATUS
+
+    ret = applyDeltaSize();
+    CAISS_FUNCTION_CHECK_STATUS
 
     CAISS_FUNCTION_END
 }
 
 
-CAISS_RET_TYPE HnswProc::createDistancePtr(CAISS_DIST_FUNC distFunc) {
+CAISS_RET_TYPE HnswProc::createDistancePtr(CAISS_DIST_FUNC distFunc, CAISS_STORAGE_TYPE storageType) {
     CAISS_FUNCTION_BEGIN
 
+    if (CAISS_STORAGE_FLOAT != storageType && CAISS_DISTANCE_EDITION == this->distance_type_) {
+        return CAISS_RET_PARAM;    // 自定义距离的函数，只能处理float32格式的数据
+    }
+
     CAISS_DELETE_PTR(this->distance_ptr_)    // 先删除，确保不会出现重复new的情况
+    unsigned int modelDim = getModelDim();    // 设定了投影的时候，模型中的维度跟输入维度不同
+    auto format = (CAISS_STORAGE_BF16 == storageType) ? HALF_BF16 : HALF_FP16;
     switch (this->distance_type_) {
         case CAISS_DISTANCE_EUC :
-            this->distance_ptr_ = new L2Space(this->dim_);
+            if (CAISS_STORAGE_FLOAT == storageType) {
+                this->distance_ptr_ = new L2Space(modelDim);
+            } else {
+                this->distance_ptr_ = new L2HalfSpace(modelDim, format);
+            }
             break;
         case CAISS_DISTANCE_INNER:
-            this->distance_ptr_ = new InnerProductSpace(this->dim_);
+            if (CAISS_STORAGE_FLOAT == storageType) {
+                this->distance_ptr_ = new InnerProductSpace(modelDim);
+            } else {
+                this->distance_ptr_ = new InnerProductHalfSpace(modelDim, format);
+            }
             break;
         case CAISS_DISTANCE_EDITION:
-            this->distance_ptr_ = new EditionProductSpace(this->dim_);
+            this->distance_ptr_ = new EditionProductSpace(modelDim);
             this->distance_ptr_->set_dist_func((DISTFUNC<float>)distFunc);
+            this->distance_ptr_->set_batch_dist_func((BATCHDISTFUNC<float>)this->batch_dist_func_);
             break;
         default:
             break;
@@ -426,36 +816,328 @@ CAISS_RET_TYPE HnswProc::createDistancePtr(CAISS_DIST_FUNC distFunc) {
 }
 
 
+CAISS_RET_TYPE HnswProc::setStorageType(unsigned int storageType) {
+    CAISS_FUNCTION_BEGIN
+
+    if (CAISS_STORAGE_FLOAT != storageType
+        && CAISS_STORAGE_FP16 != storageType
+        && CAISS_STORAGE_BF16 != storageType) {
+        return CAISS_RET_PARAM;
+    }
+
+    if (CAISS_MODE_PROCESS == this->cur_mode_) {
+        return CAISS_RET_MODE;    // 处理模式下，存储格式由模型决定
+    }
+
+    if (CAISS_MODE_TRAIN == this->cur_mode_) {
+        // 已经init过了，需要按照新的格式，重新生成距离空间
+        ret = createDistancePtr(this->dist_func_, (CAISS_STORAGE_TYPE)storageType);
+        CAISS_FUNCTION_CHECK_STATUS
+    }
+
+    this->storage_type_ = (CAISS_STORAGE_TYPE)storageType;
+    CAISS_FUNCTION_END
+}
+
+
+CAISS_RET_TYPE HnswProc::setBatchDistFunc(CAISS_BATCH_DIST_FUNC batchDistFunc) {
+    CAISS_FUNCTION_BEGIN
+
+    if (CAISS_MODE_DEFAULT != this->cur_mode_ && CAISS_DISTANCE_EDITION != this->distance_type_) {
+        return CAISS_RET_NO_SUPPORT;    // 批量计算函数，仅针对自定义距离生效
+    }
+
+    this->batch_dist_func_ = batchDistFunc;
+    if (nullptr != this->distance_ptr_) {
+        // 已经init过了，需要同步给距离空间和模型
+        this->distance_ptr_->set_batch_dist_func((BATCHDISTFUNC<float>)batchDistFunc);
+        auto ptr = HnswProc::getHnswSingleton();
+        if (nullptr != ptr) {
+            ptr->resetSpace(this->distance_ptr_);
+        }
+    }
+
+    CAISS_FUNCTION_END
+}
+
+
+CAISS_RET_TYPE HnswProc::setProjectionParam(CAISS_PARAM_TYPE paramType, unsigned int value) {
+    CAISS_FUNCTION_BEGIN
+
+    if (CAISS_MODE_PROCESS == this->cur_mode_) {
+        return CAISS_RET_MODE;    // 处理模式下，投影信息由模型决定
+    }
+
+    if (CAISS_PARAM_PROJECTION_TYPE == paramType) {
+        if (CAISS_PROJECTION_NONE != value
+            && CAISS_PROJECTION_PCA != value
+            && CAISS_PROJECTION_RANDOM_ROTATION != value) {
+            return CAISS_RET_PARAM;
+        }
+        this->projection_type_ = (CAISS_PROJECTION_TYPE)value;
+    } else {
+        this->projection_dim_ = value;    // 跟原始维度的关系，在训练的时候校验
+    }
+
+    CAISS_FUNCTION_END
+}
+
+
 /**
- * 现在每个lru，都是针对句柄独立的
- * @param word
- * @param searchType
+ * 训练前，拟合投影矩阵，并将训练数据转换到投影后的空间中
+ * @param datas
+ * @return
+ */
+CAISS_RET_TYPE HnswProc::fitProjection(std::vector<CaissDataNode> &datas) {
+    CAISS_FUNCTION_BEGIN
+
+    this->projection_.clear();
+    if (CAISS_PROJECTION_NONE == this->projection_type_) {
+        return CAISS_RET_OK;
+    }
+
+    if (CAISS_DISTANCE_EDITION == this->distance_type_) {
+        return CAISS_RET_NO_SUPPORT;    // 自定义距离，无法确定投影后的距离含义
+    }
+
+    unsigned int outDim = (0 == this->projection_dim_) ? this->dim_ : this->projection_dim_;
+    // 欧氏距离按照协方差拟合，内积距离按照二阶矩拟合（不减去均值，尽量保持内积信息）
+    ret = this->projection_.fit(this->projection_type_, datas, this->dim_, outDim,
+                                CAISS_DISTANCE_EUC == this->distance_type_);
+    CAISS_FUNCTION_CHECK_STATUS
+
+    for (auto &data : datas) {
+        ret = projectNode(data.node);
+        CAISS_FUNCTION_CHECK_STATUS
+    }
+
+    ret = createDistancePtr(this->dist_func_, this->storage_type_);    // 按照投影后的维度，重新生成距离空间
+    CAISS_FUNCTION_CHECK_STATUS
+
+    CAISS_ECHO("fit projection finished, dim is changed from [%d] to [%d].", this->dim_, outDim);
+    CAISS_FUNCTION_END
+}
+
+
+CAISS_RET_TYPE HnswProc::projectNode(std::vector<CAISS_FLOAT> &node) {
+    CAISS_FUNCTION_BEGIN
+
+    if (!this->projection_.isEnable()) {
+        return CAISS_RET_OK;
+    }
+
+    if (node.size() != this->projection_.getInDim()) {
+        return CAISS_RET_DIM;
+    }
+
+    std::vector<CAISS_FLOAT> result;
+    ret = this->projection_.transform(node.data(), result, CAISS_FALSE != this->normalize_);    // 投影后需要重新归一化
+    CAISS_FUNCTION_CHECK_STATUS
+
+    node.swap(result);
+    CAISS_FUNCTION_END
+}
+
+
+CAISS_RET_TYPE HnswProc::setBinarySearch(unsigned int value) {
+    CAISS_FUNCTION_BEGIN
+
+    if (CAISS_MODE_DEFAULT != this->cur_mode_ && CAISS_DISTANCE_EDITION == this->distance_type_) {
+        return CAISS_RET_NO_SUPPORT;    // 自定义距离，向量不一定是连续的数值信息
+    }
+
+    this->binary_search_ = (0 != value) ? CAISS_TRUE : CAISS_FALSE;
+    if (CAISS_MODE_PROCESS == this->cur_mode_) {
+        ret = applyBinarySearch();    // 已经加载模型了，直接生成（或清空）二值编码
+        CAISS_FUNCTION_CHECK_STATUS
+    }
+
+    CAISS_FUNCTION_END
+}
+
+
+/**
+ * 根据binary_search_的设定，生成或清空模型中的二值编码。仅在处理模式下调用
+ * @return
+ */
+CAISS_RET_TYPE HnswProc::applyBinarySearch() {
+    CAISS_FUNCTION_BEGIN
+    auto ptr = HnswProc::getHnswSingleton();
+    CAISS_ASSERT_NOT_NULL(ptr)
+
+    if (CAISS_FALSE == this->binary_search_) {
+        if (0 != ptr->binary_dim_) {
+            ptr->disableBinaryCodes();
+        }
+        return CAISS_RET_OK;
+    }
+
+    if (CAISS_DISTANCE_EDITION == this->distance_type_) {
+        return CAISS_RET_NO_SUPPORT;
+    }
+
+    if (ptr->binary_dim_ != getModelDim()) {
+        ptr->enableBinaryCodes(getModelDim());    // 多个句柄共用一个模型，已经生成过了，则不重复生成
+    }
+
+    CAISS_FUNCTION_END
+}
+
+
+CAISS_RET_TYPE HnswProc::setDeltaSize(unsigned int value) {
+    CAISS_FUNCTION_BEGIN
+
+    if (value > DELTA_SIZE_MAX) {
+        return CAISS_RET_PARAM;
+    }
+
+    this->delta_size_ = value;
+    if (CAISS_MODE_PROCESS == this->cur_mode_) {
+        ret = applyDeltaSize();    // 已经加载模型了，直接生效（所有句柄共用一个增量段）
+        CAISS_FUNCTION_CHECK_STATUS
+    }
+
+    CAISS_FUNCTION_END
+}
+
+
+/**
+ * 根据delta_size_的设定，调整模型中增量段的容量。仅在处理模式下调用
+ * @return
+ */
+CAISS_RET_TYPE HnswProc::applyDeltaSize() {
+    CAISS_FUNCTION_BEGIN
+    auto ptr = HnswProc::getHnswSingleton();
+    CAISS_ASSERT_NOT_NULL(ptr)
+
+    std::lock_guard<std::mutex> lock(HnswProc::hnsw_insert_lock_);    // 调整容量的时候，不能有插入
+    ptr->setDeltaCapacity(this->delta_size_);
+
+    CAISS_FUNCTION_END
+}
+
+
+/**
+ * 将增量段中的结果合并进result中（大顶堆）。合入图的过程中，同一个点可能同时出现在两边，以增量段中的为准
+ * @param query 归一化（投影）之后的查询向量
  * @param topK
- * @param isGet
+ * @param result
  * @return
  */
-CAISS_RET_TYPE HnswProc::searchInLruCache(const char *word, const CAISS_SEARCH_TYPE searchType, const unsigned int topK,
-                                          CAISS_BOOL &isGet) {
+CAISS_RET_TYPE HnswProc::mergeDeltaResult(const CAISS_FLOAT *query, const unsigned int topK, HNSW_RET_TYPE &result) {
     CAISS_FUNCTION_BEGIN
-    CAISS_ASSERT_NOT_NULL(word)
+    auto ptr = HnswProc::getHnswSingleton();
+    CAISS_ASSERT_NOT_NULL(ptr)
 
-    isGet = CAISS_FALSE;
-    if (topK == last_topK_ && searchType == last_search_type_) {    // 查询的还是上次的topK，并且查詢的方式还是一致的话
-        std::string&& result = lru_cache_.get(std::string(word));
-        if (!result.empty()) {
-            this->result_ = (result);
-            ret = RapidJsonProc::parseResult(this->result_, this->result_words_, this->result_distance_);
-            CAISS_FUNCTION_CHECK_STATUS
-            isGet = CAISS_TRUE;    // 如果有值，直接给result赋值
+    if (0 == ptr->getDeltaSize()) {
+        return CAISS_RET_OK;
+    }
+
+    HnswSearchScratch &scratch = HnswProc::getSearchScratch();
+    HNSW_RET_TYPE &delta = scratch.delta;
+    size_t begin = 0;
+    size_t end = 0;
+    ptr->searchDelta(query, topK, scratch.algo.buffer, delta, begin, end);
+
+    scratch.candidates.clear();
+    while (!result.empty()) {
+        if (result.top().second < begin || result.top().second >= end) {
+            scratch.candidates.push_back(result.top());
         }
-    } else {
-        lru_cache_.clear();    // 如果topK有变动，或者有信息插入的话，清空缓存信息
+        result.pop();
+    }
+
+    for (const auto &cur : scratch.candidates) {
+        result.push(cur);
+    }
+    while (!delta.empty()) {
+        result.push(delta.top());
+        delta.pop();
+    }
+
+    CAISS_FUNCTION_END
+}
+
+
+/**
+ * 物化模型中每个词语的近邻列表。候选个数不少于innerSearch中的设定，保证直接读取列表的结果不会更差
+ * @param listSize 不包含词语自身的近邻个数。列表中还会保存词语自身，按照编辑距离过滤掉之后，仍然有listSize个结果
+ * @return
+ */
+CAISS_RET_TYPE HnswProc::buildNeighborLists(unsigned int listSize) {
+    CAISS_FUNCTION_BEGIN
+    auto ptr = HnswProc::getHnswSingleton();
+    CAISS_ASSERT_NOT_NULL(ptr)
+
+    CAISS_ECHO("start to build neighbor lists, list size is [%d], please wait for a moment...", listSize);
+    ptr->buildNeighborLists(listSize + 1, std::max((listSize + 1) * 7, (unsigned int)ptr->ef_construction_));
+
+    CAISS_FUNCTION_END
+}
+
+
+/**
+ * 通过物化的近邻列表，获取词语的查询结果
+ * @param info
+ * @param label 词语对应的label
+ * @param topK
+ * @param filterEditDistance
+ * @param result
+ * @param isGet 列表不可用，或者过滤之后数量不足的时候，为false，需要查询图结构
+ * @return
+ */
+CAISS_RET_TYPE HnswProc::searchInNeighborList(void *info, int label, unsigned int topK, unsigned int filterEditDistance,
+                                              HNSW_RET_TYPE &result, CAISS_BOOL &isGet) {
+    CAISS_FUNCTION_BEGIN
+    auto ptr = HnswProc::getHnswSingleton();
+    CAISS_ASSERT_NOT_NULL(ptr)
+
+    isGet = CAISS_FALSE;
+    if (!ptr->getNeighborList((labeltype)label, topK, result)) {
+        return CAISS_RET_OK;
+    }
+
+    bool isFull = (result.size() >= (size_t)ptr->neighbor_list_size_);    // 列表没填满，说明模型中的点已经全部在列表中了
+    if (0 != ptr->getDeltaSize()) {
+        // 增量段中的点还没有合入图中，不在任何列表里，跟列表的结果合并
+        HnswSearchScratch &scratch = HnswProc::getSearchScratch();
+        ptr->getDataByLabel<CAISS_FLOAT>(label, scratch.query);
+        ret = mergeDeltaResult(scratch.query.data(), (unsigned int)ptr->neighbor_list_size_, result);
+        CAISS_FUNCTION_CHECK_STATUS
+    }
+
+    ret = filterByEditDistance(info, CAISS_SEARCH_WORD, result, filterEditDistance);
+    CAISS_FUNCTION_CHECK_STATUS
+
+    ret = filterByIgnoreTrie(result);
+    CAISS_FUNCTION_CHECK_STATUS
+
+    if (result.size() < topK && isFull) {
+        return CAISS_RET_OK;    // 过滤掉的太多了，列表中的点不够用
     }
 
+    while (result.size() > topK) {
+        result.pop();
+    }
+    isGet = CAISS_TRUE;
+
     CAISS_FUNCTION_END
 }
 
 
+unsigned int HnswProc::getModelDim() {
+    return this->projection_.isEnable() ? this->projection_.getOutDim() : this->dim_;
+}
+
+
+void HnswProc::getCacheScope(std::string &scope) {
+    scope.assign(this->model_path_);
+    if (this->binary_search_) {
+        scope += "|binary";    // 二值粗筛的结果跟默认查询不同
+    }
+}
+
+
 CAISS_RET_TYPE
 HnswProc::filterByRules(void *info, const CAISS_SEARCH_TYPE searchType, HNSW_RET_TYPE &result, unsigned int topK,
                         const unsigned int filterEditDistance) {
@@ -498,19 +1180,21 @@ HnswProc::filterByEditDistance(void *info, CAISS_SEARCH_TYPE searchType, HNSW_RE
     auto ptr = HnswProc::getHnswSingleton();
     CAISS_ASSERT_NOT_NULL(ptr)
 
-    string word = std::string((char *)info);    // 已经确定是查词语类型的了
-    HNSW_RET_TYPE resultBackUp;
-
+    HnswSearchScratch &scratch = HnswProc::getSearchScratch();
+    scratch.word.assign((const char *)info);    // 已经确定是查词语类型的了
+    scratch.candidates.clear();
     while (!result.empty()) {
-        auto cur = result.top();
+        scratch.candidates.push_back(result.top());
         result.pop();
-        string candWord = ptr->index_lookup_.left.find(cur.second)->second;    // 这里的label，是单词信息
-        if (EditDistanceProc::BeyondEditDistance(candWord, word, filterEditDistance)) {
-            resultBackUp.push(cur);    // 仅添加超过范围的
+    }
+
+    for (const auto &cur : scratch.candidates) {
+        ptr->getWordByLabel(cur.second, scratch.candidate);    // 这里的label，是单词信息
+        if (EditDistanceProc::BeyondEditDistance(scratch.candidate, scratch.word, filterEditDistance)) {
+            result.push(cur);    // 仅添加超过范围的
         }
     }
 
-    result = resultBackUp;
     CAISS_FUNCTION_END
 }
 
@@ -529,18 +1213,20 @@ CAISS_RET_TYPE HnswProc::filterByIgnoreTrie(HNSW_RET_TYPE &result) {
     auto ptr = HnswProc::getHnswSingleton();
     CAISS_ASSERT_NOT_NULL(ptr)
 
-    HNSW_RET_TYPE resultBackUp;
-
+    HnswSearchScratch &scratch = HnswProc::getSearchScratch();
+    std::vector<std::pair<CAISS_FLOAT, labeltype>> &candidates = scratch.candidates;
+    candidates.clear();
     while (!result.empty()) {
-        auto cur = result.top();
+        candidates.push_back(result.top());
         result.pop();
-        string candWord = ptr->index_lookup_.left.find(cur.second)->second;
-        if (!AlgorithmProc::getIgnoreTrie()->find(candWord)) {
-            resultBackUp.push(cur);    // 如果这些词语，不在过滤trie树上，就添加进来
-        }
     }
 
-    result = resultBackUp;
+    for (const auto &cur : candidates) {
+        ptr->getWordByLabel(cur.second, scratch.candidate);
+        if (!AlgorithmProc::getIgnoreTrie()->find(scratch.candidate)) {
+            result.push(cur);    // 如果这些词语，不在过滤trie树上，就添加进来
+        }
+    }
 
     CAISS_FUNCTION_END
 }
@@ -573,16 +1259,19 @@ CAISS_RET_TYPE HnswProc::createHnswSingleton(SpaceInterface<CAISS_FLOAT>* distan
  * 加载模型的时候，使用的构建方式（static成员函数）
  * @param distance_ptr
  * @param modelPath
+ * @param hotBytes 分层模式下常驻内存的字节数，为0表示全部读入内存
  * @return
  */
-CAISS_RET_TYPE HnswProc::createHnswSingleton(SpaceInterface<CAISS_FLOAT> *distance_ptr, const std::string &modelPath) {
+CAISS_RET_TYPE HnswProc::createHnswSingleton(SpaceInterface<CAISS_FLOAT> *distance_ptr, const std::string &modelPath,
+                                             size_t hotBytes) {
     CAISS_FUNCTION_BEGIN
 
     if (nullptr == HnswProc::hnsw_algo_ptr_) {
         HnswProc::hnsw_algo_lock_.writeLock();
         if (nullptr == HnswProc::hnsw_algo_ptr_) {
             // 这里是static函数信息，只能通过传递值下来的方式实现
-            HnswProc::hnsw_algo_ptr_ = new HierarchicalNSW<CAISS_FLOAT>(distance_ptr, modelPath, AlgorithmProc::getIgnoreTrie());
+            HnswProc::hnsw_algo_ptr_ = new HierarchicalNSW<CAISS_FLOAT>(distance_ptr, modelPath, AlgorithmProc::getIgnoreTrie(),
+                                                                       0, hotBytes);
         }
         HnswProc::hnsw_algo_lock_.writeUnlock();
     }
@@ -608,6 +1297,16 @@ HierarchicalNSW<CAISS_FLOAT> *HnswProc::getHnswSingleton() {
 }
 
 
+/**
+ * 获取当前线程的查询临时空间。同一个线程中的所有句柄共用，查询稳定之后不再申请内存
+ * @return
+ */
+HnswSearchScratch &HnswProc::getSearchScratch() {
+    static thread_local HnswSearchScratch scratch;
+    return scratch;
+}
+
+
 CAISS_RET_TYPE HnswProc::insertByOverwrite(CAISS_FLOAT *node, unsigned int label, const char *index) {
     CAISS_FUNCTION_BEGIN
 
@@ -629,6 +1328,32 @@ CAISS_RET_TYPE HnswProc::insertByOverwrite(CAISS_FLOAT *node, unsigned int label
 }
 
 
+/**
+ * 写入增量段中
+ * @param node
+ * @param index
+ * @param insertType
+ * @return
+ */
+CAISS_RET_TYPE HnswProc::insertByDelta(CAISS_FLOAT *node, const char *index, CAISS_INSERT_TYPE insertType) {
+    CAISS_FUNCTION_BEGIN
+
+    CAISS_ASSERT_NOT_NULL(node)
+    CAISS_ASSERT_NOT_NULL(index)
+    auto ptr = HnswProc::getHnswSingleton();
+    CAISS_ASSERT_NOT_NULL(ptr)
+
+    if (CAISS_INSERT_OVERWRITE != insertType && CAISS_INSERT_DISCARD != insertType) {
+        return CAISS_RET_PARAM;
+    }
+
+    ret = ptr->insertDelta(node, index, CAISS_INSERT_OVERWRITE == insertType);
+    CAISS_FUNCTION_CHECK_STATUS
+
+    CAISS_FUNCTION_END
+}
+
+
 CAISS_RET_TYPE HnswProc::insertByDiscard(CAISS_FLOAT *node, unsigned int label, const char *index) {
     CAISS_FUNCTION_BEGIN
 
@@ -649,39 +1374,82 @@ CAISS_RET_TYPE HnswProc::insertByDiscard(CAISS_FLOAT *node, unsigned int label,
 
 
 /**
- * 内部真实查询信息的时候，使用的函数。可以确保不用进入process状态，也可以查询
+ * 查询结果，并写入details中。可以缓存的查询，优先从进程共用的缓存中获取
  * @param info
  * @param searchType
  * @param topK
  * @param filterEditDistance
+ * @param details
  * @return
  */
-CAISS_RET_TYPE HnswProc::innerSearchResult(void *info, const CAISS_SEARCH_TYPE searchType, const unsigned int topK,
-                                           const unsigned int filterEditDistance) {
+CAISS_RET_TYPE HnswProc::innerSearchDetails(void *info, const CAISS_SEARCH_TYPE searchType, const unsigned int topK,
+                                            const unsigned int filterEditDistance, std::vector<CaissResultDetail> &details) {
+    CAISS_FUNCTION_BEGIN
+
+    // details不提前清空，命中缓存或者查询完毕之后按照结果个数调整，其中词语的内存可以重复使用
+    unsigned long long generation = 0;
+    static thread_local std::string key;
+    buildResultCacheKey(info, searchType, filterEditDistance, key);
+    if (!key.empty() && AlgorithmProc::getResultCache()->get(this->model_path_, key, topK, details, generation)) {
+        return CAISS_RET_OK;    // 命中缓存，不需要再查询
+    }
+
+    HNSW_RET_TYPE &result = HnswProc::getSearchScratch().result;
+    ret = innerSearch(info, searchType, topK, filterEditDistance, result);
+    if (CAISS_RET_OK != ret) {
+        details.clear();
+        return ret;
+    }
+
+    ret = buildResultDetails(result, details);
+    CAISS_FUNCTION_CHECK_STATUS
+
+    if (!key.empty()) {
+        AlgorithmProc::getResultCache()->put(this->model_path_, key, generation, topK, details);
+    }
+
+    CAISS_FUNCTION_END
+}
+
+
+/**
+ * 查询并过滤，获取最终的topK个结果（大顶堆）
+ * @param info
+ * @param searchType
+ * @param topK
+ * @param filterEditDistance
+ * @param result
+ * @return
+ */
+CAISS_RET_TYPE HnswProc::innerSearch(void *info, const CAISS_SEARCH_TYPE searchType, const unsigned int topK,
+                                     const unsigned int filterEditDistance, HNSW_RET_TYPE &result) {
     CAISS_FUNCTION_BEGIN
 
     CAISS_ASSERT_NOT_NULL(info)
     auto ptr = HnswProc::getHnswSingleton();
     CAISS_ASSERT_NOT_NULL(ptr)
 
-    std::vector<CAISS_FLOAT> vec;
-    vec.reserve(this->dim_);
+    HnswSearchScratch &scratch = HnswProc::getSearchScratch();
+    std::vector<CAISS_FLOAT> &vec = scratch.query;
+    while (!result.empty()) {
+        result.pop();    // 上次查询异常退出时可能有残留，逐个弹出可以保留已申请的内存
+    }
+    int label = -1;
 
     switch (searchType) {
         case CAISS_SEARCH_QUERY:
         case CAISS_LOOP_QUERY: {    // 如果传入的是query信息的话
-            for (int i = 0; i < this->dim_; i++) {
-                vec.push_back(*((CAISS_FLOAT *)info + i));
-            }
+            vec.assign((CAISS_FLOAT *)info, (CAISS_FLOAT *)info + this->dim_);
             ret = normalizeNode(vec, this->dim_);    // 前面将信息转成query的形式
+            if (CAISS_RET_OK == ret) {
+                ret = projectNode(vec);
+            }
             break;
         }
         case CAISS_SEARCH_WORD:
         case CAISS_LOOP_WORD: {    // 过传入的是word信息的话
-            int label = ptr->findWordLabel((const char *)info);
-            if (-1 != label) {
-                vec = ptr->getDataByLabel<CAISS_FLOAT>(label);    // 找到word的情况，这种情况下，不需要做normalize。因为存入的时候，已经设定好了
-            } else {
+            label = ptr->findWordLabel((const char *)info);
+            if (-1 == label) {
                 ret = CAISS_RET_NO_WORD;    // 没有找到word的情况
             }
             break;
@@ -693,19 +1461,35 @@ CAISS_RET_TYPE HnswProc::innerSearchResult(void *info, const CAISS_SEARCH_TYPE s
 
     CAISS_FUNCTION_CHECK_STATUS
 
-    unsigned int queryTopK = std::max(topK*7, this->neighbors_);    // 表示7分(*^▽^*)
-    auto *query = (CAISS_FLOAT *)vec.data();
-    HNSW_RET_TYPE&& result = isAnnSearchType(searchType)
-            ? ptr->searchKnn((void *)query, queryTopK) : ptr->forceLoop((void *)query, queryTopK);
+    CAISS_BOOL isGet = CAISS_FALSE;
+    if (CAISS_SEARCH_WORD == searchType) {
+        ret = searchInNeighborList(info, label, topK, filterEditDistance, result, isGet);    // 优先使用物化的近邻列表
+        CAISS_FUNCTION_CHECK_STATUS
+    }
 
-    // 需要加入一步过滤机制
-    ret = filterByRules(info, searchType, result, topK, filterEditDistance);
-    CAISS_FUNCTION_CHECK_STATUS
+    if (!isGet) {
+        if (isWordSearchType(searchType)) {
+            // 找到word的情况，这种情况下，不需要做normalize和投影。因为存入的时候，已经设定好了
+            ptr->getDataByLabel<CAISS_FLOAT>(label, vec);
+        }
 
-    ret = buildResult(query, searchType, result);
-    CAISS_FUNCTION_CHECK_STATUS
+        auto *query = (CAISS_FLOAT *)vec.data();
+        unsigned int queryTopK = std::max(topK*7, this->neighbors_);    // 表示7分(*^▽^*)
+        if (isAnnSearchType(searchType)) {
+            ptr->searchKnn((void *)query, queryTopK, scratch.algo, result);
+        } else {
+            result = ptr->forceLoop((void *)query, queryTopK);
+        }
+
+        ret = mergeDeltaResult(query, queryTopK, result);    // 还没有合入图中的点，在增量段中查询
+        CAISS_FUNCTION_CHECK_STATUS
 
-    CAISS_FUNCTION_END;
+        // 需要加入一步过滤机制
+        ret = filterByRules(info, searchType, result, topK, filterEditDistance);
+        CAISS_FUNCTION_CHECK_STATUS
+    }
+
+    CAISS_FUNCTION_END
 }
 
 
@@ -717,6 +1501,10 @@ CAISS_RET_TYPE HnswProc::checkModelPrecisionEnable(const float targetPrecision,
 
     unsigned int suitableTimes = 0;
     unsigned int calcTimes = min((int)datas.size(), 10000);    // 最多10000次比较
+    unsigned int loopThreadNum = 0;    // 暴力查询的线程数，为0表示自动决定
+    #ifdef _USE_OPENMP_
+        loopThreadNum = 1;    // 外层已经并行了，暴力查询内部不再开线程
+    #endif
 
     {
         #ifdef _USE_OPENMP_
@@ -724,7 +1512,7 @@ CAISS_RET_TYPE HnswProc::checkModelPrecisionEnable(const float targetPrecision,
         #endif
         for (unsigned int i = 0; i < calcTimes; i++) {
             auto fastResult = ptr->searchKnn((void *)datas[i].node.data(), fastRank);    // 记住，fastResult是倒叙的
-            auto realResult = ptr->forceLoop((void *)datas[i].node.data(), realRank);
+            auto realResult = ptr->forceLoop((void *)datas[i].node.data(), realRank, loopThreadNum);
             float fastFarDistance = fastResult.top().first;
             float realFarDistance = realResult.top().first;
 
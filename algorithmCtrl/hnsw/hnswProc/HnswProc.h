@@ -6,16 +6,31 @@
 #define CAISS_HNSWPROC_H
 
 #include <list>
+#include <mutex>
 #include <./boost/bimap/bimap.hpp>
 #include <immintrin.h>
 
 #include "../hnswAlgo/hnswlib.h"
 #include "../../AlgorithmProc.h"
+#include "../../common/NNDescent.h"
 #include "./HnswProcDefine.h"
 
 using namespace hnswlib;
 using HNSW_RET_TYPE = std::priority_queue<std::pair<CAISS_FLOAT, labeltype>>;
 
+/**
+ * 查询时使用的临时空间，每个线程一份。其中的容器只清空不释放，查询稳定之后不再申请内存
+ */
+struct HnswSearchScratch {
+    std::vector<CAISS_FLOAT> query;    // 归一化（投影）之后的查询向量
+    HNSW_RET_TYPE result;    // 查询结果（大顶堆），使用完毕之后为空
+    std::vector<std::pair<CAISS_FLOAT, labeltype>> candidates;    // 过滤时暂存的结果
+    std::string word;    // 过滤时使用的查询词语
+    std::string candidate;    // 过滤时使用的候选词语
+    HNSW_RET_TYPE delta;    // 增量段中的查询结果（大顶堆），使用完毕之后为空
+    HierarchicalNSW<CAISS_FLOAT>::SearchScratch algo;
+};
+
 class HnswProc : public AlgorithmProc {
 
 public:
@@ -36,24 +51,52 @@ public:
 
     // process_mode
     CAISS_RET_TYPE search(void *info, CAISS_SEARCH_TYPE searchType, unsigned int topK, unsigned int filterEditDistance, CAISS_SEARCH_CALLBACK searchCBFunc, const void *cbParams) override;
+    CAISS_RET_TYPE searchEx(void *info, CAISS_SEARCH_TYPE searchType, unsigned int topK, unsigned int filterEditDistance,
+                            CAISS_SEARCH_EX_CALLBACK searchCBFunc, const void *cbParams) override;
+    CAISS_RET_TYPE searchWithContext(void *info, CAISS_SEARCH_TYPE searchType, unsigned int topK,
+                                     unsigned int filterEditDistance, AlgorithmSearchContext *context,
+                                     CAISS_SEARCH_EX_CALLBACK searchCBFunc, const void *cbParams) override;
     CAISS_RET_TYPE insert(CAISS_FLOAT *node, const char *index, CAISS_INSERT_TYPE insertType) override;
+    CAISS_RET_TYPE insertBatch(CAISS_FLOAT *nodes, const char **indexes, unsigned int num,
+                               CAISS_INSERT_TYPE insertType) override;
+    bool supportConcurrentInsert() override;
     CAISS_RET_TYPE save(const char *modelPath) override;    // 默认写成是当前模型的
     CAISS_RET_TYPE getResultSize(unsigned int& size) override;
     CAISS_RET_TYPE getResult(char *result, unsigned int size) override;
     CAISS_RET_TYPE ignore(const char *label, bool isIgnore) override;
+    CAISS_RET_TYPE setParam(CAISS_PARAM_TYPE paramType, const void *value) override;
 
 
 protected:
     CAISS_RET_TYPE reset();
     CAISS_RET_TYPE loadDatas(const char *dataPath, std::vector<CaissDataNode> &datas);
-    CAISS_RET_TYPE trainModel(std::vector<CaissDataNode> &datas, unsigned int showSpan);
-    CAISS_RET_TYPE buildResult(const CAISS_FLOAT *query, CAISS_SEARCH_TYPE searchType,
-                               HNSW_RET_TYPE &predResult);
+    CAISS_RET_TYPE trainModel(std::vector<CaissDataNode> &datas, const std::vector<std::vector<unsigned>> &knnGraph,
+                              unsigned int showSpan);
+    CAISS_RET_TYPE buildKnnGraph(const std::vector<CaissDataNode> &datas, std::vector<std::vector<unsigned>> &knnGraph);
+    CAISS_RET_TYPE seedBaseLayer(const std::vector<std::vector<unsigned>> &knnGraph);
+    CAISS_RET_TYPE buildResult(CAISS_SEARCH_TYPE searchType);
+    CAISS_RET_TYPE buildResultDetails(HNSW_RET_TYPE &predResult, std::vector<CaissResultDetail> &details);
     CAISS_RET_TYPE loadModel(const char *modelPath);
-    CAISS_RET_TYPE createDistancePtr(CAISS_DIST_FUNC distFunc);
-    CAISS_RET_TYPE innerSearchResult(void *info, CAISS_SEARCH_TYPE searchType, unsigned int topK,
-                                    unsigned int filterEditDistance);
-    CAISS_RET_TYPE searchInLruCache(const char *word, CAISS_SEARCH_TYPE searchType, unsigned int topK, CAISS_BOOL &isGet);
+    CAISS_RET_TYPE createDistancePtr(CAISS_DIST_FUNC distFunc, CAISS_STORAGE_TYPE storageType);
+    CAISS_RET_TYPE setStorageType(unsigned int storageType);
+    CAISS_RET_TYPE setBatchDistFunc(CAISS_BATCH_DIST_FUNC batchDistFunc);
+    CAISS_RET_TYPE setProjectionParam(CAISS_PARAM_TYPE paramType, unsigned int value);
+    CAISS_RET_TYPE fitProjection(std::vector<CaissDataNode> &datas);
+    CAISS_RET_TYPE projectNode(std::vector<CAISS_FLOAT> &node);
+    CAISS_RET_TYPE setBinarySearch(unsigned int value);
+    CAISS_RET_TYPE applyBinarySearch();
+    CAISS_RET_TYPE setDeltaSize(unsigned int value);
+    CAISS_RET_TYPE applyDeltaSize();
+    CAISS_RET_TYPE mergeDeltaResult(const CAISS_FLOAT *query, unsigned int topK, HNSW_RET_TYPE &result);
+    CAISS_RET_TYPE buildNeighborLists(unsigned int listSize);
+    CAISS_RET_TYPE searchInNeighborList(void *info, int label, unsigned int topK, unsigned int filterEditDistance,
+                                        HNSW_RET_TYPE &result, CAISS_BOOL &isGet);
+    unsigned int getModelDim();
+    void getCacheScope(std::string &scope) override;
+    CAISS_RET_TYPE innerSearchDetails(void *info, CAISS_SEARCH_TYPE searchType, unsigned int topK,
+                                      unsigned int filterEditDistance, std::vector<CaissResultDetail> &details);
+    CAISS_RET_TYPE innerSearch(void *info, CAISS_SEARCH_TYPE searchType, unsigned int topK,
+                               unsigned int filterEditDistance, HNSW_RET_TYPE &result);
 
     /* 函数过滤条件 */
     CAISS_RET_TYPE filterByRules(void *info, CAISS_SEARCH_TYPE searchType, HNSW_RET_TYPE &result, unsigned int topK,
@@ -66,21 +109,36 @@ protected:
 private:
     static CAISS_RET_TYPE createHnswSingleton(SpaceInterface<CAISS_FLOAT> *distance_ptr, unsigned int maxDataSize, CAISS_BOOL normalize, unsigned int maxIndexSize=64,
                                               unsigned int maxNeighbor=32, unsigned int efSearch=100, unsigned int efConstruction=100);
-    static CAISS_RET_TYPE createHnswSingleton(SpaceInterface<CAISS_FLOAT> *distance_ptr, const std::string &modelPath);
+    static CAISS_RET_TYPE createHnswSingleton(SpaceInterface<CAISS_FLOAT> *distance_ptr, const std::string &modelPath,
+                                              size_t hotBytes=0);
     static CAISS_RET_TYPE destroyHnswSingleton();
     static CAISS_RET_TYPE checkModelPrecisionEnable(float targetPrecision, unsigned int fastRank, unsigned int realRank,
                                                     const std::vector<CaissDataNode> &datas, float &calcPrecision);
 
     static HierarchicalNSW<CAISS_FLOAT>* getHnswSingleton();
+    static HnswSearchScratch &getSearchScratch();
     static CAISS_RET_TYPE insertByOverwrite(CAISS_FLOAT *node, unsigned int label, const char *index);
     static CAISS_RET_TYPE insertByDiscard(CAISS_FLOAT *node, unsigned int label, const char *index);
+    static CAISS_RET_TYPE insertByDelta(CAISS_FLOAT *node, const char *index, CAISS_INSERT_TYPE insertType);
 
     static HierarchicalNSW<CAISS_FLOAT>*     hnsw_algo_ptr_;
     static RWLock                            hnsw_algo_lock_;
+    static std::mutex                        hnsw_insert_lock_;    // 保证同一时刻只有一个插入
 
 private:
     SpaceInterface<CAISS_FLOAT>*             distance_ptr_;    // 其实，这里也可以考虑用static了
     unsigned int                             neighbors_;
+    CAISS_DIST_FUNC                          dist_func_;
+    CAISS_STORAGE_TYPE                       storage_type_;    // 训练时使用的存储格式（通过setParam设定，init时不清空）
+    CAISS_BATCH_DIST_FUNC                    batch_dist_func_;    // 自定义距离的批量计算函数（通过setParam设定，init时不清空）
+    CAISS_PROJECTION_TYPE                    projection_type_;    // 训练时使用的投影方式（通过setParam设定，init时不清空）
+    unsigned int                             projection_dim_;
+    ProjectionProc                           projection_;    // 当前模型对应的投影信息
+    CAISS_BOOL                               binary_search_;    // 是否开启二值粗筛查询（通过setParam设定，init时不清空）
+    CAISS_BOOL                               knn_graph_seed_;    // 训练时是否用kNN图补充第0层邻居（通过setParam设定，init时不清空）
+    unsigned int                             hot_memory_;    // 分层模式下常驻内存的大小（MB），为0表示不分层（通过setParam设定，init时不清空）
+    unsigned int                             neighbor_list_size_;    // 每个词语物化的近邻个数，为0表示以模型为准（通过setParam设定，init时不清空）
+    unsigned int                             delta_size_;    // 插入时增量段容纳的点数，为0表示直接插入图中（通过setParam设定，init时不清空）
 };
 
 
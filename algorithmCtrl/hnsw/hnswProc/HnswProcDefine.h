@@ -10,6 +10,9 @@
 const static unsigned int NEIGHBOR_NUMS_DEFAULT = 64;
 const static unsigned int EF_SEARCH_DEFAULT = 200;
 const static unsigned int EF_CONSTRUCTOR_DEFAULT = 200;
+const static unsigned int NEIGHBOR_LIST_SIZE_MAX = 1024;    // 每个词语物化的近邻个数的上限
+const static unsigned int DELTA_SIZE_DEFAULT = 0;    // 插入时增量段默认容纳的点数（默认不使用增量段，直接插入图中）
+const static unsigned int DELTA_SIZE_MAX = 65536;    // 增量段容纳的点数的上限（查询时需要逐个计算距离）
 
 struct HnswTrainParams {
     explicit HnswTrainParams(unsigned int step) {
@@ -0,0 +1,448 @@
+//
+// Created by Chunel on 2020/10/4.
+//
+
+#include <fstream>
+#include <algorithm>
+#include <limits>
+
+#include "IvfIndex.h"
+#include "../../common/KMeans.h"
+#include "../../flat/flatAlgo/FlatKernel.h"
+#include "../../flat/flatAlgo/FlatIndex.h"
+
+using namespace std;
+
+template<typename T>
+static void writeIvfPOD(std::ostream &out, const T &podRef) {
+    out.write((char *) &podRef, sizeof(T));
+}
+
+template<typename T>
+static void readIvfPOD(std::istream &in, T &podRef) {
+    in.read((char *) &podRef, sizeof(T));
+}
+
+static void writeIvfString(std::ostream &out, const std::string &str) {
+    auto len = (unsigned int)str.size();
+    writeIvfPOD(out, len);
+    out.write(str.data(), len);
+}
+
+static void readIvfString(std::istream &in, std::string &str) {
+    unsigned int len = 0;
+    readIvfPOD(in, len);
+    str.resize(len);
+    in.read(&str[0], len);
+}
+
+
+IvfIndex::IvfIndex() {
+    this->dim_ = 0;
+    this->distance_type_ = CAISS_DISTANCE_DEFAULT;
+    this->max_size_ = 0;
+    this->max_index_size_ = 0;
+    this->normalize_ = CAISS_FALSE;
+    this->nlist_ = 0;
+    this->nprobe_ = 1;
+}
+
+
+IvfIndex::IvfIndex(unsigned int dim, CAISS_DISTANCE_TYPE distanceType, unsigned int maxSize,
+                   unsigned int maxIndexSize, CAISS_BOOL normalize) {
+    this->dim_ = dim;
+    this->distance_type_ = distanceType;
+    this->max_size_ = maxSize;
+    this->max_index_size_ = maxIndexSize;
+    this->normalize_ = normalize;
+    this->nlist_ = 0;
+    this->nprobe_ = 1;
+}
+
+
+CAISS_RET_TYPE IvfIndex::build(const std::vector<CAISS_FLOAT> &datas, const std::vector<std::string> &words,
+                               unsigned int nlist) {
+    CAISS_FUNCTION_BEGIN
+
+    auto size = (unsigned int)words.size();
+    if (0 == size || datas.size() != (size_t)size * this->dim_) {
+        return CAISS_RET_PARAM;
+    }
+
+    nlist = std::max(std::min(nlist, size), 1u);
+    KMeans kmeans(this->dim_, this->distance_type_);
+    ret = kmeans.train(datas.data(), size, nlist, this->centroids_);
+    CAISS_FUNCTION_CHECK_STATUS
+
+    this->nlist_ = nlist;
+    this->centroid_norms_.resize(nlist);
+    for (unsigned int i = 0; i < nlist; i++) {
+        const CAISS_FLOAT *cur = this->centroids_.data() + (size_t)i * this->dim_;
+        this->centroid_norms_[i] = FlatDot(cur, cur, this->dim_);
+    }
+
+    this->lists_.assign(nlist, IvfList());
+    this->locations_.clear();
+    this->words_.clear();
+    this->word_lookup_.clear();
+
+    // 全量数据一起分配倒排表，比逐个插入的时候计算更快
+    std::vector<unsigned int> labels;
+    kmeans.assign(datas.data(), size, this->centroids_.data(), nlist, labels, nullptr);
+    for (unsigned int i = 0; i < size; i++) {
+        const std::string &word = words[i];
+        if (word.empty() || word.size() > this->max_index_size_) {
+            return CAISS_RET_WORD_SIZE;
+        }
+
+        const CAISS_FLOAT *node = datas.data() + (size_t)i * this->dim_;
+        auto cur = this->word_lookup_.find(word);
+        if (cur != this->word_lookup_.end()) {
+            removeFromList(cur->second);    // 重复的词语，以最后一次出现的为准
+            appendToList(labels[i], cur->second, node);
+            continue;
+        }
+
+        if (this->words_.size() >= this->max_size_) {
+            return CAISS_RET_MODEL_SIZE;
+        }
+
+        auto id = (unsigned int)this->words_.size();
+        this->word_lookup_[word] = id;
+        this->words_.push_back(word);
+        this->locations_.emplace_back(0, 0);
+        appendToList(labels[i], id, node);
+    }
+
+    CAISS_FUNCTION_END
+}
+
+
+CAISS_RET_TYPE IvfIndex::addPoint(const CAISS_FLOAT *node, const std::string &word, bool overwrite) {
+    CAISS_FUNCTION_BEGIN
+    CAISS_ASSERT_NOT_NULL(node)
+
+    if (word.empty() || word.size() > this->max_index_size_) {
+        return CAISS_RET_WORD_SIZE;
+    }
+
+    if (0 == this->nlist_) {
+        return CAISS_RET_MODEL_SIZE;    // 还没有训练聚类中心
+    }
+
+    std::vector<unsigned int> lists;
+    searchLists(node, 1, lists);
+
+    auto cur = this->word_lookup_.find(word);
+    if (cur != this->word_lookup_.end()) {
+        if (overwrite) {
+            removeFromList(cur->second);
+            appendToList(lists[0], cur->second, node);
+        }
+        return CAISS_RET_OK;
+    }
+
+    if (this->words_.size() >= this->max_size_) {
+        return CAISS_RET_MODEL_SIZE;
+    }
+
+    auto id = (unsigned int)this->words_.size();
+    this->word_lookup_[word] = id;
+    this->words_.push_back(word);
+    this->locations_.emplace_back(0, 0);
+    appendToList(lists[0], id, node);
+
+    CAISS_FUNCTION_END
+}
+
+
+CAISS_RET_TYPE IvfIndex::search(const CAISS_FLOAT *query, unsigned int topK, unsigned int nprobe,
+                                ALGO_RET_TYPE &result) const {
+    CAISS_FUNCTION_BEGIN
+    CAISS_ASSERT_NOT_NULL(query)
+
+    if (0 == topK || 0 == this->nlist_) {
+        return CAISS_RET_OK;
+    }
+
+    std::vector<unsigned int> lists;
+    searchLists(query, (0 != nprobe) ? nprobe : this->nprobe_, lists);
+
+    CAISS_FLOAT queryNorm = FlatDot(query, query, this->dim_);
+    CAISS_FLOAT threshold = std::numeric_limits<CAISS_FLOAT>::max();
+    std::vector<std::pair<CAISS_FLOAT, unsigned int>> heap;
+    heap.reserve(topK + 1);
+    for (auto listId : lists) {
+        searchInList(this->lists_[listId], query, queryNorm, topK, heap, threshold);
+    }
+
+    result = ALGO_RET_TYPE(std::less<std::pair<CAISS_FLOAT, unsigned int>>(), std::move(heap));
+    CAISS_FUNCTION_END
+}
+
+
+CAISS_RET_TYPE IvfIndex::forceLoop(const CAISS_FLOAT *query, unsigned int topK, ALGO_RET_TYPE &result) const {
+    CAISS_FUNCTION_BEGIN
+    CAISS_ASSERT_NOT_NULL(query)
+
+    if (0 == topK) {
+        return CAISS_RET_OK;
+    }
+
+    CAISS_FLOAT queryNorm = FlatDot(query, query, this->dim_);
+    CAISS_FLOAT threshold = std::numeric_limits<CAISS_FLOAT>::max();
+    std::vector<std::pair<CAISS_FLOAT, unsigned int>> heap;
+    heap.reserve(topK + 1);
+    for (const auto &list : this->lists_) {
+        searchInList(list, query, queryNorm, topK, heap, threshold);
+    }
+
+    result = ALGO_RET_TYPE(std::less<std::pair<CAISS_FLOAT, unsigned int>>(), std::move(heap));
+    CAISS_FUNCTION_END
+}
+
+
+CAISS_RET_TYPE IvfIndex::save(const std::string &path, const std::list<std::string> &ignoreList) const {
+    CAISS_FUNCTION_BEGIN
+
+    std::ofstream output(path, std::ios::binary);
+    if (!output) {
+        return CAISS_RET_PATH;
+    }
+
+    writeIvfPOD(output, IVF_MODEL_MAGIC);
+    writeIvfPOD(output, IVF_MODEL_VERSION);
+    writeIvfPOD(output, this->dim_);
+    writeIvfPOD(output, (int)this->distance_type_);
+    writeIvfPOD(output, (int)this->normalize_);
+    writeIvfPOD(output, this->max_size_);
+    writeIvfPOD(output, this->max_index_size_);
+    writeIvfPOD(output, this->nlist_);
+    writeIvfPOD(output, this->nprobe_);
+    output.write((const char *)this->centroids_.data(), this->centroids_.size() * sizeof(CAISS_FLOAT));
+
+    auto size = (unsigned int)this->words_.size();
+    writeIvfPOD(output, size);
+    for (const auto &word : this->words_) {
+        writeIvfString(output, word);
+    }
+
+    // 按照倒排表依次保存，加载的时候不需要重新分配
+    for (const auto &list : this->lists_) {
+        auto num = (unsigned int)list.ids.size();
+        writeIvfPOD(output, num);
+        output.write((const char *)list.ids.data(), num * sizeof(unsigned int));
+        output.write((const char *)list.datas.data(), list.datas.size() * sizeof(CAISS_FLOAT));
+    }
+
+    auto ignoreSize = (unsigned int)ignoreList.size();
+    writeIvfPOD(output, ignoreSize);
+    for (const auto &word : ignoreList) {
+        writeIvfString(output, word);
+    }
+
+    output.close();
+    CAISS_FUNCTION_END
+}
+
+
+CAISS_RET_TYPE IvfIndex::load(const std::string &path, TrieProc *trie) {
+    CAISS_FUNCTION_BEGIN
+
+    std::ifstream input(path, std::ios::binary);
+    if (!input) {
+        return CAISS_RET_PATH;
+    }
+
+    int magic = 0, version = 0, distanceType = 0, normalize = 0;
+    readIvfPOD(input, magic);
+    readIvfPOD(input, version);
+    if (IVF_MODEL_MAGIC != magic || IVF_MODEL_VERSION < version) {
+        return CAISS_RET_PATH;    // 不是ivf算法生成的模型
+    }
+
+    readIvfPOD(input, this->dim_);
+    readIvfPOD(input, distanceType);
+    readIvfPOD(input, normalize);
+    readIvfPOD(input, this->max_size_);
+    readIvfPOD(input, this->max_index_size_);
+    readIvfPOD(input, this->nlist_);
+    readIvfPOD(input, this->nprobe_);
+    this->distance_type_ = (CAISS_DISTANCE_TYPE)distanceType;
+    this->normalize_ = (CAISS_BOOL)normalize;
+
+    this->centroids_.resize((size_t)this->nlist_ * this->dim_);
+    input.read((char *)this->centroids_.data(), this->centroids_.size() * sizeof(CAISS_FLOAT));
+    this->centroid_norms_.resize(this->nlist_);
+    for (unsigned int i = 0; i < this->nlist_; i++) {
+        const CAISS_FLOAT *cur = this->centroids_.data() + (size_t)i * this->dim_;
+        this->centroid_norms_[i] = FlatDot(cur, cur, this->dim_);
+    }
+
+    unsigned int size = 0;
+    readIvfPOD(input, size);
+    this->words_.resize(size);
+    this->word_lookup_.clear();
+    for (unsigned int i = 0; i < size; i++) {
+        readIvfString(input, this->words_[i]);
+        this->word_lookup_[this->words_[i]] = i;
+    }
+
+    this->lists_.assign(this->nlist_, IvfList());
+    this->locations_.assign(size, std::make_pair(0u, 0u));
+    for (unsigned int i = 0; i < this->nlist_ && input; i++) {
+        auto &list = this->lists_[i];
+        unsigned int num = 0;
+        readIvfPOD(input, num);
+        list.ids.resize(num);
+        input.read((char *)list.ids.data(), num * sizeof(unsigned int));
+        list.datas.resize((size_t)num * this->dim_);
+        input.read((char *)list.datas.data(), list.datas.size() * sizeof(CAISS_FLOAT));
+        list.norms.resize(num);
+        for (unsigned int j = 0; j < num; j++) {
+            const CAISS_FLOAT *cur = list.datas.data() + (size_t)j * this->dim_;
+            list.norms[j] = FlatDot(cur, cur, this->dim_);
+            if (list.ids[j] < size) {
+                this->locations_[list.ids[j]] = std::make_pair(i, j);
+            }
+        }
+    }
+
+    unsigned int ignoreSize = 0;
+    readIvfPOD(input, ignoreSize);
+    for (unsigned int i = 0; i < ignoreSize && nullptr != trie; i++) {
+        std::string word;
+        readIvfString(input, word);
+        trie->insert(word);
+    }
+
+    if (!input) {
+        return CAISS_RET_ERR;    // 模型文件不完整
+    }
+
+    input.close();
+    CAISS_FUNCTION_END
+}
+
+
+void IvfIndex::setNprobe(unsigned int nprobe) {
+    this->nprobe_ = std::max(nprobe, 1u);
+}
+
+
+unsigned int IvfIndex::getNprobe() const {
+    return this->nprobe_;
+}
+
+
+unsigned int IvfIndex::getNlist() const {
+    return this->nlist_;
+}
+
+
+int IvfIndex::findWordId(const std::string &word) const {
+    auto cur = this->word_lookup_.find(word);
+    return (cur != this->word_lookup_.end()) ? (int)cur->second : ALGO_NO_WORD_ID;
+}
+
+
+const std::string &IvfIndex::getWord(unsigned int id) const {
+    return this->words_[id];
+}
+
+
+const CAISS_FLOAT *IvfIndex::getData(unsigned int id) const {
+    const auto &location = this->locations_[id];
+    return this->lists_[location.first].datas.data() + (size_t)location.second * this->dim_;
+}
+
+
+unsigned int IvfIndex::getDim() const {
+    return this->dim_;
+}
+
+
+unsigned int IvfIndex::getSize() const {
+    return (unsigned int)this->words_.size();
+}
+
+
+CAISS_BOOL IvfIndex::getNormalize() const {
+    return this->normalize_;
+}
+
+
+CAISS_DISTANCE_TYPE IvfIndex::getDistanceType() const {
+    return this->distance_type_;
+}
+
+
+void IvfIndex::searchLists(const CAISS_FLOAT *query, unsigned int nprobe, std::vector<unsigned int> &lists) const {
+    KMeans::nearest(query, this->dim_, this->centroids_.data(), this->centroid_norms_.data(), this->nlist_, nprobe, lists);
+}
+
+
+void IvfIndex::searchInList(const IvfList &list, const CAISS_FLOAT *query, CAISS_FLOAT queryNorm, unsigned int topK,
+                            std::vector<std::pair<CAISS_FLOAT, unsigned int>> &heap, CAISS_FLOAT &threshold) const {
+    auto num = (unsigned int)list.ids.size();
+    CAISS_FLOAT dots[FLAT_BASE_BLOCK];
+    for (unsigned int bBegin = 0; bBegin < num; bBegin += FLAT_BASE_BLOCK) {
+        unsigned int bNum = std::min(FLAT_BASE_BLOCK, num - bBegin);
+        FlatDotTile(query, 1, list.datas.data() + (size_t)bBegin * this->dim_, bNum, this->dim_, dots, FLAT_BASE_BLOCK);
+        for (unsigned int j = 0; j < bNum; j++) {
+            CAISS_FLOAT dist = calcDistance(dots[j], queryNorm, list.norms[bBegin + j]);
+            if (dist >= threshold) {
+                continue;
+            }
+
+            heap.emplace_back(dist, list.ids[bBegin + j]);
+            std::push_heap(heap.begin(), heap.end());
+            if (heap.size() > topK) {
+                std::pop_heap(heap.begin(), heap.end());
+                heap.pop_back();
+            }
+            if (heap.size() >= topK) {
+                threshold = heap.front().first;
+            }
+        }
+    }
+}
+
+
+void IvfIndex::appendToList(unsigned int listId, unsigned int id, const CAISS_FLOAT *node) {
+    auto &list = this->lists_[listId];
+    this->locations_[id] = std::make_pair(listId, (unsigned int)list.ids.size());
+    list.ids.push_back(id);
+    list.datas.insert(list.datas.end(), node, node + this->dim_);
+    list.norms.push_back(FlatDot(node, node, this->dim_));
+}
+
+
+void IvfIndex::removeFromList(unsigned int id) {
+    // 用倒排表中最后一个向量，填补被删除的位置
+    auto location = this->locations_[id];
+    auto &list = this->lists_[location.first];
+    auto last = (unsigned int)list.ids.size() - 1;
+    if (location.second != last) {
+        unsigned int lastId = list.ids[last];
+        std::copy(list.datas.begin() + (size_t)last * this->dim_, list.datas.begin() + (size_t)(last + 1) * this->dim_,
+                  list.datas.begin() + (size_t)location.second * this->dim_);
+        list.norms[location.second] = list.norms[last];
+        list.ids[location.second] = lastId;
+        this->locations_[lastId].second = location.second;
+    }
+
+    list.ids.pop_back();
+    list.norms.pop_back();
+    list.datas.resize((size_t)last * this->dim_);
+}
+
+
+CAISS_FLOAT IvfIndex::calcDistance(CAISS_FLOAT dot, CAISS_FLOAT queryNorm, CAISS_FLOAT baseNorm) const {
+    if (CAISS_DISTANCE_INNER == this->distance_type_) {
+        return 1.0f - dot;    // 跟hnsw中内积距离的定义保持一致
+    }
+
+    CAISS_FLOAT dist = queryNorm + baseNorm - 2.0f * dot;    // |q-x|^2 = |q|^2 + |x|^2 - 2<q,x>
+    return std::max(dist, 0.0f);
+}
@@ -0,0 +1,117 @@
+//
+// Created by Chunel on 2020/10/4.
+// 倒排聚类（ivf-flat）的模型信息。先通过k-means训练nlist个聚类中心，每个向量放入距离最近的中心对应的倒排表中，
+// 同一个倒排表中的向量连续存放。查询的时候，只遍历距离query最近的nprobe个倒排表
+//
+
+#ifndef CAISS_IVFINDEX_H
+#define CAISS_IVFINDEX_H
+
+#include <list>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include "../../common/CommonAlgoDefine.h"
+#include "../../../utilsCtrl/UtilsInclude.h"
+
+const static int IVF_MODEL_MAGIC = 0x20465649;    // 模型文件头部的标识（"IVF "）
+const static int IVF_MODEL_VERSION = 1;
+
+class IvfIndex {
+
+public:
+    explicit IvfIndex();
+    IvfIndex(unsigned int dim, CAISS_DISTANCE_TYPE distanceType, unsigned int maxSize, unsigned int maxIndexSize,
+             CAISS_BOOL normalize);
+
+    /**
+     * 训练聚类中心，并将所有向量放入对应的倒排表中（之前的信息会被清空）
+     * @param datas 连续存放的向量（已经归一化）
+     * @param words 跟向量一一对应的词语
+     * @param nlist 聚类中心的个数
+     * @return
+     */
+    CAISS_RET_TYPE build(const std::vector<CAISS_FLOAT> &datas, const std::vector<std::string> &words, unsigned int nlist);
+
+    /**
+     * 加入向量信息。向量放入距离最近的中心对应的倒排表中，聚类中心不会更新
+     * @param node 已经归一化的向量
+     * @param word
+     * @param overwrite 词语已经存在的时候，是否覆盖
+     * @return
+     */
+    CAISS_RET_TYPE addPoint(const CAISS_FLOAT *node, const std::string &word, bool overwrite);
+
+    /**
+     * 遍历距离query最近的nprobe个倒排表，查询topK个结果
+     * @param query
+     * @param topK
+     * @param nprobe 为0表示使用模型中保存的值
+     * @param result
+     * @return
+     */
+    CAISS_RET_TYPE search(const CAISS_FLOAT *query, unsigned int topK, unsigned int nprobe, ALGO_RET_TYPE &result) const;
+    CAISS_RET_TYPE forceLoop(const CAISS_FLOAT *query, unsigned int topK, ALGO_RET_TYPE &result) const;
+
+    CAISS_RET_TYPE save(const std::string &path, const std::list<std::string> &ignoreList) const;
+    CAISS_RET_TYPE load(const std::string &path, TrieProc *trie);
+
+    void setNprobe(unsigned int nprobe);
+    unsigned int getNprobe() const;
+    unsigned int getNlist() const;
+
+    int findWordId(const std::string &word) const;
+    const std::string &getWord(unsigned int id) const;
+    const CAISS_FLOAT *getData(unsigned int id) const;
+
+    unsigned int getDim() const;
+    unsigned int getSize() const;
+    CAISS_BOOL getNormalize() const;
+    CAISS_DISTANCE_TYPE getDistanceType() const;
+
+protected:
+    struct IvfList {
+        std::vector<CAISS_FLOAT> datas;    // 倒排表中的向量，连续存放
+        std::vector<CAISS_FLOAT> norms;    // 每个向量模长的平方（欧氏距离使用）
+        std::vector<unsigned int> ids;     // 每个向量在模型中的id
+    };
+
+    /**
+     * 查找距离向量最近的nprobe个聚类中心，按照距离从近到远放入lists中
+     */
+    void searchLists(const CAISS_FLOAT *query, unsigned int nprobe, std::vector<unsigned int> &lists) const;
+
+    /**
+     * 在一个倒排表中查询，并更新结果堆
+     */
+    void searchInList(const IvfList &list, const CAISS_FLOAT *query, CAISS_FLOAT queryNorm, unsigned int topK,
+                      std::vector<std::pair<CAISS_FLOAT, unsigned int>> &heap, CAISS_FLOAT &threshold) const;
+
+    void appendToList(unsigned int listId, unsigned int id, const CAISS_FLOAT *node);
+    void removeFromList(unsigned int id);
+
+    /**
+     * 将内积信息，转换成对应的距离
+     */
+    inline CAISS_FLOAT calcDistance(CAISS_FLOAT dot, CAISS_FLOAT queryNorm, CAISS_FLOAT baseNorm) const;
+
+private:
+    unsigned int dim_;
+    CAISS_DISTANCE_TYPE distance_type_;
+    unsigned int max_size_;
+    unsigned int max_index_size_;    // 词语的最大长度
+    CAISS_BOOL normalize_;
+    unsigned int nlist_;
+    unsigned int nprobe_;
+
+    std::vector<CAISS_FLOAT> centroids_;    // 聚类中心，连续存放
+    std::vector<CAISS_FLOAT> centroid_norms_;
+    std::vector<IvfList> lists_;
+    std::vector<std::pair<unsigned int, unsigned int>> locations_;    // 每个id对应的 <倒排表id, 表中位置>
+    std::vector<std::string> words_;
+    std::unordered_map<std::string, unsigned int> word_lookup_;
+};
+
+
+#endif //CAISS_IVFINDEX_H
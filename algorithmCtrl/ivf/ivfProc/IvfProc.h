@@ -0,0 +1,63 @@
+//
+// Created by Chunel on 2020/10/4.
+// ivf算法的封装层。除了聚类中心之外，几乎不需要额外的内存，并且构建速度很快，适合数据量很大、需要定期全量重建的场景
+//
+
+#ifndef CAISS_IVFPROC_H
+#define CAISS_IVFPROC_H
+
+#include "../../common/CommonAlgoProc.h"
+#include "../ivfAlgo/IvfIndex.h"
+#include "IvfProcDefine.h"
+
+class IvfProc : public CommonAlgoProc {
+
+public:
+    explicit IvfProc();
+    ~IvfProc() override;
+
+    CAISS_RET_TYPE init(CAISS_MODE mode, CAISS_DISTANCE_TYPE distanceType,
+                        unsigned int dim, const char *modelPath, CAISS_DIST_FUNC distFunc) override;
+
+    // train_mode
+    CAISS_RET_TYPE train(const char *dataPath, unsigned int maxDataSize, CAISS_BOOL normalize,
+                         unsigned int maxIndexSize, float precision, unsigned int fastRank,
+                         unsigned int realRank, unsigned int step, unsigned int maxEpoch,
+                         unsigned int showSpan) override;
+
+    // process_mode
+    CAISS_RET_TYPE insert(CAISS_FLOAT *node, const char *index, CAISS_INSERT_TYPE insertType) override;
+    CAISS_RET_TYPE save(const char *modelPath) override;
+
+    CAISS_RET_TYPE setParam(CAISS_PARAM_TYPE paramType, const void *value) override;
+
+protected:
+    CAISS_RET_TYPE reset();
+    CAISS_RET_TYPE loadModel();
+    CAISS_RET_TYPE checkModelPrecisionEnable(float targetPrecision, unsigned int fastRank, unsigned int realRank,
+                                             const std::vector<CaissDataNode> &datas, float &calcPrecision);
+
+    CAISS_RET_TYPE searchVector(const CAISS_FLOAT *query, unsigned int topK, CAISS_SEARCH_TYPE searchType,
+                                ALGO_RET_TYPE &result) override;
+    int findWordId(const std::string &word) override;
+    CAISS_RET_TYPE getWordById(unsigned int id, std::string &word) override;
+    CAISS_RET_TYPE getVectorById(unsigned int id, std::vector<CAISS_FLOAT> &vec) override;
+    void getCacheScope(std::string &scope) override;
+
+private:
+    static CAISS_RET_TYPE createIvfSingleton(unsigned int dim, CAISS_DISTANCE_TYPE distanceType, unsigned int maxDataSize,
+                                             unsigned int maxIndexSize, CAISS_BOOL normalize);
+    static CAISS_RET_TYPE createIvfSingleton(const std::string &modelPath);
+    static CAISS_RET_TYPE destroyIvfSingleton();
+    static IvfIndex* getIvfSingleton();
+
+    static IvfIndex*                         ivf_index_ptr_;
+    static RWLock                            ivf_index_lock_;
+
+private:
+    unsigned int                             nlist_;     // 训练时的聚类中心个数，为0表示自动决定（通过setParam设定，init时不清空）
+    unsigned int                             nprobe_;    // 查询时遍历的倒排表个数，为0表示使用模型中的值（通过setParam设定，init时不清空）
+};
+
+
+#endif //CAISS_IVFPROC_H
@@ -0,0 +1,34 @@
+//
+// Created by Chunel on 2020/10/4.
+//
+
+#ifndef CAISS_IVFPROCDEFINE_H
+#define CAISS_IVFPROCDEFINE_H
+
+#include <cmath>
+#include <algorithm>
+
+const static unsigned int IVF_NLIST_TIMES = 4;             // 自动决定聚类中心个数时，取 4 * sqrt(数据量)
+const static unsigned int IVF_NPROBE_DEFAULT = 8;          // 查询时默认遍历的倒排表个数
+const static unsigned int IVF_CHECK_TIMES_MAX = 2000;      // 检查准确率时，最多的比较次数
+
+struct IvfTrainParams {
+    IvfTrainParams(unsigned int nlist, unsigned int size, unsigned int step) {
+        this->nlist = (0 != nlist) ? nlist : IVF_NLIST_TIMES * (unsigned int)std::sqrt((double)size);
+        this->nlist = std::max(std::min(this->nlist, size), 1u);
+        this->nprobe = std::min(IVF_NPROBE_DEFAULT, this->nlist);
+        this->step = step;
+    }
+
+    void update(float span) {
+        // 传入的是精确度的差距。聚类中心不需要重新训练，只增加查询时遍历的倒排表个数
+        this->nprobe += (unsigned int)(1.0f + (float)this->nprobe * (1.0f + span * 10.0f) * (float)step / 10.0f);
+        this->nprobe = std::min(this->nprobe, this->nlist);
+    }
+
+    unsigned int nlist;             // 聚类中心个数
+    unsigned int nprobe;            // 查询时遍历的倒排表个数
+    unsigned int step;              // 数据更新快慢的决定因素
+};
+
+#endif //CAISS_IVFPROCDEFINE_H
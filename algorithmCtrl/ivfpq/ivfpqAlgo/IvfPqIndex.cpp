@@ -0,0 +1,553 @@
+//
+// Created by Chunel on 2020/10/11.
+//
+
+#include <fstream>
+#include <algorithm>
+#include <limits>
+
+#include "IvfPqIndex.h"
+#include "../../common/KMeans.h"
+#include "../../flat/flatAlgo/FlatKernel.h"
+
+using namespace std;
+
+template<typename T>
+static void writeIvfPqPOD(std::ostream &out, const T &podRef) {
+    out.write((char *) &podRef, sizeof(T));
+}
+
+template<typename T>
+static void readIvfPqPOD(std::istream &in, T &podRef) {
+    in.read((char *) &podRef, sizeof(T));
+}
+
+static void writeIvfPqString(std::ostream &out, const std::string &str) {
+    auto len = (unsigned int)str.size();
+    writeIvfPqPOD(out, len);
+    out.write(str.data(), len);
+}
+
+static void readIvfPqString(std::istream &in, std::string &str) {
+    unsigned int len = 0;
+    readIvfPqPOD(in, len);
+    str.resize(len);
+    in.read(&str[0], len);
+}
+
+
+IvfPqIndex::IvfPqIndex() {
+    this->dim_ = 0;
+    this->distance_type_ = CAISS_DISTANCE_DEFAULT;
+    this->max_size_ = 0;
+    this->max_index_size_ = 0;
+    this->normalize_ = CAISS_FALSE;
+    this->nlist_ = 0;
+    this->nprobe_ = 1;
+    this->rerank_ = 0;
+}
+
+
+IvfPqIndex::IvfPqIndex(unsigned int dim, CAISS_DISTANCE_TYPE distanceType, unsigned int maxSize,
+                       unsigned int maxIndexSize, CAISS_BOOL normalize) {
+    this->dim_ = dim;
+    this->distance_type_ = distanceType;
+    this->max_size_ = maxSize;
+    this->max_index_size_ = maxIndexSize;
+    this->normalize_ = normalize;
+    this->nlist_ = 0;
+    this->nprobe_ = 1;
+    this->rerank_ = 0;
+}
+
+
+CAISS_RET_TYPE IvfPqIndex::build(std::vector<CAISS_FLOAT> &&datas, const std::vector<std::string> &words,
+                                 unsigned int nlist, unsigned int m) {
+    CAISS_FUNCTION_BEGIN
+
+    auto rowNum = (unsigned int)words.size();
+    if (0 == rowNum || datas.size() != (size_t)rowNum * this->dim_) {
+        return CAISS_RET_PARAM;
+    }
+
+    // 重复的词语，以最后一次出现的为准。id按照第一次出现的顺序分配
+    this->words_.clear();
+    this->word_lookup_.clear();
+    std::vector<unsigned int> rows;
+    for (unsigned int i = 0; i < rowNum; i++) {
+        const std::string &word = words[i];
+        if (word.empty() || word.size() > this->max_index_size_) {
+            return CAISS_RET_WORD_SIZE;
+        }
+
+        auto cur = this->word_lookup_.find(word);
+        if (cur != this->word_lookup_.end()) {
+            rows[cur->second] = i;
+            continue;
+        }
+
+        if (this->words_.size() >= this->max_size_) {
+            return CAISS_RET_MODEL_SIZE;
+        }
+        this->word_lookup_[word] = (unsigned int)this->words_.size();
+        this->words_.push_back(word);
+        rows.push_back(i);
+    }
+
+    // 第id个词语对应的行，不会小于id，所以可以原地向前整理
+    auto size = (unsigned int)this->words_.size();
+    for (unsigned int id = 0; id < size; id++) {
+        if (rows[id] != id) {
+            std::copy(datas.begin() + (size_t)rows[id] * this->dim_, datas.begin() + (size_t)(rows[id] + 1) * this->dim_,
+                      datas.begin() + (size_t)id * this->dim_);
+        }
+    }
+    datas.resize((size_t)size * this->dim_);
+    this->train_datas_.swap(datas);
+    this->dirty_datas_.clear();
+    this->raw_map_.close();
+
+    nlist = std::max(std::min(nlist, size), 1u);
+    KMeans kmeans(this->dim_, this->distance_type_);
+    ret = kmeans.train(this->train_datas_.data(), size, nlist, this->centroids_);
+    CAISS_FUNCTION_CHECK_STATUS
+
+    this->nlist_ = nlist;
+    this->centroid_norms_.resize(nlist);
+    for (unsigned int i = 0; i < nlist; i++) {
+        const CAISS_FLOAT *cur = this->centroids_.data() + (size_t)i * this->dim_;
+        this->centroid_norms_[i] = FlatDot(cur, cur, this->dim_);
+    }
+
+    std::vector<unsigned int> labels;
+    kmeans.assign(this->train_datas_.data(), size, this->centroids_.data(), nlist, labels, nullptr);
+    std::vector<CAISS_FLOAT> residuals((size_t)size * this->dim_);
+    for (unsigned int i = 0; i < size; i++) {
+        calcResidual(this->train_datas_.data() + (size_t)i * this->dim_, labels[i], residuals.data() + (size_t)i * this->dim_);
+    }
+
+    this->pq_ = ProductQuantizer(this->dim_, m);
+    ret = this->pq_.train(residuals.data(), size);
+    CAISS_FUNCTION_CHECK_STATUS
+
+    unsigned int codeSize = this->pq_.getCodeSize();
+    std::vector<PQ_CODE_TYPE> codes((size_t)size * codeSize);
+    this->pq_.encode(residuals.data(), size, codes.data());
+
+    this->lists_.assign(nlist, IvfPqList());
+    this->locations_.assign(size, std::make_pair(0u, 0u));
+    for (unsigned int i = 0; i < size; i++) {
+        appendToList(labels[i], i, codes.data() + (size_t)i * codeSize);
+    }
+
+    CAISS_FUNCTION_END
+}
+
+
+CAISS_RET_TYPE IvfPqIndex::addPoint(const CAISS_FLOAT *node, const std::string &word, bool overwrite) {
+    CAISS_FUNCTION_BEGIN
+    CAISS_ASSERT_NOT_NULL(node)
+
+    if (word.empty() || word.size() > this->max_index_size_) {
+        return CAISS_RET_WORD_SIZE;
+    }
+
+    if (0 == this->nlist_) {
+        return CAISS_RET_MODEL_SIZE;    // 还没有训练聚类中心
+    }
+
+    unsigned int id = 0;
+    auto cur = this->word_lookup_.find(word);
+    if (cur != this->word_lookup_.end()) {
+        if (!overwrite) {
+            return CAISS_RET_OK;
+        }
+        id = cur->second;
+        removeFromList(id);
+    } else {
+        if (this->words_.size() >= this->max_size_) {
+            return CAISS_RET_MODEL_SIZE;
+        }
+        id = (unsigned int)this->words_.size();
+        this->word_lookup_[word] = id;
+        this->words_.push_back(word);
+        this->locations_.emplace_back(0, 0);
+    }
+
+    std::vector<unsigned int> lists;
+    KMeans::nearest(node, this->dim_, this->centroids_.data(), this->centroid_norms_.data(), this->nlist_, 1, lists);
+    std::vector<CAISS_FLOAT> residual(this->dim_);
+    calcResidual(node, lists[0], residual.data());
+    std::vector<PQ_CODE_TYPE> code(this->pq_.getCodeSize());
+    this->pq_.encode(residual.data(), code.data());
+    appendToList(lists[0], id, code.data());
+
+    // 映射的模型文件是只读的，新的原始向量保存在内存中
+    this->dirty_datas_[id].assign(node, node + this->dim_);
+
+    CAISS_FUNCTION_END
+}
+
+
+CAISS_RET_TYPE IvfPqIndex::search(const CAISS_FLOAT *query, unsigned int topK, unsigned int nprobe,
+                                  unsigned int rerank, ALGO_RET_TYPE &result) const {
+    CAISS_FUNCTION_BEGIN
+    CAISS_ASSERT_NOT_NULL(query)
+
+    if (0 == topK || 0 == this->nlist_) {
+        return CAISS_RET_OK;
+    }
+
+    std::vector<unsigned int> lists;
+    KMeans::nearest(query, this->dim_, this->centroids_.data(), this->centroid_norms_.data(), this->nlist_,
+                    (0 != nprobe) ? nprobe : this->nprobe_, lists);
+
+    unsigned int candNum = (0 != rerank) ? topK * rerank : topK;
+    CAISS_FLOAT threshold = std::numeric_limits<CAISS_FLOAT>::max();
+    std::vector<std::pair<CAISS_FLOAT, unsigned int>> heap;
+    heap.reserve(candNum + 1);
+
+    std::vector<CAISS_FLOAT> table(this->pq_.getTableSize());
+    if (CAISS_DISTANCE_INNER == this->distance_type_) {
+        // 1 - <q, c + r> = (1 - <q, c>) - <q, r>，内积表跟倒排表无关，只需要计算一次
+        this->pq_.computeDotTable(query, table.data());
+        for (auto listId : lists) {
+            CAISS_FLOAT base = 1.0f - FlatDot(query, this->centroids_.data() + (size_t)listId * this->dim_, this->dim_);
+            searchInList(this->lists_[listId], table.data(), base, -1.0f, candNum, heap, threshold);
+        }
+    } else {
+        // |q - c - r|^2，每个倒排表按照 q - c 计算一次距离表
+        std::vector<CAISS_FLOAT> residual(this->dim_);
+        for (auto listId : lists) {
+            if (this->lists_[listId].ids.empty()) {
+                continue;
+            }
+            calcResidual(query, listId, residual.data());
+            this->pq_.computeL2Table(residual.data(), table.data());
+            searchInList(this->lists_[listId], table.data(), 0.0f, 1.0f, candNum, heap, threshold);
+        }
+    }
+
+    if (0 != rerank) {
+        CAISS_FLOAT queryNorm = FlatDot(query, query, this->dim_);
+        for (auto &cur : heap) {
+            cur.first = calcDistance(query, queryNorm, getData(cur.second));
+        }
+        std::sort(heap.begin(), heap.end());
+        heap.resize(std::min((size_t)topK, heap.size()));
+    }
+
+    result = ALGO_RET_TYPE(std::less<std::pair<CAISS_FLOAT, unsigned int>>(), std::move(heap));
+    CAISS_FUNCTION_END
+}
+
+
+CAISS_RET_TYPE IvfPqIndex::forceLoop(const CAISS_FLOAT *query, unsigned int topK, ALGO_RET_TYPE &result) const {
+    CAISS_FUNCTION_BEGIN
+    CAISS_ASSERT_NOT_NULL(query)
+
+    if (0 == topK) {
+        return CAISS_RET_OK;
+    }
+
+    // 暴力查询按照原始向量计算，结果是精确的
+    CAISS_FLOAT queryNorm = FlatDot(query, query, this->dim_);
+    CAISS_FLOAT threshold = std::numeric_limits<CAISS_FLOAT>::max();
+    auto size = getSize();
+    for (unsigned int i = 0; i < size; i++) {
+        CAISS_FLOAT dist = calcDistance(query, queryNorm, getData(i));
+        if (dist >= threshold) {
+            continue;
+        }
+
+        result.emplace(dist, i);
+        if (result.size() > topK) {
+            result.pop();
+        }
+        if (result.size() >= topK) {
+            threshold = result.top().first;
+        }
+    }
+
+    CAISS_FUNCTION_END
+}
+
+
+CAISS_RET_TYPE IvfPqIndex::save(const std::string &path, const std::list<std::string> &ignoreList) const {
+    CAISS_FUNCTION_BEGIN
+
+    std::ofstream output(path, std::ios::binary);
+    if (!output) {
+        return CAISS_RET_PATH;
+    }
+
+    writeIvfPqPOD(output, IVFPQ_MODEL_MAGIC);
+    writeIvfPqPOD(output, IVFPQ_MODEL_VERSION);
+    writeIvfPqPOD(output, this->dim_);
+    writeIvfPqPOD(output, (int)this->distance_type_);
+    writeIvfPqPOD(output, (int)this->normalize_);
+    writeIvfPqPOD(output, this->max_size_);
+    writeIvfPqPOD(output, this->max_index_size_);
+    writeIvfPqPOD(output, this->nlist_);
+    writeIvfPqPOD(output, this->nprobe_);
+    writeIvfPqPOD(output, this->rerank_);
+    output.write((const char *)this->centroids_.data(), this->centroids_.size() * sizeof(CAISS_FLOAT));
+    this->pq_.save(output);
+
+    auto size = (unsigned int)this->words_.size();
+    writeIvfPqPOD(output, size);
+    for (const auto &word : this->words_) {
+        writeIvfPqString(output, word);
+    }
+
+    for (const auto &list : this->lists_) {
+        auto num = (unsigned int)list.ids.size();
+        writeIvfPqPOD(output, num);
+        output.write((const char *)list.ids.data(), num * sizeof(unsigned int));
+        output.write((const char *)list.codes.data(), list.codes.size() * sizeof(PQ_CODE_TYPE));
+    }
+
+    auto ignoreSize = (unsigned int)ignoreList.size();
+    writeIvfPqPOD(output, ignoreSize);
+    for (const auto &word : ignoreList) {
+        writeIvfPqString(output, word);
+    }
+
+    // 原始向量放在文件最后，起始位置按照页大小对齐，加载的时候直接映射
+    auto rawOffset = (unsigned long long)MmapAlignSize((size_t)output.tellp() + sizeof(unsigned long long));
+    writeIvfPqPOD(output, rawOffset);
+    std::vector<char> padding((size_t)rawOffset - (size_t)output.tellp(), 0);
+    output.write(padding.data(), padding.size());
+    for (unsigned int i = 0; i < size; i++) {
+        output.write((const char *)getData(i), this->dim_ * sizeof(CAISS_FLOAT));
+    }
+
+    output.close();
+    CAISS_FUNCTION_END
+}
+
+
+CAISS_RET_TYPE IvfPqIndex::load(const std::string &path, TrieProc *trie) {
+    CAISS_FUNCTION_BEGIN
+
+    std::ifstream input(path, std::ios::binary);
+    if (!input) {
+        return CAISS_RET_PATH;
+    }
+
+    int magic = 0, version = 0, distanceType = 0, normalize = 0;
+    readIvfPqPOD(input, magic);
+    readIvfPqPOD(input, version);
+    if (IVFPQ_MODEL_MAGIC != magic || IVFPQ_MODEL_VERSION < version) {
+        return CAISS_RET_PATH;    // 不是ivf-pq算法生成的模型
+    }
+
+    readIvfPqPOD(input, this->dim_);
+    readIvfPqPOD(input, distanceType);
+    readIvfPqPOD(input, normalize);
+    readIvfPqPOD(input, this->max_size_);
+    readIvfPqPOD(input, this->max_index_size_);
+    readIvfPqPOD(input, this->nlist_);
+    readIvfPqPOD(input, this->nprobe_);
+    readIvfPqPOD(input, this->rerank_);
+    this->distance_type_ = (CAISS_DISTANCE_TYPE)distanceType;
+    this->normalize_ = (CAISS_BOOL)normalize;
+
+    this->centroids_.resize((size_t)this->nlist_ * this->dim_);
+    input.read((char *)this->centroids_.data(), this->centroids_.size() * sizeof(CAISS_FLOAT));
+    this->centroid_norms_.resize(this->nlist_);
+    for (unsigned int i = 0; i < this->nlist_; i++) {
+        const CAISS_FLOAT *cur = this->centroids_.data() + (size_t)i * this->dim_;
+        this->centroid_norms_[i] = FlatDot(cur, cur, this->dim_);
+    }
+    this->pq_.load(input);
+
+    unsigned int size = 0;
+    readIvfPqPOD(input, size);
+    this->words_.resize(size);
+    this->word_lookup_.clear();
+    for (unsigned int i = 0; i < size; i++) {
+        readIvfPqString(input, this->words_[i]);
+        this->word_lookup_[this->words_[i]] = i;
+    }
+
+    unsigned int codeSize = this->pq_.getCodeSize();
+    this->lists_.assign(this->nlist_, IvfPqList());
+    this->locations_.assign(size, std::make_pair(0u, 0u));
+    for (unsigned int i = 0; i < this->nlist_ && input; i++) {
+        auto &list = this->lists_[i];
+        unsigned int num = 0;
+        readIvfPqPOD(input, num);
+        list.ids.resize(num);
+        input.read((char *)list.ids.data(), num * sizeof(unsigned int));
+        list.codes.resize((size_t)num * codeSize);
+        input.read((char *)list.codes.data(), list.codes.size() * sizeof(PQ_CODE_TYPE));
+        for (unsigned int j = 0; j < num; j++) {
+            if (list.ids[j] < size) {
+                this->locations_[list.ids[j]] = std::make_pair(i, j);
+            }
+        }
+    }
+
+    unsigned int ignoreSize = 0;
+    readIvfPqPOD(input, ignoreSize);
+    for (unsigned int i = 0; i < ignoreSize && nullptr != trie; i++) {
+        std::string word;
+        readIvfPqString(input, word);
+        trie->insert(word);
+    }
+
+    unsigned long long rawOffset = 0;
+    readIvfPqPOD(input, rawOffset);
+    if (!input) {
+        return CAISS_RET_ERR;    // 模型文件不完整
+    }
+    input.close();
+
+    // 原始向量只在重新排序和暴力查询的时候按需访问，随机读取为主
+    std::vector<CAISS_FLOAT>().swap(this->train_datas_);
+    this->dirty_datas_.clear();
+    ret = this->raw_map_.open(path, (size_t)rawOffset, (size_t)size * this->dim_ * sizeof(CAISS_FLOAT), MMAP_ADVICE_RANDOM);
+    CAISS_FUNCTION_CHECK_STATUS
+
+    CAISS_FUNCTION_END
+}
+
+
+void IvfPqIndex::setNprobe(unsigned int nprobe) {
+    this->nprobe_ = std::max(nprobe, 1u);
+}
+
+
+unsigned int IvfPqIndex::getNprobe() const {
+    return this->nprobe_;
+}
+
+
+void IvfPqIndex::setRerank(unsigned int rerank) {
+    this->rerank_ = rerank;
+}
+
+
+unsigned int IvfPqIndex::getRerank() const {
+    return this->rerank_;
+}
+
+
+unsigned int IvfPqIndex::getNlist() const {
+    return this->nlist_;
+}
+
+
+int IvfPqIndex::findWordId(const std::string &word) const {
+    auto cur = this->word_lookup_.find(word);
+    return (cur != this->word_lookup_.end()) ? (int)cur->second : ALGO_NO_WORD_ID;
+}
+
+
+const std::string &IvfPqIndex::getWord(unsigned int id) const {
+    return this->words_[id];
+}
+
+
+const CAISS_FLOAT *IvfPqIndex::getData(unsigned int id) const {
+    if (!this->dirty_datas_.empty()) {
+        auto cur = this->dirty_datas_.find(id);
+        if (cur != this->dirty_datas_.end()) {
+            return cur->second.data();
+        }
+    }
+
+    const CAISS_FLOAT *base = this->train_datas_.empty()
+                              ? (const CAISS_FLOAT *)this->raw_map_.getData() : this->train_datas_.data();
+    return base + (size_t)id * this->dim_;
+}
+
+
+unsigned int IvfPqIndex::getDim() const {
+    return this->dim_;
+}
+
+
+unsigned int IvfPqIndex::getSize() const {
+    return (unsigned int)this->words_.size();
+}
+
+
+CAISS_BOOL IvfPqIndex::getNormalize() const {
+    return this->normalize_;
+}
+
+
+CAISS_DISTANCE_TYPE IvfPqIndex::getDistanceType() const {
+    return this->distance_type_;
+}
+
+
+void IvfPqIndex::searchInList(const IvfPqList &list, const CAISS_FLOAT *table, CAISS_FLOAT base, CAISS_FLOAT sign,
+                              unsigned int topK, std::vector<std::pair<CAISS_FLOAT, unsigned int>> &heap,
+                              CAISS_FLOAT &threshold) const {
+    unsigned int codeSize = this->pq_.getCodeSize();
+    const PQ_CODE_TYPE *code = list.codes.data();
+    for (size_t i = 0; i < list.ids.size(); i++, code += codeSize) {
+        CAISS_FLOAT dist = base + sign * this->pq_.lookup(table, code);
+        if (dist >= threshold) {
+            continue;
+        }
+
+        heap.emplace_back(dist, list.ids[i]);
+        std::push_heap(heap.begin(), heap.end());
+        if (heap.size() > topK) {
+            std::pop_heap(heap.begin(), heap.end());
+            heap.pop_back();
+        }
+        if (heap.size() >= topK) {
+            threshold = heap.front().first;
+        }
+    }
+}
+
+
+void IvfPqIndex::appendToList(unsigned int listId, unsigned int id, const PQ_CODE_TYPE *code) {
+    auto &list = this->lists_[listId];
+    this->locations_[id] = std::make_pair(listId, (unsigned int)list.ids.size());
+    list.ids.push_back(id);
+    list.codes.insert(list.codes.end(), code, code + this->pq_.getCodeSize());
+}
+
+
+void IvfPqIndex::removeFromList(unsigned int id) {
+    // 用倒排表中最后一个编码，填补被删除的位置
+    unsigned int codeSize = this->pq_.getCodeSize();
+    auto location = this->locations_[id];
+    auto &list = this->lists_[location.first];
+    auto last = (unsigned int)list.ids.size() - 1;
+    if (location.second != last) {
+        unsigned int lastId = list.ids[last];
+        std::copy(list.codes.begin() + (size_t)last * codeSize, list.codes.begin() + (size_t)(last + 1) * codeSize,
+                  list.codes.begin() + (size_t)location.second * codeSize);
+        list.ids[location.second] = lastId;
+        this->locations_[lastId].second = location.second;
+    }
+
+    list.ids.pop_back();
+    list.codes.resize((size_t)last * codeSize);
+}
+
+
+void IvfPqIndex::calcResidual(const CAISS_FLOAT *node, unsigned int listId, CAISS_FLOAT *residual) const {
+    const CAISS_FLOAT *centroid = this->centroids_.data() + (size_t)listId * this->dim_;
+    for (unsigned int i = 0; i < this->dim_; i++) {
+        residual[i] = node[i] - centroid[i];
+    }
+}
+
+
+CAISS_FLOAT IvfPqIndex::calcDistance(const CAISS_FLOAT *query, CAISS_FLOAT queryNorm, const CAISS_FLOAT *node) const {
+    CAISS_FLOAT dot = FlatDot(query, node, this->dim_);
+    if (CAISS_DISTANCE_INNER == this->distance_type_) {
+        return 1.0f - dot;    // 跟hnsw中内积距离的定义保持一致
+    }
+
+    return std::max(queryNorm + FlatDot(node, node, this->dim_) - 2.0f * dot, 0.0f);
+}
@@ -0,0 +1,134 @@
+//
+// Created by Chunel on 2020/10/11.
+// 倒排聚类 + 乘积量化（ivf-pq）的模型信息。向量减去所在聚类中心之后的残差，按照pq编码存放在倒排表中，
+// 内存中每个向量只占m个字节。查询的时候，对每个遍历到的倒排表计算一次adc距离表，
+// 之后可以从内存映射的原始向量中，读取候选点的真实向量重新排序
+//
+
+#ifndef CAISS_IVFPQINDEX_H
+#define CAISS_IVFPQINDEX_H
+
+#include <list>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include "../../common/CommonAlgoDefine.h"
+#include "../../common/ProductQuantizer.h"
+#include "../../../utilsCtrl/UtilsInclude.h"
+
+const static int IVFPQ_MODEL_MAGIC = 0x51504649;    // 模型文件头部的标识（"IFPQ"）
+const static int IVFPQ_MODEL_VERSION = 1;
+
+class IvfPqIndex {
+
+public:
+    explicit IvfPqIndex();
+    IvfPqIndex(unsigned int dim, CAISS_DISTANCE_TYPE distanceType, unsigned int maxSize, unsigned int maxIndexSize,
+               CAISS_BOOL normalize);
+
+    /**
+     * 训练聚类中心和pq码本，并将所有向量编码之后放入对应的倒排表中（之前的信息会被清空）
+     * @param datas 连续存放的向量（已经归一化）。原始向量会被保留，用于重新排序
+     * @param words 跟向量一一对应的词语
+     * @param nlist 聚类中心的个数
+     * @param m pq的段数，为0表示自动决定
+     * @return
+     */
+    CAISS_RET_TYPE build(std::vector<CAISS_FLOAT> &&datas, const std::vector<std::string> &words,
+                         unsigned int nlist, unsigned int m);
+
+    /**
+     * 加入向量信息。向量编码之后放入距离最近的中心对应的倒排表中，聚类中心和码本不会更新
+     * @param node 已经归一化的向量
+     * @param word
+     * @param overwrite 词语已经存在的时候，是否覆盖
+     * @return
+     */
+    CAISS_RET_TYPE addPoint(const CAISS_FLOAT *node, const std::string &word, bool overwrite);
+
+    /**
+     * 遍历距离query最近的nprobe个倒排表，查询topK个结果
+     * @param query
+     * @param topK
+     * @param nprobe 为0表示使用模型中保存的值
+     * @param rerank 按照pq距离召回 topK*rerank 个候选点，再按照原始向量重新排序。为0表示不重新排序（返回的是pq距离）
+     * @param result
+     * @return
+     */
+    CAISS_RET_TYPE search(const CAISS_FLOAT *query, unsigned int topK, unsigned int nprobe, unsigned int rerank,
+                          ALGO_RET_TYPE &result) const;
+    CAISS_RET_TYPE forceLoop(const CAISS_FLOAT *query, unsigned int topK, ALGO_RET_TYPE &result) const;
+
+    CAISS_RET_TYPE save(const std::string &path, const std::list<std::string> &ignoreList) const;
+
+    /**
+     * 加载模型。原始向量通过mmap映射，不会读入内存
+     * @param path
+     * @param trie
+     * @return
+     */
+    CAISS_RET_TYPE load(const std::string &path, TrieProc *trie);
+
+    void setNprobe(unsigned int nprobe);
+    unsigned int getNprobe() const;
+    void setRerank(unsigned int rerank);
+    unsigned int getRerank() const;
+    unsigned int getNlist() const;
+
+    int findWordId(const std::string &word) const;
+    const std::string &getWord(unsigned int id) const;
+    const CAISS_FLOAT *getData(unsigned int id) const;
+
+    unsigned int getDim() const;
+    unsigned int getSize() const;
+    CAISS_BOOL getNormalize() const;
+    CAISS_DISTANCE_TYPE getDistanceType() const;
+
+protected:
+    struct IvfPqList {
+        std::vector<PQ_CODE_TYPE> codes;    // 倒排表中向量残差的pq编码，连续存放
+        std::vector<unsigned int> ids;      // 每个编码在模型中的id
+    };
+
+    /**
+     * 通过adc距离表，遍历一个倒排表，并更新结果堆。距离为 base + sign * lookup(table, code)
+     */
+    void searchInList(const IvfPqList &list, const CAISS_FLOAT *table, CAISS_FLOAT base, CAISS_FLOAT sign,
+                      unsigned int topK, std::vector<std::pair<CAISS_FLOAT, unsigned int>> &heap,
+                      CAISS_FLOAT &threshold) const;
+
+    void appendToList(unsigned int listId, unsigned int id, const PQ_CODE_TYPE *code);
+    void removeFromList(unsigned int id);
+
+    /**
+     * 计算向量相对于聚类中心的残差
+     */
+    void calcResidual(const CAISS_FLOAT *node, unsigned int listId, CAISS_FLOAT *residual) const;
+    CAISS_FLOAT calcDistance(const CAISS_FLOAT *query, CAISS_FLOAT queryNorm, const CAISS_FLOAT *node) const;
+
+private:
+    unsigned int dim_;
+    CAISS_DISTANCE_TYPE distance_type_;
+    unsigned int max_size_;
+    unsigned int max_index_size_;    // 词语的最大长度
+    CAISS_BOOL normalize_;
+    unsigned int nlist_;
+    unsigned int nprobe_;
+    unsigned int rerank_;
+
+    std::vector<CAISS_FLOAT> centroids_;    // 聚类中心，连续存放
+    std::vector<CAISS_FLOAT> centroid_norms_;
+    ProductQuantizer pq_;
+    std::vector<IvfPqList> lists_;
+    std::vector<std::pair<unsigned int, unsigned int>> locations_;    // 每个id对应的 <倒排表id, 表中位置>
+    std::vector<std::string> words_;
+    std::unordered_map<std::string, unsigned int> word_lookup_;
+
+    std::vector<CAISS_FLOAT> train_datas_;    // 训练时的原始向量，按照id连续存放
+    MmapProc raw_map_;                        // 加载之后，原始向量通过mmap访问
+    std::unordered_map<unsigned int, std::vector<CAISS_FLOAT>> dirty_datas_;    // 加载之后，新插入或者被覆盖的原始向量
+};
+
+
+#endif //CAISS_IVFPQINDEX_H
@@ -0,0 +1,359 @@
+//
+// Created by Chunel on 2020/10/11.
+// 跟hnsw一样，模型信息是所有句柄共用的，锁在manage这一层保存
+//
+
+#include <cmath>
+#include "IvfPqProc.h"
+
+using namespace std;
+
+IvfPqIndex* IvfPqProc::ivf_pq_index_ptr_ = nullptr;
+RWLock IvfPqProc::ivf_pq_index_lock_;
+
+
+IvfPqProc::IvfPqProc() {
+    this->nlist_ = 0;
+    this->pq_m_ = 0;
+    this->nprobe_ = 0;
+    this->rerank_ = -1;
+}
+
+
+IvfPqProc::~IvfPqProc() {
+    this->reset();
+}
+
+
+CAISS_RET_TYPE IvfPqProc::init(const CAISS_MODE mode, const CAISS_DISTANCE_TYPE distanceType, const unsigned int dim,
+                             const char *modelPath, const CAISS_DIST_FUNC distFunc) {
+    CAISS_FUNCTION_BEGIN
+    CAISS_ASSERT_NOT_NULL(modelPath)
+
+    if (CAISS_DISTANCE_EUC != distanceType && CAISS_DISTANCE_INNER != distanceType) {
+        return CAISS_RET_NO_SUPPORT;    // 聚类中心和码本需要在向量空间中求平均，暂不支持自定义距离
+    }
+
+    reset();
+
+    this->dim_ = dim;
+    this->cur_mode_ = mode;
+    this->model_path_ = buildModelPath(modelPath);
+    this->distance_type_ = distanceType;
+
+    if (CAISS_MODE_PROCESS == this->cur_mode_) {
+        ret = loadModel();
+        CAISS_FUNCTION_CHECK_STATUS
+    }
+
+    CAISS_FUNCTION_END
+}
+
+
+CAISS_RET_TYPE IvfPqProc::reset() {
+    CAISS_FUNCTION_BEGIN
+
+    this->dim_ = 0;
+    this->cur_mode_ = CAISS_MODE_DEFAULT;
+    this->normalize_ = CAISS_FALSE;
+    this->result_.clear();
+
+    CAISS_FUNCTION_END
+}
+
+
+CAISS_RET_TYPE IvfPqProc::train(const char *dataPath, const unsigned int maxDataSize, const CAISS_BOOL normalize,
+                              const unsigned int maxIndexSize, const float precision, const unsigned int fastRank,
+                              const unsigned int realRank, const unsigned int step, const unsigned int maxEpoch,
+                              const unsigned int showSpan) {
+    CAISS_FUNCTION_BEGIN
+    CAISS_ASSERT_NOT_NULL(dataPath)
+    CAISS_CHECK_MODE_ENABLE(CAISS_MODE_TRAIN)
+
+    this->normalize_ = normalize;
+    std::vector<CaissDataNode> datas;
+    CAISS_ECHO("start load datas from [%s].", dataPath);
+    ret = loadDatas(dataPath, datas);
+    CAISS_FUNCTION_CHECK_STATUS
+
+    destroyIvfPqSingleton();
+    ret = createIvfPqSingleton(this->dim_, this->distance_type_, maxDataSize, maxIndexSize, normalize);
+    CAISS_FUNCTION_CHECK_STATUS
+
+    auto ptr = IvfPqProc::getIvfPqSingleton();
+    CAISS_ASSERT_NOT_NULL(ptr)
+
+    std::vector<CAISS_FLOAT> vecs;
+    std::vector<std::string> words;
+    vecs.reserve(datas.size() * this->dim_);
+    words.reserve(datas.size());
+    for (const auto &data : datas) {
+        vecs.insert(vecs.end(), data.node.begin(), data.node.end());
+        words.push_back(data.index);
+    }
+
+    IvfPqTrainParams params(this->nlist_, this->pq_m_, (unsigned int)datas.size(), step);
+    CAISS_ECHO("start to train [%d] centroids and pq codebooks, please wait for a moment...", params.nlist);
+    ret = ptr->build(std::move(vecs), words, params.nlist, params.m);    // 聚类中心和码本只训练一次，之后的轮次只调整查询参数
+    CAISS_FUNCTION_CHECK_STATUS
+
+    unsigned int epoch = 0;
+    while (epoch < maxEpoch) {
+        CAISS_ECHO("start to check caiss model with nprobe [%d] and rerank [%d] for [%d] in [%d] epochs.",
+                   params.nprobe, params.rerank, ++epoch, maxEpoch);
+        ptr->setNprobe(params.nprobe);
+        ptr->setRerank(params.rerank);
+
+        float calcPrecision = 0.0f;
+        ret = checkModelPrecisionEnable(precision, fastRank, realRank, datas, calcPrecision);
+        if (CAISS_RET_OK == ret) {
+            CAISS_ECHO("train success, precision is [%0.4f] , model is saved to path [%s].", calcPrecision,
+                       this->model_path_.c_str());
+            break;
+        } else if (CAISS_RET_WARNING == ret) {
+            float span = precision - calcPrecision;
+            CAISS_ECHO("warning, the model's precision is not suitable, span = [%f], train again automatic.", span);
+            params.update(span);
+        }
+    }
+
+    // 无论准确率是否达标，都保存最后一次训练的结果，跟hnsw的处理方式一致
+    remove(this->model_path_.c_str());
+    CAISS_RET_TYPE saveRet = ptr->save(this->model_path_, std::list<std::string>());
+    if (CAISS_RET_OK != saveRet) {
+        return saveRet;
+    }
+
+    CAISS_FUNCTION_CHECK_STATUS    // 如果是precision达不到要求，则返回警告信息
+    CAISS_FUNCTION_END
+}
+
+
+CAISS_RET_TYPE IvfPqProc::insert(CAISS_FLOAT *node, const char *index, const CAISS_INSERT_TYPE insertType) {
+    CAISS_FUNCTION_BEGIN
+    CAISS_ASSERT_NOT_NULL(node)
+    CAISS_ASSERT_NOT_NULL(index)
+    CAISS_CHECK_MODE_ENABLE(CAISS_MODE_PROCESS)
+    auto ptr = IvfPqProc::getIvfPqSingleton();
+    CAISS_ASSERT_NOT_NULL(ptr)
+
+    if (CAISS_INSERT_OVERWRITE != insertType && CAISS_INSERT_DISCARD != insertType) {
+        return CAISS_RET_PARAM;
+    }
+
+    std::vector<CAISS_FLOAT> vec(node, node + this->dim_);
+    ret = normalizeNode(vec, this->dim_);
+    CAISS_FUNCTION_CHECK_STATUS
+
+    // 新增的向量编码之后放入最近的倒排表中，聚类中心和码本保持不变。数据分布变化较大时，建议重新训练
+    ret = ptr->addPoint(vec.data(), std::string(index), CAISS_INSERT_OVERWRITE == insertType);
+    CAISS_FUNCTION_CHECK_STATUS
+
+    AlgorithmProc::invalidateResultCache();    // 如果插入成功，则之前缓存的结果失效
+    CAISS_FUNCTION_END
+}
+
+
+CAISS_RET_TYPE IvfPqProc::save(const char *modelPath) {
+    CAISS_FUNCTION_BEGIN
+    auto ptr = IvfPqProc::getIvfPqSingleton();
+    CAISS_ASSERT_NOT_NULL(ptr)
+
+    std::string path = (nullptr == modelPath) ? this->model_path_ : buildModelPath(modelPath);
+    remove(path.c_str());
+    ret = ptr->save(path, AlgorithmProc::getIgnoreTrie()->getAllWords());
+    CAISS_FUNCTION_CHECK_STATUS
+
+    CAISS_FUNCTION_END
+}
+
+
+CAISS_RET_TYPE IvfPqProc::setParam(CAISS_PARAM_TYPE paramType, const void *value) {
+    CAISS_FUNCTION_BEGIN
+    CAISS_ASSERT_NOT_NULL(value)
+
+    switch (paramType) {
+        case CAISS_PARAM_IVF_NLIST:
+            this->nlist_ = *(const unsigned int *)value;
+            break;
+        case CAISS_PARAM_PQ_M:
+            this->pq_m_ = *(const unsigned int *)value;
+            break;
+        case CAISS_PARAM_IVF_NPROBE:
+            this->nprobe_ = *(const unsigned int *)value;    // 仅对当前句柄生效，不修改共用的模型
+            break;
+        case CAISS_PARAM_PQ_RERANK:
+            this->rerank_ = (int)*(const unsigned int *)value;
+            break;
+        default:
+            ret = CAISS_RET_NO_SUPPORT;
+            break;
+    }
+
+    CAISS_FUNCTION_CHECK_STATUS
+    CAISS_FUNCTION_END
+}
+
+
+/************************ 以下是本Proc类内部函数 ************************/
+CAISS_RET_TYPE IvfPqProc::loadModel() {
+    CAISS_FUNCTION_BEGIN
+
+    ret = createIvfPqSingleton(this->model_path_);
+    CAISS_FUNCTION_CHECK_STATUS
+    auto ptr = IvfPqProc::getIvfPqSingleton();
+    CAISS_ASSERT_NOT_NULL(ptr)
+
+    if (ptr->getDim() != this->dim_) {
+        return CAISS_RET_DIM;
+    }
+
+    if (ptr->getDistanceType() != this->distance_type_) {
+        return CAISS_RET_PARAM;    // 聚类中心和码本是按照训练时的距离类型训练的
+    }
+    this->normalize_ = ptr->getNormalize();
+
+    CAISS_FUNCTION_END
+}
+
+
+CAISS_RET_TYPE IvfPqProc::checkModelPrecisionEnable(const float targetPrecision, const unsigned int fastRank,
+                                                  const unsigned int realRank, const std::vector<CaissDataNode> &datas,
+                                                  float &calcPrecision) {
+    CAISS_FUNCTION_BEGIN
+    auto ptr = IvfPqProc::getIvfPqSingleton();
+    CAISS_ASSERT_NOT_NULL(ptr)
+
+    unsigned int suitableTimes = 0;
+    unsigned int calcTimes = min((unsigned int)datas.size(), IVFPQ_CHECK_TIMES_MAX);
+    for (unsigned int i = 0; i < calcTimes; i++) {
+        ALGO_RET_TYPE fastResult, realResult;
+        ret = ptr->search(datas[i].node.data(), fastRank, 0, ptr->getRerank(), fastResult);
+        CAISS_FUNCTION_CHECK_STATUS
+        ret = ptr->forceLoop(datas[i].node.data(), realRank, realResult);
+        CAISS_FUNCTION_CHECK_STATUS
+        if (fastResult.empty() || realResult.empty()) {
+            continue;
+        }
+
+        if (std::abs(fastResult.top().first - realResult.top().first) < 0.000002f) {    // 这里近似小于
+            suitableTimes++;
+        }
+    }
+
+    calcPrecision = (0 == calcTimes) ? 0.0f : (float)suitableTimes / (float)calcTimes;
+    ret = (calcPrecision >= targetPrecision) ? CAISS_RET_OK : CAISS_RET_WARNING;
+    CAISS_FUNCTION_CHECK_STATUS
+
+    CAISS_FUNCTION_END
+}
+
+
+CAISS_RET_TYPE IvfPqProc::searchVector(const CAISS_FLOAT *query, const unsigned int topK, const CAISS_SEARCH_TYPE searchType,
+                                     ALGO_RET_TYPE &result) {
+    CAISS_FUNCTION_BEGIN
+    CAISS_ASSERT_NOT_NULL(query)
+    auto ptr = IvfPqProc::getIvfPqSingleton();
+    CAISS_ASSERT_NOT_NULL(ptr)
+
+    if (isAnnSearchType(searchType)) {
+        unsigned int rerank = (this->rerank_ >= 0) ? (unsigned int)this->rerank_ : ptr->getRerank();
+        ret = ptr->search(query, topK, this->nprobe_, rerank, result);
+    } else {
+        ret = ptr->forceLoop(query, topK, result);
+    }
+    CAISS_FUNCTION_CHECK_STATUS
+
+    CAISS_FUNCTION_END
+}
+
+
+int IvfPqProc::findWordId(const std::string &word) {
+    auto ptr = IvfPqProc::getIvfPqSingleton();
+    return (nullptr != ptr) ? ptr->findWordId(word) : ALGO_NO_WORD_ID;
+}
+
+
+CAISS_RET_TYPE IvfPqProc::getWordById(const unsigned int id, std::string &word) {
+    CAISS_FUNCTION_BEGIN
+    auto ptr = IvfPqProc::getIvfPqSingleton();
+    CAISS_ASSERT_NOT_NULL(ptr)
+
+    word = ptr->getWord(id);
+    CAISS_FUNCTION_END
+}
+
+
+CAISS_RET_TYPE IvfPqProc::getVectorById(const unsigned int id, std::vector<CAISS_FLOAT> &vec) {
+    CAISS_FUNCTION_BEGIN
+    auto ptr = IvfPqProc::getIvfPqSingleton();
+    CAISS_ASSERT_NOT_NULL(ptr)
+
+    const CAISS_FLOAT *data = ptr->getData(id);
+    vec.assign(data, data + ptr->getDim());
+    CAISS_FUNCTION_END
+}
+
+
+void IvfPqProc::getCacheScope(std::string &scope) {
+    scope.assign(this->model_path_);
+    scope += "|nprobe=";    // 以下参数仅对当前句柄生效
+    scope += std::to_string(this->nprobe_);
+    scope += "|rerank=";
+    scope += std::to_string(this->rerank_);
+}
+
+
+CAISS_RET_TYPE IvfPqProc::createIvfPqSingleton(const unsigned int dim, const CAISS_DISTANCE_TYPE distanceType,
+                                           const unsigned int maxDataSize, const unsigned int maxIndexSize,
+                                           const CAISS_BOOL normalize) {
+    CAISS_FUNCTION_BEGIN
+
+    if (nullptr == IvfPqProc::ivf_pq_index_ptr_) {
+        IvfPqProc::ivf_pq_index_lock_.writeLock();
+        if (nullptr == IvfPqProc::ivf_pq_index_ptr_) {
+            IvfPqProc::ivf_pq_index_ptr_ = new IvfPqIndex(dim, distanceType, maxDataSize, maxIndexSize, normalize);
+        }
+        IvfPqProc::ivf_pq_index_lock_.writeUnlock();
+    }
+
+    CAISS_FUNCTION_END
+}
+
+
+CAISS_RET_TYPE IvfPqProc::createIvfPqSingleton(const std::string &modelPath) {
+    CAISS_FUNCTION_BEGIN
+
+    if (nullptr == IvfPqProc::ivf_pq_index_ptr_) {
+        IvfPqProc::ivf_pq_index_lock_.writeLock();
+        if (nullptr == IvfPqProc::ivf_pq_index_ptr_) {
+            auto ptr = new IvfPqIndex();
+            ret = ptr->load(modelPath, AlgorithmProc::getIgnoreTrie());
+            if (CAISS_RET_OK == ret) {
+                IvfPqProc::ivf_pq_index_ptr_ = ptr;
+            } else {
+                CAISS_DELETE_PTR(ptr)
+            }
+        }
+        IvfPqProc::ivf_pq_index_lock_.writeUnlock();
+    }
+
+    CAISS_FUNCTION_CHECK_STATUS
+    CAISS_FUNCTION_END
+}
+
+
+CAISS_RET_TYPE IvfPqProc::destroyIvfPqSingleton() {
+    CAISS_FUNCTION_BEGIN
+
+    IvfPqProc::ivf_pq_index_lock_.writeLock();
+    CAISS_DELETE_PTR(IvfPqProc::ivf_pq_index_ptr_)
+    IvfPqProc::ivf_pq_index_lock_.writeUnlock();
+
+    CAISS_FUNCTION_END
+}
+
+
+IvfPqIndex* IvfPqProc::getIvfPqSingleton() {
+    return IvfPqProc::ivf_pq_index_ptr_;
+}
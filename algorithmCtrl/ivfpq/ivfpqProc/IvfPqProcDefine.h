@@ -0,0 +1,40 @@
+//
+// Created by Chunel on 2020/10/11.
+//
+
+#ifndef CAISS_IVFPQPROCDEFINE_H
+#define CAISS_IVFPQPROCDEFINE_H
+
+#include <cmath>
+#include <algorithm>
+
+const static unsigned int IVFPQ_NLIST_TIMES = 4;           // 自动决定聚类中心个数时，取 4 * sqrt(数据量)
+const static unsigned int IVFPQ_NPROBE_DEFAULT = 8;        // 查询时默认遍历的倒排表个数
+const static unsigned int IVFPQ_RERANK_DEFAULT = 4;        // 默认按照pq距离召回 topK*4 个候选点，再重新排序
+const static unsigned int IVFPQ_CHECK_TIMES_MAX = 2000;    // 检查准确率时，最多的比较次数
+
+struct IvfPqTrainParams {
+    IvfPqTrainParams(unsigned int nlist, unsigned int m, unsigned int size, unsigned int step) {
+        this->nlist = (0 != nlist) ? nlist : IVFPQ_NLIST_TIMES * (unsigned int)std::sqrt((double)size);
+        this->nlist = std::max(std::min(this->nlist, size), 1u);
+        this->m = m;
+        this->nprobe = std::min(IVFPQ_NPROBE_DEFAULT, this->nlist);
+        this->rerank = IVFPQ_RERANK_DEFAULT;
+        this->step = step;
+    }
+
+    void update(float span) {
+        // 传入的是精确度的差距。聚类中心和码本不需要重新训练，只调整查询时的遍历范围和重新排序的候选数量
+        this->nprobe += (unsigned int)(1.0f + (float)this->nprobe * (1.0f + span * 10.0f) * (float)step / 10.0f);
+        this->nprobe = std::min(this->nprobe, this->nlist);
+        this->rerank += (unsigned int)(1.0f + (float)this->rerank * (1.0f + span * 10.0f) * (float)step / 10.0f);
+    }
+
+    unsigned int nlist;             // 聚类中心个数
+    unsigned int m;                 // pq的段数
+    unsigned int nprobe;            // 查询时遍历的倒排表个数
+    unsigned int rerank;            // 重新排序的候选倍数
+    unsigned int step;              // 数据更新快慢的决定因素
+};
+
+#endif //CAISS_IVFPQPROCDEFINE_H
@@ -0,0 +1,337 @@
+//
+// Created by Chunel on 2020/9/20.
+//
+
+#include <fstream>
+#include <algorithm>
+#include <limits>
+
+#include "NsgModel.h"
+#include "../../common/NNDescent.h"
+
+using namespace std;
+
+template<typename T>
+static void writeNsgPOD(std::ostream &out, const T &podRef) {
+    out.write((char *) &podRef, sizeof(T));
+}
+
+template<typename T>
+static void readNsgPOD(std::istream &in, T &podRef) {
+    in.read((char *) &podRef, sizeof(T));
+}
+
+static void writeNsgString(std::ostream &out, const std::string &str) {
+    auto len = (unsigned int)str.size();
+    writeNsgPOD(out, len);
+    out.write(str.data(), len);
+}
+
+static void readNsgString(std::istream &in, std::string &str) {
+    unsigned int len = 0;
+    readNsgPOD(in, len);
+    str.resize(len);
+    in.read(&str[0], len);
+}
+
+
+NsgModel::NsgModel() {
+    this->dim_ = 0;
+    this->distance_type_ = CAISS_DISTANCE_DEFAULT;
+    this->max_size_ = 0;
+    this->max_index_size_ = 0;
+    this->normalize_ = CAISS_FALSE;
+    this->search_pool_ = 0;
+    this->index_ = nullptr;
+}
+
+
+NsgModel::NsgModel(unsigned int dim, CAISS_DISTANCE_TYPE distanceType, unsigned int maxSize,
+                   unsigned int maxIndexSize, CAISS_BOOL normalize) {
+    this->dim_ = dim;
+    this->distance_type_ = distanceType;
+    this->max_size_ = maxSize;
+    this->max_index_size_ = maxIndexSize;
+    this->normalize_ = normalize;
+    this->search_pool_ = 0;
+    this->index_ = nullptr;
+}
+
+
+NsgModel::~NsgModel() {
+    CAISS_DELETE_PTR(this->index_)
+}
+
+
+CAISS_RET_TYPE NsgModel::addPoint(const CAISS_FLOAT *node, const std::string &word) {
+    CAISS_FUNCTION_BEGIN
+    CAISS_ASSERT_NOT_NULL(node)
+
+    if (word.empty() || word.size() > this->max_index_size_) {
+        return CAISS_RET_WORD_SIZE;
+    }
+
+    if (nullptr != this->index_) {
+        return CAISS_RET_NO_SUPPORT;    // nsg是静态图，构建完成之后不支持插入
+    }
+
+    auto cur = this->word_lookup_.find(word);
+    if (cur != this->word_lookup_.end()) {
+        std::copy(node, node + this->dim_, this->datas_.begin() + (size_t)cur->second * this->dim_);
+        return CAISS_RET_OK;
+    }
+
+    if (this->words_.size() >= this->max_size_) {
+        return CAISS_RET_MODEL_SIZE;
+    }
+
+    this->word_lookup_[word] = (unsigned int)this->words_.size();
+    this->words_.push_back(word);
+    this->datas_.insert(this->datas_.end(), node, node + this->dim_);
+
+    CAISS_FUNCTION_END
+}
+
+
+CAISS_RET_TYPE NsgModel::buildKnnGraph(unsigned int knn, std::vector<std::vector<unsigned>> &graph) const {
+    CAISS_FUNCTION_BEGIN
+
+    NNDescent nnd(this->datas_.data(), getSize(), this->dim_, this->distance_type_);
+    ret = nnd.build(NNDescentParams(knn), graph);
+    CAISS_FUNCTION_CHECK_STATUS
+
+    CAISS_FUNCTION_END
+}
+
+
+CAISS_RET_TYPE NsgModel::build(const std::vector<std::vector<unsigned>> &knnGraph, unsigned int buildPool,
+                               unsigned int maxDegree, unsigned int maxCandidate) {
+    CAISS_FUNCTION_BEGIN
+
+    auto size = (unsigned int)this->words_.size();
+    if (size < 2 || knnGraph.size() != size) {
+        return CAISS_RET_PARAM;
+    }
+
+    efanna2e::Parameters params;
+    params.Set<unsigned>("L", std::min(buildPool, size));    // 候选集合不能超过点的总数
+    params.Set<unsigned>("R", maxDegree);
+    params.Set<unsigned>("C", maxCandidate);
+
+    CAISS_DELETE_PTR(this->index_)
+    this->index_ = new efanna2e::IndexNSG(this->dim_, size, getMetric(), nullptr);
+    std::vector<std::vector<unsigned>> graph(knnGraph);    // 多轮训练时，kNN图会被重复使用
+    this->index_->SetNnGraph(graph);
+    this->index_->Build(size, this->datas_.data(), params);
+    this->index_->OptimizeGraph(this->datas_.data());
+
+    CAISS_FUNCTION_END
+}
+
+
+CAISS_RET_TYPE NsgModel::search(const CAISS_FLOAT *query, unsigned int topK, ALGO_RET_TYPE &result) const {
+    CAISS_FUNCTION_BEGIN
+    CAISS_ASSERT_NOT_NULL(query)
+    CAISS_ASSERT_NOT_NULL(this->index_)
+
+    topK = std::min(topK, getSize());
+    if (0 == topK) {
+        return CAISS_RET_OK;
+    }
+
+    efanna2e::Parameters params;
+    params.Set<unsigned>("L_search", std::max(this->search_pool_, topK));
+    std::vector<unsigned> indices(topK);
+    this->index_->SearchWithOptGraph(query, topK, params, indices.data());
+
+    for (auto id : indices) {
+        result.emplace(calcDistance(query, getData(id)), id);    // 图查询的排序距离，不是真实距离，需要重新计算
+    }
+
+    CAISS_FUNCTION_END
+}
+
+
+CAISS_RET_TYPE NsgModel::forceLoop(const CAISS_FLOAT *query, unsigned int topK, ALGO_RET_TYPE &result) const {
+    CAISS_FUNCTION_BEGIN
+    CAISS_ASSERT_NOT_NULL(query)
+    CAISS_ASSERT_NOT_NULL(this->index_)
+
+    if (0 == topK) {
+        return CAISS_RET_OK;
+    }
+
+    auto size = getSize();
+    CAISS_FLOAT threshold = std::numeric_limits<CAISS_FLOAT>::max();
+    for (unsigned int i = 0; i < size; i++) {
+        CAISS_FLOAT dist = calcDistance(query, getData(i));
+        if (dist >= threshold) {
+            continue;
+        }
+
+        result.emplace(dist, i);
+        if (result.size() > topK) {
+            result.pop();
+        }
+        if (result.size() >= topK) {
+            threshold = result.top().first;
+        }
+    }
+
+    CAISS_FUNCTION_END
+}
+
+
+CAISS_RET_TYPE NsgModel::save(const std::string &path, const std::list<std::string> &ignoreList) const {
+    CAISS_FUNCTION_BEGIN
+    CAISS_ASSERT_NOT_NULL(this->index_)
+
+    std::ofstream output(path, std::ios::binary);
+    if (!output) {
+        return CAISS_RET_PATH;
+    }
+
+    writeNsgPOD(output, NSG_MODEL_MAGIC);
+    writeNsgPOD(output, NSG_MODEL_VERSION);
+    writeNsgPOD(output, this->dim_);
+    writeNsgPOD(output, (int)this->distance_type_);
+    writeNsgPOD(output, (int)this->normalize_);
+    writeNsgPOD(output, this->max_size_);
+    writeNsgPOD(output, this->max_index_size_);
+    writeNsgPOD(output, this->search_pool_);
+
+    auto size = getSize();
+    writeNsgPOD(output, size);
+    for (const auto &word : this->words_) {
+        writeNsgString(output, word);
+    }
+    for (unsigned int i = 0; i < size; i++) {
+        output.write((const char *)getData(i), this->dim_ * sizeof(CAISS_FLOAT));
+    }
+    this->index_->Save(output);
+
+    auto ignoreSize = (unsigned int)ignoreList.size();
+    writeNsgPOD(output, ignoreSize);
+    for (const auto &word : ignoreList) {
+        writeNsgString(output, word);
+    }
+
+    output.close();
+    CAISS_FUNCTION_END
+}
+
+
+CAISS_RET_TYPE NsgModel::load(const std::string &path, TrieProc *trie) {
+    CAISS_FUNCTION_BEGIN
+
+    std::ifstream input(path, std::ios::binary);
+    if (!input) {
+        return CAISS_RET_PATH;
+    }
+
+    int magic = 0, version = 0, distanceType = 0, normalize = 0;
+    readNsgPOD(input, magic);
+    readNsgPOD(input, version);
+    if (NSG_MODEL_MAGIC != magic || NSG_MODEL_VERSION < version) {
+        return CAISS_RET_PATH;    // 不是nsg算法生成的模型
+    }
+
+    readNsgPOD(input, this->dim_);
+    readNsgPOD(input, distanceType);
+    readNsgPOD(input, normalize);
+    readNsgPOD(input, this->max_size_);
+    readNsgPOD(input, this->max_index_size_);
+    readNsgPOD(input, this->search_pool_);
+    this->distance_type_ = (CAISS_DISTANCE_TYPE)distanceType;
+    this->normalize_ = (CAISS_BOOL)normalize;
+
+    unsigned int size = 0;
+    readNsgPOD(input, size);
+    this->words_.resize(size);
+    this->word_lookup_.clear();
+    for (unsigned int i = 0; i < size; i++) {
+        readNsgString(input, this->words_[i]);
+        this->word_lookup_[this->words_[i]] = i;
+    }
+
+    // 向量读取之后，拷贝进opt图中，临时空间随即释放
+    std::vector<CAISS_FLOAT> datas((size_t)size * this->dim_);
+    input.read((char *)datas.data(), datas.size() * sizeof(CAISS_FLOAT));
+    CAISS_DELETE_PTR(this->index_)
+    this->index_ = new efanna2e::IndexNSG(this->dim_, size, getMetric(), nullptr);
+    this->index_->Load(input);
+    if (!input) {
+        return CAISS_RET_ERR;    // 模型文件不完整
+    }
+    this->index_->OptimizeGraph(datas.data());
+
+    unsigned int ignoreSize = 0;
+    readNsgPOD(input, ignoreSize);
+    for (unsigned int i = 0; i < ignoreSize && nullptr != trie; i++) {
+        std::string word;
+        readNsgString(input, word);
+        trie->insert(word);
+    }
+
+    input.close();
+    CAISS_FUNCTION_END
+}
+
+
+void NsgModel::setSearchPool(unsigned int searchPool) {
+    this->search_pool_ = searchPool;
+}
+
+
+unsigned int NsgModel::getSearchPool() const {
+    return this->search_pool_;
+}
+
+
+int NsgModel::findWordId(const std::string &word) const {
+    auto cur = this->word_lookup_.find(word);
+    return (cur != this->word_lookup_.end()) ? (int)cur->second : ALGO_NO_WORD_ID;
+}
+
+
+const std::string &NsgModel::getWord(unsigned int id) const {
+    return this->words_[id];
+}
+
+
+const CAISS_FLOAT *NsgModel::getData(unsigned int id) const {
+    return (nullptr != this->index_) ? this->index_->GetOptData(id) : this->datas_.data() + (size_t)id * this->dim_;
+}
+
+
+unsigned int NsgModel::getDim() const {
+    return this->dim_;
+}
+
+
+unsigned int NsgModel::getSize() const {
+    return (unsigned int)this->words_.size();
+}
+
+
+CAISS_BOOL NsgModel::getNormalize() const {
+    return this->normalize_;
+}
+
+
+CAISS_DISTANCE_TYPE NsgModel::getDistanceType() const {
+    return this->distance_type_;
+}
+
+
+CAISS_FLOAT NsgModel::calcDistance(const CAISS_FLOAT *query, const CAISS_FLOAT *node) const {
+    // 跟hnsw和flat中的距离定义保持一致
+    return (CAISS_DISTANCE_INNER == this->distance_type_)
+           ? 1.0f - efanna2e::DotSIMD(query, node, this->dim_)
+           : efanna2e::L2SqrSIMD(query, node, this->dim_);
+}
+
+
+efanna2e::Metric NsgModel::getMetric() const {
+    return (CAISS_DISTANCE_INNER == this->distance_type_) ? efanna2e::INNER_PRODUCT : efanna2e::L2;
+}
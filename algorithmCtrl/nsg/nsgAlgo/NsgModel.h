@@ -0,0 +1,101 @@
+//
+// Created by Chunel on 2020/9/20.
+// nsg算法的模型信息。构图完成后，向量和邻居信息按照IndexNSG::OptimizeGraph的方式连续存放，
+// 查询的时候通过SearchWithOptGraph进行。原始向量在OptimizeGraph之后释放，内存占用较小
+//
+
+#ifndef CAISS_NSGMODEL_H
+#define CAISS_NSGMODEL_H
+
+#include <list>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include "../../common/CommonAlgoDefine.h"
+#include "../../../utilsCtrl/UtilsInclude.h"
+#include "efanna2e/index_nsg.h"
+
+const static int NSG_MODEL_MAGIC = 0x2047534E;    // 模型文件头部的标识（"NSG "）
+const static int NSG_MODEL_VERSION = 1;
+
+class NsgModel {
+
+public:
+    explicit NsgModel();
+    NsgModel(unsigned int dim, CAISS_DISTANCE_TYPE distanceType, unsigned int maxSize, unsigned int maxIndexSize,
+             CAISS_BOOL normalize);
+    ~NsgModel();
+
+    /**
+     * 加入向量信息，仅在构图之前使用。词语已经存在的时候，覆盖之前的向量
+     * @param node 已经归一化的向量
+     * @param word
+     * @return
+     */
+    CAISS_RET_TYPE addPoint(const CAISS_FLOAT *node, const std::string &word);
+
+    /**
+     * 通过NN-Descent构建kNN图（不包含自身），作为nsg构图的输入
+     * @param knn 每个点的邻居数
+     * @param graph
+     * @return
+     */
+    CAISS_RET_TYPE buildKnnGraph(unsigned int knn, std::vector<std::vector<unsigned>> &graph) const;
+
+    /**
+     * 根据kNN图构建nsg图，并转换成查询使用的连续存储格式
+     * @param knnGraph
+     * @param buildPool 构图时的候选集合大小（L）
+     * @param maxDegree 最大出度（R）
+     * @param maxCandidate 裁边时最多考虑的候选点数（C）
+     * @return
+     */
+    CAISS_RET_TYPE build(const std::vector<std::vector<unsigned>> &knnGraph, unsigned int buildPool,
+                         unsigned int maxDegree, unsigned int maxCandidate);
+
+    /**
+     * 图查询，返回结果中的距离是精确距离
+     * @param query
+     * @param topK
+     * @param result
+     * @return
+     */
+    CAISS_RET_TYPE search(const CAISS_FLOAT *query, unsigned int topK, ALGO_RET_TYPE &result) const;
+    CAISS_RET_TYPE forceLoop(const CAISS_FLOAT *query, unsigned int topK, ALGO_RET_TYPE &result) const;
+
+    CAISS_RET_TYPE save(const std::string &path, const std::list<std::string> &ignoreList) const;
+    CAISS_RET_TYPE load(const std::string &path, TrieProc *trie);
+
+    void setSearchPool(unsigned int searchPool);
+    unsigned int getSearchPool() const;
+
+    int findWordId(const std::string &word) const;
+    const std::string &getWord(unsigned int id) const;
+    const CAISS_FLOAT *getData(unsigned int id) const;
+
+    unsigned int getDim() const;
+    unsigned int getSize() const;
+    CAISS_BOOL getNormalize() const;
+    CAISS_DISTANCE_TYPE getDistanceType() const;
+
+protected:
+    inline CAISS_FLOAT calcDistance(const CAISS_FLOAT *query, const CAISS_FLOAT *node) const;
+    efanna2e::Metric getMetric() const;
+
+private:
+    unsigned int dim_;
+    CAISS_DISTANCE_TYPE distance_type_;
+    unsigned int max_size_;
+    unsigned int max_index_size_;    // 词语的最大长度
+    CAISS_BOOL normalize_;
+    unsigned int search_pool_;       // 查询时候选集合大小（L_search）
+
+    std::vector<CAISS_FLOAT> datas_;    // 训练时的原始向量。加载模型的时候不保存，只使用opt图中的向量
+    std::vector<std::string> words_;
+    std::unordered_map<std::string, unsigned int> word_lookup_;
+    efanna2e::IndexNSG *index_;
+};
+
+
+#endif //CAISS_NSGMODEL_H
@@ -14,6 +14,80 @@ namespace efanna2e{
     FAST_L2 = 2,
     PQ = 3
   };
+
+#if defined(__AVX__)
+  #define EFANNA_USE_AVX
+#elif defined(__SSE__)
+  #define EFANNA_USE_SSE
+#endif
+
+  // 平方欧氏距离
+  static inline float L2SqrSIMD(const float* a, const float* b, unsigned size) {
+    unsigned i = 0;
+    float result = 0;
+#if defined(EFANNA_USE_AVX)
+    __m256 sum0 = _mm256_setzero_ps(), sum1 = _mm256_setzero_ps();
+    for (; i + 16 <= size; i += 16) {
+      __m256 d0 = _mm256_sub_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i));
+      __m256 d1 = _mm256_sub_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8));
+      sum0 = _mm256_add_ps(sum0, _mm256_mul_ps(d0, d0));
+      sum1 = _mm256_add_ps(sum1, _mm256_mul_ps(d1, d1));
+    }
+    sum0 = _mm256_add_ps(sum0, sum1);
+    __m128 sum = _mm_add_ps(_mm256_castps256_ps128(sum0), _mm256_extractf128_ps(sum0, 1));
+    float tmp[4];
+    _mm_storeu_ps(tmp, sum);
+    result = tmp[0] + tmp[1] + tmp[2] + tmp[3];
+#elif defined(EFANNA_USE_SSE)
+    __m128 sum0 = _mm_setzero_ps(), sum1 = _mm_setzero_ps();
+    for (; i + 8 <= size; i += 8) {
+      __m128 d0 = _mm_sub_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i));
+      __m128 d1 = _mm_sub_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4));
+      sum0 = _mm_add_ps(sum0, _mm_mul_ps(d0, d0));
+      sum1 = _mm_add_ps(sum1, _mm_mul_ps(d1, d1));
+    }
+    float tmp[4];
+    _mm_storeu_ps(tmp, _mm_add_ps(sum0, sum1));
+    result = tmp[0] + tmp[1] + tmp[2] + tmp[3];
+#endif
+    for (; i < size; i++) {
+      float diff = a[i] - b[i];
+      result += diff * diff;
+    }
+    return result;
+  }
+
+  // 内积
+  static inline float DotSIMD(const float* a, const float* b, unsigned size) {
+    unsigned i = 0;
+    float result = 0;
+#if defined(EFANNA_USE_AVX)
+    __m256 sum0 = _mm256_setzero_ps(), sum1 = _mm256_setzero_ps();
+    for (; i + 16 <= size; i += 16) {
+      sum0 = _mm256_add_ps(sum0, _mm256_mul_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)));
+      sum1 = _mm256_add_ps(sum1, _mm256_mul_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8)));
+    }
+    sum0 = _mm256_add_ps(sum0, sum1);
+    __m128 sum = _mm_add_ps(_mm256_castps256_ps128(sum0), _mm256_extractf128_ps(sum0, 1));
+    float tmp[4];
+    _mm_storeu_ps(tmp, sum);
+    result = tmp[0] + tmp[1] + tmp[2] + tmp[3];
+#elif defined(EFANNA_USE_SSE)
+    __m128 sum0 = _mm_setzero_ps(), sum1 = _mm_setzero_ps();
+    for (; i + 8 <= size; i += 8) {
+      sum0 = _mm_add_ps(sum0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+      sum1 = _mm_add_ps(sum1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+    }
+    float tmp[4];
+    _mm_storeu_ps(tmp, _mm_add_ps(sum0, sum1));
+    result = tmp[0] + tmp[1] + tmp[2] + tmp[3];
+#endif
+    for (; i < size; i++) {
+      result += a[i] * b[i];
+    }
+    return result;
+  }
+
     class Distance {
     public:
         virtual float compare(const float* a, const float* b, unsigned length) const = 0;
@@ -23,29 +97,27 @@ namespace efanna2e{
     class DistanceL2 : public Distance{
     public:
         float compare(const float* a, const float* b, unsigned size) const {
-            float result = 0;
-
-            return result;
+            return L2SqrSIMD(a, b, size);
         }
     };
 
+  // 跟caiss中hnsw的内积距离定义保持一致（1 - <a,b>），距离越小越相似
   class DistanceInnerProduct : public Distance{
   public:
     float compare(const float* a, const float* b, unsigned size) const {
-      float result = 0;
-      return result;
+      return 1.0f - DotSIMD(a, b, size);
     }
 
   };
+  // |a-b|^2 = |a|^2 - 2<a,b> + |b|^2。同一个query比较时，|query|^2是常量，故只需要保存底库向量的norm
   class DistanceFastL2 : public DistanceInnerProduct{
    public:
     float norm(const float* a, unsigned size) const{
-      float result = 0;
-      return result;
+      return DotSIMD(a, a, size);
     }
     using DistanceInnerProduct::compare;
-    float compare(const float* a, const float* b, float norm, unsigned size) const {//not implement
-      float result = -2 * DistanceInnerProduct::compare(a, b, size);
+    float compare(const float* a, const float* b, float norm, unsigned size) const {
+      float result = -2 * DotSIMD(a, b, size);
       result += norm;
       return result;
     }
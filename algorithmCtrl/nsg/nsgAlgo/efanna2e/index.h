@@ -43,11 +43,14 @@ class Index {
   inline size_t GetSizeOfDataset() const { return nd_; }
 
   inline const float *GetDataset() const { return data_; }
+
+  inline Metric GetMetric() const { return metric_; }
  protected:
   const size_t dimension_;
   const float *data_;
   size_t nd_;
   bool has_built;
+  Metric metric_;
   Distance* distance_;
 };
 
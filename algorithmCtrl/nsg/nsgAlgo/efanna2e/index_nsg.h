@@ -24,6 +24,13 @@ class IndexNSG : public Index {
   virtual void Save(const char *filename)override;
   virtual void Load(const char *filename)override;
 
+  // 图信息写入/读取已经打开的流，便于跟词语、向量等信息保存在同一个模型文件中
+  void Save(std::ostream &out) const;
+  void Load(std::istream &in);
+
+  // 传入构建好的kNN图，Build的时候不再从nn_graph_path中读取
+  void SetNnGraph(std::vector<std::vector<unsigned> > &graph);
+
 
   virtual void Build(size_t n, const float *data, const Parameters &parameters) override;
 
@@ -37,8 +44,23 @@ class IndexNSG : public Index {
       const float *query,
       size_t K,
       const Parameters &parameters,
-      unsigned *indices);
-  void OptimizeGraph(float* data);
+      unsigned *indices) const;
+  void OptimizeGraph(const float* data);
+
+  // Build之后可以使用，获取构建完成的邻居信息（OptimizeGraph之后会被清空）
+  inline const std::vector<std::vector<unsigned> > &GetGraph() const { return final_graph_; }
+
+  // 以下接口，仅在OptimizeGraph之后可以使用
+  inline const float *GetOptData(unsigned id) const {
+    return (const float *)(opt_graph_ + node_size * id) + 1;
+  }
+  inline const unsigned *GetOptNeighbors(unsigned id, unsigned &num) const {
+    const unsigned *neighbors = (const unsigned *)(opt_graph_ + node_size * id + data_len);
+    num = *neighbors;
+    return neighbors + 1;
+  }
+  inline unsigned GetEntry() const { return ep_; }
+  inline unsigned GetWidth() const { return width; }
 
   protected:
     typedef std::vector<std::vector<unsigned > > CompactGraph;
@@ -13,9 +13,12 @@ namespace efanna2e {
 #define _CONTROL_NUM 100
 IndexNSG::IndexNSG(const size_t dimension, const size_t n, Metric m,
                    Index *initializer)
-    : Index(dimension, n, m), initializer_{initializer} {}
+    : Index(dimension, n, m), initializer_{initializer}, width(0), ep_(0),
+      opt_graph_(nullptr), node_size(0), data_len(0), neighbor_len(0) {}
 
-IndexNSG::~IndexNSG() {}
+IndexNSG::~IndexNSG() {
+  free(opt_graph_);
+}
 
 void IndexNSG::Save(const char *filename) {
   std::ofstream out(filename, std::ios::binary | std::ios::out);
@@ -49,6 +52,39 @@ void IndexNSG::Load(const char *filename) {
   cc /= nd_;
   // std::cout<<cc<<std::endl;
 }
+
+void IndexNSG::Save(std::ostream &out) const {
+  out.write((char *)&width, sizeof(unsigned));
+  out.write((char *)&ep_, sizeof(unsigned));
+  for (unsigned i = 0; i < nd_; i++) {
+    unsigned GK = 0;
+    const unsigned *neighbors = nullptr;
+    if (nullptr != opt_graph_) {
+      neighbors = GetOptNeighbors(i, GK);
+    } else {
+      GK = (unsigned)final_graph_[i].size();
+      neighbors = final_graph_[i].data();
+    }
+    out.write((char *)&GK, sizeof(unsigned));
+    out.write((char *)neighbors, GK * sizeof(unsigned));
+  }
+}
+
+void IndexNSG::Load(std::istream &in) {
+  in.read((char *)&width, sizeof(unsigned));
+  in.read((char *)&ep_, sizeof(unsigned));
+  final_graph_.resize(nd_);
+  for (unsigned i = 0; i < nd_ && in; i++) {
+    unsigned k = 0;
+    in.read((char *)&k, sizeof(unsigned));
+    final_graph_[i].resize(k);
+    in.read((char *)final_graph_[i].data(), k * sizeof(unsigned));
+  }
+}
+
+void IndexNSG::SetNnGraph(std::vector<std::vector<unsigned> > &graph) {
+  final_graph_.swap(graph);
+}
 void IndexNSG::Load_nn_graph(const char *filename) {
   std::ifstream in(filename, std::ios::binary);
   unsigned k;
@@ -386,9 +422,11 @@ void IndexNSG::Link(const Parameters &parameters, SimpleNeighbor *cut_graph_) {
 }
 
 void IndexNSG::Build(size_t n, const float *data, const Parameters &parameters) {
-  std::string nn_graph_path = parameters.Get<std::string>("nn_graph_path");
+  std::string nn_graph_path = final_graph_.empty() ? parameters.Get<std::string>("nn_graph_path") : "";
   unsigned range = parameters.Get<unsigned>("R");
-  Load_nn_graph(nn_graph_path.c_str());
+  if (final_graph_.empty()) {
+    Load_nn_graph(nn_graph_path.c_str());    // 没有通过SetNnGraph传入kNN图，则从文件中读取
+  }
   data_ = data;
   init_graph(parameters);
   SimpleNeighbor *cut_graph_ = new SimpleNeighbor[nd_ * (size_t)range];
@@ -420,6 +458,7 @@ void IndexNSG::Build(size_t n, const float *data, const Parameters &parameters)
   }
   avg /= 1.0 * nd_;
   printf("Degree Statistics: Max = %d, Min = %d, Avg = %d\n", max, min, avg);
+  delete[] cut_graph_;
 
   has_built = true;
 }
@@ -489,9 +528,12 @@ void IndexNSG::Search(const float *query, const float *x, size_t K,
 }
 
 void IndexNSG::SearchWithOptGraph(const float *query, size_t K,
-                                  const Parameters &parameters, unsigned *indices) {
+                                  const Parameters &parameters, unsigned *indices) const {
   unsigned L = parameters.Get<unsigned>("L_search");
-  DistanceFastL2 *dist_fast = (DistanceFastL2 *)distance_;
+  if (L > nd_) L = (unsigned)nd_;    // 候选集合不能超过点的总数，否则随机补点的时候无法结束
+  if (K > L) K = L;
+  DistanceFastL2 fast;
+  DistanceFastL2 *dist_fast = &fast;
 
   std::vector<Neighbor> retset(L + 1);
   std::vector<unsigned> init_ids(L);
@@ -577,19 +619,22 @@ void IndexNSG::SearchWithOptGraph(const float *query, size_t K,
   }
 }
 
-void IndexNSG::OptimizeGraph(float *data) {  // use after build or load
+void IndexNSG::OptimizeGraph(const float *data) {  // use after build or load
 
   data_ = data;
   data_len = (dimension_ + 1) * sizeof(float);
   neighbor_len = (width + 1) * sizeof(unsigned);
   node_size = data_len + neighbor_len;
+  free(opt_graph_);
   opt_graph_ = (char *)malloc(node_size * nd_);
-  DistanceFastL2 *dist_fast = (DistanceFastL2 *)distance_;
+  DistanceFastL2 fast;
+  DistanceFastL2 *dist_fast = &fast;
   for (unsigned i = 0; i < nd_; i++) {
     char *cur_node_offset = opt_graph_ + i * node_size;
-    float cur_norm = dist_fast->norm(data_ + i * dimension_, dimension_);
+    // 内积距离下，norm记为0，此时 -2<a,b> 跟内积距离的排序一致
+    float cur_norm = (INNER_PRODUCT == metric_) ? 0.0f : dist_fast->norm(data_ + (size_t)i * dimension_, dimension_);
     std::memcpy(cur_node_offset, &cur_norm, sizeof(float));
-    std::memcpy(cur_node_offset + sizeof(float), data_ + i * dimension_,
+    std::memcpy(cur_node_offset + sizeof(float), data_ + (size_t)i * dimension_,
                 data_len - sizeof(float));
 
     cur_node_offset += data_len;
@@ -600,6 +645,7 @@ void IndexNSG::OptimizeGraph(float *data) {  // use after build or load
     std::vector<unsigned>().swap(final_graph_[i]);
   }
   CompactGraph().swap(final_graph_);
+  data_ = nullptr;    // 向量已经拷贝到opt_graph_中，外部的数据可以释放了
 }
 
 void IndexNSG::DFS(boost::dynamic_bitset<> &flag, unsigned root, unsigned &cnt) {
@@ -0,0 +1,308 @@
+//
+// Created by Chunel on 2020/9/20.
+// 跟hnsw一样，模型信息是所有句柄共用的，锁在manage这一层保存
+//
+
+#include <cmath>
+#include "NsgProc.h"
+
+using namespace std;
+
+NsgModel* NsgProc::nsg_model_ptr_ = nullptr;
+RWLock NsgProc::nsg_model_lock_;
+
+
+NsgProc::NsgProc() = default;
+
+
+NsgProc::~NsgProc() {
+    this->reset();
+}
+
+
+CAISS_RET_TYPE NsgProc::init(const CAISS_MODE mode, const CAISS_DISTANCE_TYPE distanceType, const unsigned int dim,
+                             const char *modelPath, const CAISS_DIST_FUNC distFunc) {
+    CAISS_FUNCTION_BEGIN
+    CAISS_ASSERT_NOT_NULL(modelPath)
+
+    if (CAISS_DISTANCE_EUC != distanceType && CAISS_DISTANCE_INNER != distanceType) {
+        return CAISS_RET_NO_SUPPORT;    // 构图的过程中需要大量计算距离，暂不支持自定义距离
+    }
+
+    reset();
+
+    this->dim_ = dim;
+    this->cur_mode_ = mode;
+    this->model_path_ = buildModelPath(modelPath);
+    this->distance_type_ = distanceType;
+
+    if (CAISS_MODE_PROCESS == this->cur_mode_) {
+        ret = loadModel();
+        CAISS_FUNCTION_CHECK_STATUS
+    }
+
+    CAISS_FUNCTION_END
+}
+
+
+CAISS_RET_TYPE NsgProc::reset() {
+    CAISS_FUNCTION_BEGIN
+
+    this->dim_ = 0;
+    this->cur_mode_ = CAISS_MODE_DEFAULT;
+    this->normalize_ = CAISS_FALSE;
+    this->result_.clear();
+
+    CAISS_FUNCTION_END
+}
+
+
+CAISS_RET_TYPE NsgProc::train(const char *dataPath, const unsigned int maxDataSize, const CAISS_BOOL normalize,
+                              const unsigned int maxIndexSize, const float precision, const unsigned int fastRank,
+                              const unsigned int realRank, const unsigned int step, const unsigned int maxEpoch,
+                              const unsigned int showSpan) {
+    CAISS_FUNCTION_BEGIN
+    CAISS_ASSERT_NOT_NULL(dataPath)
+    CAISS_CHECK_MODE_ENABLE(CAISS_MODE_TRAIN)
+
+    this->normalize_ = normalize;
+    std::vector<CaissDataNode> datas;
+    CAISS_ECHO("start load datas from [%s].", dataPath);
+    ret = loadDatas(dataPath, datas);
+    CAISS_FUNCTION_CHECK_STATUS
+
+    destroyNsgSingleton();
+    ret = createNsgSingleton(this->dim_, this->distance_type_, maxDataSize, maxIndexSize, normalize);
+    CAISS_FUNCTION_CHECK_STATUS
+
+    auto ptr = NsgProc::getNsgSingleton();
+    CAISS_ASSERT_NOT_NULL(ptr)
+    for (unsigned int i = 0; i < datas.size(); i++) {
+        ret = ptr->addPoint(datas[i].node.data(), datas[i].index);
+        CAISS_FUNCTION_CHECK_STATUS
+    }
+
+    NsgTrainParams params(step);
+    std::vector<std::vector<unsigned>> knnGraph;
+    CAISS_ECHO("start to build knn graph, please wait for a moment...");
+    ret = ptr->buildKnnGraph(params.knn, knnGraph);    // kNN图跟训练参数无关，多轮训练的时候复用
+    CAISS_FUNCTION_CHECK_STATUS
+
+    unsigned int epoch = 0;
+    while (epoch < maxEpoch) {
+        CAISS_ECHO("start to train caiss model for [%d] in [%d] epochs.", ++epoch, maxEpoch);
+        ret = trainModel(knnGraph, params);
+        CAISS_FUNCTION_CHECK_STATUS
+        CAISS_ECHO("model build finished, check model precision automatic, please wait for a moment...");
+
+        float calcPrecision = 0.0f;
+        ret = checkModelPrecisionEnable(precision, fastRank, realRank, datas, calcPrecision);
+        if (CAISS_RET_OK == ret) {
+            CAISS_ECHO("train success, precision is [%0.4f] , model is saved to path [%s].", calcPrecision,
+                       this->model_path_.c_str());
+            break;
+        } else if (CAISS_RET_WARNING == ret) {
+            float span = precision - calcPrecision;
+            CAISS_ECHO("warning, the model's precision is not suitable, span = [%f], train again automatic.", span);
+            params.update(span);
+        }
+    }
+
+    // 无论准确率是否达标，都保存最后一次训练的结果，跟hnsw的处理方式一致
+    remove(this->model_path_.c_str());
+    CAISS_RET_TYPE saveRet = ptr->save(this->model_path_, std::list<std::string>());
+    if (CAISS_RET_OK != saveRet) {
+        return saveRet;
+    }
+
+    CAISS_FUNCTION_CHECK_STATUS    // 如果是precision达不到要求，则返回警告信息
+    CAISS_FUNCTION_END
+}
+
+
+CAISS_RET_TYPE NsgProc::insert(CAISS_FLOAT *node, const char *index, const CAISS_INSERT_TYPE insertType) {
+    CAISS_FUNCTION_BEGIN
+    CAISS_ASSERT_NOT_NULL(node)
+    CAISS_ASSERT_NOT_NULL(index)
+    CAISS_CHECK_MODE_ENABLE(CAISS_MODE_PROCESS)
+
+    return CAISS_RET_NO_SUPPORT;    // nsg是静态图，新增信息需要重新训练
+    CAISS_FUNCTION_END
+}
+
+
+CAISS_RET_TYPE NsgProc::save(const char *modelPath) {
+    CAISS_FUNCTION_BEGIN
+    auto ptr = NsgProc::getNsgSingleton();
+    CAISS_ASSERT_NOT_NULL(ptr)
+
+    std::string path = (nullptr == modelPath) ? this->model_path_ : buildModelPath(modelPath);
+    remove(path.c_str());
+    ret = ptr->save(path, AlgorithmProc::getIgnoreTrie()->getAllWords());
+    CAISS_FUNCTION_CHECK_STATUS
+
+    CAISS_FUNCTION_END
+}
+
+
+/************************ 以下是本Proc类内部函数 ************************/
+CAISS_RET_TYPE NsgProc::loadModel() {
+    CAISS_FUNCTION_BEGIN
+
+    ret = createNsgSingleton(this->model_path_);
+    CAISS_FUNCTION_CHECK_STATUS
+    auto ptr = NsgProc::getNsgSingleton();
+    CAISS_ASSERT_NOT_NULL(ptr)
+
+    if (ptr->getDim() != this->dim_) {
+        return CAISS_RET_DIM;
+    }
+
+    if (ptr->getDistanceType() != this->distance_type_) {
+        return CAISS_RET_PARAM;    // 图是按照训练时的距离类型构建的
+    }
+    this->normalize_ = ptr->getNormalize();
+
+    CAISS_FUNCTION_END
+}
+
+
+CAISS_RET_TYPE NsgProc::trainModel(const std::vector<std::vector<unsigned>> &knnGraph, const NsgTrainParams &params) {
+    CAISS_FUNCTION_BEGIN
+    auto ptr = NsgProc::getNsgSingleton();
+    CAISS_ASSERT_NOT_NULL(ptr)
+
+    ret = ptr->build(knnGraph, params.buildPool, params.maxDegree, params.maxCandidate);
+    CAISS_FUNCTION_CHECK_STATUS
+    ptr->setSearchPool(params.searchPool);
+
+    CAISS_FUNCTION_END
+}
+
+
+CAISS_RET_TYPE NsgProc::checkModelPrecisionEnable(const float targetPrecision, const unsigned int fastRank,
+                                                  const unsigned int realRank, const std::vector<CaissDataNode> &datas,
+                                                  float &calcPrecision) {
+    CAISS_FUNCTION_BEGIN
+    auto ptr = NsgProc::getNsgSingleton();
+    CAISS_ASSERT_NOT_NULL(ptr)
+
+    unsigned int suitableTimes = 0;
+    unsigned int calcTimes = min((unsigned int)datas.size(), NSG_CHECK_TIMES_MAX);
+    for (unsigned int i = 0; i < calcTimes; i++) {
+        ALGO_RET_TYPE fastResult, realResult;
+        ret = ptr->search(datas[i].node.data(), fastRank, fastResult);
+        CAISS_FUNCTION_CHECK_STATUS
+        ret = ptr->forceLoop(datas[i].node.data(), realRank, realResult);
+        CAISS_FUNCTION_CHECK_STATUS
+        if (fastResult.empty() || realResult.empty()) {
+            continue;
+        }
+
+        if (std::abs(fastResult.top().first - realResult.top().first) < 0.000002f) {    // 这里近似小于
+            suitableTimes++;
+        }
+    }
+
+    calcPrecision = (0 == calcTimes) ? 0.0f : (float)suitableTimes / (float)calcTimes;
+    ret = (calcPrecision >= targetPrecision) ? CAISS_RET_OK : CAISS_RET_WARNING;
+    CAISS_FUNCTION_CHECK_STATUS
+
+    CAISS_FUNCTION_END
+}
+
+
+CAISS_RET_TYPE NsgProc::searchVector(const CAISS_FLOAT *query, const unsigned int topK, const CAISS_SEARCH_TYPE searchType,
+                                     ALGO_RET_TYPE &result) {
+    CAISS_FUNCTION_BEGIN
+    CAISS_ASSERT_NOT_NULL(query)
+    auto ptr = NsgProc::getNsgSingleton();
+    CAISS_ASSERT_NOT_NULL(ptr)
+
+    ret = isAnnSearchType(searchType) ? ptr->search(query, topK, result) : ptr->forceLoop(query, topK, result);
+    CAISS_FUNCTION_CHECK_STATUS
+
+    CAISS_FUNCTION_END
+}
+
+
+int NsgProc::findWordId(const std::string &word) {
+    auto ptr = NsgProc::getNsgSingleton();
+    return (nullptr != ptr) ? ptr->findWordId(word) : ALGO_NO_WORD_ID;
+}
+
+
+CAISS_RET_TYPE NsgProc::getWordById(const unsigned int id, std::string &word) {
+    CAISS_FUNCTION_BEGIN
+    auto ptr = NsgProc::getNsgSingleton();
+    CAISS_ASSERT_NOT_NULL(ptr)
+
+    word = ptr->getWord(id);
+    CAISS_FUNCTION_END
+}
+
+
+CAISS_RET_TYPE NsgProc::getVectorById(const unsigned int id, std::vector<CAISS_FLOAT> &vec) {
+    CAISS_FUNCTION_BEGIN
+    auto ptr = NsgProc::getNsgSingleton();
+    CAISS_ASSERT_NOT_NULL(ptr)
+
+    const CAISS_FLOAT *data = ptr->getData(id);
+    vec.assign(data, data + ptr->getDim());
+    CAISS_FUNCTION_END
+}
+
+
+CAISS_RET_TYPE NsgProc::createNsgSingleton(const unsigned int dim, const CAISS_DISTANCE_TYPE distanceType,
+                                           const unsigned int maxDataSize, const unsigned int maxIndexSize,
+                                           const CAISS_BOOL normalize) {
+    CAISS_FUNCTION_BEGIN
+
+    if (nullptr == NsgProc::nsg_model_ptr_) {
+        NsgProc::nsg_model_lock_.writeLock();
+        if (nullptr == NsgProc::nsg_model_ptr_) {
+            NsgProc::nsg_model_ptr_ = new NsgModel(dim, distanceType, maxDataSize, maxIndexSize, normalize);
+        }
+        NsgProc::nsg_model_lock_.writeUnlock();
+    }
+
+    CAISS_FUNCTION_END
+}
+
+
+CAISS_RET_TYPE NsgProc::createNsgSingleton(const std::string &modelPath) {
+    CAISS_FUNCTION_BEGIN
+
+    if (nullptr == NsgProc::nsg_model_ptr_) {
+        NsgProc::nsg_model_lock_.writeLock();
+        if (nullptr == NsgProc::nsg_model_ptr_) {
+            auto ptr = new NsgModel();
+            ret = ptr->load(modelPath, AlgorithmProc::getIgnoreTrie());
+            if (CAISS_RET_OK == ret) {
+                NsgProc::nsg_model_ptr_ = ptr;
+            } else {
+                CAISS_DELETE_PTR(ptr)
+            }
+        }
+        NsgProc::nsg_model_lock_.writeUnlock();
+    }
+
+    CAISS_FUNCTION_CHECK_STATUS
+    CAISS_FUNCTION_END
+}
+
+
+CAISS_RET_TYPE NsgProc::destroyNsgSingleton() {
+    CAISS_FUNCTION_BEGIN
+
+    NsgProc::nsg_model_lock_.writeLock();
+    CAISS_DELETE_PTR(NsgProc::nsg_model_ptr_)
+    NsgProc::nsg_model_lock_.writeUnlock();
+
+    CAISS_FUNCTION_END
+}
+
+
+NsgModel* NsgProc::getNsgSingleton() {
+    return NsgProc::nsg_model_ptr_;
+}
@@ -0,0 +1,57 @@
+//
+// Created by Chunel on 2020/9/20.
+// nsg算法的封装层。nsg是静态图，构建完成之后不支持插入，但是内存占用较小，适合数据量很大的场景
+//
+
+#ifndef CAISS_NSGPROC_H
+#define CAISS_NSGPROC_H
+
+#include "../../common/CommonAlgoProc.h"
+#include "../nsgAlgo/NsgModel.h"
+#include "NsgProcDefine.h"
+
+class NsgProc : public CommonAlgoProc {
+
+public:
+    explicit NsgProc();
+    ~NsgProc() override;
+
+    CAISS_RET_TYPE init(CAISS_MODE mode, CAISS_DISTANCE_TYPE distanceType,
+                        unsigned int dim, const char *modelPath, CAISS_DIST_FUNC distFunc) override;
+
+    // train_mode
+    CAISS_RET_TYPE train(const char *dataPath, unsigned int maxDataSize, CAISS_BOOL normalize,
+                         unsigned int maxIndexSize, float precision, unsigned int fastRank,
+                         unsigned int realRank, unsigned int step, unsigned int maxEpoch,
+                         unsigned int showSpan) override;
+
+    // process_mode
+    CAISS_RET_TYPE insert(CAISS_FLOAT *node, const char *index, CAISS_INSERT_TYPE insertType) override;
+    CAISS_RET_TYPE save(const char *modelPath) override;
+
+protected:
+    CAISS_RET_TYPE reset();
+    CAISS_RET_TYPE loadModel();
+    CAISS_RET_TYPE trainModel(const std::vector<std::vector<unsigned>> &knnGraph, const NsgTrainParams &params);
+    CAISS_RET_TYPE checkModelPrecisionEnable(float targetPrecision, unsigned int fastRank, unsigned int realRank,
+                                             const std::vector<CaissDataNode> &datas, float &calcPrecision);
+
+    CAISS_RET_TYPE searchVector(const CAISS_FLOAT *query, unsigned int topK, CAISS_SEARCH_TYPE searchType,
+                                ALGO_RET_TYPE &result) override;
+    int findWordId(const std::string &word) override;
+    CAISS_RET_TYPE getWordById(unsigned int id, std::string &word) override;
+    CAISS_RET_TYPE getVectorById(unsigned int id, std::vector<CAISS_FLOAT> &vec) override;
+
+private:
+    static CAISS_RET_TYPE createNsgSingleton(unsigned int dim, CAISS_DISTANCE_TYPE distanceType, unsigned int maxDataSize,
+                                             unsigned int maxIndexSize, CAISS_BOOL normalize);
+    static CAISS_RET_TYPE createNsgSingleton(const std::string &modelPath);
+    static CAISS_RET_TYPE destroyNsgSingleton();
+    static NsgModel* getNsgSingleton();
+
+    static NsgModel*                         nsg_model_ptr_;
+    static RWLock                            nsg_model_lock_;
+};
+
+
+#endif //CAISS_NSGPROC_H
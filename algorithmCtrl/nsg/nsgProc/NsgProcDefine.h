@@ -0,0 +1,40 @@
+//
+// Created by Chunel on 2020/9/20.
+//
+
+#ifndef CAISS_NSGPROCDEFINE_H
+#define CAISS_NSGPROCDEFINE_H
+
+const static unsigned int NSG_KNN_DEFAULT = 64;              // kNN图中每个点的邻居数
+const static unsigned int NSG_BUILD_POOL_DEFAULT = 50;       // 构图时的候选集合大小（L）
+const static unsigned int NSG_MAX_DEGREE_DEFAULT = 32;       // 最大出度（R）
+const static unsigned int NSG_MAX_CANDIDATE_DEFAULT = 500;   // 裁边时最多考虑的候选点数（C）
+const static unsigned int NSG_SEARCH_POOL_DEFAULT = 100;     // 查询时候选集合大小（L_search）
+const static unsigned int NSG_CHECK_TIMES_MAX = 2000;        // 检查准确率时，最多的比较次数
+
+struct NsgTrainParams {
+    explicit NsgTrainParams(unsigned int step) {
+        this->knn = NSG_KNN_DEFAULT;
+        this->buildPool = NSG_BUILD_POOL_DEFAULT;
+        this->maxDegree = NSG_MAX_DEGREE_DEFAULT;
+        this->maxCandidate = NSG_MAX_CANDIDATE_DEFAULT;
+        this->searchPool = NSG_SEARCH_POOL_DEFAULT;
+        this->step = step;
+    }
+
+    void update(float span) {
+        // 传入的是精确度的差距。kNN图不需要重新构建，只调整构图和查询的参数
+        this->buildPool += (unsigned int)(10.0f + (float)this->buildPool * (1.0f + span * 10.0f) * (float)step / 10.0f);
+        this->maxDegree += (unsigned int)(8.0f + (float)this->maxDegree * (1.0f + span * 10.0f) * (float)step / 10.0f);
+        this->searchPool += (unsigned int)(20.0f + (float)this->searchPool * (1.0f + span * 5.0f) * (float)step / 5.0f);
+    }
+
+    unsigned int knn;               // kNN图中每个点的邻居数
+    unsigned int buildPool;         // 构图时的候选集合大小
+    unsigned int maxDegree;         // 最大出度
+    unsigned int maxCandidate;      // 裁边时最多考虑的候选点数
+    unsigned int searchPool;        // 查询时候选集合大小
+    unsigned int step;              // 数据更新快慢的决定因素
+};
+
+#endif //CAISS_NSGPROCDEFINE_H
@@ -0,0 +1,598 @@
+//
+// Created by Chunel on 2020/10/25.
+//
+
+#include <cstdio>
+#include <fstream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <unordered_map>
+
+#include "ShardIndex.h"
+
+using namespace std;
+using namespace hnswlib;
+
+using SHARD_RET_TYPE = std::priority_queue<std::pair<CAISS_FLOAT, labeltype>>;    // 单个分片的查询结果，<距离, 分片内label>
+
+template<typename T>
+static void writeShardPOD(std::ostream &out, const T &podRef) {
+    out.write((char *) &podRef, sizeof(T));
+}
+
+template<typename T>
+static void readShardPOD(std::istream &in, T &podRef) {
+    in.read((char *) &podRef, sizeof(T));
+}
+
+static void writeShardString(std::ostream &out, const std::string &str) {
+    auto len = (unsigned int)str.size();
+    writeShardPOD(out, len);
+    out.write(str.data(), len);
+}
+
+static void readShardString(std::istream &in, std::string &str) {
+    unsigned int len = 0;
+    readShardPOD(in, len);
+    str.resize(len);
+    in.read(&str[0], len);
+}
+
+static std::string getDirectory(const std::string &path) {
+    size_t pos = path.find_last_of("/\\");
+    return (std::string::npos == pos) ? std::string() : path.substr(0, pos + 1);
+}
+
+
+ShardIndex::ShardIndex() {
+    this->dim_ = 0;
+    this->distance_type_ = CAISS_DISTANCE_DEFAULT;
+    this->shard_num_ = 0;
+    this->max_size_ = 0;
+    this->max_index_size_ = 0;
+    this->normalize_ = CAISS_FALSE;
+    this->space_ = nullptr;
+    this->pool_ = nullptr;
+}
+
+
+ShardIndex::ShardIndex(const unsigned int dim, const CAISS_DISTANCE_TYPE distanceType, const unsigned int shardNum,
+                       const unsigned int maxSize, const unsigned int maxIndexSize, const CAISS_BOOL normalize) {
+    this->dim_ = dim;
+    this->distance_type_ = distanceType;
+    this->shard_num_ = std::max(shardNum, 1u);
+    this->max_size_ = (maxSize + this->shard_num_ - 1) / this->shard_num_;    // 数据轮流分配，每个分片的数量最多相差1
+    this->max_index_size_ = maxIndexSize;
+    this->normalize_ = normalize;
+    this->space_ = nullptr;
+    this->pool_ = nullptr;
+
+    createSpace();
+    this->shards_.assign(this->shard_num_, nullptr);
+    std::vector<RWLock>(this->shard_num_).swap(this->shard_locks_);
+    startPool();
+}
+
+
+ShardIndex::~ShardIndex() {
+    CAISS_DELETE_PTR(this->pool_)    // 先停止线程池，保证没有正在执行的查询
+    clearShards();
+    CAISS_DELETE_PTR(this->space_)
+}
+
+
+CAISS_RET_TYPE ShardIndex::build(const std::vector<CaissDataNode> &datas, const HnswTrainParams &params) {
+    CAISS_FUNCTION_BEGIN
+
+    if (nullptr == this->space_) {
+        return CAISS_RET_NO_SUPPORT;
+    }
+
+    // 重复的词语只保留最后一次出现的，跟hnsw覆盖插入的结果一致，同时保证一个词语只存在于一个分片中
+    std::unordered_map<std::string, unsigned int> lastPos;
+    for (unsigned int i = 0; i < datas.size(); i++) {
+        lastPos[datas[i].index] = i;
+    }
+
+    std::vector<std::vector<unsigned int>> shardDatas(this->shard_num_);
+    unsigned int cur = 0;
+    for (unsigned int i = 0; i < datas.size(); i++) {
+        if (lastPos[datas[i].index] == i) {
+            shardDatas[cur % this->shard_num_].push_back(i);
+            cur++;
+        }
+    }
+
+    clearShards();
+    this->shards_.assign(this->shard_num_, nullptr);
+    std::vector<CAISS_RET_TYPE> rets(this->shard_num_, CAISS_RET_OK);
+    auto worker = [&](unsigned int shardId) {
+        auto shard = new HierarchicalNSW<CAISS_FLOAT>(this->space_, this->max_size_, this->normalize_,
+                                                      this->max_index_size_, params.neighborNums, params.efSearch,
+                                                      params.efConstructor);
+        const auto &ids = shardDatas[shardId];
+        for (unsigned int i = 0; i < ids.size() && CAISS_RET_OK == rets[shardId]; i++) {
+            const CaissDataNode &data = datas[ids[i]];
+            rets[shardId] = shard->addPoint((void *)data.node.data(), i, data.index.c_str());    // 分片内的label，即为分片内的序号
+        }
+        this->shards_[shardId] = shard;
+    };
+
+    std::vector<std::thread> threads;
+    for (unsigned int i = 0; i < this->shard_num_; i++) {
+        threads.emplace_back(worker, i);    // 每个分片在单独的线程中构建
+    }
+    for (auto &t : threads) {
+        t.join();
+    }
+
+    for (unsigned int i = 0; i < this->shard_num_; i++) {
+        ret = rets[i];
+        CAISS_FUNCTION_CHECK_STATUS
+        CAISS_ECHO("shard [%d] build finished, size is [%d].", i, (int)shardDatas[i].size());
+    }
+
+    CAISS_FUNCTION_END
+}
+
+
+CAISS_RET_TYPE ShardIndex::addPoint(const CAISS_FLOAT *node, const std::string &word, const bool overwrite) {
+    CAISS_FUNCTION_BEGIN
+    CAISS_ASSERT_NOT_NULL(node)
+
+    if (word.length() > this->max_index_size_) {
+        return CAISS_RET_WORD_SIZE;
+    }
+
+    int id = findWordId(word);
+    if (ALGO_NO_WORD_ID != id) {
+        if (!overwrite) {
+            return CAISS_RET_OK;
+        }
+
+        unsigned int shardId = (unsigned int)id % this->shard_num_;
+        this->shard_locks_[shardId].writeLock();
+        ret = this->shards_[shardId]->overwriteNode((void *)node, word.c_str());
+        this->shard_locks_[shardId].writeUnlock();
+        CAISS_FUNCTION_CHECK_STATUS
+        return CAISS_RET_OK;
+    }
+
+    // 新的词语，插入到当前数据量最小的分片中。分片可能正在被重新加载，读取个数的时候需要加读锁
+    unsigned int shardId = 0;
+    size_t minCount = 0;
+    for (unsigned int i = 0; i < this->shard_num_; i++) {
+        this->shard_locks_[i].readLock();
+        size_t count = this->shards_[i]->cur_element_count_;
+        this->shard_locks_[i].readUnlock();
+        if (0 == i || count < minCount) {
+            shardId = i;
+            minCount = count;
+        }
+    }
+
+    this->shard_locks_[shardId].writeLock();
+    auto shard = this->shards_[shardId];
+    if (shard->cur_element_count_ >= shard->max_elements_) {
+        ret = CAISS_RET_MODEL_SIZE;    // 最小的分片都满了
+    } else {
+        ret = shard->addPoint((void *)node, shard->cur_element_count_, word.c_str());
+    }
+    this->shard_locks_[shardId].writeUnlock();
+    CAISS_FUNCTION_CHECK_STATUS
+
+    CAISS_FUNCTION_END
+}
+
+
+CAISS_RET_TYPE ShardIndex::search(const CAISS_FLOAT *query, const unsigned int topK, ALGO_RET_TYPE &result) const {
+    CAISS_FUNCTION_BEGIN
+    CAISS_ASSERT_NOT_NULL(query)
+
+    std::vector<SHARD_RET_TYPE> shardResults(this->shard_num_);
+    ret = scatter([&](unsigned int shardId) -> CAISS_RET_TYPE {
+        this->shard_locks_[shardId].readLock();
+        auto shard = this->shards_[shardId];
+        if (nullptr != shard && shard->cur_element_count_ > 0) {
+            shardResults[shardId] = shard->searchKnn(query, topK);
+        }
+        this->shard_locks_[shardId].readUnlock();
+        return CAISS_RET_OK;
+    });
+    CAISS_FUNCTION_CHECK_STATUS
+
+    gather(shardResults, topK, result);
+    CAISS_FUNCTION_END
+}
+
+
+CAISS_RET_TYPE ShardIndex::forceLoop(const CAISS_FLOAT *query, const unsigned int topK, ALGO_RET_TYPE &result) const {
+    CAISS_FUNCTION_BEGIN
+    CAISS_ASSERT_NOT_NULL(query)
+
+    std::vector<SHARD_RET_TYPE> shardResults(this->shard_num_);
+    ret = scatter([&](unsigned int shardId) -> CAISS_RET_TYPE {
+        this->shard_locks_[shardId].readLock();
+        auto shard = this->shards_[shardId];
+        if (nullptr != shard && shard->cur_element_count_ > 0) {
+            shardResults[shardId] = shard->forceLoop(query, topK, 1);    // 已经按照分片并行了，分片内部不再开线程
+        }
+        this->shard_locks_[shardId].readUnlock();
+        return CAISS_RET_OK;
+    });
+    CAISS_FUNCTION_CHECK_STATUS
+
+    gather(shardResults, topK, result);
+    CAISS_FUNCTION_END
+}
+
+
+CAISS_RET_TYPE ShardIndex::save(const std::string &path, const std::list<std::string> &ignoreList) const {
+    CAISS_FUNCTION_BEGIN
+
+    for (auto shard : this->shards_) {
+        if (nullptr == shard) {
+            return CAISS_RET_ERR;    // 还没有构建
+        }
+    }
+
+    // 忽略信息只写在清单文件中，分片文件中的忽略列表为空
+    for (unsigned int i = 0; i < this->shard_num_; i++) {
+        std::string shardPath = buildShardPath(path, i);
+        remove(shardPath.c_str());
+        this->shard_locks_[i].readLock();
+        this->shards_[i]->saveIndex(shardPath, std::list<std::string>());
+        this->shard_locks_[i].readUnlock();
+    }
+
+    std::ofstream output(path, std::ios::binary);
+    if (!output) {
+        return CAISS_RET_PATH;
+    }
+
+    writeShardPOD(output, SHARD_MODEL_MAGIC);
+    writeShardPOD(output, SHARD_MODEL_VERSION);
+    writeShardPOD(output, this->dim_);
+    writeShardPOD(output, (int)this->distance_type_);
+    writeShardPOD(output, (int)this->normalize_);
+    writeShardPOD(output, this->max_size_);
+    writeShardPOD(output, this->max_index_size_);
+    writeShardPOD(output, this->shard_num_);
+    for (unsigned int i = 0; i < this->shard_num_; i++) {
+        std::string shardPath = buildShardPath(path, i);
+        writeShardString(output, shardPath.substr(getDirectory(shardPath).length()));    // 只记录文件名，整个目录可以一起移动
+    }
+
+    auto ignoreSize = (unsigned int)ignoreList.size();
+    writeShardPOD(output, ignoreSize);
+    for (const auto &word : ignoreList) {
+        writeShardString(output, word);
+    }
+
+    if (!output) {
+        return CAISS_RET_ERR;
+    }
+    output.close();
+
+    CAISS_FUNCTION_END
+}
+
+
+CAISS_RET_TYPE ShardIndex::load(const std::string &path, TrieProc *trie) {
+    CAISS_FUNCTION_BEGIN
+
+    std::ifstream input(path, std::ios::binary);
+    if (!input) {
+        return CAISS_RET_PATH;
+    }
+
+    int magic = 0, version = 0, distanceType = 0, normalize = 0;
+    readShardPOD(input, magic);
+    readShardPOD(input, version);
+    if (SHARD_MODEL_MAGIC != magic || SHARD_MODEL_VERSION < version) {
+        return CAISS_RET_PATH;    // 不是分片算法生成的模型
+    }
+
+    readShardPOD(input, this->dim_);
+    readShardPOD(input, distanceType);
+    readShardPOD(input, normalize);
+    readShardPOD(input, this->max_size_);
+    readShardPOD(input, this->max_index_size_);
+    readShardPOD(input, this->shard_num_);
+    this->distance_type_ = (CAISS_DISTANCE_TYPE)distanceType;
+    this->normalize_ = (CAISS_BOOL)normalize;
+    if (!input || 0 == this->shard_num_) {
+        return CAISS_RET_ERR;
+    }
+
+    std::string directory = getDirectory(path);
+    this->shard_paths_.resize(this->shard_num_);
+    for (unsigned int i = 0; i < this->shard_num_; i++) {
+        std::string name;
+        readShardString(input, name);
+        this->shard_paths_[i] = directory + name;
+    }
+
+    std::list<std::string> ignoreList;
+    unsigned int ignoreSize = 0;
+    readShardPOD(input, ignoreSize);
+    for (unsigned int i = 0; i < ignoreSize; i++) {
+        std::string word;
+        readShardString(input, word);
+        ignoreList.push_back(word);
+    }
+
+    if (!input) {
+        return CAISS_RET_ERR;    // 清单文件不完整
+    }
+    input.close();
+
+    ret = createSpace();
+    CAISS_FUNCTION_CHECK_STATUS
+
+    clearShards();
+    this->shards_.assign(this->shard_num_, nullptr);
+    std::vector<RWLock>(this->shard_num_).swap(this->shard_locks_);
+    std::vector<CAISS_RET_TYPE> rets(this->shard_num_, CAISS_RET_OK);
+    std::vector<std::thread> threads;
+    for (unsigned int i = 0; i < this->shard_num_; i++) {
+        threads.emplace_back([this, i, &rets] {
+            rets[i] = loadShard(this->shard_paths_[i], this->shards_[i]);    // 各分片并行加载
+        });
+    }
+    for (auto &t : threads) {
+        t.join();
+    }
+
+    for (auto cur : rets) {
+        ret = cur;
+        CAISS_FUNCTION_CHECK_STATUS
+    }
+
+    if (nullptr != trie) {
+        for (const auto &word : ignoreList) {
+            trie->insert(word);
+        }
+    }
+
+    startPool();
+    CAISS_FUNCTION_END
+}
+
+
+CAISS_RET_TYPE ShardIndex::reloadShard(const unsigned int shardId) {
+    CAISS_FUNCTION_BEGIN
+
+    if (shardId >= this->shard_num_) {
+        return CAISS_RET_PARAM;
+    }
+
+    if (shardId >= this->shard_paths_.size()) {
+        return CAISS_RET_MODE;    // 只有加载的模型，才有对应的分片文件
+    }
+
+    // 先在锁外完成加载，替换的时候才加写锁，不影响其他分片（以及本分片加载期间）的查询
+    HierarchicalNSW<CAISS_FLOAT> *shard = nullptr;
+    ret = loadShard(this->shard_paths_[shardId], shard);
+    CAISS_FUNCTION_CHECK_STATUS
+
+    if (shard->max_elements_ > this->max_size_) {
+        this->max_size_ = (unsigned int)shard->max_elements_;
+    }
+
+    this->shard_locks_[shardId].writeLock();
+    std::swap(this->shards_[shardId], shard);
+    this->shard_locks_[shardId].writeUnlock();
+    CAISS_DELETE_PTR(shard)
+
+    CAISS_FUNCTION_END
+}
+
+
+int ShardIndex::findWordId(const std::string &word) const {
+    for (unsigned int i = 0; i < this->shard_num_; i++) {
+        this->shard_locks_[i].readLock();    // 重新加载分片的时候，旧的分片会被释放
+        int label = this->shards_[i]->findWordLabel(word.c_str());
+        this->shard_locks_[i].readUnlock();
+        if (-1 != label) {
+            return (int)toGlobalId(i, (labeltype)label);
+        }
+    }
+
+    return ALGO_NO_WORD_ID;
+}
+
+
+CAISS_RET_TYPE ShardIndex::getWord(const unsigned int id, std::string &word) const {
+    CAISS_FUNCTION_BEGIN
+
+    unsigned int shardId = id % this->shard_num_;
+    this->shard_locks_[shardId].readLock();
+    bool found = this->shards_[shardId]->getWordByLabel(id / this->shard_num_, word);
+    this->shard_locks_[shardId].readUnlock();
+    if (!found) {
+        return CAISS_RET_PARAM;
+    }
+
+    CAISS_FUNCTION_END
+}
+
+
+CAISS_RET_TYPE ShardIndex::getData(const unsigned int id, std::vector<CAISS_FLOAT> &vec) const {
+    CAISS_FUNCTION_BEGIN
+
+    unsigned int shardId = id % this->shard_num_;
+    labeltype label = id / this->shard_num_;
+    this->shard_locks_[shardId].readLock();    // 插入和重新加载的时候加写锁，读锁内的点信息不会变化
+    auto shard = this->shards_[shardId];
+    bool found = (shard->label_lookup_.end() != shard->label_lookup_.find(label));
+    if (found) {
+        shard->getDataByLabel(label, vec);
+    }
+    this->shard_locks_[shardId].readUnlock();
+    if (!found) {
+        return CAISS_RET_PARAM;
+    }
+
+    CAISS_FUNCTION_END
+}
+
+
+unsigned int ShardIndex::getDim() const {
+    return this->dim_;
+}
+
+
+unsigned int ShardIndex::getShardNum() const {
+    return this->shard_num_;
+}
+
+
+unsigned int ShardIndex::getSize() const {
+    size_t size = 0;
+    for (unsigned int i = 0; i < this->shards_.size(); i++) {
+        this->shard_locks_[i].readLock();
+        auto shard = this->shards_[i];
+        size += (nullptr != shard) ? shard->cur_element_count_.load() : 0;
+        this->shard_locks_[i].readUnlock();
+    }
+    return (unsigned int)size;
+}
+
+
+CAISS_BOOL ShardIndex::getNormalize() const {
+    return this->normalize_;
+}
+
+
+CAISS_DISTANCE_TYPE ShardIndex::getDistanceType() const {
+    return this->distance_type_;
+}
+
+
+CAISS_RET_TYPE ShardIndex::scatter(const std::function<CAISS_RET_TYPE(unsigned int)> &func) const {
+    CAISS_FUNCTION_BEGIN
+    if (this->shard_num_ > 1) {
+        CAISS_ASSERT_NOT_NULL(this->pool_)
+    }
+
+    std::vector<CAISS_RET_TYPE> rets(this->shard_num_, CAISS_RET_OK);
+    std::mutex mtx;
+    std::condition_variable cond;
+    unsigned int remain = this->shard_num_ - 1;
+    for (unsigned int i = 1; i < this->shard_num_; i++) {
+        this->pool_->appendTask(ThreadTaskInfo([&, i]() -> int {
+            rets[i] = func(i);
+            std::lock_guard<std::mutex> lock(mtx);
+            remain--;
+            cond.notify_one();    // 持有锁的时候通知，保证等待方返回之前，条件变量一直有效
+            return 0;
+        }, nullptr, false, nullptr, nullptr));
+    }
+
+    rets[0] = func(0);    // 当前线程处理第0个分片
+    {
+        std::unique_lock<std::mutex> lock(mtx);
+        cond.wait(lock, [&remain] { return 0 == remain; });
+    }
+
+    for (auto cur : rets) {
+        ret = cur;
+        CAISS_FUNCTION_CHECK_STATUS
+    }
+
+    CAISS_FUNCTION_END
+}
+
+
+void ShardIndex::gather(std::vector<SHARD_RET_TYPE> &shardResults, const unsigned int topK,
+                        ALGO_RET_TYPE &result) const {
+    for (unsigned int i = 0; i < shardResults.size(); i++) {
+        auto &cur = shardResults[i];
+        while (!cur.empty()) {
+            auto item = cur.top();
+            cur.pop();
+            if (result.size() < topK || item.first < result.top().first) {
+                result.emplace(item.first, toGlobalId(i, item.second));
+                if (result.size() > topK) {
+                    result.pop();
+                }
+            }
+        }
+    }
+}
+
+
+CAISS_RET_TYPE ShardIndex::createSpace() {
+    CAISS_FUNCTION_BEGIN
+
+    CAISS_DELETE_PTR(this->space_)
+    switch (this->distance_type_) {
+        case CAISS_DISTANCE_EUC:
+            this->space_ = new L2Space(this->dim_);
+            break;
+        case CAISS_DISTANCE_INNER:
+            this->space_ = new InnerProductSpace(this->dim_);
+            break;
+        default:
+            ret = CAISS_RET_NO_SUPPORT;    // 分片之间需要按照同一种距离合并结果
+            break;
+    }
+    CAISS_FUNCTION_CHECK_STATUS
+
+    CAISS_FUNCTION_END
+}
+
+
+CAISS_RET_TYPE ShardIndex::loadShard(const std::string &path, HierarchicalNSW<CAISS_FLOAT> *&shard) const {
+    CAISS_FUNCTION_BEGIN
+    CAISS_ASSERT_NOT_NULL(this->space_)
+
+    std::ifstream input(path, std::ios::binary);
+    if (!input) {
+        return CAISS_RET_PATH;    // hnsw读取模型时不检查文件是否存在，这里先确认
+    }
+    input.close();
+
+    TrieProc trie;    // 单独训练的分片文件中可能带有忽略信息，以清单文件中的为准，这里不使用
+    auto ptr = new HierarchicalNSW<CAISS_FLOAT>(this->space_, path, &trie);
+    if (ptr->label_offset_ - ptr->offsetData_ != this->dim_ * sizeof(CAISS_FLOAT)
+        || ptr->normalize_ != this->normalize_) {
+        CAISS_DELETE_PTR(ptr)
+        return CAISS_RET_DIM;    // 分片之间的维度和存储格式必须一致
+    }
+
+    shard = ptr;
+    CAISS_FUNCTION_END
+}
+
+
+void ShardIndex::clearShards() {
+    for (auto &shard : this->shards_) {
+        CAISS_DELETE_PTR(shard)
+    }
+    this->shards_.clear();
+}
+
+
+void ShardIndex::startPool() {
+    CAISS_DELETE_PTR(this->pool_)
+    if (this->shard_num_ > 1) {
+        this->pool_ = new ThreadPool(this->shard_num_ - 1);    // 当前线程也会参与查询
+        this->pool_->start();
+    }
+}
+
+
+std::string ShardIndex::buildShardPath(const std::string &path, const unsigned int shardId) const {
+    std::string suffix;
+    std::string base = path;
+    size_t pos = path.find_last_of('.');
+    if (std::string::npos != pos && pos > getDirectory(path).length()) {
+        suffix = path.substr(pos);
+        base = path.substr(0, pos);
+    }
+
+    return base + SHARD_FILE_TAG + std::to_string(shardId) + suffix;
+}
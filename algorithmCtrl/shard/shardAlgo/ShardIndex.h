@@ -0,0 +1,127 @@
+//
+// Created by Chunel on 2020/10/25.
+// 分片的hnsw模型信息。数据按照顺序轮流分配到各个分片中，每个分片是一个独立的hnsw模型，
+// 构建的时候每个分片一个线程；查询的时候通过线程池并行查询各个分片，再合并成全局的topK结果
+//
+
+#ifndef CAISS_SHARDINDEX_H
+#define CAISS_SHARDINDEX_H
+
+#include <list>
+#include <string>
+#include <vector>
+#include <functional>
+
+#include "../../common/CommonAlgoDefine.h"
+#include "../../hnsw/hnswAlgo/hnswlib.h"
+#include "../../hnsw/hnswProc/HnswProcDefine.h"
+#include "../../../utilsCtrl/UtilsInclude.h"
+#include "../../../threadCtrl/ThreadInclude.h"
+
+const static int SHARD_MODEL_MAGIC = 0x44524853;    // 清单文件头部的标识（"SHRD"）
+const static int SHARD_MODEL_VERSION = 1;
+const static std::string SHARD_FILE_TAG = "_shard";    // 分片文件名：清单文件名（去掉后缀）+ SHARD_FILE_TAG + 分片号 + 后缀
+
+class ShardIndex {
+
+public:
+    explicit ShardIndex();
+    ShardIndex(unsigned int dim, CAISS_DISTANCE_TYPE distanceType, unsigned int shardNum, unsigned int maxSize,
+               unsigned int maxIndexSize, CAISS_BOOL normalize);
+    ~ShardIndex();
+
+    /**
+     * 构建所有分片。已有的分片信息会被清空，每个分片在单独的线程中构建
+     * @param datas 已经归一化的数据。词语重复时，以最后一次出现的为准
+     * @param params
+     * @return
+     */
+    CAISS_RET_TYPE build(const std::vector<CaissDataNode> &datas, const HnswTrainParams &params);
+
+    /**
+     * 插入向量信息。词语已经存在时，在其所在的分片中覆盖（或丢弃）；否则插入到当前最小的分片中
+     * @param node 已经归一化的向量
+     * @param word
+     * @param overwrite
+     * @return
+     */
+    CAISS_RET_TYPE addPoint(const CAISS_FLOAT *node, const std::string &word, bool overwrite);
+
+    /**
+     * 并行查询所有分片，并合并结果。结果中的id为全局id
+     * @param query
+     * @param topK
+     * @param result
+     * @return
+     */
+    CAISS_RET_TYPE search(const CAISS_FLOAT *query, unsigned int topK, ALGO_RET_TYPE &result) const;
+    CAISS_RET_TYPE forceLoop(const CAISS_FLOAT *query, unsigned int topK, ALGO_RET_TYPE &result) const;
+
+    /**
+     * 保存清单文件和所有分片文件。分片文件跟清单文件放在同一目录下，可以作为hnsw模型单独加载
+     * @param path 清单文件路径
+     * @param ignoreList
+     * @return
+     */
+    CAISS_RET_TYPE save(const std::string &path, const std::list<std::string> &ignoreList) const;
+    CAISS_RET_TYPE load(const std::string &path, TrieProc *trie);
+
+    /**
+     * 从磁盘上重新加载某一个分片（如：单独重新训练了该分片），其余分片不受影响，可以继续查询
+     * @param shardId
+     * @return
+     */
+    CAISS_RET_TYPE reloadShard(unsigned int shardId);
+
+    int findWordId(const std::string &word) const;
+    CAISS_RET_TYPE getWord(unsigned int id, std::string &word) const;
+    CAISS_RET_TYPE getData(unsigned int id, std::vector<CAISS_FLOAT> &vec) const;
+
+    unsigned int getDim() const;
+    unsigned int getShardNum() const;
+    unsigned int getSize() const;
+    CAISS_BOOL getNormalize() const;
+    CAISS_DISTANCE_TYPE getDistanceType() const;
+
+protected:
+    /**
+     * 将func(shardId)分发到各个分片上执行，当前线程也参与计算，全部完成之后返回
+     * @param func
+     * @return 第一个不成功的返回值
+     */
+    CAISS_RET_TYPE scatter(const std::function<CAISS_RET_TYPE(unsigned int)> &func) const;
+
+    /**
+     * 将各个分片的结果（局部label），合并成全局的topK结果
+     */
+    void gather(std::vector<std::priority_queue<std::pair<CAISS_FLOAT, hnswlib::labeltype>>> &shardResults,
+                unsigned int topK, ALGO_RET_TYPE &result) const;
+
+    CAISS_RET_TYPE createSpace();
+    CAISS_RET_TYPE loadShard(const std::string &path, hnswlib::HierarchicalNSW<CAISS_FLOAT> *&shard) const;
+    void clearShards();
+    void startPool();
+
+    std::string buildShardPath(const std::string &path, unsigned int shardId) const;
+
+    inline unsigned int toGlobalId(unsigned int shardId, hnswlib::labeltype label) const {
+        return (unsigned int)label * this->shard_num_ + shardId;    // 全局id按照分片号交错排列，各分片可以独立增长
+    }
+
+private:
+    unsigned int dim_;
+    CAISS_DISTANCE_TYPE distance_type_;
+    unsigned int shard_num_;
+    unsigned int max_size_;          // 每个分片的最大数据量
+    unsigned int max_index_size_;    // 词语的最大长度
+    CAISS_BOOL normalize_;
+    std::vector<std::string> shard_paths_;    // 加载模型时各分片文件的路径，重新加载分片时使用
+
+    hnswlib::SpaceInterface<CAISS_FLOAT> *space_;    // 所有分片共用的距离空间
+    std::vector<hnswlib::HierarchicalNSW<CAISS_FLOAT> *> shards_;
+    mutable std::vector<RWLock> shard_locks_;    // 查询时加读锁，插入和重新加载时加写锁
+    ThreadPool *pool_;    // 分片查询使用的线程池，跟manage层的线程池分开，避免互相等待
+};
+
+
+#endif //CAISS_SHARDINDEX_H
@@ -0,0 +1,333 @@
+//
+// Created by Chunel on 2020/10/25.
+// 跟hnsw一样，模型信息是所有句柄共用的，锁在manage这一层保存
+//
+
+#include <cmath>
+#include "ShardProc.h"
+
+using namespace std;
+
+ShardIndex* ShardProc::shard_index_ptr_ = nullptr;
+RWLock ShardProc::shard_index_lock_;
+
+
+ShardProc::ShardProc() {
+    this->shard_num_ = SHARD_NUM_DEFAULT;
+}
+
+
+ShardProc::~ShardProc() {
+    this->reset();
+}
+
+
+CAISS_RET_TYPE ShardProc::init(const CAISS_MODE mode, const CAISS_DISTANCE_TYPE distanceType, const unsigned int dim,
+                               const char *modelPath, const CAISS_DIST_FUNC distFunc) {
+    CAISS_FUNCTION_BEGIN
+    CAISS_ASSERT_NOT_NULL(modelPath)
+
+    if (CAISS_DISTANCE_EUC != distanceType && CAISS_DISTANCE_INNER != distanceType) {
+        return CAISS_RET_NO_SUPPORT;    // 各分片的结果需要按照距离合并，暂不支持自定义距离
+    }
+
+    reset();
+
+    this->dim_ = dim;
+    this->cur_mode_ = mode;
+    this->model_path_ = buildModelPath(modelPath);
+    this->distance_type_ = distanceType;
+
+    if (CAISS_MODE_PROCESS == this->cur_mode_) {
+        ret = loadModel();
+        CAISS_FUNCTION_CHECK_STATUS
+    }
+
+    CAISS_FUNCTION_END
+}
+
+
+CAISS_RET_TYPE ShardProc::reset() {
+    CAISS_FUNCTION_BEGIN
+
+    this->dim_ = 0;
+    this->cur_mode_ = CAISS_MODE_DEFAULT;
+    this->normalize_ = CAISS_FALSE;
+    this->result_.clear();
+
+    CAISS_FUNCTION_END
+}
+
+
+CAISS_RET_TYPE ShardProc::train(const char *dataPath, const unsigned int maxDataSize, const CAISS_BOOL normalize,
+                                const unsigned int maxIndexSize, const float precision, const unsigned int fastRank,
+                                const unsigned int realRank, const unsigned int step, const unsigned int maxEpoch,
+                                const unsigned int showSpan) {
+    CAISS_FUNCTION_BEGIN
+    CAISS_ASSERT_NOT_NULL(dataPath)
+    CAISS_CHECK_MODE_ENABLE(CAISS_MODE_TRAIN)
+
+    this->normalize_ = normalize;
+    std::vector<CaissDataNode> datas;
+    CAISS_ECHO("start load datas from [%s].", dataPath);
+    ret = loadDatas(dataPath, datas);
+    CAISS_FUNCTION_CHECK_STATUS
+
+    destroyShardSingleton();
+    ret = createShardSingleton(this->dim_, this->distance_type_, this->shard_num_, maxDataSize, maxIndexSize, normalize);
+    CAISS_FUNCTION_CHECK_STATUS
+
+    auto ptr = ShardProc::getShardSingleton();
+    CAISS_ASSERT_NOT_NULL(ptr)
+
+    HnswTrainParams params(step);
+    unsigned int epoch = 0;
+    while (epoch < maxEpoch) {
+        CAISS_ECHO("start to train caiss model for [%d] in [%d] epochs, shard num is [%d].",
+                   ++epoch, maxEpoch, ptr->getShardNum());
+        ret = ptr->build(datas, params);    // 每一轮都重新构建所有分片
+        CAISS_FUNCTION_CHECK_STATUS
+        CAISS_ECHO("model build finished, check model precision automatic, please wait for a moment...");
+
+        float calcPrecision = 0.0f;
+        ret = checkModelPrecisionEnable(precision, fastRank, realRank, datas, calcPrecision);
+        if (CAISS_RET_OK == ret) {
+            CAISS_ECHO("train success, precision is [%0.4f] , model is saved to path [%s].", calcPrecision,
+                       this->model_path_.c_str());
+            break;
+        } else if (CAISS_RET_WARNING == ret) {
+            float span = precision - calcPrecision;
+            CAISS_ECHO("warning, the model's precision is not suitable, span = [%f], train again automatic.", span);
+            params.update(span);
+        }
+    }
+
+    // 无论准确率是否达标，都保存最后一次训练的结果，跟hnsw的处理方式一致
+    remove(this->model_path_.c_str());
+    CAISS_RET_TYPE saveRet = ptr->save(this->model_path_, std::list<std::string>());
+    if (CAISS_RET_OK != saveRet) {
+        return saveRet;
+    }
+
+    CAISS_FUNCTION_CHECK_STATUS    // 如果是precision达不到要求，则返回警告信息
+    CAISS_FUNCTION_END
+}
+
+
+CAISS_RET_TYPE ShardProc::insert(CAISS_FLOAT *node, const char *index, const CAISS_INSERT_TYPE insertType) {
+    CAISS_FUNCTION_BEGIN
+    CAISS_ASSERT_NOT_NULL(node)
+    CAISS_ASSERT_NOT_NULL(index)
+    CAISS_CHECK_MODE_ENABLE(CAISS_MODE_PROCESS)
+    auto ptr = ShardProc::getShardSingleton();
+    CAISS_ASSERT_NOT_NULL(ptr)
+
+    if (CAISS_INSERT_OVERWRITE != insertType && CAISS_INSERT_DISCARD != insertType) {
+        return CAISS_RET_PARAM;
+    }
+
+    std::vector<CAISS_FLOAT> vec(node, node + this->dim_);
+    ret = normalizeNode(vec, this->dim_);
+    CAISS_FUNCTION_CHECK_STATUS
+
+    ret = ptr->addPoint(vec.data(), std::string(index), CAISS_INSERT_OVERWRITE == insertType);
+    CAISS_FUNCTION_CHECK_STATUS
+
+    AlgorithmProc::invalidateResultCache();    // 如果插入成功，则之前缓存的结果失效
+    CAISS_FUNCTION_END
+}
+
+
+CAISS_RET_TYPE ShardProc::save(const char *modelPath) {
+    CAISS_FUNCTION_BEGIN
+    auto ptr = ShardProc::getShardSingleton();
+    CAISS_ASSERT_NOT_NULL(ptr)
+
+    std::string path = (nullptr == modelPath) ? this->model_path_ : buildModelPath(modelPath);
+    remove(path.c_str());
+    ret = ptr->save(path, AlgorithmProc::getIgnoreTrie()->getAllWords());
+    CAISS_FUNCTION_CHECK_STATUS
+
+    CAISS_FUNCTION_END
+}
+
+
+CAISS_RET_TYPE ShardProc::setParam(CAISS_PARAM_TYPE paramType, const void *value) {
+    CAISS_FUNCTION_BEGIN
+    CAISS_ASSERT_NOT_NULL(value)
+
+    unsigned int num = *(const unsigned int *)value;
+    switch (paramType) {
+        case CAISS_PARAM_SHARD_NUM:
+            if (num > SHARD_NUM_MAX) {
+                return CAISS_RET_PARAM;
+            }
+            this->shard_num_ = (0 == num) ? SHARD_NUM_DEFAULT : num;
+            break;
+        case CAISS_PARAM_SHARD_RELOAD: {
+            CAISS_CHECK_MODE_ENABLE(CAISS_MODE_PROCESS)
+            auto ptr = ShardProc::getShardSingleton();
+            CAISS_ASSERT_NOT_NULL(ptr)
+            ret = ptr->reloadShard(num);
+            AlgorithmProc::invalidateResultCache();    // 分片内容有变化，之前缓存的结果失效
+            break;
+        }
+        default:
+            ret = CAISS_RET_NO_SUPPORT;
+            break;
+    }
+
+    CAISS_FUNCTION_CHECK_STATUS
+    CAISS_FUNCTION_END
+}
+
+
+/************************ 以下是本Proc类内部函数 ************************/
+CAISS_RET_TYPE ShardProc::loadModel() {
+    CAISS_FUNCTION_BEGIN
+
+    ret = createShardSingleton(this->model_path_);
+    CAISS_FUNCTION_CHECK_STATUS
+    auto ptr = ShardProc::getShardSingleton();
+    CAISS_ASSERT_NOT_NULL(ptr)
+
+    if (ptr->getDim() != this->dim_) {
+        return CAISS_RET_DIM;
+    }
+
+    if (ptr->getDistanceType() != this->distance_type_) {
+        return CAISS_RET_PARAM;    // 各分片是按照训练时的距离类型构建的
+    }
+    this->normalize_ = ptr->getNormalize();
+
+    CAISS_FUNCTION_END
+}
+
+
+CAISS_RET_TYPE ShardProc::checkModelPrecisionEnable(const float targetPrecision, const unsigned int fastRank,
+                                                    const unsigned int realRank, const std::vector<CaissDataNode> &datas,
+                                                    float &calcPrecision) {
+    CAISS_FUNCTION_BEGIN
+    auto ptr = ShardProc::getShardSingleton();
+    CAISS_ASSERT_NOT_NULL(ptr)
+
+    unsigned int suitableTimes = 0;
+    unsigned int calcTimes = min((unsigned int)datas.size(), SHARD_CHECK_TIMES_MAX);
+    for (unsigned int i = 0; i < calcTimes; i++) {
+        ALGO_RET_TYPE fastResult, realResult;
+        ret = ptr->search(datas[i].node.data(), fastRank, fastResult);
+        CAISS_FUNCTION_CHECK_STATUS
+        ret = ptr->forceLoop(datas[i].node.data(), realRank, realResult);
+        CAISS_FUNCTION_CHECK_STATUS
+        if (fastResult.empty() || realResult.empty()) {
+            continue;
+        }
+
+        if (std::abs(fastResult.top().first - realResult.top().first) < 0.000002f) {    // 这里近似小于
+            suitableTimes++;
+        }
+    }
+
+    calcPrecision = (0 == calcTimes) ? 0.0f : (float)suitableTimes / (float)calcTimes;
+    ret = (calcPrecision >= targetPrecision) ? CAISS_RET_OK : CAISS_RET_WARNING;
+    CAISS_FUNCTION_CHECK_STATUS
+
+    CAISS_FUNCTION_END
+}
+
+
+CAISS_RET_TYPE ShardProc::searchVector(const CAISS_FLOAT *query, const unsigned int topK,
+                                       const CAISS_SEARCH_TYPE searchType, ALGO_RET_TYPE &result) {
+    CAISS_FUNCTION_BEGIN
+    CAISS_ASSERT_NOT_NULL(query)
+    auto ptr = ShardProc::getShardSingleton();
+    CAISS_ASSERT_NOT_NULL(ptr)
+
+    ret = isAnnSearchType(searchType) ? ptr->search(query, topK, result) : ptr->forceLoop(query, topK, result);
+    CAISS_FUNCTION_CHECK_STATUS
+
+    CAISS_FUNCTION_END
+}
+
+
+int ShardProc::findWordId(const std::string &word) {
+    auto ptr = ShardProc::getShardSingleton();
+    return (nullptr != ptr) ? ptr->findWordId(word) : ALGO_NO_WORD_ID;
+}
+
+
+CAISS_RET_TYPE ShardProc::getWordById(const unsigned int id, std::string &word) {
+    CAISS_FUNCTION_BEGIN
+    auto ptr = ShardProc::getShardSingleton();
+    CAISS_ASSERT_NOT_NULL(ptr)
+
+    ret = ptr->getWord(id, word);
+    CAISS_FUNCTION_CHECK_STATUS
+    CAISS_FUNCTION_END
+}
+
+
+CAISS_RET_TYPE ShardProc::getVectorById(const unsigned int id, std::vector<CAISS_FLOAT> &vec) {
+    CAISS_FUNCTION_BEGIN
+    auto ptr = ShardProc::getShardSingleton();
+    CAISS_ASSERT_NOT_NULL(ptr)
+
+    ret = ptr->getData(id, vec);
+    CAISS_FUNCTION_CHECK_STATUS
+    CAISS_FUNCTION_END
+}
+
+
+CAISS_RET_TYPE ShardProc::createShardSingleton(const unsigned int dim, const CAISS_DISTANCE_TYPE distanceType,
+                                               const unsigned int shardNum, const unsigned int maxDataSize,
+                                               const unsigned int maxIndexSize, const CAISS_BOOL normalize) {
+    CAISS_FUNCTION_BEGIN
+
+    if (nullptr == ShardProc::shard_index_ptr_) {
+        ShardProc::shard_index_lock_.writeLock();
+        if (nullptr == ShardProc::shard_index_ptr_) {
+            ShardProc::shard_index_ptr_ = new ShardIndex(dim, distanceType, shardNum, maxDataSize, maxIndexSize, normalize);
+        }
+        ShardProc::shard_index_lock_.writeUnlock();
+    }
+
+    CAISS_FUNCTION_END
+}
+
+
+CAISS_RET_TYPE ShardProc::createShardSingleton(const std::string &modelPath) {
+    CAISS_FUNCTION_BEGIN
+
+    if (nullptr == ShardProc::shard_index_ptr_) {
+        ShardProc::shard_index_lock_.writeLock();
+        if (nullptr == ShardProc::shard_index_ptr_) {
+            auto ptr = new ShardIndex();
+            ret = ptr->load(modelPath, AlgorithmProc::getIgnoreTrie());
+            if (CAISS_RET_OK == ret) {
+                ShardProc::shard_index_ptr_ = ptr;
+            } else {
+                CAISS_DELETE_PTR(ptr)
+            }
+        }
+        ShardProc::shard_index_lock_.writeUnlock();
+    }
+
+    CAISS_FUNCTION_CHECK_STATUS
+    CAISS_FUNCTION_END
+}
+
+
+CAISS_RET_TYPE ShardProc::destroyShardSingleton() {
+    CAISS_FUNCTION_BEGIN
+
+    ShardProc::shard_index_lock_.writeLock();
+    CAISS_DELETE_PTR(ShardProc::shard_index_ptr_)
+    ShardProc::shard_index_lock_.writeUnlock();
+
+    CAISS_FUNCTION_END
+}
+
+
+ShardIndex* ShardProc::getShardSingleton() {
+    return ShardProc::shard_index_ptr_;
+}
@@ -0,0 +1,61 @@
+//
+// Created by Chunel on 2020/10/25.
+// 分片hnsw算法的封装层。多个hnsw分片并行构建和查询，适合单个hnsw模型构建过慢，或者数据量超过单个模型上限的场景
+//
+
+#ifndef CAISS_SHARDPROC_H
+#define CAISS_SHARDPROC_H
+
+#include "../../common/CommonAlgoProc.h"
+#include "../shardAlgo/ShardIndex.h"
+#include "ShardProcDefine.h"
+
+class ShardProc : public CommonAlgoProc {
+
+public:
+    explicit ShardProc();
+    ~ShardProc() override;
+
+    CAISS_RET_TYPE init(CAISS_MODE mode, CAISS_DISTANCE_TYPE distanceType,
+                        unsigned int dim, const char *modelPath, CAISS_DIST_FUNC distFunc) override;
+
+    // train_mode
+    CAISS_RET_TYPE train(const char *dataPath, unsigned int maxDataSize, CAISS_BOOL normalize,
+                         unsigned int maxIndexSize, float precision, unsigned int fastRank,
+                         unsigned int realRank, unsigned int step, unsigned int maxEpoch,
+                         unsigned int showSpan) override;
+
+    // process_mode
+    CAISS_RET_TYPE insert(CAISS_FLOAT *node, const char *index, CAISS_INSERT_TYPE insertType) override;
+    CAISS_RET_TYPE save(const char *modelPath) override;
+
+    CAISS_RET_TYPE setParam(CAISS_PARAM_TYPE paramType, const void *value) override;
+
+protected:
+    CAISS_RET_TYPE reset();
+    CAISS_RET_TYPE loadModel();
+    CAISS_RET_TYPE checkModelPrecisionEnable(float targetPrecision, unsigned int fastRank, unsigned int realRank,
+                                             const std::vector<CaissDataNode> &datas, float &calcPrecision);
+
+    CAISS_RET_TYPE searchVector(const CAISS_FLOAT *query, unsigned int topK, CAISS_SEARCH_TYPE searchType,
+                                ALGO_RET_TYPE &result) override;
+    int findWordId(const std::string &word) override;
+    CAISS_RET_TYPE getWordById(unsigned int id, std::string &word) override;
+    CAISS_RET_TYPE getVectorById(unsigned int id, std::vector<CAISS_FLOAT> &vec) override;
+
+private:
+    static CAISS_RET_TYPE createShardSingleton(unsigned int dim, CAISS_DISTANCE_TYPE distanceType, unsigned int shardNum,
+                                               unsigned int maxDataSize, unsigned int maxIndexSize, CAISS_BOOL normalize);
+    static CAISS_RET_TYPE createShardSingleton(const std::string &modelPath);
+    static CAISS_RET_TYPE destroyShardSingleton();
+    static ShardIndex* getShardSingleton();
+
+    static ShardIndex*                       shard_index_ptr_;
+    static RWLock                            shard_index_lock_;
+
+private:
+    unsigned int                             shard_num_;    // 训练时的分片个数（通过setParam设定，init时不清空）
+};
+
+
+#endif //CAISS_SHARDPROC_H
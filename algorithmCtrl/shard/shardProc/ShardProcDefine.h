@@ -0,0 +1,12 @@
+//
+// Created by Chunel on 2020/10/25.
+//
+
+#ifndef CAISS_SHARDPROCDEFINE_H
+#define CAISS_SHARDPROCDEFINE_H
+
+const static unsigned int SHARD_NUM_DEFAULT = 4;            // 默认的分片个数
+const static unsigned int SHARD_NUM_MAX = 64;               // 最多的分片个数
+const static unsigned int SHARD_CHECK_TIMES_MAX = 2000;     // 检查准确率时，最多的比较次数
+
+#endif //CAISS_SHARDPROCDEFINE_H
@@ -0,0 +1,223 @@
+//
+// Created by Chunel on 2020/11/8.
+// 检查hnsw查询稳定之后不再申请内存：替换全局的operator new，统计预热之后查询过程中的申请次数，不为0则返回失败
+//
+
+#include <new>
+#include <random>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+
+#include "../../caissLib/CaissLib.h"
+#include "../../utilsCtrl/UtilsInclude.h"
+
+const static unsigned int ALLOC_CHECK_NUM = 2000;    // 训练样本个数
+const static unsigned int ALLOC_CHECK_DIM = 32;
+const static unsigned int ALLOC_CHECK_TIMES = 200;    // 预热和统计时，各自的查询次数
+const static unsigned int ALLOC_CHECK_TOP_K = 10;
+const static char *ALLOC_CHECK_MODEL_PATH = "caiss_alloc_check.caiss";
+const static char *ALLOC_CHECK_CUSTOM_MODEL_PATH = "caiss_alloc_check_custom.caiss";
+
+static thread_local bool g_counting = false;    // 只统计当前线程，后台线程的申请不计入
+static thread_local unsigned long long g_alloc_count = 0;
+
+void *operator new(size_t size) {
+    if (g_counting) {
+        g_alloc_count++;
+    }
+    void *ptr = malloc(0 == size ? 1 : size);
+    if (nullptr == ptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void *operator new[](size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void *ptr) noexcept {
+    free(ptr);
+}
+
+void operator delete[](void *ptr) noexcept {
+    free(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept {
+    free(ptr);
+}
+
+void operator delete[](void *ptr, size_t) noexcept {
+    free(ptr);
+}
+
+
+static CAISS_FLOAT STDCALL customDist(CAISS_VOID *vec1, CAISS_VOID *vec2, const CAISS_VOID *params) {
+    size_t dim = *(const size_t *)params;
+    CAISS_FLOAT dist = 0.0f;
+    for (size_t i = 0; i < dim; i++) {
+        CAISS_FLOAT diff = ((const CAISS_FLOAT *)vec1)[i] - ((const CAISS_FLOAT *)vec2)[i];
+        dist += diff * diff;
+    }
+    return dist;
+}
+
+static CAISS_VOID STDCALL customBatchDist(const CAISS_VOID *vec, const CAISS_VOID **candidates, CAISS_UINT num,
+                                          CAISS_FLOAT *distances, const CAISS_VOID *params) {
+    for (CAISS_UINT i = 0; i < num; i++) {
+        distances[i] = customDist((CAISS_VOID *)vec, (CAISS_VOID *)candidates[i], params);
+    }
+}
+
+
+/**
+ * 预热之后，统计ALLOC_CHECK_TIMES次查询中的申请次数
+ * @param handle
+ * @param infos 依次查询的信息
+ * @param searchType
+ * @param name 打印时使用的名称
+ * @return 有申请的时候，返回CAISS_RET_ERR
+ */
+static int checkSearch(void *handle, const std::vector<void *> &infos, CAISS_SEARCH_TYPE searchType, const char *name) {
+    CAISS_FUNCTION_BEGIN
+
+    for (unsigned int i = 0; i < ALLOC_CHECK_TIMES; i++) {
+        ret = CAISS_Search(handle, infos[i % infos.size()], searchType, ALLOC_CHECK_TOP_K, 0);
+        CAISS_FUNCTION_CHECK_STATUS
+    }
+
+    g_alloc_count = 0;
+    g_counting = true;
+    for (unsigned int i = 0; i < ALLOC_CHECK_TIMES && CAISS_RET_OK == ret; i++) {
+        ret = CAISS_Search(handle, infos[i % infos.size()], searchType, ALLOC_CHECK_TOP_K, 0);
+    }
+    g_counting = false;
+    CAISS_FUNCTION_CHECK_STATUS
+
+    printf("[caiss] %s : [%llu] allocations in [%d] warm searches.\n", name, g_alloc_count, ALLOC_CHECK_TIMES);
+    if (0 != g_alloc_count) {
+        return CAISS_RET_ERR;
+    }
+
+    CAISS_FUNCTION_END
+}
+
+
+static int trainModel(const char *path, const std::vector<CAISS_FLOAT> &datas, const std::vector<const char *> &labels,
+                      CAISS_DISTANCE_TYPE distanceType, CAISS_DIST_FUNC distFunc) {
+    CAISS_FUNCTION_BEGIN
+
+    void *handle = nullptr;
+    ret = CAISS_CreateHandle(&handle);
+    CAISS_FUNCTION_CHECK_STATUS
+
+    ret = CAISS_Init(handle, CAISS_MODE_TRAIN, distanceType, ALLOC_CHECK_DIM, path, distFunc);
+    CAISS_FUNCTION_CHECK_STATUS
+
+    ret = CAISS_TrainFromBuffer(handle, datas.data(), (const char **)labels.data(), ALLOC_CHECK_NUM, ALLOC_CHECK_DIM,
+                                ALLOC_CHECK_NUM, CAISS_FALSE, 16, 0.9f, 5, 5, 1, 1, ALLOC_CHECK_NUM);
+    if (CAISS_RET_WARNING == ret) {
+        ret = CAISS_RET_OK;    // 准确率不满足要求，不影响检查
+    }
+    CAISS_FUNCTION_CHECK_STATUS
+
+    ret = CAISS_DestroyHandle(handle);
+    CAISS_FUNCTION_CHECK_STATUS
+
+    CAISS_FUNCTION_END
+}
+
+
+static int checkAllocation() {
+    CAISS_FUNCTION_BEGIN
+
+    ret = CAISS_Environment(1, CAISS_ALGO_HNSW, CAISS_MANAGE_SYNC);
+    CAISS_FUNCTION_CHECK_STATUS
+
+    std::mt19937 engine(ALLOC_CHECK_NUM);
+    std::normal_distribution<CAISS_FLOAT> dist(0.0f, 1.0f);
+    std::vector<CAISS_FLOAT> datas(ALLOC_CHECK_NUM * ALLOC_CHECK_DIM);
+    for (CAISS_FLOAT &value : datas) {
+        value = dist(engine);
+    }
+    std::vector<std::string> words(ALLOC_CHECK_NUM);
+    std::vector<const char *> labels(ALLOC_CHECK_NUM);
+    std::vector<void *> queries, wordInfos;
+    for (unsigned int i = 0; i < ALLOC_CHECK_NUM; i++) {
+        words[i] = "word_" + std::to_string(i);
+        labels[i] = words[i].c_str();
+        if (i < ALLOC_CHECK_TIMES) {
+            queries.push_back(&datas[i * ALLOC_CHECK_DIM]);
+            wordInfos.push_back((void *)labels[i]);
+        }
+    }
+
+    ret = trainModel(ALLOC_CHECK_MODEL_PATH, datas, labels, CAISS_DISTANCE_EUC, nullptr);
+    CAISS_FUNCTION_CHECK_STATUS
+
+    void *handle = nullptr;
+    ret = CAISS_CreateHandle(&handle);
+    CAISS_FUNCTION_CHECK_STATUS
+    ret = CAISS_Init(handle, CAISS_MODE_PROCESS, CAISS_DISTANCE_EUC, ALLOC_CHECK_DIM, ALLOC_CHECK_MODEL_PATH);
+    CAISS_FUNCTION_CHECK_STATUS
+
+    unsigned int value = 0;
+    ret = CAISS_SetParam(handle, CAISS_PARAM_RESULT_CACHE_SIZE, &value);    // 先不使用缓存，每次都真实查询
+    CAISS_FUNCTION_CHECK_STATUS
+    ret = checkSearch(handle, queries, CAISS_SEARCH_QUERY, "query search");
+    CAISS_FUNCTION_CHECK_STATUS
+    ret = checkSearch(handle, wordInfos, CAISS_SEARCH_WORD, "word search");
+    CAISS_FUNCTION_CHECK_STATUS
+
+    value = 1;
+    ret = CAISS_SetParam(handle, CAISS_PARAM_BINARY_SEARCH, &value);
+    CAISS_FUNCTION_CHECK_STATUS
+    ret = checkSearch(handle, queries, CAISS_SEARCH_QUERY, "binary query search");
+    CAISS_FUNCTION_CHECK_STATUS
+    value = 0;
+    ret = CAISS_SetParam(handle, CAISS_PARAM_BINARY_SEARCH, &value);
+    CAISS_FUNCTION_CHECK_STATUS
+
+    value = 16;
+    ret = CAISS_SetParam(handle, CAISS_PARAM_RESULT_CACHE_SIZE, &value);
+    CAISS_FUNCTION_CHECK_STATUS
+    ret = checkSearch(handle, wordInfos, CAISS_SEARCH_WORD, "cached word search");
+    CAISS_FUNCTION_CHECK_STATUS
+
+    value = 0;
+    ret = CAISS_SetParam(handle, CAISS_PARAM_RESULT_CACHE_SIZE, &value);
+    CAISS_FUNCTION_CHECK_STATUS
+    ret = CAISS_DestroyHandle(handle);
+    CAISS_FUNCTION_CHECK_STATUS
+
+    // 自定义距离，并且设定了批量计算函数的情况
+    ret = trainModel(ALLOC_CHECK_CUSTOM_MODEL_PATH, datas, labels, CAISS_DISTANCE_EDITION, customDist);
+    CAISS_FUNCTION_CHECK_STATUS
+
+    ret = CAISS_CreateHandle(&handle);
+    CAISS_FUNCTION_CHECK_STATUS
+    CAISS_BATCH_DIST_FUNC batchFunc = customBatchDist;
+    ret = CAISS_SetParam(handle, CAISS_PARAM_BATCH_DIST_FUNC, &batchFunc);
+    CAISS_FUNCTION_CHECK_STATUS
+    ret = CAISS_Init(handle, CAISS_MODE_PROCESS, CAISS_DISTANCE_EDITION, ALLOC_CHECK_DIM,
+                     ALLOC_CHECK_CUSTOM_MODEL_PATH, customDist);
+    CAISS_FUNCTION_CHECK_STATUS
+    ret = checkSearch(handle, queries, CAISS_SEARCH_QUERY, "batch distance query search");
+    CAISS_FUNCTION_CHECK_STATUS
+    ret = CAISS_DestroyHandle(handle);
+    CAISS_FUNCTION_CHECK_STATUS
+
+    CAISS_FUNCTION_END
+}
+
+
+int main() {
+    int ret = checkAllocation();
+    remove(ALLOC_CHECK_MODEL_PATH);
+    remove(ALLOC_CHECK_CUSTOM_MODEL_PATH);
+    printf("[caiss] allocation check %s, ret is [%d].\n", (CAISS_RET_OK == ret) ? "passed" : "failed", ret);
+    return (CAISS_RET_OK == ret) ? 0 : 1;
+}
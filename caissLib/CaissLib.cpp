@@ -60,6 +60,14 @@ CAISS_LIB_API CAISS_RET_TYPE STDCALL CAISS_Init(void* handle,
 }
 
 
+CAISS_LIB_API CAISS_RET_TYPE STDCALL CAISS_SetParam(void *handle,
+                                                    const CAISS_PARAM_TYPE paramType,
+                                                    const void *value) {
+    CAISS_ASSERT_ENVIRONMENT_INIT
+    return g_manage->setParam(handle, paramType, value);
+}
+
+
 CAISS_LIB_API CAISS_RET_TYPE STDCALL CAISS_Train(void *handle,
                                                  const char *dataPath,
                                                  const unsigned int maxDataSize,
@@ -75,6 +83,25 @@ CAISS_LIB_API CAISS_RET_TYPE STDCALL CAISS_Train(void *handle,
     return g_manage->train(handle, dataPath, maxDataSize, normalize, maxIndexSize, precision, fastRank, realRank, step, maxEpoch, showSpan);
 }
 
+CAISS_LIB_API CAISS_RET_TYPE STDCALL CAISS_TrainFromBuffer(void *handle,
+                                                           const CAISS_FLOAT *datas,
+                                                           const char **labels,
+                                                           const unsigned int num,
+                                                           const unsigned int dim,
+                                                           const unsigned int maxDataSize,
+                                                           const CAISS_BOOL normalize,
+                                                           const unsigned int maxIndexSize,
+                                                           const float precision,
+                                                           const unsigned int fastRank,
+                                                           const unsigned int realRank,
+                                                           const unsigned int step,
+                                                           const unsigned int maxEpoch,
+                                                           const unsigned int showSpan) {
+    CAISS_ASSERT_ENVIRONMENT_INIT
+    return g_manage->trainFromBuffer(handle, datas, labels, num, dim, maxDataSize, normalize, maxIndexSize, precision,
+                                     fastRank, realRank, step, maxEpoch, showSpan);
+}
+
 CAISS_LIB_API CAISS_RET_TYPE STDCALL CAISS_Search(void *handle,
                                                   void *info,
                                                   const CAISS_SEARCH_TYPE searchType,
@@ -87,6 +114,48 @@ CAISS_LIB_API CAISS_RET_TYPE STDCALL CAISS_Search(void *handle,
 }
 
 
+CAISS_LIB_API CAISS_RET_TYPE STDCALL CAISS_SearchEx(void *handle,
+                                                    void *info,
+                                                    const CAISS_SEARCH_TYPE searchType,
+                                                    const unsigned int topK,
+                                                    CAISS_RESULT_ITEM *results,
+                                                    unsigned int &size,
+                                                    const unsigned int filterEditDistance,
+                                                    const CAISS_SEARCH_EX_CALLBACK searchCBFunc,
+                                                    const void *cbParams) {
+    CAISS_ASSERT_ENVIRONMENT_INIT
+    return g_manage->searchEx(handle, info, searchType, topK, results, size, filterEditDistance, searchCBFunc, cbParams);
+}
+
+
+CAISS_LIB_API CAISS_RET_TYPE STDCALL CAISS_CreateSearchContext(void **context) {
+    CAISS_ASSERT_ENVIRONMENT_INIT
+    return g_manage->createSearchContext(context);
+}
+
+
+CAISS_LIB_API CAISS_RET_TYPE STDCALL CAISS_SearchWithContext(void *handle,
+                                                             void *context,
+                                                             void *info,
+                                                             const CAISS_SEARCH_TYPE searchType,
+                                                             const unsigned int topK,
+                                                             CAISS_RESULT_ITEM *results,
+                                                             unsigned int &size,
+                                                             const unsigned int filterEditDistance,
+                                                             const CAISS_SEARCH_EX_CALLBACK searchCBFunc,
+                                                             const void *cbParams) {
+    CAISS_ASSERT_ENVIRONMENT_INIT
+    return g_manage->searchWithContext(handle, context, info, searchType, topK, results, size, filterEditDistance,
+                                       searchCBFunc, cbParams);
+}
+
+
+CAISS_LIB_API CAISS_RET_TYPE STDCALL CAISS_DestroySearchContext(void *context) {
+    CAISS_ASSERT_ENVIRONMENT_INIT
+    return g_manage->destroySearchContext(context);
+}
+
+
 CAISS_LIB_API CAISS_RET_TYPE STDCALL CAISS_GetResultSize(void *handle,
                                                          unsigned int &size) {
     CAISS_ASSERT_ENVIRONMENT_INIT
@@ -111,6 +180,16 @@ CAISS_LIB_API CAISS_RET_TYPE STDCALL CAISS_Insert(void *handle,
 }
 
 
+CAISS_LIB_API CAISS_RET_TYPE STDCALL CAISS_InsertBatch(void *handle,
+                                                       CAISS_FLOAT *nodes,
+                                                       const char **labels,
+                                                       const unsigned int num,
+                                                       CAISS_INSERT_TYPE insertType) {
+    CAISS_ASSERT_ENVIRONMENT_INIT
+    return g_manage->insertBatch(handle, nodes, labels, num, insertType);
+}
+
+
 CAISS_LIB_API CAISS_RET_TYPE STDCALL CAISS_Ignore(void *handle,
                                                   const char *label,
                                                   const bool isIgnore) {
@@ -69,6 +69,18 @@ extern "C" {
             const char *modelPath,
             CAISS_DIST_FUNC distFunc = nullptr);
 
+    /**
+     * 设定参数信息
+     * @param handle 句柄信息
+     * @param paramType 参数类型（详见CaissLibDefine.h文件）
+     * @param value 参数值（指向的数据类型，详见CaissLibDefine.h文件中对应参数类型的说明）
+     * @return 运行成功返回0，警告返回1，其他异常值，参考错误码定义
+     * @notice 设定的参数，在句柄销毁之前持续生效。CAISS_Init()不会清空已经设定的参数
+     */
+    CAISS_LIB_API CAISS_RET_TYPE STDCALL CAISS_SetParam(void *handle,
+            CAISS_PARAM_TYPE paramType,
+            const void *value);
+
     /**
      * 模型训练功能 （当快速查询fastRank个数，均在真实realRank个数的范围内的准确率，超过precision的时候，训练完成）
      * @param handle 句柄信息
@@ -97,6 +109,41 @@ extern "C" {
             unsigned int maxEpoch = 5,
             unsigned int showSpan = 1000);
 
+    /**
+     * 使用内存中的向量训练模型，不需要先将向量写成训练文件
+     * @param handle 句柄信息
+     * @param datas 训练样本的向量信息，num个向量连续存放
+     * @param labels 训练样本的标签信息，跟datas一一对应
+     * @param num 样本个数
+     * @param dim 向量维度（需要跟CAISS_Init时设定的维度一致）
+     * @param maxDataSize 最大样本个数（小于num的时候，按照num处理）
+     * @param normalize 样本数据是否归一化
+     * @param maxIndexSize 样本标签最大长度
+     * @param precision 目标精确度
+     * @param fastRank 快速查询排名个数
+     * @param realRank 真实查询排名个数
+     * @param step 迭代步径
+     * @param maxEpoch 最大迭代轮数 （maxEpoch轮后，准确率仍不满足要求，则停止训练，返回警告信息）
+     * @param showSpan 信息打印行数
+     * @return 运行成功返回0，警告返回1，其他异常值，参考错误码定义
+     * @notice 仅支持同步模式（CAISS_MANAGE_SYNC），训练完成之后再返回，之后不再使用datas和labels的内存
+     *         其余流程跟CAISS_Train一致
+     */
+    CAISS_LIB_API CAISS_RET_TYPE STDCALL CAISS_TrainFromBuffer(void *handle,
+            const CAISS_FLOAT *datas,
+            const char **labels,
+            unsigned int num,
+            unsigned int dim,
+            unsigned int maxDataSize,
+            CAISS_BOOL normalize,
+            unsigned int maxIndexSize = 64,
+            float precision = 0.95,
+            unsigned int fastRank = 5,
+            unsigned int realRank = 5,
+            unsigned int step = 1,
+            unsigned int maxEpoch = 5,
+            unsigned int showSpan = 1000);
+
     /**
      * 查询功能
      * @param handle 句柄信息
@@ -120,6 +167,76 @@ extern "C" {
             CAISS_SEARCH_CALLBACK searchCBFunc = nullptr,
             const void *cbParams = nullptr);
 
+    /**
+     * 查询功能（结构化结果）。不拼接json信息，结果直接写入results中
+     * @param handle 句柄信息
+     * @param info 待查询的信息
+     * @param searchType 查询信息的类型（详见CaissLibDefine.h文件）
+     * @param topK 返回最近的topK个信息
+     * @param results 存放结果的数组，至少包含topK个元素，可以为空（仅通过回调函数获取结果）
+     * @param size 实际写入results中的结果个数
+     * @param filterEditDistance 需要过滤的最小词语编辑距离（同CAISS_Search）
+     * @param searchCBFunc 查询到结果后，执行回调函数，传入的是连续存放的结果信息
+     * @param cbParams 回调函数中，传入的参数信息
+     * @return 运行成功返回0，警告返回1，词查询模式下，没有找到单词返回2，其他异常值，参考错误码定义
+     * @notice 结果中的label指向库内部的内存，在当前句柄下一次查询、或者模型被修改（插入、保存等）之前有效，如需保留请自行拷贝。
+     *         异步模式下，结果只能通过回调函数获取（results需要传入nullptr）。
+     *         CAISS_SearchEx的结果，不会影响CAISS_GetResult获取到的信息
+     */
+    CAISS_LIB_API CAISS_RET_TYPE STDCALL CAISS_SearchEx(void *handle,
+            void *info,
+            CAISS_SEARCH_TYPE searchType,
+            unsigned int topK,
+            CAISS_RESULT_ITEM *results,
+            unsigned int &size,
+            unsigned int filterEditDistance = CAISS_DEFAULT_EDIT_DISTANCE,
+            CAISS_SEARCH_EX_CALLBACK searchCBFunc = nullptr,
+            const void *cbParams = nullptr);
+
+    /**
+     * 创建查询上下文
+     * @param context 查询上下文
+     * @return 运行成功返回0，警告返回1，其他异常值，参考错误码定义
+     * @notice 查询上下文用于保存一次查询的结果信息，不属于任何句柄。
+     *         每个线程使用各自的上下文时，可以通过同一个句柄并行查询
+     */
+    CAISS_LIB_API CAISS_RET_TYPE STDCALL CAISS_CreateSearchContext(void **context);
+
+    /**
+     * 使用查询上下文查询（结构化结果）。结果保存在context中，不影响句柄中的结果信息
+     * @param handle 句柄信息
+     * @param context 查询上下文（通过CAISS_CreateSearchContext创建）
+     * @param info 待查询的信息
+     * @param searchType 查询信息的类型（详见CaissLibDefine.h文件）
+     * @param topK 返回最近的topK个信息
+     * @param results 存放结果的数组，至少包含topK个元素，可以为空（仅通过回调函数获取结果）
+     * @param size 实际写入results中的结果个数
+     * @param filterEditDistance 需要过滤的最小词语编辑距离（同CAISS_Search）
+     * @param searchCBFunc 查询到结果后，执行回调函数，传入的是连续存放的结果信息
+     * @param cbParams 回调函数中，传入的参数信息
+     * @return 运行成功返回0，警告返回1，词查询模式下，没有找到单词返回2，其他异常值，参考错误码定义
+     * @notice 结果中的label指向context中的内存，在使用同一个context的下一次查询、或者context被销毁之前有效。
+     *         同一个context同一时刻只能被一个查询使用。
+     *         异步模式下，结果只能通过回调函数获取（results需要传入nullptr），context需要在回调执行之前保持有效
+     */
+    CAISS_LIB_API CAISS_RET_TYPE STDCALL CAISS_SearchWithContext(void *handle,
+            void *context,
+            void *info,
+            CAISS_SEARCH_TYPE searchType,
+            unsigned int topK,
+            CAISS_RESULT_ITEM *results,
+            unsigned int &size,
+            unsigned int filterEditDistance = CAISS_DEFAULT_EDIT_DISTANCE,
+            CAISS_SEARCH_EX_CALLBACK searchCBFunc = nullptr,
+            const void *cbParams = nullptr);
+
+    /**
+     * 销毁查询上下文
+     * @param context 查询上下文
+     * @return 运行成功返回0，警告返回1，其他异常值，参考错误码定义
+     */
+    CAISS_LIB_API CAISS_RET_TYPE STDCALL CAISS_DestroySearchContext(void *context);
+
     /**
      * 获取结果字符串长度
      * @param handle 句柄信息
@@ -148,12 +265,34 @@ extern "C" {
      * @param insertType 插入类型（详见CaissLibDefine.h文件）
      * @return 运行成功返回0，警告返回1，其他异常值，参考错误码定义
      * @notice 插入信息实时生效。程序结束后，是否保存新插入的信息，取决于是否调用CAISS_Save()方法
+     *         hnsw算法插入的时候不会阻塞查询（多次插入之间依次执行；覆盖已有词语的向量时，仅在写入向量的瞬间等待正在进行的查询结束），其他算法插入的时候，会阻塞所有查询
+     *         hnsw算法下，设定了CAISS_PARAM_HNSW_DELTA_SIZE（大于0）时，插入的信息先写入增量段（查询时跟图一起查询，立即生效），由后台线程合入图中，CAISS_Save()之前会全部合入
+     *         hnsw算法覆盖已有的词语时，会重新建立该词语在图中的连接，耗时比插入新的词语多
      */
     CAISS_LIB_API CAISS_RET_TYPE STDCALL CAISS_Insert(void *handle,
             CAISS_FLOAT *node,
             const char *label,
             CAISS_INSERT_TYPE insertType);
 
+    /**
+     * 批量插入信息
+     * @param handle 句柄信息
+     * @param nodes 待插入的向量信息，num个向量连续存放
+     * @param labels 待插入向量的标签信息，跟nodes一一对应
+     * @param num 插入的个数
+     * @param insertType 插入类型（详见CaissLibDefine.h文件）
+     * @return 运行成功返回0，警告返回1，其他异常值，参考错误码定义
+     * @notice 仅支持同步模式（CAISS_MANAGE_SYNC），整批只加一次锁。插入完成之后再返回
+     *         hnsw算法下，整批统一判断词语是否存在，新的词语由多个线程并行加入图中，覆盖的词语由多个线程并行重新建立连接；
+     *         标签过长或者超过模型最大尺寸的时候，整批都不插入
+     *         同一批中有重复标签的时候，覆盖模式以最后一个为准，忽略模式以第一个为准
+     */
+    CAISS_LIB_API CAISS_RET_TYPE STDCALL CAISS_InsertBatch(void *handle,
+            CAISS_FLOAT *nodes,
+            const char **labels,
+            unsigned int num,
+            CAISS_INSERT_TYPE insertType);
+
     /**
      * 忽略信息
      * @param handle 句柄信息
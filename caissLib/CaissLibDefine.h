@@ -41,9 +41,21 @@ using CAISS_LIST_STRING = std::list<std::string>;
 
 /* 自定义用于计算距离的函数 */
 typedef CAISS_FLOAT (STDCALL *CAISS_DIST_FUNC)(CAISS_VOID *vec1, CAISS_VOID *vec2, const CAISS_VOID *params);
+/* 自定义用于批量计算距离的函数，计算vec跟num个candidates之间的距离，结果依次写入distances中 */
+typedef CAISS_VOID (STDCALL *CAISS_BATCH_DIST_FUNC)(const CAISS_VOID *vec, const CAISS_VOID **candidates, CAISS_UINT num,
+                                                    CAISS_FLOAT *distances, const CAISS_VOID *params);
 /* 查询到结果后，触发的回调函数 */
 typedef CAISS_VOID (STDCALL *CAISS_SEARCH_CALLBACK)(CAISS_LIST_STRING &words, CAISS_LIST_FLOAT &distances, const CAISS_VOID *params);
 
+/* 结构化的查询结果（CAISS_SearchEx中使用） */
+struct CAISS_RESULT_ITEM {
+    CAISS_UINT index;          // 结果在模型中的id（同json结果中的index）
+    CAISS_FLOAT distance;      // 跟查询信息之间的距离
+    const char *label;         // 结果的词语信息。指向库内部的内存，在当前句柄下一次查询、或者模型被修改之前有效
+};
+/* 结构化查询到结果后，触发的回调函数。results中按照距离从近到远，连续存放size个结果 */
+typedef CAISS_VOID (STDCALL *CAISS_SEARCH_EX_CALLBACK)(const CAISS_RESULT_ITEM *results, CAISS_UINT size, const CAISS_VOID *params);
+
 /* 函数返回值定义 */
 #define CAISS_RET_NO_WORD       (2)     // 模型词库中无对应词语问题
 #define CAISS_RET_WARNING       (1)     // 流程告警
@@ -103,7 +115,55 @@ enum CAISS_DISTANCE_TYPE {
 enum CAISS_ALGO_TYPE {
     CAISS_ALGO_DEFAULT = 1,
     CAISS_ALGO_HNSW = 1,            // hnsw算法（准确度高，空间复杂度较大）
-    CAISS_ALGO_NSG = 2              // nsg算法（准确度较高，空间复杂度小）
+    CAISS_ALGO_NSG = 2,             // nsg算法（准确度较高，空间复杂度小）
+    CAISS_ALGO_FLAT = 3,            // flat算法（精确查询，构建速度快，适合数据量不大的情况）
+    CAISS_ALGO_IVF = 4,             // ivf算法（倒排聚类，内存占用接近原始向量，构建速度快，适合数据量很大的情况）
+    CAISS_ALGO_IVF_PQ = 5,          // ivf-pq算法（倒排聚类+乘积量化，内存中只保存编码，原始向量通过mmap读取，适合数据量超过内存的情况）
+    CAISS_ALGO_DISKANN = 6,         // diskann算法（磁盘图索引，内存中只保存pq编码，图和原始向量按需从磁盘读取，适合数据量远超内存的情况）
+    CAISS_ALGO_HNSW_SHARD = 7       // 分片hnsw算法（多个hnsw分片并行构建、并行查询，构建时间约为hnsw的1/分片数）
+};
+
+enum CAISS_PARAM_TYPE {
+    CAISS_PARAM_DEFAULT = 0,
+    CAISS_PARAM_STORAGE_TYPE = 1,    // 向量存储格式。value指向unsigned int，取值见CAISS_STORAGE_TYPE（需在CAISS_Train之前设定）
+    CAISS_PARAM_BATCH_DIST_FUNC = 2,    // 批量距离计算函数。value指向CAISS_BATCH_DIST_FUNC，仅在自定义距离下生效
+    CAISS_PARAM_PROJECTION_TYPE = 3,    // 向量投影方式。value指向unsigned int，取值见CAISS_PROJECTION_TYPE（需在CAISS_Train之前设定）
+    CAISS_PARAM_PROJECTION_DIM = 4,     // 投影后的维度。value指向unsigned int，为0表示跟原始维度一致（需在CAISS_Train之前设定）
+    CAISS_PARAM_BINARY_SEARCH = 5,      // 二值粗筛查询。value指向unsigned int，非0表示开启（处理模式下，对快速查询生效）
+    CAISS_PARAM_KNN_GRAPH_SEED = 6,     // 训练时用NN-Descent构建的kNN图补充hnsw第0层的邻居。value指向unsigned int，非0表示开启（仅支持欧氏和内积距离，需在CAISS_Train之前设定）
+    CAISS_PARAM_IVF_NLIST = 7,          // ivf的聚类中心个数。value指向unsigned int，为0表示根据数据量自动决定（需在CAISS_Train之前设定）
+    CAISS_PARAM_IVF_NPROBE = 8,         // ivf查询时遍历的聚类个数。value指向unsigned int（处理模式下设定，覆盖训练时得到的值）
+    CAISS_PARAM_PQ_M = 9,               // ivf-pq的段数（每个向量编码之后的字节数）。value指向unsigned int，需要能整除维度，为0表示自动决定（需在CAISS_Train之前设定）
+    CAISS_PARAM_PQ_RERANK = 10,         // ivf-pq重新排序的候选倍数。value指向unsigned int，为0表示不重新排序，直接返回pq距离（处理模式下设定，覆盖训练时得到的值）
+    CAISS_PARAM_DISK_SEARCH_POOL = 11,  // diskann查询时的候选集合大小。value指向unsigned int，为0表示使用训练时得到的值（处理模式下设定）
+    CAISS_PARAM_DISK_BEAM_WIDTH = 12,   // diskann查询时每一轮从磁盘读取的节点数。value指向unsigned int，为0表示使用训练时得到的值（处理模式下设定）
+    CAISS_PARAM_HNSW_HOT_MEMORY = 13,   // hnsw分层加载模型时，常驻内存的热点数据大小（MB）。value指向unsigned int，为0表示全部读入内存（处理模式下，需在CAISS_Init之前设定）
+    CAISS_PARAM_SHARD_NUM = 14,         // 分片hnsw的分片个数。value指向unsigned int，为0表示使用默认值（需在CAISS_Train之前设定）
+    CAISS_PARAM_SHARD_RELOAD = 15,      // 从磁盘上重新加载分片hnsw中的某个分片。value指向unsigned int，为分片号（处理模式下设定）
+    CAISS_PARAM_HNSW_NEIGHBOR_LIST = 16,    // hnsw模型中，为每个词语预先计算并保存的近邻个数（不包含词语自身）。value指向unsigned int，为0表示以模型中的设定为准（在CAISS_Train或CAISS_Save时生效）。插入或覆盖之后，只有可能受影响的词语的列表失效（查询时改为查询图结构），CAISS_Save时重新物化
+    CAISS_PARAM_RESULT_CACHE_SIZE = 17,     // 进程内所有句柄共用的查询结果缓存大小（MB）。value指向unsigned int，为0表示不缓存（任意时刻设定，对所有句柄生效）
+    CAISS_PARAM_QUERY_CACHE = 18,           // 是否缓存按照向量查询的结果。value指向unsigned int，取值见CAISS_QUERY_CACHE_TYPE，默认不缓存（仅对当前句柄生效）
+    CAISS_PARAM_QUERY_CACHE_TOLERANCE = 19, // 近似重复模式下，向量每一维的量化步长（单位：万分之一）。value指向unsigned int，为0表示使用默认值10（仅对当前句柄生效）
+    CAISS_PARAM_HNSW_DELTA_SIZE = 20,       // hnsw插入时使用的增量段容纳的点数。value指向unsigned int，为0表示直接插入图中，默认为0（所有句柄共用，以最后一次设定为准）
+};
+
+enum CAISS_STORAGE_TYPE {
+    CAISS_STORAGE_DEFAULT = 0,
+    CAISS_STORAGE_FLOAT = 0,        // float32存储
+    CAISS_STORAGE_FP16 = 1,         // fp16半精度存储（内存减半，精度略有损失）
+    CAISS_STORAGE_BF16 = 2,         // bf16半精度存储（内存减半，数值范围同float32）
+};
+
+enum CAISS_QUERY_CACHE_TYPE {
+    CAISS_QUERY_CACHE_NONE = 0,               // 不缓存按照向量查询的结果
+    CAISS_QUERY_CACHE_EXACT = 1,              // 归一化之后的向量完全一致时，才使用缓存的结果
+    CAISS_QUERY_CACHE_NEAR = 2,               // 归一化之后的向量，每一维按照步长量化之后一致时，使用缓存的结果（近似重复的查询）
+};
+
+enum CAISS_PROJECTION_TYPE {
+    CAISS_PROJECTION_NONE = 0,                // 不做投影
+    CAISS_PROJECTION_PCA = 1,                 // pca降维（训练时拟合）
+    CAISS_PROJECTION_RANDOM_ROTATION = 2,     // 随机正交旋转（可同时降维）
 };
 
 
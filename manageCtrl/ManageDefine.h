@@ -14,6 +14,7 @@ using FuncCreateHandle = std::function<CAISS_RET_TYPE(void **handle)>;
 using FuncDestroyHandle = std::function<CAISS_RET_TYPE(void *handle)>;
 using FuncInit = std::function<CAISS_RET_TYPE(void *handle, CAISS_MODE mode, CAISS_DISTANCE_TYPE distanceType,
                                               unsigned int dim, const char *modelPath, CAISS_DIST_FUNC distFunc)>;
+using FuncSetParam = std::function<CAISS_RET_TYPE(void *handle, CAISS_PARAM_TYPE paramType, const void *value)>;
 using FuncTrain = std::function<CAISS_RET_TYPE(void *handle, const char *dataPath, unsigned int maxDataSize, CAISS_BOOL normalize,
                                                unsigned int maxIndexSize, float precision, unsigned int fastRank,
                                                unsigned int realRank, unsigned int step, unsigned int maxEpoch,
@@ -80,6 +80,56 @@ CAISS_RET_TYPE ManageProc::init(void *handle, CAISS_MODE mode, CAISS_DISTANCE_TY
     this->lock_.writeUnlock();
     CAISS_FUNCTION_CHECK_STATUS
 
+    proc->invalidateResultCache();    // 模型可能被重新加载过了，这个模型之前缓存的结果失效
+
+    CAISS_FUNCTION_END
+}
+
+CAISS_RET_TYPE ManageProc::setParam(void *handle, CAISS_PARAM_TYPE paramType, const void *value) {
+    CAISS_FUNCTION_BEGIN
+    CAISS_ASSERT_NOT_NULL(value)
+
+    AlgorithmProc *proc = this->getInstance(handle);
+    CAISS_ASSERT_NOT_NULL(proc)
+
+    if (CAISS_PARAM_RESULT_CACHE_SIZE == paramType) {
+        return AlgorithmProc::setResultCacheSize(*(const unsigned int *)value);    // 进程内共用的参数，不需要经过具体算法
+    }
+
+    this->lock_.writeLock();
+    if (CAISS_PARAM_QUERY_CACHE == paramType || CAISS_PARAM_QUERY_CACHE_TOLERANCE == paramType) {
+        ret = proc->setQueryCacheParam(paramType, *(const unsigned int *)value);    // 所有算法共用的参数
+    } else {
+        ret = proc->setParam(paramType, value);
+    }
+    this->lock_.writeUnlock();
+    CAISS_FUNCTION_CHECK_STATUS
+
+    CAISS_FUNCTION_END
+}
+
+/**
+ * 创建查询上下文。上下文不属于任何句柄，由调用方持有
+ * @param context
+ * @return
+ */
+CAISS_RET_TYPE ManageProc::createSearchContext(void **context) {
+    CAISS_FUNCTION_BEGIN
+    CAISS_ASSERT_NOT_NULL(context)
+
+    *context = new AlgorithmSearchContext();
+
+    CAISS_FUNCTION_END
+}
+
+
+CAISS_RET_TYPE ManageProc::destroySearchContext(void *context) {
+    CAISS_FUNCTION_BEGIN
+    CAISS_ASSERT_NOT_NULL(context)
+
+    auto *ctx = (AlgorithmSearchContext *)context;
+    CAISS_DELETE_PTR(ctx)
+
     CAISS_FUNCTION_END
 }
 
@@ -129,7 +179,12 @@ AlgorithmProc* ManageProc::createAlgoProc() {
     AlgorithmProc *proc = nullptr;
     switch (this->algo_type_) {
         case CAISS_ALGO_HNSW: proc = new HnswProc(); break;
-        case CAISS_ALGO_NSG: break;
+        case CAISS_ALGO_NSG: proc = new NsgProc(); break;
+        case CAISS_ALGO_FLAT: proc = new FlatProc(); break;
+        case CAISS_ALGO_IVF: proc = new IvfProc(); break;
+        case CAISS_ALGO_IVF_PQ: proc = new IvfPqProc(); break;
+        case CAISS_ALGO_DISKANN: proc = new DiskAnnProc(); break;
+        case CAISS_ALGO_HNSW_SHARD: proc = new ShardProc(); break;
         default:
             break;
     }
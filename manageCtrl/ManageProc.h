@@ -23,6 +23,9 @@ public:
     virtual CAISS_RET_TYPE destroyHandle(void *handle);
     virtual CAISS_RET_TYPE init(void *handle, CAISS_MODE mode, CAISS_DISTANCE_TYPE distanceType, unsigned int dim, const char *modelPath,
                                 CAISS_DIST_FUNC distFunc);
+    virtual CAISS_RET_TYPE setParam(void *handle, CAISS_PARAM_TYPE paramType, const void *value);
+    CAISS_RET_TYPE createSearchContext(void **context);
+    CAISS_RET_TYPE destroySearchContext(void *context);
 
     /* 以下几个函数，同步和异步需要区分实现 */
     virtual CAISS_RET_TYPE train(void *handle, const char *dataPath, unsigned int maxDataSize, CAISS_BOOL normalize,
@@ -32,12 +35,33 @@ public:
         CAISS_FUNCTION_NO_SUPPORT
     }
 
+    virtual CAISS_RET_TYPE trainFromBuffer(void *handle, const CAISS_FLOAT *datas, const char **labels, unsigned int num,
+                                           unsigned int dim, unsigned int maxDataSize, CAISS_BOOL normalize,
+                                           unsigned int maxIndexSize, float precision, unsigned int fastRank,
+                                           unsigned int realRank, unsigned int step, unsigned int maxEpoch,
+                                           unsigned int showSpan) {
+        CAISS_FUNCTION_NO_SUPPORT
+    }
+
     virtual CAISS_RET_TYPE search(void *handle, void *info, CAISS_SEARCH_TYPE searchType,
                                   unsigned int topK, const unsigned int filterEditDistance,
                                   CAISS_SEARCH_CALLBACK searchCBFunc, const void *cbParams) {
         CAISS_FUNCTION_NO_SUPPORT
     }
 
+    virtual CAISS_RET_TYPE searchEx(void *handle, void *info, CAISS_SEARCH_TYPE searchType, unsigned int topK,
+                                    CAISS_RESULT_ITEM *results, unsigned int &size, unsigned int filterEditDistance,
+                                    CAISS_SEARCH_EX_CALLBACK searchCBFunc, const void *cbParams) {
+        CAISS_FUNCTION_NO_SUPPORT
+    }
+
+    virtual CAISS_RET_TYPE searchWithContext(void *handle, void *context, void *info, CAISS_SEARCH_TYPE searchType,
+                                             unsigned int topK, CAISS_RESULT_ITEM *results, unsigned int &size,
+                                             unsigned int filterEditDistance, CAISS_SEARCH_EX_CALLBACK searchCBFunc,
+                                             const void *cbParams) {
+        CAISS_FUNCTION_NO_SUPPORT
+    }
+
     virtual CAISS_RET_TYPE getResultSize(void *handle, unsigned int &size) {
         CAISS_FUNCTION_NO_SUPPORT
     }
@@ -55,6 +79,11 @@ public:
         CAISS_FUNCTION_NO_SUPPORT
     }
 
+    virtual CAISS_RET_TYPE insertBatch(void *handle, CAISS_FLOAT *nodes, const char **labels, unsigned int num,
+                                       CAISS_INSERT_TYPE insertType) {
+        CAISS_FUNCTION_NO_SUPPORT
+    }
+
     virtual CAISS_RET_TYPE ignore(void *handle, const char *label, bool isIgnore) {
         CAISS_FUNCTION_NO_SUPPORT
     }
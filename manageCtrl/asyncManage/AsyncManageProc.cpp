@@ -81,6 +81,96 @@ CAISS_RET_TYPE AsyncManageProc::search(void *handle,
 }
 
 
+/**
+ * 异步模式下，查询在线程池中执行，结果只能通过回调函数获取
+ */
+CAISS_RET_TYPE AsyncManageProc::searchEx(void *handle, void *info, CAISS_SEARCH_TYPE searchType, unsigned int topK,
+                                         CAISS_RESULT_ITEM *results, unsigned int &size, const unsigned int filterEditDistance,
+                                         const CAISS_SEARCH_EX_CALLBACK searchCBFunc, const void *cbParams) {
+    CAISS_FUNCTION_BEGIN
+
+    size = 0;
+    if (nullptr != results || nullptr == searchCBFunc) {
+        return CAISS_RET_PARAM;
+    }
+
+    AlgorithmProc *algo = getInstance(handle);
+    CAISS_ASSERT_NOT_NULL(algo)
+
+    auto threadPool = getThreadPoolSingleton();
+    CAISS_ASSERT_NOT_NULL(threadPool)
+
+    MemoryPool *memoryPool = getMemoryPoolSingleton();
+    CAISS_ASSERT_NOT_NULL(memoryPool)
+
+    FreeBlock *block = memoryPool->allocate();
+    CAISS_ASSERT_NOT_NULL(block)
+
+    void *ptr = nullptr;
+    if (searchType == CAISS_SEARCH_WORD || searchType == CAISS_LOOP_WORD) {
+        ptr = block->data;
+        CAISS_ASSERT_NOT_NULL(ptr)
+        memset(ptr, 0, BLOCK_SIZE);
+        memcpy(ptr, info, strlen((char *)info) + 1);
+    } else {
+        ptr = info;
+    }
+
+    ThreadTaskInfo task(std::bind(&AlgorithmProc::searchEx, algo, ptr, searchType, topK, filterEditDistance, searchCBFunc, cbParams),
+            this->getRWLock(algo), false, memoryPool, block);
+    threadPool->appendTask(task);
+
+    CAISS_FUNCTION_END
+}
+
+
+/**
+ * 异步模式下，结果只能通过回调函数获取。context需要在回调执行之前保持有效，
+ * 结果不写入句柄，所以同一个句柄的多个查询可以在线程池中并行执行
+ */
+CAISS_RET_TYPE AsyncManageProc::searchWithContext(void *handle, void *context, void *info, CAISS_SEARCH_TYPE searchType,
+                                                  unsigned int topK, CAISS_RESULT_ITEM *results, unsigned int &size,
+                                                  const unsigned int filterEditDistance,
+                                                  const CAISS_SEARCH_EX_CALLBACK searchCBFunc, const void *cbParams) {
+    CAISS_FUNCTION_BEGIN
+    CAISS_ASSERT_NOT_NULL(context)
+
+    size = 0;
+    if (nullptr != results || nullptr == searchCBFunc) {
+        return CAISS_RET_PARAM;
+    }
+
+    AlgorithmProc *algo = getInstance(handle);
+    CAISS_ASSERT_NOT_NULL(algo)
+
+    auto threadPool = getThreadPoolSingleton();
+    CAISS_ASSERT_NOT_NULL(threadPool)
+
+    MemoryPool *memoryPool = getMemoryPoolSingleton();
+    CAISS_ASSERT_NOT_NULL(memoryPool)
+
+    FreeBlock *block = memoryPool->allocate();
+    CAISS_ASSERT_NOT_NULL(block)
+
+    void *ptr = nullptr;
+    if (searchType == CAISS_SEARCH_WORD || searchType == CAISS_LOOP_WORD) {
+        ptr = block->data;
+        CAISS_ASSERT_NOT_NULL(ptr)
+        memset(ptr, 0, BLOCK_SIZE);
+        memcpy(ptr, info, strlen((char *)info) + 1);
+    } else {
+        ptr = info;
+    }
+
+    ThreadTaskInfo task(std::bind(&AlgorithmProc::searchWithContext, algo, ptr, searchType, topK, filterEditDistance,
+                                  (AlgorithmSearchContext *)context, searchCBFunc, cbParams),
+            this->getRWLock(algo), false, memoryPool, block, true);
+    threadPool->appendTask(task);
+
+    CAISS_FUNCTION_END
+}
+
+
 CAISS_RET_TYPE AsyncManageProc::save(void *handle, const char *modelPath) {
     CAISS_FUNCTION_BEGIN
 
@@ -126,8 +216,10 @@ CAISS_RET_TYPE AsyncManageProc::insert(void *handle, CAISS_FLOAT *node, const ch
     memcpy(ptr, label, strlen(label) + 1);
 
 
+    // 支持并行插入的算法，插入任务不需要独占线程池，也不会阻塞当前句柄的可重入查询
+    bool isConcurrent = algo->supportConcurrentInsert();
     ThreadTaskInfo task(std::bind(&AlgorithmProc::insert, algo, node, ptr, insertType),
-            this->getRWLock(algo), true, memoryPool, block);
+            this->getRWLock(algo), !isConcurrent, memoryPool, block, isConcurrent);
     threadPool->appendTask(task);
 
     CAISS_FUNCTION_END
@@ -48,6 +48,15 @@ public:
                           unsigned int topK, unsigned int filterEditDistance,
                           CAISS_SEARCH_CALLBACK searchCBFunc, const void *cbParams) override ;
 
+    CAISS_RET_TYPE searchEx(void *handle, void *info, CAISS_SEARCH_TYPE searchType, unsigned int topK,
+                            CAISS_RESULT_ITEM *results, unsigned int &size, unsigned int filterEditDistance,
+                            CAISS_SEARCH_EX_CALLBACK searchCBFunc, const void *cbParams) override ;
+
+    CAISS_RET_TYPE searchWithContext(void *handle, void *context, void *info, CAISS_SEARCH_TYPE searchType,
+                                     unsigned int topK, CAISS_RESULT_ITEM *results, unsigned int &size,
+                                     unsigned int filterEditDistance, CAISS_SEARCH_EX_CALLBACK searchCBFunc,
+                                     const void *cbParams) override ;
+
     CAISS_RET_TYPE save(void *handle, const char *modelPath) override ;
 
     // label 是数据标签，index表示数据第几个信息
@@ -50,6 +50,57 @@ CAISS_RET_TYPE SyncManageProc::search(void *handle, void *info, CAISS_SEARCH_TYP
 }
 
 
+CAISS_RET_TYPE SyncManageProc::searchEx(void *handle, void *info, CAISS_SEARCH_TYPE searchType, unsigned int topK,
+                                        CAISS_RESULT_ITEM *results, unsigned int &size, const unsigned int filterEditDistance,
+                                        const CAISS_SEARCH_EX_CALLBACK searchCBFunc, const void *cbParams) {
+    CAISS_FUNCTION_BEGIN
+
+    AlgorithmProc *proc = this->getInstance(handle);
+    CAISS_ASSERT_NOT_NULL(proc)
+
+    size = 0;
+    this->lock_.readLock();
+    ret = proc->searchEx(info, searchType, topK, filterEditDistance, searchCBFunc, cbParams);
+    if (CAISS_RET_OK == ret && nullptr != results) {
+        ret = proc->getResultItems(results, size);
+    }
+    this->lock_.readUnlock();
+
+    CAISS_FUNCTION_CHECK_STATUS
+
+    CAISS_FUNCTION_END
+}
+
+
+/**
+ * 使用查询上下文查询。结果只写入context中，跟searchEx一样只加读锁，同一个句柄可以被多个线程同时使用
+ */
+CAISS_RET_TYPE SyncManageProc::searchWithContext(void *handle, void *context, void *info, CAISS_SEARCH_TYPE searchType,
+                                                 unsigned int topK, CAISS_RESULT_ITEM *results, unsigned int &size,
+                                                 const unsigned int filterEditDistance,
+                                                 const CAISS_SEARCH_EX_CALLBACK searchCBFunc, const void *cbParams) {
+    CAISS_FUNCTION_BEGIN
+    CAISS_ASSERT_NOT_NULL(context)
+
+    AlgorithmProc *proc = this->getInstance(handle);
+    CAISS_ASSERT_NOT_NULL(proc)
+
+    size = 0;
+    auto *ctx = (AlgorithmSearchContext *)context;
+    this->lock_.readLock();
+    ret = proc->searchWithContext(info, searchType, topK, filterEditDistance, ctx, searchCBFunc, cbParams);
+    this->lock_.readUnlock();
+    CAISS_FUNCTION_CHECK_STATUS
+
+    if (nullptr != results) {
+        ret = AlgorithmProc::copyResultItems(ctx->items, results, size);
+        CAISS_FUNCTION_CHECK_STATUS
+    }
+
+    CAISS_FUNCTION_END
+}
+
+
 CAISS_RET_TYPE SyncManageProc::train(void *handle, const char *dataPath, const unsigned int maxDataSize, CAISS_BOOL normalize,
                       const unsigned int maxIndexSize, const float precision, const unsigned int fastRank,
                       const unsigned int realRank, const unsigned int step, const unsigned int maxEpoch,
@@ -69,6 +120,29 @@ CAISS_RET_TYPE SyncManageProc::train(void *handle, const char *dataPath, const u
 }
 
 
+CAISS_RET_TYPE SyncManageProc::trainFromBuffer(void *handle, const CAISS_FLOAT *datas, const char **labels,
+                                               const unsigned int num, const unsigned int dim,
+                                               const unsigned int maxDataSize, CAISS_BOOL normalize,
+                                               const unsigned int maxIndexSize, const float precision,
+                                               const unsigned int fastRank, const unsigned int realRank,
+                                               const unsigned int step, const unsigned int maxEpoch,
+                                               const unsigned int showSpan) {
+    CAISS_FUNCTION_BEGIN
+
+    AlgorithmProc *proc = this->getInstance(handle);
+    CAISS_ASSERT_NOT_NULL(proc)
+
+    this->lock_.writeLock();
+    ret = proc->trainFromBuffer(datas, labels, num, dim, maxDataSize, normalize, maxIndexSize, precision,
+                                fastRank, realRank, step, maxEpoch, showSpan);
+    this->lock_.writeUnlock();
+
+    CAISS_FUNCTION_CHECK_STATUS
+
+    CAISS_FUNCTION_END
+}
+
+
 CAISS_RET_TYPE SyncManageProc::save(void *handle, const char *modelPath) {
     CAISS_FUNCTION_BEGIN
 
@@ -91,9 +165,39 @@ CAISS_RET_TYPE SyncManageProc::insert(void *handle, CAISS_FLOAT *node, const cha
     AlgorithmProc *proc = this->getInstance(handle);
     CAISS_ASSERT_NOT_NULL(proc)
 
-    this->lock_.writeLock();
-    ret = proc->insert(node, label, insertType);
-    this->lock_.writeUnlock();
+    if (proc->supportConcurrentInsert()) {
+        // 算法内部保证插入和查询之间的同步，这里只需要防止跟训练、保存等操作同时进行
+        this->lock_.readLock();
+        ret = proc->insert(node, label, insertType);
+        this->lock_.readUnlock();
+    } else {
+        this->lock_.writeLock();
+        ret = proc->insert(node, label, insertType);
+        this->lock_.writeUnlock();
+    }
+    CAISS_FUNCTION_CHECK_STATUS
+
+    CAISS_FUNCTION_END
+}
+
+
+CAISS_RET_TYPE SyncManageProc::insertBatch(void *handle, CAISS_FLOAT *nodes, const char **labels, unsigned int num,
+                                           CAISS_INSERT_TYPE insertType) {
+    CAISS_FUNCTION_BEGIN
+
+    AlgorithmProc *proc = this->getInstance(handle);
+    CAISS_ASSERT_NOT_NULL(proc)
+
+    // 整批只加一次锁
+    if (proc->supportConcurrentInsert()) {
+        this->lock_.readLock();
+        ret = proc->insertBatch(nodes, labels, num, insertType);
+        this->lock_.readUnlock();
+    } else {
+        this->lock_.writeLock();
+        ret = proc->insertBatch(nodes, labels, num, insertType);
+        this->lock_.writeUnlock();
+    }
     CAISS_FUNCTION_CHECK_STATUS
 
     CAISS_FUNCTION_END
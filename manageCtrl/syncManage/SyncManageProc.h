@@ -19,14 +19,28 @@ public:
                          unsigned int maxIndexSize, float precision, unsigned int fastRank,
                          unsigned int realRank, unsigned int step, unsigned int maxEpoch,
                          unsigned int showSpan) override ;
+    CAISS_RET_TYPE trainFromBuffer(void *handle, const CAISS_FLOAT *datas, const char **labels, unsigned int num,
+                                   unsigned int dim, unsigned int maxDataSize, CAISS_BOOL normalize,
+                                   unsigned int maxIndexSize, float precision, unsigned int fastRank,
+                                   unsigned int realRank, unsigned int step, unsigned int maxEpoch,
+                                   unsigned int showSpan) override ;
 
     CAISS_RET_TYPE search(void *handle, void *info, CAISS_SEARCH_TYPE searchType, unsigned int topK, unsigned int filterEditDistance, CAISS_SEARCH_CALLBACK searchCBFunc, const void *cbParams) override ;
+    CAISS_RET_TYPE searchEx(void *handle, void *info, CAISS_SEARCH_TYPE searchType, unsigned int topK,
+                            CAISS_RESULT_ITEM *results, unsigned int &size, unsigned int filterEditDistance,
+                            CAISS_SEARCH_EX_CALLBACK searchCBFunc, const void *cbParams) override ;
+    CAISS_RET_TYPE searchWithContext(void *handle, void *context, void *info, CAISS_SEARCH_TYPE searchType,
+                                     unsigned int topK, CAISS_RESULT_ITEM *results, unsigned int &size,
+                                     unsigned int filterEditDistance, CAISS_SEARCH_EX_CALLBACK searchCBFunc,
+                                     const void *cbParams) override ;
     CAISS_RET_TYPE getResultSize(void *handle, unsigned int &size) override ;
     CAISS_RET_TYPE getResult(void *handle, char *result, unsigned int size) override ;
 
     CAISS_RET_TYPE save(void *handle, const char *modelPath) override ;
     // label 是数据标签，index表示数据第几个信息
     CAISS_RET_TYPE insert(void *handle, CAISS_FLOAT *node, const char *label, CAISS_INSERT_TYPE insertType) override ;
+    CAISS_RET_TYPE insertBatch(void *handle, CAISS_FLOAT *nodes, const char **labels, unsigned int num,
+                               CAISS_INSERT_TYPE insertType) override ;
     CAISS_RET_TYPE ignore(void *handle, const char *label, bool isIgnore) override ;
 };
 
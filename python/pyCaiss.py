@@ -25,10 +25,52 @@ CAISS_DISTANCE_EDITION = 99
 
 CAISS_ALGO_HNSW = 1
 CAISS_ALGO_NSG = 2
+CAISS_ALGO_FLAT = 3
+CAISS_ALGO_IVF = 4
+CAISS_ALGO_IVF_PQ = 5
+CAISS_ALGO_DISKANN = 6
+CAISS_ALGO_HNSW_SHARD = 7
+
+CAISS_PARAM_STORAGE_TYPE = 1
+CAISS_PARAM_PROJECTION_TYPE = 3
+CAISS_PARAM_PROJECTION_DIM = 4
+CAISS_PARAM_BINARY_SEARCH = 5
+CAISS_PARAM_KNN_GRAPH_SEED = 6
+CAISS_PARAM_IVF_NLIST = 7
+CAISS_PARAM_IVF_NPROBE = 8
+CAISS_PARAM_PQ_M = 9
+CAISS_PARAM_PQ_RERANK = 10
+CAISS_PARAM_DISK_SEARCH_POOL = 11
+CAISS_PARAM_DISK_BEAM_WIDTH = 12
+CAISS_PARAM_HNSW_HOT_MEMORY = 13
+CAISS_PARAM_SHARD_NUM = 14
+CAISS_PARAM_SHARD_RELOAD = 15
+CAISS_PARAM_HNSW_NEIGHBOR_LIST = 16
+CAISS_PARAM_RESULT_CACHE_SIZE = 17
+CAISS_PARAM_QUERY_CACHE = 18
+CAISS_PARAM_QUERY_CACHE_TOLERANCE = 19
+CAISS_PARAM_HNSW_DELTA_SIZE = 20
+
+CAISS_STORAGE_FLOAT = 0
+CAISS_STORAGE_FP16 = 1
+CAISS_STORAGE_BF16 = 2
+
+CAISS_PROJECTION_NONE = 0
+CAISS_PROJECTION_PCA = 1
+CAISS_PROJECTION_RANDOM_ROTATION = 2
+
+CAISS_QUERY_CACHE_NONE = 0
+CAISS_QUERY_CACHE_EXACT = 1
+CAISS_QUERY_CACHE_NEAR = 2
 
 CAISS_RET_OK = 0    # 返回值，正常
 
 
+class CaissResultItem(Structure):
+    # 对应CaissLibDefine.h中的CAISS_RESULT_ITEM
+    _fields_ = [('index', c_uint), ('distance', c_float), ('label', c_char_p)]
+
+
 class PyCaiss:
     def __init__(self, path, max_thread_size, algo_type, manage_type):
         self._caiss = CDLL(path)
@@ -45,6 +87,11 @@ class PyCaiss:
             self._dim = dim
         return ret
 
+    def set_param(self, handle, param_type, value):
+        # 当前支持的参数，均为unsigned int类型
+        val = c_uint(value)
+        return self._caiss.CAISS_SetParam(handle, param_type, byref(val))
+
     def train(self, handle, data_path, max_data_size, normalize,
               max_index_size, precision, fast_rank, real_rank, step, max_epoch, show_span):
         path = create_string_buffer(data_path.encode(), len(data_path)+1)
@@ -52,6 +99,25 @@ class PyCaiss:
         return self._caiss.CAISS_Train(handle, path, max_data_size, normalize,
                                        max_index_size, precision, fast_rank, real_rank, step, max_epoch, show_span)
 
+    def train_from_buffer(self, handle, datas, labels, max_data_size, normalize,
+                          max_index_size, precision, fast_rank, real_rank, step, max_epoch, show_span):
+        # datas为num个dim维向量组成的列表，labels为对应的标签列表，直接传入内存训练，不需要生成训练文件
+        num = len(datas)
+        if num != len(labels):
+            return -6    # -6表示参数问题
+
+        vecs = (c_float * (num * self._dim))()
+        for i in range(0, num):
+            if self._dim != len(datas[i]):
+                return -8    # -8表示维度问题
+            vecs[i * self._dim: (i + 1) * self._dim] = datas[i]
+
+        words = (c_char_p * num)(*[label.encode() for label in labels])
+        precision = c_float(precision)
+        return self._caiss.CAISS_TrainFromBuffer(handle, vecs, words, num, self._dim, max_data_size, normalize,
+                                                 max_index_size, precision, fast_rank, real_rank, step, max_epoch,
+                                                 show_span)
+
     def sync_search(self, handle, info, search_type, top_k, filter_edit_distance):
         if search_type == CAISS_SEARCH_QUERY or search_type == CAISS_LOOP_QUERY:
             # 如果传入的是数组信息，需要将数组转成指针传递下去
@@ -81,5 +147,49 @@ class PyCaiss:
 
         return ret, result.value.decode()
 
+    def sync_search_ex(self, handle, info, search_type, top_k, filter_edit_distance):
+        # 结构化查询，返回[(label, distance, index), ...]，不经过json解析
+        if search_type == CAISS_SEARCH_QUERY or search_type == CAISS_LOOP_QUERY:
+            if self._dim != len(info):
+                return -8, []
+
+            query = (c_float * self._dim)(*info)
+        else:
+            query = create_string_buffer(info.encode(), len(info)+1)
+
+        results = (CaissResultItem * top_k)()
+        size = c_uint(0)
+        ret = self._caiss.CAISS_SearchEx(handle, query, search_type, top_k, results, byref(size),
+                                         filter_edit_distance, None, None)
+        if CAISS_RET_OK != ret:
+            return ret, []
+
+        return ret, [(results[i].label.decode(), results[i].distance, results[i].index) for i in range(size.value)]
+
+    def create_search_context(self, context):
+        return self._caiss.CAISS_CreateSearchContext(pointer(context))
+
+    def sync_search_with_context(self, handle, context, info, search_type, top_k, filter_edit_distance):
+        # 结果保存在context中，每个线程使用各自的context时，可以通过同一个句柄并行查询
+        if search_type == CAISS_SEARCH_QUERY or search_type == CAISS_LOOP_QUERY:
+            if self._dim != len(info):
+                return -8, []
+
+            query = (c_float * self._dim)(*info)
+        else:
+            query = create_string_buffer(info.encode(), len(info)+1)
+
+        results = (CaissResultItem * top_k)()
+        size = c_uint(0)
+        ret = self._caiss.CAISS_SearchWithContext(handle, context, query, search_type, top_k, results, byref(size),
+                                                  filter_edit_distance, None, None)
+        if CAISS_RET_OK != ret:
+            return ret, []
+
+        return ret, [(results[i].label.decode(), results[i].distance, results[i].index) for i in range(size.value)]
+
+    def destroy_search_context(self, context):
+        return self._caiss.CAISS_DestroySearchContext(context)
+
     def destroy(self, handle):
         return self._caiss.CAISS_DestroyHandle(handle)
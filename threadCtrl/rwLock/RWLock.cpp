@@ -6,6 +6,8 @@
 
 RWLock::RWLock() {
     this->read_cnt_ = 0;
+    this->write_wait_cnt_ = 0;
+    this->writing_ = false;
 }
 
 RWLock::~RWLock() {
@@ -13,28 +15,33 @@ RWLock::~RWLock() {
 }
 
 void RWLock::readLock() {
-    read_mtx_.lock();
+    std::unique_lock<std::mutex> lock(mtx_);
+    read_cond_.wait(lock, [this] { return !writing_ && 0 == write_wait_cnt_; });    // 有写锁在等待的时候，先让写锁执行
     read_cnt_++;
-    if (1 == read_cnt_) {
-        write_mtx_.lock();    // 当进入读状态的时候，写锁锁住
-    }
-    read_mtx_.unlock();
 }
 
 void RWLock::writeLock() {
-    write_mtx_.lock();
+    std::unique_lock<std::mutex> lock(mtx_);
+    write_wait_cnt_++;
+    write_cond_.wait(lock, [this] { return !writing_ && 0 == read_cnt_; });
+    write_wait_cnt_--;
+    writing_ = true;
 }
 
 void RWLock::readUnlock() {
-    read_mtx_.lock();
+    std::lock_guard<std::mutex> lock(mtx_);
     read_cnt_--;
-    if (0 == read_cnt_) {
-        write_mtx_.unlock();    // 没有线程正在读的情况下，将写锁打开
+    if (0 == read_cnt_ && write_wait_cnt_ > 0) {
+        write_cond_.notify_one();    // 没有线程正在读的情况下，唤醒等待的写锁
     }
-
-    read_mtx_.unlock();
 }
 
 void RWLock::writeUnlock() {
-    write_mtx_.unlock();
+    std::lock_guard<std::mutex> lock(mtx_);
+    writing_ = false;
+    if (write_wait_cnt_ > 0) {
+        write_cond_.notify_one();
+    } else {
+        read_cond_.notify_all();
+    }
 }
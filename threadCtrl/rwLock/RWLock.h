@@ -6,6 +6,7 @@
 #define CAISS_RWLOCK_H
 
 #include <mutex>
+#include <condition_variable>
 
 enum RWLockType {
     DEFAULT_LOCK_TYPE = 0,    // 用于初始化，无动作发生
@@ -13,6 +14,10 @@ enum RWLockType {
     WRITE_LOCK_TYPE = 2,
 };
 
+/**
+ * 读写锁。写优先：有线程在等待写锁的时候，新的读锁需要等待，避免持续的查询让写入一直等待
+ * 加锁和解锁可以在不同的线程中进行。同一个线程不能重复加读锁（有写锁在等待的时候，会死锁）
+ */
 class RWLock {
 /* 其实可以考虑，在外面封装一层Ctrl，在作用域内自动销毁锁 */
 public:
@@ -25,9 +30,12 @@ public:
     void writeUnlock();
 
 private:
-    int read_cnt_;
-    std::mutex read_mtx_;
-    std::mutex write_mtx_;
+    unsigned int read_cnt_;    // 持有读锁的个数
+    unsigned int write_wait_cnt_;    // 等待写锁的个数
+    bool writing_;    // 是否有线程持有写锁
+    std::mutex mtx_;
+    std::condition_variable read_cond_;
+    std::condition_variable write_cond_;
 };
 
 
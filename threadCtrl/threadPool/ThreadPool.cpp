@@ -57,11 +57,15 @@ void ThreadPool::work() {
         if (curTask.taskFunc && curTask.rwLock && curTask.block && curTask.memPool) {
             curTask.isUniq ? this->func_lock_.writeLock() : this->func_lock_.readLock();    // work函数是在不同的thread中运行的，不会出事的
             auto *lck = (RWLock *)curTask.rwLock;
-            lck->writeLock();    // 这里必须用write-lock，是因为需要确保，同一个算法句柄，不会被两个线程进入两次
+            // 一般的任务必须用write-lock，是因为需要确保，同一个算法句柄，不会被两个线程进入两次
+            // 可重入的任务（如：使用查询上下文的查询）不修改句柄中的信息，用read-lock即可
+            curTask.isReentrant ? lck->readLock() : lck->writeLock();
             curTask.taskFunc();
             curTask.memPool->deallocate(curTask.block);    // 处理完了之后，清理缓存，用于下一次分配
-            lck->writeUnlock();
+            curTask.isReentrant ? lck->readUnlock() : lck->writeUnlock();
             curTask.isUniq ? this->func_lock_.writeUnlock() : this->func_lock_.readUnlock();
+        } else if (curTask.taskFunc && !curTask.rwLock) {
+            curTask.taskFunc();    // 算法内部拆分的子任务（如分片查询），不需要加锁和回收缓存，由调用方自行同步
         }
     }
 }
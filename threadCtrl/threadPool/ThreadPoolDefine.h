@@ -9,12 +9,14 @@
 #include "../../utilsCtrl/UtilsInclude.h"
 
 struct ThreadTaskInfo {
-    ThreadTaskInfo(std::function<int()> func, RWLock *rwLock, bool isUniq, MemoryPool *memPool, FreeBlock *block) {
+    ThreadTaskInfo(std::function<int()> func, RWLock *rwLock, bool isUniq, MemoryPool *memPool, FreeBlock *block,
+                   bool isReentrant = false) {
         this->taskFunc = func;
         this->rwLock = rwLock;    // 传入其中的管理类，为了实现在pool中进行信息加锁
         this->isUniq = isUniq;
         this->memPool = memPool;
         this->block = block;
+        this->isReentrant = isReentrant;
     }
 
     ThreadTaskInfo() {
@@ -23,6 +25,7 @@ struct ThreadTaskInfo {
         this->isUniq = false;
         this->memPool = nullptr;
         this->block = nullptr;
+        this->isReentrant = false;
     }
 
     ThreadTaskInfo& operator= (const ThreadTaskInfo& info) {
@@ -32,6 +35,7 @@ struct ThreadTaskInfo {
         this->isUniq = info.isUniq;
         this->memPool = info.memPool;
         this->block = info.block;
+        this->isReentrant = info.isReentrant;
         return *this;
     }
 
@@ -42,6 +46,7 @@ struct ThreadTaskInfo {
         this->isUniq = info.isUniq;
         this->memPool = info.memPool;
         this->block = info.block;
+        this->isReentrant = info.isReentrant;
     }
 
     std::function<int()> taskFunc;
@@ -49,6 +54,7 @@ struct ThreadTaskInfo {
     bool isUniq;    // 是否是独占的执行函数
     MemoryPool* memPool;
     FreeBlock* block;
+    bool isReentrant;    // 是否可以跟同一个句柄的其他可重入任务并行执行（不修改句柄中的信息）
 };
 
 
@@ -15,5 +15,8 @@
 #include "./lruProc/LruProc.h"
 #include "./trieProc/TrieProc.h"
 #include "./editDistanceProc/EditDistanceProc.h"
+#include "./projectionProc/ProjectionProc.h"
+#include "./mmapProc/MmapProc.h"
+#include "./resultCacheProc/ResultCacheProc.h"
 
 #endif    //CAISS_UTILSINCLUDE_H
@@ -22,6 +22,11 @@ public:
      * @return
      */
     static bool BeyondEditDistance(const string &fst, const string &snd, const unsigned int dist) {
+        unsigned int diff = (unsigned int)(fst.length() > snd.length()
+                                           ? fst.length() - snd.length() : snd.length() - fst.length());
+        if (diff > dist) {
+            return true;    // 长度之差是编辑距离的下限，超过了就不需要再计算
+        }
         return (EditDistanceProc::calc(fst, snd) > dist);
     }
 
@@ -33,17 +38,19 @@ public:
      */
     static unsigned int calc(const string &fst, const string &snd) {
 
-        string longStr = fst;
-        string shortStr = snd;
-        if (longStr.length() < shortStr.length()) {
+        const string *longStr = &fst;
+        const string *shortStr = &snd;
+        if (longStr->length() < shortStr->length()) {
             swap(longStr, shortStr);    // 确保长的在第一个
         }
 
-        int longLen = (int)longStr.size() + 1;    // 用于初始化的值，均加一操作
-        int shortLen = (int)shortStr.size() + 1;
+        int longLen = (int)longStr->size() + 1;    // 用于初始化的值，均加一操作
+        int shortLen = (int)shortStr->size() + 1;
 
-        vector<int> vecBefore(shortLen, 0);
-        vector<int> vecCur(shortLen, 0);
+        static thread_local vector<int> vecBefore;    // 每个线程一份，重复计算时不再申请内存
+        static thread_local vector<int> vecCur;
+        vecBefore.assign(shortLen, 0);
+        vecCur.assign(shortLen, 0);
 
         for (int i = 0; i < longLen; i++) {
             for (int j = 0; j < shortLen; j++) {
@@ -52,17 +59,17 @@ public:
                 } else if (j == 0) {
                     vecCur[j] = i;
                 } else {
-                    if (longStr[i-1] == shortStr[j-1]) {
+                    if ((*longStr)[i-1] == (*shortStr)[j-1]) {
                         vecCur[j] = vecBefore[j-1];
                     } else {
                         vecCur[j] = std::min(std::min(vecBefore[j], vecCur[j-1]), vecBefore[j-1]) + 1;
                     }
                 }
             }
-            vecBefore = vecCur;    // 记录上一条信息
+            vecBefore.swap(vecCur);    // 记录上一条信息
         }
 
-        return (unsigned int)vecCur.back();    // 返回最后一个数据
+        return (unsigned int)vecBefore.back();    // 交换之后，最后一行的信息在vecBefore中
     }
 
 
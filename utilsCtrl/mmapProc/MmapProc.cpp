@@ -0,0 +1,271 @@
+//
+// Created by Chunel on 2020/10/11.
+//
+
+#include <fstream>
+#include <cstring>
+#include <algorithm>
+
+#ifndef WIN32
+    #include <fcntl.h>
+    #include <unistd.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+#endif
+
+#include "MmapProc.h"
+
+#ifndef WIN32
+static int getMadviseFlag(MMAP_ADVICE_TYPE advice) {
+    int flag = MADV_NORMAL;
+    switch (advice) {
+        case MMAP_ADVICE_RANDOM: flag = MADV_RANDOM; break;
+        case MMAP_ADVICE_SEQUENTIAL: flag = MADV_SEQUENTIAL; break;
+        case MMAP_ADVICE_WILLNEED: flag = MADV_WILLNEED; break;
+        case MMAP_ADVICE_DONTNEED: flag = MADV_DONTNEED; break;
+#ifdef MADV_COLD
+        case MMAP_ADVICE_COLD: flag = MADV_COLD; break;
+#endif
+        default:
+            break;
+    }
+    return flag;
+}
+#endif
+
+
+MmapProc::MmapProc() {
+    this->addr_ = nullptr;
+    this->map_length_ = 0;
+    this->page_offset_ = 0;
+    this->length_ = 0;
+}
+
+
+MmapProc::~MmapProc() {
+    this->close();
+}
+
+
+CAISS_RET_TYPE MmapProc::open(const std::string &path, size_t offset, size_t length, MMAP_ADVICE_TYPE advice) {
+    CAISS_FUNCTION_BEGIN
+
+    close();
+    if (0 == length) {
+        return CAISS_RET_OK;
+    }
+
+#ifndef WIN32
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return CAISS_RET_PATH;
+    }
+
+    // mmap的起始位置必须按照页对齐
+    size_t alignedOffset = offset / MMAP_PAGE_SIZE * MMAP_PAGE_SIZE;
+    this->page_offset_ = offset - alignedOffset;
+    this->map_length_ = length + this->page_offset_;
+    void *addr = mmap(nullptr, this->map_length_, PROT_READ, MAP_SHARED, fd, (off_t)alignedOffset);
+    ::close(fd);    // 映射建立之后，文件描述符可以关闭
+    if (MAP_FAILED == addr) {
+        this->map_length_ = 0;
+        this->page_offset_ = 0;
+        return CAISS_RET_ERR;
+    }
+
+    this->addr_ = (char *)addr;
+    this->length_ = length;
+    madvise(this->addr_, this->map_length_, getMadviseFlag(advice));
+#else
+    std::ifstream input(path, std::ios::binary);
+    if (!input) {
+        return CAISS_RET_PATH;
+    }
+
+    this->buffer_.resize(length);
+    input.seekg((std::streamoff)offset);
+    input.read(this->buffer_.data(), length);
+    if (!input) {
+        this->buffer_.clear();
+        return CAISS_RET_ERR;
+    }
+    this->length_ = length;
+#endif
+
+    CAISS_FUNCTION_END
+}
+
+
+CAISS_RET_TYPE MmapProc::openPrivate(const std::string &path, size_t offset, size_t length, size_t capacity,
+                                     MMAP_ADVICE_TYPE advice) {
+    CAISS_FUNCTION_BEGIN
+
+    close();
+    capacity = std::max(capacity, length);
+    if (0 == capacity) {
+        return CAISS_RET_OK;
+    }
+
+#ifndef WIN32
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return CAISS_RET_PATH;
+    }
+
+    struct stat fileStat = {};
+    if (0 != fstat(fd, &fileStat) || (size_t)fileStat.st_size < offset + length) {
+        ::close(fd);
+        return CAISS_RET_ERR;    // 文件被截断，访问映射区域的时候会出错
+    }
+
+    // 先映射整段匿名空间，再将文件区域覆盖在其头部，保证两部分地址连续
+    size_t alignedOffset = offset / MMAP_PAGE_SIZE * MMAP_PAGE_SIZE;
+    this->page_offset_ = offset - alignedOffset;
+    this->map_length_ = MmapAlignSize(capacity + this->page_offset_);
+    void *addr = mmap(nullptr, this->map_length_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (MAP_FAILED == addr) {
+        ::close(fd);
+        this->map_length_ = 0;
+        this->page_offset_ = 0;
+        return CAISS_RET_ERR;
+    }
+
+    size_t fileEnd = this->page_offset_ + length;
+    if (length > 0 && MAP_FAILED == mmap(addr, fileEnd, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED,
+                                         fd, (off_t)alignedOffset)) {
+        ::close(fd);
+        munmap(addr, this->map_length_);
+        this->map_length_ = 0;
+        this->page_offset_ = 0;
+        return CAISS_RET_ERR;
+    }
+    ::close(fd);
+
+    this->addr_ = (char *)addr;
+    this->length_ = capacity;
+
+    // 文件区域最后一页中，length之后是文件中的其他内容，清空之后跟预留空间保持一致
+    size_t pageEnd = std::min(MmapAlignSize(fileEnd), this->map_length_);
+    if (length > 0 && pageEnd > fileEnd) {
+        memset(this->addr_ + fileEnd, 0, pageEnd - fileEnd);
+    }
+    madvise(this->addr_, this->map_length_, getMadviseFlag(advice));
+#else
+    std::ifstream input(path, std::ios::binary);
+    if (!input) {
+        return CAISS_RET_PATH;
+    }
+
+    this->buffer_.assign(capacity, 0);
+    input.seekg((std::streamoff)offset);
+    input.read(this->buffer_.data(), length);
+    if (!input) {
+        this->buffer_.clear();
+        return CAISS_RET_ERR;
+    }
+    this->length_ = capacity;
+#endif
+
+    CAISS_FUNCTION_END
+}
+
+
+CAISS_RET_TYPE MmapProc::close() {
+    CAISS_FUNCTION_BEGIN
+
+#ifndef WIN32
+    if (nullptr != this->addr_) {
+        munmap(this->addr_, this->map_length_);
+    }
+#endif
+
+    this->addr_ = nullptr;
+    this->map_length_ = 0;
+    this->page_offset_ = 0;
+    this->length_ = 0;
+    std::vector<char>().swap(this->buffer_);
+
+    CAISS_FUNCTION_END
+}
+
+
+CAISS_RET_TYPE MmapProc::advise(size_t offset, size_t length, MMAP_ADVICE_TYPE advice) const {
+    CAISS_FUNCTION_BEGIN
+
+    if (offset + length > this->length_) {
+        return CAISS_RET_PARAM;
+    }
+
+#ifndef WIN32
+    CAISS_ASSERT_NOT_NULL(this->addr_)
+    // madvise的起始位置同样需要按照页对齐
+    size_t begin = (this->page_offset_ + offset) / MMAP_PAGE_SIZE * MMAP_PAGE_SIZE;
+    size_t end = this->page_offset_ + offset + length;
+    if (0 != madvise(this->addr_ + begin, end - begin, getMadviseFlag(advice))) {
+        return CAISS_RET_ERR;
+    }
+#endif
+
+    CAISS_FUNCTION_END
+}
+
+
+CAISS_RET_TYPE MmapProc::lock(size_t offset, size_t length) const {
+    CAISS_FUNCTION_BEGIN
+
+    if (offset + length > this->length_) {
+        return CAISS_RET_PARAM;
+    }
+
+#ifndef WIN32
+    CAISS_ASSERT_NOT_NULL(this->addr_)
+    size_t begin = (this->page_offset_ + offset) / MMAP_PAGE_SIZE * MMAP_PAGE_SIZE;
+    size_t end = this->page_offset_ + offset + length;
+    if (0 != mlock(this->addr_ + begin, end - begin)) {
+        return CAISS_RET_RES;    // 一般是超过了RLIMIT_MEMLOCK的限制
+    }
+#endif
+
+    CAISS_FUNCTION_END
+}
+
+
+CAISS_RET_TYPE MmapProc::unlock(size_t offset, size_t length) const {
+    CAISS_FUNCTION_BEGIN
+
+    if (offset + length > this->length_) {
+        return CAISS_RET_PARAM;
+    }
+
+#ifndef WIN32
+    CAISS_ASSERT_NOT_NULL(this->addr_)
+    // 只解除完全落在区域内的页，避免影响到相邻区域中仍需要锁定的部分
+    size_t begin = MmapAlignSize(this->page_offset_ + offset);
+    size_t end = (this->page_offset_ + offset + length) / MMAP_PAGE_SIZE * MMAP_PAGE_SIZE;
+    if (end > begin && 0 != munlock(this->addr_ + begin, end - begin)) {
+        return CAISS_RET_ERR;
+    }
+#endif
+
+    CAISS_FUNCTION_END
+}
+
+
+const char *MmapProc::getData() const {
+    return (nullptr != this->addr_) ? this->addr_ + this->page_offset_ : this->buffer_.data();
+}
+
+
+char *MmapProc::getMutableData() {
+    return (nullptr != this->addr_) ? this->addr_ + this->page_offset_ : this->buffer_.data();
+}
+
+
+size_t MmapProc::getLength() const {
+    return this->length_;
+}
+
+
+bool MmapProc::isOpen() const {
+    return this->length_ > 0;
+}
@@ -0,0 +1,80 @@
+//
+// Created by Chunel on 2020/10/11.
+// 以只读的方式，将模型文件中的一段区域映射到内存中。数据只有在被访问的时候，才会由系统读入page cache，
+// 适合向量总量超过物理内存，但是每次查询只访问其中一小部分的场景。不支持mmap的平台上，直接读入内存
+//
+
+#ifndef CAISS_MMAPPROC_H
+#define CAISS_MMAPPROC_H
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../UtilsProc.h"
+#include "../UtilsDefine.h"
+#include "MmapProcDefine.h"
+
+class MmapProc : public UtilsProc {
+public:
+    explicit MmapProc();
+    ~MmapProc() override;
+
+    /**
+     * 映射文件中的一段区域
+     * @param path 文件路径
+     * @param offset 区域在文件中的起始位置
+     * @param length 区域的长度
+     * @param advice 访问方式的提示
+     * @return
+     */
+    CAISS_RET_TYPE open(const std::string &path, size_t offset, size_t length, MMAP_ADVICE_TYPE advice);
+
+    /**
+     * 以写时复制的方式映射文件中的一段区域，并在其后预留空间。修改不会写回文件，
+     * 未修改的部分仍由系统按需读取和回收
+     * @param path 文件路径
+     * @param offset 区域在文件中的起始位置
+     * @param length 区域的长度
+     * @param capacity 映射的总长度（不小于length），超出文件区域的部分初始为0
+     * @param advice 访问方式的提示
+     * @return
+     */
+    CAISS_RET_TYPE openPrivate(const std::string &path, size_t offset, size_t length, size_t capacity,
+                               MMAP_ADVICE_TYPE advice);
+    CAISS_RET_TYPE close();
+
+    /**
+     * 对映射区域中的一部分，修改访问方式的提示
+     * @param offset 相对于映射区域起始位置的偏移
+     * @param length
+     * @param advice
+     * @return
+     */
+    CAISS_RET_TYPE advise(size_t offset, size_t length, MMAP_ADVICE_TYPE advice) const;
+
+    /**
+     * 将映射区域中的一部分锁定在物理内存中（或解除锁定）。锁定的长度受系统RLIMIT_MEMLOCK限制。
+     * 锁定时包含区域两端所在的页，解除时只处理完全落在区域内的页
+     * @param offset 相对于映射区域起始位置的偏移
+     * @param length
+     * @return
+     */
+    CAISS_RET_TYPE lock(size_t offset, size_t length) const;
+    CAISS_RET_TYPE unlock(size_t offset, size_t length) const;
+
+    const char *getData() const;
+    char *getMutableData();    // 仅对openPrivate映射的区域可写
+    size_t getLength() const;
+    bool isOpen() const;
+
+private:
+    char *addr_;              // 映射的起始地址（按照页对齐）
+    size_t map_length_;       // 实际映射的长度
+    size_t page_offset_;      // 需要的区域，相对于映射起始地址的偏移
+    size_t length_;
+    std::vector<char> buffer_;    // 不支持mmap时，存放读入的数据
+};
+
+
+#endif //CAISS_MMAPPROC_H
@@ -0,0 +1,28 @@
+//
+// Created by Chunel on 2020/10/11.
+//
+
+#ifndef CAISS_MMAPPROCDEFINE_H
+#define CAISS_MMAPPROCDEFINE_H
+
+#include <stddef.h>
+
+const static size_t MMAP_PAGE_SIZE = 4096;    // 文件中需要映射的区域，按照页大小对齐存放
+
+enum MMAP_ADVICE_TYPE {
+    MMAP_ADVICE_NORMAL = 0,         // 默认的预读策略
+    MMAP_ADVICE_RANDOM = 1,         // 随机访问（关闭预读，适合按照id零散读取向量）
+    MMAP_ADVICE_SEQUENTIAL = 2,     // 顺序访问（加大预读）
+    MMAP_ADVICE_WILLNEED = 3,       // 即将访问，提前读入page cache
+    MMAP_ADVICE_DONTNEED = 4,       // 暂时不会访问，可以释放对应的物理内存（私有映射中被修改过的内容会丢失）
+    MMAP_ADVICE_COLD = 5,           // 冷数据，内存紧张时优先回收，内容不会丢失（系统不支持时忽略）
+};
+
+/**
+ * 将长度向上对齐到页大小
+ */
+inline size_t MmapAlignSize(size_t size) {
+    return (size + MMAP_PAGE_SIZE - 1) / MMAP_PAGE_SIZE * MMAP_PAGE_SIZE;
+}
+
+#endif //CAISS_MMAPPROCDEFINE_H
@@ -0,0 +1,598 @@
+//
+// Created by Chunel on 2020/9/5.
+//
+
+#include <cmath>
+#include <random>
+#include <algorithm>
+#include <cstring>
+
+#if defined(__AVX__) || defined(__SSE__)
+    #include <immintrin.h>
+#endif
+
+#include "ProjectionProc.h"
+
+#if defined(__AVX__) || defined(__SSE__)
+inline static float horizontalSum(__m128 v) {
+    __m128 shuf = _mm_movehl_ps(v, v);
+    __m128 sums = _mm_add_ps(v, shuf);
+    shuf = _mm_shuffle_ps(sums, sums, 0x55);
+    return _mm_cvtss_f32(_mm_add_ss(sums, shuf));
+}
+#endif
+
+#if defined(__AVX__)
+inline static float horizontalSum(__m256 v) {
+    return horizontalSum(_mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1)));
+}
+#endif
+
+
+ProjectionProc::ProjectionProc() {
+    clear();
+}
+
+
+ProjectionProc::~ProjectionProc() {
+    clear();
+}
+
+
+CAISS_RET_TYPE ProjectionProc::fit(const CAISS_PROJECTION_TYPE type, const std::vector<CaissDataNode> &datas,
+                                   const unsigned int inDim, const unsigned int outDim, const bool centered) {
+    CAISS_FUNCTION_BEGIN
+
+    clear();
+    if (0 == inDim || 0 == outDim || outDim > inDim) {
+        return CAISS_RET_DIM;
+    }
+
+    this->in_dim_ = inDim;
+    this->out_dim_ = outDim;
+    switch (type) {
+        case CAISS_PROJECTION_PCA:
+            ret = fitPca(datas, centered);
+            break;
+        case CAISS_PROJECTION_RANDOM_ROTATION:
+            ret = fitRandomRotation();
+            break;
+        default:
+            ret = CAISS_RET_PARAM;
+            break;
+    }
+
+    if (CAISS_RET_OK != ret) {
+        clear();
+        return ret;
+    }
+
+    this->type_ = type;
+    CAISS_FUNCTION_END
+}
+
+
+CAISS_RET_TYPE ProjectionProc::transform(const CAISS_FLOAT *in, std::vector<CAISS_FLOAT> &out, const bool normalize) const {
+    CAISS_FUNCTION_BEGIN
+    CAISS_ASSERT_NOT_NULL(in)
+
+    if (!isEnable()) {
+        return CAISS_RET_ERR;
+    }
+
+    out.resize(this->out_dim_);
+    gemv(this->matrix_.data(), in, out.data(), this->out_dim_, this->in_dim_);
+
+    if (normalize) {
+        CAISS_FLOAT sum = 0.0f;
+        for (auto val : out) {
+            sum += val * val;
+        }
+
+        if (sum > 0.0f) {
+            CAISS_FLOAT denominator = std::sqrt(sum);
+            for (auto &val : out) {
+                val /= denominator;
+            }
+        }
+    }
+
+    CAISS_FUNCTION_END
+}
+
+
+CAISS_RET_TYPE ProjectionProc::serialize(std::string &info) const {
+    CAISS_FUNCTION_BEGIN
+
+    info.clear();
+    if (!isEnable()) {
+        return CAISS_RET_OK;    // 没有投影信息的时候，序列化的结果为空
+    }
+
+    ProjectionHeader header = {PROJECTION_MAGIC, PROJECTION_VERSION, (unsigned int)this->type_,
+                               this->in_dim_, this->out_dim_};
+    info.append((const char *)&header, sizeof(header));
+    info.append((const char *)this->matrix_.data(), this->matrix_.size() * sizeof(CAISS_FLOAT));
+
+    CAISS_FUNCTION_END
+}
+
+
+CAISS_RET_TYPE ProjectionProc::deserialize(const std::string &info) {
+    CAISS_FUNCTION_BEGIN
+
+    clear();
+    if (info.empty()) {
+        return CAISS_RET_OK;
+    }
+
+    if (info.size() < sizeof(ProjectionHeader)) {
+        return CAISS_RET_ERR;
+    }
+
+    ProjectionHeader header = {};    // 值初始化，再从序列化信息中拷贝
+    memcpy(&header, info.data(), sizeof(header));
+    if (PROJECTION_MAGIC != header.magic || PROJECTION_VERSION != header.version
+        || (CAISS_PROJECTION_PCA != header.type && CAISS_PROJECTION_RANDOM_ROTATION != header.type)
+        || 0 == header.outDim || header.outDim > header.inDim) {
+        return CAISS_RET_ERR;
+    }
+
+    size_t matrixSize = (size_t)header.inDim * header.outDim;
+    if (info.size() != sizeof(header) + matrixSize * sizeof(CAISS_FLOAT)) {
+        return CAISS_RET_ERR;
+    }
+
+    this->matrix_.resize(matrixSize);
+    memcpy(this->matrix_.data(), info.data() + sizeof(header), matrixSize * sizeof(CAISS_FLOAT));
+    this->type_ = (CAISS_PROJECTION_TYPE)header.type;
+    this->in_dim_ = header.inDim;
+    this->out_dim_ = header.outDim;
+
+    CAISS_FUNCTION_END
+}
+
+
+void ProjectionProc::clear() {
+    this->type_ = CAISS_PROJECTION_NONE;
+    this->in_dim_ = 0;
+    this->out_dim_ = 0;
+    this->matrix_.clear();
+}
+
+
+bool ProjectionProc::isEnable() const {
+    return CAISS_PROJECTION_NONE != this->type_;
+}
+
+
+unsigned int ProjectionProc::getInDim() const {
+    return this->in_dim_;
+}
+
+
+unsigned int ProjectionProc::getOutDim() const {
+    return this->out_dim_;
+}
+
+
+/************************ 以下是本Proc类内部函数 ************************/
+/**
+ * 取协方差矩阵（或二阶矩矩阵）最大的out_dim_个特征向量，作为投影矩阵
+ * @param datas
+ * @param centered
+ * @return
+ */
+CAISS_RET_TYPE ProjectionProc::fitPca(const std::vector<CaissDataNode> &datas, const bool centered) {
+    CAISS_FUNCTION_BEGIN
+
+    const unsigned int dim = this->in_dim_;
+    if (datas.empty()) {
+        return CAISS_RET_PARAM;
+    }
+
+    // 样本过多的时候，等间隔采样
+    size_t stride = std::max((size_t)1, datas.size() / PROJECTION_MAX_SAMPLE_SIZE);
+    std::vector<const CaissDataNode *> samples;
+    for (size_t i = 0; i < datas.size(); i += stride) {
+        if (datas[i].node.size() != dim) {
+            return CAISS_RET_DIM;
+        }
+        samples.push_back(&datas[i]);
+    }
+
+    std::vector<double> mean(dim, 0.0);
+    if (centered) {
+        for (auto sample : samples) {
+            for (unsigned int i = 0; i < dim; i++) {
+                mean[i] += sample->node[i];
+            }
+        }
+        for (auto &val : mean) {
+            val /= (double)samples.size();
+        }
+    }
+
+    // 只累加上三角部分，最后再对称过去
+    std::vector<double> matrix((size_t)dim * dim, 0.0);
+    std::vector<double> vec(dim);
+    for (auto sample : samples) {
+        for (unsigned int i = 0; i < dim; i++) {
+            vec[i] = sample->node[i] - mean[i];
+        }
+
+        for (unsigned int i = 0; i < dim; i++) {
+            double *row = matrix.data() + (size_t)i * dim;
+            const double val = vec[i];
+            for (unsigned int j = i; j < dim; j++) {
+                row[j] += val * vec[j];
+            }
+        }
+    }
+
+    for (unsigned int i = 0; i < dim; i++) {
+        for (unsigned int j = i; j < dim; j++) {
+            matrix[(size_t)i * dim + j] /= (double)samples.size();
+            matrix[(size_t)j * dim + i] = matrix[(size_t)i * dim + j];
+        }
+    }
+
+    std::vector<double> values;
+    symmetricEigen(matrix, dim, values);    // 结束后，matrix的第i行，是第i个特征值对应的特征向量
+
+    std::vector<unsigned int> order(dim);
+    for (unsigned int i = 0; i < dim; i++) {
+        order[i] = i;
+    }
+    std::sort(order.begin(), order.end(), [&values](unsigned int a, unsigned int b) {
+        return values[a] > values[b];    // 特征值从大到小
+    });
+
+    this->matrix_.resize((size_t)this->out_dim_ * dim);
+    for (unsigned int i = 0; i < this->out_dim_; i++) {
+        const double *src = matrix.data() + (size_t)order[i] * dim;
+        for (unsigned int j = 0; j < dim; j++) {
+            this->matrix_[(size_t)i * dim + j] = (CAISS_FLOAT)src[j];
+        }
+    }
+
+    CAISS_FUNCTION_END
+}
+
+
+/**
+ * 生成随机正交矩阵的前out_dim_行（高斯随机矩阵正交化）
+ * @return
+ */
+CAISS_RET_TYPE ProjectionProc::fitRandomRotation() {
+    CAISS_FUNCTION_BEGIN
+
+    std::mt19937 engine(PROJECTION_RANDOM_SEED);
+    std::normal_distribution<float> distribution(0.0f, 1.0f);
+
+    this->matrix_.resize((size_t)this->out_dim_ * this->in_dim_);
+    for (auto &val : this->matrix_) {
+        val = distribution(engine);
+    }
+
+    if (!orthonormalize(this->matrix_, this->out_dim_, this->in_dim_)) {
+        return CAISS_RET_ERR;
+    }
+
+    CAISS_FUNCTION_END
+}
+
+
+/**
+ * 实对称矩阵的特征值分解（Householder三对角化 + QL隐式迭代，参考JAMA中的tred2和tql2实现）
+ * @param matrix 输入dim*dim的对称矩阵，输出时，第i行为第i个特征向量
+ * @param dim
+ * @param values 输出特征值（未排序）
+ */
+void ProjectionProc::symmetricEigen(std::vector<double> &matrix, const unsigned int dim, std::vector<double> &values) {
+    const int n = (int)dim;
+    auto V = [&matrix, n](int i, int j) -> double& {
+        return matrix[(size_t)i * n + j];
+    };
+
+    std::vector<double> d(n), e(n);
+    for (int j = 0; j < n; j++) {
+        d[j] = V(n - 1, j);
+    }
+
+    // Householder变换，化为三对角矩阵
+    for (int i = n - 1; i > 0; i--) {
+        double scale = 0.0;
+        double h = 0.0;
+        for (int k = 0; k < i; k++) {
+            scale += std::fabs(d[k]);
+        }
+
+        if (0.0 == scale) {
+            e[i] = d[i - 1];
+            for (int j = 0; j < i; j++) {
+                d[j] = V(i - 1, j);
+                V(i, j) = 0.0;
+                V(j, i) = 0.0;
+            }
+        } else {
+            for (int k = 0; k < i; k++) {
+                d[k] /= scale;
+                h += d[k] * d[k];
+            }
+            double f = d[i - 1];
+            double g = std::sqrt(h);
+            if (f > 0) {
+                g = -g;
+            }
+            e[i] = scale * g;
+            h = h - f * g;
+            d[i - 1] = f - g;
+            for (int j = 0; j < i; j++) {
+                e[j] = 0.0;
+            }
+
+            for (int j = 0; j < i; j++) {
+                f = d[j];
+                V(j, i) = f;
+                g = e[j] + V(j, j) * f;
+                for (int k = j + 1; k <= i - 1; k++) {
+                    g += V(k, j) * d[k];
+                    e[k] += V(k, j) * f;
+                }
+                e[j] = g;
+            }
+
+            f = 0.0;
+            for (int j = 0; j < i; j++) {
+                e[j] /= h;
+                f += e[j] * d[j];
+            }
+            double hh = f / (h + h);
+            for (int j = 0; j < i; j++) {
+                e[j] -= hh * d[j];
+            }
+            for (int j = 0; j < i; j++) {
+                f = d[j];
+                g = e[j];
+                for (int k = j; k <= i - 1; k++) {
+                    V(k, j) -= (f * e[k] + g * d[k]);
+                }
+                d[j] = V(i - 1, j);
+                V(i, j) = 0.0;
+            }
+        }
+        d[i] = h;
+    }
+
+    // 累积变换矩阵
+    for (int i = 0; i < n - 1; i++) {
+        V(n - 1, i) = V(i, i);
+        V(i, i) = 1.0;
+        double h = d[i + 1];
+        if (0.0 != h) {
+            for (int k = 0; k <= i; k++) {
+                d[k] = V(k, i + 1) / h;
+            }
+            for (int j = 0; j <= i; j++) {
+                double g = 0.0;
+                for (int k = 0; k <= i; k++) {
+                    g += V(k, i + 1) * V(k, j);
+                }
+                for (int k = 0; k <= i; k++) {
+                    V(k, j) -= g * d[k];
+                }
+            }
+        }
+        for (int k = 0; k <= i; k++) {
+            V(k, i + 1) = 0.0;
+        }
+    }
+    for (int j = 0; j < n; j++) {
+        d[j] = V(n - 1, j);
+        V(n - 1, j) = 0.0;
+    }
+    V(n - 1, n - 1) = 1.0;
+    e[0] = 0.0;
+
+    // 转置之后，特征向量按行存储，QL迭代中对特征向量的旋转，即可连续访问内存
+    for (int i = 0; i < n; i++) {
+        for (int j = i + 1; j < n; j++) {
+            std::swap(V(i, j), V(j, i));
+        }
+    }
+
+    // QL隐式迭代，求三对角矩阵的特征值和特征向量
+    for (int i = 1; i < n; i++) {
+        e[i - 1] = e[i];
+    }
+    e[n - 1] = 0.0;
+
+    double f = 0.0;
+    double tst1 = 0.0;
+    const double eps = std::pow(2.0, -52.0);
+    for (int l = 0; l < n; l++) {
+        tst1 = std::max(tst1, std::fabs(d[l]) + std::fabs(e[l]));
+        int m = l;
+        while (m < n - 1) {
+            if (std::fabs(e[m]) <= eps * tst1) {
+                break;
+            }
+            m++;
+        }
+
+        if (m > l) {
+            unsigned int iter = 0;
+            do {
+                iter++;
+                double g = d[l];
+                double p = (d[l + 1] - g) / (2.0 * e[l]);
+                double r = std::hypot(p, 1.0);
+                if (p < 0) {
+                    r = -r;
+                }
+                d[l] = e[l] / (p + r);
+                d[l + 1] = e[l] * (p + r);
+                double dl1 = d[l + 1];
+                double h = g - d[l];
+                for (int i = l + 2; i < n; i++) {
+                    d[i] -= h;
+                }
+                f = f + h;
+
+                p = d[m];
+                double c = 1.0;
+                double c2 = c;
+                double c3 = c;
+                double el1 = e[l + 1];
+                double s = 0.0;
+                double s2 = 0.0;
+                for (int i = m - 1; i >= l; i--) {
+                    c3 = c2;
+                    c2 = c;
+                    s2 = s;
+                    g = c * e[i];
+                    h = c * p;
+                    r = std::hypot(p, e[i]);
+                    e[i + 1] = s * r;
+                    s = e[i] / r;
+                    c = p / r;
+                    p = c * d[i] - s * g;
+                    d[i + 1] = h + s * (c * g + s * d[i]);
+
+                    double *cur = &V(i, 0);
+                    double *next = &V(i + 1, 0);
+                    for (int k = 0; k < n; k++) {
+                        h = next[k];
+                        next[k] = s * cur[k] + c * h;
+                        cur[k] = c * cur[k] - s * h;
+                    }
+                }
+                p = -s * s2 * c3 * el1 * e[l] / dl1;
+                e[l] = s * p;
+                d[l] = c * p;
+            } while (std::fabs(e[l]) > eps * tst1 && iter < PROJECTION_MAX_ITERATION);
+        }
+        d[l] = d[l] + f;
+        e[l] = 0.0;
+    }
+
+    values.swap(d);
+}
+
+
+/**
+ * 对num个长度为dim的向量，做施密特正交化（修正版，计算两轮保证数值稳定）
+ * @param rows
+ * @param num
+ * @param dim
+ * @return 出现线性相关的情况，返回false
+ */
+bool ProjectionProc::orthonormalize(std::vector<CAISS_FLOAT> &rows, const unsigned int num, const unsigned int dim) {
+    std::vector<double> cur(dim);
+    for (unsigned int i = 0; i < num; i++) {
+        CAISS_FLOAT *row = rows.data() + (size_t)i * dim;
+        for (unsigned int k = 0; k < dim; k++) {
+            cur[k] = row[k];
+        }
+
+        for (int round = 0; round < 2; round++) {
+            for (unsigned int j = 0; j < i; j++) {
+                const CAISS_FLOAT *prev = rows.data() + (size_t)j * dim;
+                double dot = 0.0;
+                for (unsigned int k = 0; k < dim; k++) {
+                    dot += cur[k] * prev[k];
+                }
+                for (unsigned int k = 0; k < dim; k++) {
+                    cur[k] -= dot * prev[k];
+                }
+            }
+        }
+
+        double norm = 0.0;
+        for (unsigned int k = 0; k < dim; k++) {
+            norm += cur[k] * cur[k];
+        }
+        norm = std::sqrt(norm);
+        if (norm < 1e-6) {
+            return false;
+        }
+
+        for (unsigned int k = 0; k < dim; k++) {
+            row[k] = (CAISS_FLOAT)(cur[k] / norm);
+        }
+    }
+
+    return true;
+}
+
+
+/**
+ * 矩阵乘向量。每次同时计算4行，复用向量的读取
+ * @param matrix rows*cols，按行存储
+ * @param vec 长度为cols
+ * @param out 长度为rows
+ * @param rows
+ * @param cols
+ */
+void ProjectionProc::gemv(const CAISS_FLOAT *matrix, const CAISS_FLOAT *vec, CAISS_FLOAT *out,
+                          const unsigned int rows, const unsigned int cols) {
+    unsigned int r = 0;
+#if defined(__AVX__) || defined(__SSE__)
+    for (; r + 4 <= rows; r += 4) {
+        const CAISS_FLOAT *m0 = matrix + (size_t)r * cols;
+        const CAISS_FLOAT *m1 = m0 + cols;
+        const CAISS_FLOAT *m2 = m1 + cols;
+        const CAISS_FLOAT *m3 = m2 + cols;
+        unsigned int c = 0;
+    #if defined(__AVX__)
+        __m256 s0 = _mm256_setzero_ps();
+        __m256 s1 = _mm256_setzero_ps();
+        __m256 s2 = _mm256_setzero_ps();
+        __m256 s3 = _mm256_setzero_ps();
+        for (; c + 8 <= cols; c += 8) {
+            __m256 v = _mm256_loadu_ps(vec + c);
+            s0 = _mm256_add_ps(s0, _mm256_mul_ps(_mm256_loadu_ps(m0 + c), v));
+            s1 = _mm256_add_ps(s1, _mm256_mul_ps(_mm256_loadu_ps(m1 + c), v));
+            s2 = _mm256_add_ps(s2, _mm256_mul_ps(_mm256_loadu_ps(m2 + c), v));
+            s3 = _mm256_add_ps(s3, _mm256_mul_ps(_mm256_loadu_ps(m3 + c), v));
+        }
+    #else
+        __m128 s0 = _mm_setzero_ps();
+        __m128 s1 = _mm_setzero_ps();
+        __m128 s2 = _mm_setzero_ps();
+        __m128 s3 = _mm_setzero_ps();
+        for (; c + 4 <= cols; c += 4) {
+            __m128 v = _mm_loadu_ps(vec + c);
+            s0 = _mm_add_ps(s0, _mm_mul_ps(_mm_loadu_ps(m0 + c), v));
+            s1 = _mm_add_ps(s1, _mm_mul_ps(_mm_loadu_ps(m1 + c), v));
+            s2 = _mm_add_ps(s2, _mm_mul_ps(_mm_loadu_ps(m2 + c), v));
+            s3 = _mm_add_ps(s3, _mm_mul_ps(_mm_loadu_ps(m3 + c), v));
+        }
+    #endif
+        CAISS_FLOAT res0 = horizontalSum(s0);
+        CAISS_FLOAT res1 = horizontalSum(s1);
+        CAISS_FLOAT res2 = horizontalSum(s2);
+        CAISS_FLOAT res3 = horizontalSum(s3);
+        for (; c < cols; c++) {
+            res0 += m0[c] * vec[c];
+            res1 += m1[c] * vec[c];
+            res2 += m2[c] * vec[c];
+            res3 += m3[c] * vec[c];
+        }
+        out[r] = res0;
+        out[r + 1] = res1;
+        out[r + 2] = res2;
+        out[r + 3] = res3;
+    }
+#endif
+
+    for (; r < rows; r++) {
+        const CAISS_FLOAT *row = matrix + (size_t)r * cols;
+        CAISS_FLOAT res = 0.0f;
+        for (unsigned int c = 0; c < cols; c++) {
+            res += row[c] * vec[c];
+        }
+        out[r] = res;
+    }
+}
@@ -0,0 +1,68 @@
+//
+// Created by Chunel on 2020/9/5.
+// 向量投影（降维/旋转）功能，在训练的时候拟合，在查询和插入的时候使用
+//
+
+#ifndef CAISS_PROJECTIONPROC_H
+#define CAISS_PROJECTIONPROC_H
+
+#include <iostream>
+#include <vector>
+#include <string>
+
+#include "../UtilsProc.h"
+#include "../UtilsDefine.h"
+#include "ProjectionProcDefine.h"
+
+class ProjectionProc : public UtilsProc {
+public:
+    explicit ProjectionProc();
+    ~ProjectionProc() override;
+
+    /**
+     * 根据训练数据，拟合投影矩阵
+     * @param type 投影类型
+     * @param datas 训练数据
+     * @param inDim 原始维度
+     * @param outDim 投影后的维度（不能超过inDim）
+     * @param centered 是否按照协方差矩阵（减去均值）拟合。否则按照二阶矩拟合，更适合内积距离
+     * @return
+     */
+    CAISS_RET_TYPE fit(CAISS_PROJECTION_TYPE type, const std::vector<CaissDataNode> &datas,
+                       unsigned int inDim, unsigned int outDim, bool centered);
+
+    /**
+     * 对向量做投影
+     * @param in 长度为inDim的向量
+     * @param out 长度为outDim的向量
+     * @param normalize 投影后是否需要重新归一化
+     * @return
+     */
+    CAISS_RET_TYPE transform(const CAISS_FLOAT *in, std::vector<CAISS_FLOAT> &out, bool normalize) const;
+
+    CAISS_RET_TYPE serialize(std::string &info) const;
+    CAISS_RET_TYPE deserialize(const std::string &info);
+    void clear();
+
+    bool isEnable() const;
+    unsigned int getInDim() const;
+    unsigned int getOutDim() const;
+
+protected:
+    CAISS_RET_TYPE fitPca(const std::vector<CaissDataNode> &datas, bool centered);
+    CAISS_RET_TYPE fitRandomRotation();
+
+    static void symmetricEigen(std::vector<double> &matrix, unsigned int dim, std::vector<double> &values);
+    static bool orthonormalize(std::vector<CAISS_FLOAT> &rows, unsigned int num, unsigned int dim);
+    static void gemv(const CAISS_FLOAT *matrix, const CAISS_FLOAT *vec, CAISS_FLOAT *out,
+                     unsigned int rows, unsigned int cols);
+
+private:
+    CAISS_PROJECTION_TYPE type_;
+    unsigned int in_dim_;
+    unsigned int out_dim_;
+    std::vector<CAISS_FLOAT> matrix_;    // out_dim_ * in_dim_ 大小，按行存储
+};
+
+
+#endif //CAISS_PROJECTIONPROC_H
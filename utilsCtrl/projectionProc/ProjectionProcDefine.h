@@ -0,0 +1,23 @@
+//
+// Created by Chunel on 2020/9/5.
+//
+
+#ifndef CAISS_PROJECTIONPROCDEFINE_H
+#define CAISS_PROJECTIONPROCDEFINE_H
+
+const static int PROJECTION_MAGIC = 0x4A4F5250;    // 投影信息的标识
+const static int PROJECTION_VERSION = 1;
+const static unsigned int PROJECTION_MAX_SAMPLE_SIZE = 10000;    // 拟合pca时，最多使用的样本个数
+const static unsigned int PROJECTION_RANDOM_SEED = 1024;    // 随机旋转矩阵的种子
+const static unsigned int PROJECTION_MAX_ITERATION = 50;    // 特征值分解的最大迭代轮数
+
+/* 序列化之后，写在投影矩阵之前的头部信息 */
+struct ProjectionHeader {
+    int magic;
+    int version;
+    unsigned int type;
+    unsigned int inDim;
+    unsigned int outDim;
+};
+
+#endif //CAISS_PROJECTIONPROCDEFINE_H
@@ -65,47 +65,43 @@ CAISS_RET_TYPE RapidJsonProc::parseInputData(const char *line, CaissDataNode& da
 
 
 CAISS_RET_TYPE
-RapidJsonProc::buildSearchResult(const std::list<CaissResultDetail> &details, CAISS_DISTANCE_TYPE distanceType,
-                                 std::string &result, std::string searchType) {
+RapidJsonProc::buildSearchResult(const std::vector<CaissResultDetail> &details, CAISS_DISTANCE_TYPE distanceType,
+                                 std::string &result, const char *searchType) {
     CAISS_FUNCTION_BEGIN
 
-    Document dom;
-    dom.SetObject();
-
-    Document::AllocatorType& alloc = dom.GetAllocator();
-    dom.AddMember("version", CAISS_VERSION, alloc);
-    Value val(Type::kObjectType);
-    val.SetInt((int)details.size());
-    dom.AddMember("size", val, alloc);
-
-    std::string distType = buildDistanceType(distanceType);    // 需要在这里开一个string，然后再构建json。否则release版本无法使用
-    dom.AddMember("distance_type", StringRef(distType.c_str()), alloc);
-    dom.AddMember("search_type", StringRef(searchType.c_str()), alloc);
-
-    rapidjson::Value array(rapidjson::kArrayType);
-
+    // 按照SAX的方式直接写入，不构建dom。缓冲区每个线程一份，清空后内存可以重复使用
+    static thread_local StringBuffer buffer;
+    static thread_local Writer<StringBuffer> writer(buffer);
+    buffer.Clear();
+    writer.Reset(buffer);
+
+    std::string distType = buildDistanceType(distanceType);
+    writer.StartObject();
+    writer.Key("version");
+    writer.String(CAISS_VERSION);
+    writer.Key("size");
+    writer.Int((int)details.size());
+    writer.Key("distance_type");
+    writer.String(distType.c_str(), (SizeType)distType.size());
+    writer.Key("search_type");
+    writer.String(searchType);
+
+    writer.Key("details");
+    writer.StartArray();
     for (const CaissResultDetail& detail : details) {
-        rapidjson::Value obj(rapidjson::kObjectType);
-
-        val.SetFloat((detail.distance < 0.00001 && detail.distance > -0.00001) ? (0.0f) : detail.distance);
-        obj.AddMember("distance", val, alloc);
-        val.SetInt(detail.index);
-        obj.AddMember("index", val, alloc);    // 这里的index，表示的是这属于模型中的第几个节点(注：跟算法类中，index和label的取名正好相反)
-        obj.AddMember("label", StringRef(detail.label.c_str()), alloc);    // 这里的label，表示单词信息
-//        rapidjson::Value node(rapidjson::kArrayType);    // 输出向量的具体内容，暂时不需要了
-//        for (auto j : detail.node) {
-//            node.PushBack(j, alloc);
-//        }
-//        obj.AddMember("node", node, alloc);
-        array.PushBack(obj, alloc);
+        writer.StartObject();
+        writer.Key("distance");
+        writer.Double((detail.distance < 0.00001 && detail.distance > -0.00001) ? (0.0f) : detail.distance);
+        writer.Key("index");
+        writer.Int((int)detail.index);    // 这里的index，表示的是这属于模型中的第几个节点(注：跟算法类中，index和label的取名正好相反)
+        writer.Key("label");
+        writer.String(detail.label.c_str(), (SizeType)detail.label.size());    // 这里的label，表示单词信息
+        writer.EndObject();
     }
+    writer.EndArray();
+    writer.EndObject();
 
-    dom.AddMember("details", array, alloc);
-
-    StringBuffer buffer;
-    Writer<StringBuffer> writer(buffer);
-    dom.Accept(writer);
-    result = buffer.GetString();    // 将最终的结果值，赋值给result信息，并返回
+    result.assign(buffer.GetString(), buffer.GetSize());    // 将最终的结果值，赋值给result信息，并返回
 
     CAISS_FUNCTION_END
 }
@@ -7,6 +7,7 @@
 
 #include <list>
 #include <string>
+#include <vector>
 
 #include "../rapidjson/document.h"
 #include "../../UtilsProc.h"
@@ -24,8 +25,8 @@ public:
     ~RapidJsonProc();
 
     static CAISS_RET_TYPE parseInputData(const char *line, CaissDataNode& node);
-    static CAISS_RET_TYPE buildSearchResult(const std::list<CaissResultDetail> &details, CAISS_DISTANCE_TYPE distanceType,
-                                            std::string &result, std::string searchType);
+    static CAISS_RET_TYPE buildSearchResult(const std::vector<CaissResultDetail> &details, CAISS_DISTANCE_TYPE distanceType,
+                                            std::string &result, const char *searchType);
     static CAISS_RET_TYPE parseResult(const std::string& result, CAISS_LIST_STRING& resultWords, CAISS_LIST_FLOAT& resultDistances);
 };
 
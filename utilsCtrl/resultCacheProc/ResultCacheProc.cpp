@@ -0,0 +1,176 @@
+//
+// Created by Chunel on 2020/10/31.
+//
+
+#include <cmath>
+#include <algorithm>
+#include <functional>
+
+#include "ResultCacheProc.h"
+
+
+ResultCacheProc::ResultCacheProc(size_t capacity) {
+    this->stripe_capacity_ = capacity / RESULT_CACHE_STRIPE_NUM;
+}
+
+
+ResultCacheProc::~ResultCacheProc() {
+    clear();
+}
+
+
+bool ResultCacheProc::get(const std::string &scope, const std::string &key, const unsigned int topK,
+                          std::vector<CaissResultDetail> &details, unsigned long long &generation) {
+    generation = getGeneration(scope);
+    if (0 == this->stripe_capacity_) {
+        return false;
+    }
+
+    ResultCacheStripe &stripe = getStripe(key);
+    std::lock_guard<std::mutex> lock(stripe.lock);
+
+    auto cur = stripe.cache.find(key);
+    if (cur == stripe.cache.end()) {
+        return false;
+    }
+
+    auto iter = cur->second;
+    if (iter->generation != generation) {
+        eraseNode(stripe, iter);    // 模型有变动，缓存的结果已经失效
+        return false;
+    }
+
+    if (topK > iter->topK) {
+        return false;    // 缓存的结果不够用，需要重新查询
+    }
+
+    size_t size = std::min((size_t)topK, iter->details.size());
+    details.assign(iter->details.begin(), iter->details.begin() + size);
+    stripe.nodes.splice(stripe.nodes.begin(), stripe.nodes, iter);    // 移动到最前面
+    return true;
+}
+
+
+void ResultCacheProc::put(const std::string &scope, const std::string &key, const unsigned long long generation,
+                          const unsigned int topK, const std::vector<CaissResultDetail> &details) {
+    size_t capacity = this->stripe_capacity_;
+    if (0 == capacity || generation != getGeneration(scope)) {
+        return;
+    }
+
+    ResultCacheStripe &stripe = getStripe(key);
+    std::lock_guard<std::mutex> lock(stripe.lock);
+
+    auto cur = stripe.cache.find(key);
+    if (cur != stripe.cache.end()) {
+        if (cur->second->generation == generation && cur->second->topK >= topK) {
+            stripe.nodes.splice(stripe.nodes.begin(), stripe.nodes, cur->second);    // 已有更完整的结果，保留原来的
+            return;
+        }
+        eraseNode(stripe, cur->second);
+    }
+
+    ResultCacheNode node;
+    node.key = key;
+    node.topK = topK;
+    node.generation = generation;
+    node.details = details;
+    node.bytes = calcBytes(node);
+    if (node.bytes > capacity) {
+        return;    // 单个结果就超过了容量，不缓存
+    }
+
+    stripe.bytes += node.bytes;
+    stripe.nodes.push_front(std::move(node));
+    stripe.cache[key] = stripe.nodes.begin();
+
+    while (stripe.bytes > capacity) {
+        eraseNode(stripe, std::prev(stripe.nodes.end()));    // 淘汰最久没有使用的
+    }
+}
+
+
+void ResultCacheProc::invalidate(const std::string &scope) {
+    std::lock_guard<std::mutex> lock(this->generation_lock_);
+    this->generations_[scope]++;
+}
+
+
+void ResultCacheProc::setCapacity(const size_t capacity) {
+    this->stripe_capacity_ = capacity / RESULT_CACHE_STRIPE_NUM;
+    for (ResultCacheStripe &stripe : this->stripes_) {
+        std::lock_guard<std::mutex> lock(stripe.lock);
+        while (stripe.bytes > this->stripe_capacity_) {
+            eraseNode(stripe, std::prev(stripe.nodes.end()));
+        }
+    }
+}
+
+
+void ResultCacheProc::clear() {
+    for (ResultCacheStripe &stripe : this->stripes_) {
+        std::lock_guard<std::mutex> lock(stripe.lock);
+        stripe.nodes.clear();
+        stripe.cache.clear();
+        stripe.bytes = 0;
+    }
+}
+
+
+void ResultCacheProc::buildKey(const char *word, const int searchType, const unsigned int filterEditDistance,
+                               std::string &key) {
+    key += RESULT_CACHE_KEY_SEPARATOR;
+    key += std::to_string(searchType);
+    key += RESULT_CACHE_KEY_SEPARATOR;
+    key += std::to_string(filterEditDistance);
+    key += RESULT_CACHE_KEY_SEPARATOR;
+    key += word;
+}
+
+
+void ResultCacheProc::buildKey(const CAISS_FLOAT *query, const unsigned int dim, const int searchType,
+                               const CAISS_FLOAT tolerance, std::string &key) {
+    key += RESULT_CACHE_KEY_SEPARATOR;
+    key += std::to_string(searchType);
+    key += RESULT_CACHE_KEY_SEPARATOR;
+    if (tolerance <= 0.0f) {
+        key.append((const char *)query, dim * sizeof(CAISS_FLOAT));
+        return;
+    }
+
+    key += RESULT_CACHE_KEY_SEPARATOR;    // 跟完全一致的key区分开
+    for (unsigned int i = 0; i < dim; i++) {
+        // 每一维相差远小于步长的向量，大概率落在同一个格子中。格子边界加上偏移，避免按照固定小数位保存的数据正好落在边界上
+        int code = (int)std::floor(query[i] / tolerance + RESULT_CACHE_GRID_OFFSET);
+        key.append((const char *)&code, sizeof(int));
+    }
+}
+
+
+/************************ 以下是本Proc类内部函数 ************************/
+ResultCacheProc::ResultCacheStripe &ResultCacheProc::getStripe(const std::string &key) {
+    return this->stripes_[std::hash<std::string>()(key) % RESULT_CACHE_STRIPE_NUM];
+}
+
+
+void ResultCacheProc::eraseNode(ResultCacheStripe &stripe, std::list<ResultCacheNode>::iterator iter) {
+    stripe.bytes -= iter->bytes;
+    stripe.cache.erase(iter->key);
+    stripe.nodes.erase(iter);
+}
+
+
+unsigned long long ResultCacheProc::getGeneration(const std::string &scope) {
+    std::lock_guard<std::mutex> lock(this->generation_lock_);
+    auto cur = this->generations_.find(scope);
+    return (cur != this->generations_.end()) ? cur->second : 0;
+}
+
+
+size_t ResultCacheProc::calcBytes(const ResultCacheNode &node) {
+    size_t bytes = sizeof(ResultCacheNode) + node.key.capacity() * 2;    // key在map中还保存了一份
+    for (const CaissResultDetail &detail : node.details) {
+        bytes += sizeof(CaissResultDetail) + detail.label.capacity();
+    }
+    return bytes;
+}
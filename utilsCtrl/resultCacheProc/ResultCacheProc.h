@@ -0,0 +1,107 @@
+//
+// Created by Chunel on 2020/10/31.
+// 进程内所有句柄共用的查询结果缓存。按照key分段加锁，每一段内部按照lru的方式淘汰；
+// 缓存的是结果本身（id、距离和词语），topK较小的查询可以直接从topK较大的结果中截取。
+// 每个模型（作用域）有自己的版本号，模型内容有变动的时候（插入、忽略、重新加载等），更新这个模型的版本号即可让它之前的结果全部失效
+//
+
+#ifndef CAISS_RESULTCACHEPROC_H
+#define CAISS_RESULTCACHEPROC_H
+
+#include <iostream>
+#include <list>
+#include <mutex>
+#include <atomic>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include "../UtilsProc.h"
+#include "./ResultCacheProcDefine.h"
+
+class ResultCacheProc : public UtilsProc {
+public:
+    explicit ResultCacheProc(size_t capacity = (size_t)RESULT_CACHE_DEFAULT_SIZE << 20);
+    ~ResultCacheProc() override;
+
+    /**
+     * 获取缓存的结果
+     * @param scope 版本号的作用域（模型路径）
+     * @param key
+     * @param topK 结果中最多包含topK个元素
+     * @param details
+     * @param generation 返回scope当前的版本号，未命中的时候，查询完毕后放入缓存时使用
+     * @return 是否命中
+     */
+    bool get(const std::string &scope, const std::string &key, unsigned int topK,
+             std::vector<CaissResultDetail> &details, unsigned long long &generation);
+
+    /**
+     * 放入缓存。如果查询过程中scope的版本号有变化，则不放入
+     * @param scope
+     * @param key
+     * @param generation 查询之前获取的版本号
+     * @param topK
+     * @param details
+     */
+    void put(const std::string &scope, const std::string &key, unsigned long long generation, unsigned int topK,
+             const std::vector<CaissResultDetail> &details);
+
+    /**
+     * 更新scope的版本号，这个模型之前缓存的结果全部失效（在之后的查询中被淘汰），其他模型的不受影响
+     * @param scope
+     */
+    void invalidate(const std::string &scope);
+
+    /**
+     * 设定缓存的总大小，为0表示不缓存
+     * @param capacity 字节数
+     */
+    void setCapacity(size_t capacity);
+
+    void clear();
+
+    /**
+     * 拼接查询词语时的key
+     * @param word
+     * @param searchType
+     * @param filterEditDistance
+     * @param key 传入时为模型作用域，在其后追加查询信息
+     */
+    static void buildKey(const char *word, int searchType, unsigned int filterEditDistance, std::string &key);
+
+    /**
+     * 拼接查询向量时的key
+     * @param query 已经归一化的向量
+     * @param dim
+     * @param searchType
+     * @param tolerance 每一维的量化步长，为0表示按照原始数值拼接（完全一致才能命中）
+     * @param key 传入时为模型作用域，在其后追加查询信息
+     */
+    static void buildKey(const CAISS_FLOAT *query, unsigned int dim, int searchType, CAISS_FLOAT tolerance,
+                         std::string &key);
+
+protected:
+    struct ResultCacheStripe {
+        std::mutex lock;
+        std::list<ResultCacheNode> nodes;    // 最近使用的放在前面
+        std::unordered_map<std::string, std::list<ResultCacheNode>::iterator> cache;
+        size_t bytes = 0;
+    };
+
+    ResultCacheStripe &getStripe(const std::string &key);
+    void eraseNode(ResultCacheStripe &stripe, std::list<ResultCacheNode>::iterator iter);
+
+    static size_t calcBytes(const ResultCacheNode &node);
+
+    unsigned long long getGeneration(const std::string &scope);
+
+private:
+    ResultCacheStripe stripes_[RESULT_CACHE_STRIPE_NUM];
+    std::atomic<size_t> stripe_capacity_;    // 每一段的最大字节数
+    std::mutex generation_lock_;
+    std::unordered_map<std::string, unsigned long long> generations_;    // 每个模型的版本号，没有记录的为0
+};
+
+
+#endif //CAISS_RESULTCACHEPROC_H
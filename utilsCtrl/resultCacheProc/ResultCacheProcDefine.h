@@ -0,0 +1,26 @@
+//
+// Created by Chunel on 2020/10/31.
+//
+
+#ifndef CAISS_RESULTCACHEPROCDEFINE_H
+#define CAISS_RESULTCACHEPROCDEFINE_H
+
+#include <string>
+#include <vector>
+
+#include "../UtilsDefine.h"
+
+const static unsigned int RESULT_CACHE_STRIPE_NUM = 16;    // 分段加锁的段数，不同段之间的读写互不影响
+const static unsigned int RESULT_CACHE_DEFAULT_SIZE = 16;    // 默认的缓存大小（MB）
+const static char RESULT_CACHE_KEY_SEPARATOR = '\x1f';    // 拼接缓存key时使用的分隔符
+const static float RESULT_CACHE_GRID_OFFSET = 0.381966f;    // 量化向量时，格子边界的偏移（步长的比例）
+
+struct ResultCacheNode {
+    std::string key;    // 模型作用域 + 查询方式 +（过滤条件 + 查询的词语）或者（量化之后的查询向量）
+    unsigned int topK;    // 缓存时查询的topK，不超过这个值的查询都可以直接使用
+    unsigned long long generation;    // 缓存时的版本号，跟当前版本号不一致的时候失效
+    std::vector<CaissResultDetail> details;    // 按照距离从近到远排列的结果
+    size_t bytes;    // 当前节点大致占用的内存大小
+};
+
+#endif //CAISS_RESULTCACHEPROCDEFINE_H